@@ -0,0 +1,187 @@
+// Huge-page arena benchmark: generates a few very large Ore sources, so that each file's
+// arena grows far past --huge-page-threshold, and compiles them with every --huge-pages
+// mode. Reports the median parse and codegen phase times from --time-report (the two walks
+// over the AST), and dTLB misses per phase from --perf-counters where the kernel exposes
+// them.
+//
+//   node Benchmarks/huge-pages.js [--ore <path>] [--dir <dir>] [--files <n>] [--decls <n>]
+//                                 [--runs <n>] [--modes off,thp,hugetlb] [--json <path>] [-- <Ore arguments>]
+//
+// "hugetlb" needs a reserved pool (vm.nr_hugepages); without one Ore warns and uses THP, so
+// that row measures the fallback. Every mode has to produce the same module; a mismatch
+// fails the run.
+
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const crypto = require('crypto');
+const child_process = require('child_process');
+
+function parseArguments(argv) {
+    const options = {
+        ore: path.resolve('Ore'),
+        dir: path.join(os.tmpdir(), 'ore-huge-pages'),
+        files: 2,
+        decls: 400000,
+        runs: 5,
+        modes: ['off', 'thp', 'hugetlb'],
+        json: null,
+        extra: [],
+    };
+    for (let i = 2; i < argv.length; ++i) {
+        const value = argv[i + 1];
+        if (argv[i] === '--') {
+            options.extra = argv.slice(i + 1);
+            break;
+        }
+        else if (argv[i] === '--ore') options.ore = path.resolve(value);
+        else if (argv[i] === '--dir') options.dir = path.resolve(value);
+        else if (argv[i] === '--files') options.files = parseInt(value);
+        else if (argv[i] === '--decls') options.decls = parseInt(value);
+        else if (argv[i] === '--runs') options.runs = parseInt(value);
+        else if (argv[i] === '--modes') options.modes = value.split(',');
+        else if (argv[i] === '--json') options.json = value;
+        else throw new Error('unknown argument ' + argv[i]);
+        ++i;
+    }
+    return options;
+}
+
+function median(samples) {
+    const sorted = samples.slice().sort((a, b) => a - b);
+    return sorted[sorted.length >> 1];
+}
+
+// NOTE(jsn): One long run of declarations per file; every third is a string so the arena
+// holds string data between the nodes, as it does for real sources.
+function generate(options) {
+    fs.rmSync(options.dir, { recursive: true, force: true });
+    fs.mkdirSync(options.dir, { recursive: true });
+    for (let f = 0; f < options.files; ++f) {
+        const lines = [];
+        for (let i = 0; i < options.decls; ++i) {
+            const name = `f${f}_v${i}`;
+            if (i % 3 === 0) lines.push(`var ${name} = "entry ${i}";`);
+            else lines.push(`var ${name} = ${(i * 40503) % 999983};`);
+        }
+        fs.writeFileSync(path.join(options.dir, `large${f}.or`), lines.join('\n') + '\n');
+    }
+}
+
+function parseTable(output, title) {
+    const start = output.indexOf(`===== ${title} =====`);
+    const rows = {};
+    if (start < 0) return rows;
+    for (const line of output.slice(start).split('\n').slice(2)) {
+        if (!line.trim() || line.startsWith('=====')) break;
+        const columns = line.trim().split(/\s+/);
+        rows[columns[0]] = columns.slice(1);
+    }
+    return rows;
+}
+
+function compile(options, mode) {
+    const args = ['-q', '--wasm', '--time-report', '--perf-counters', '--huge-pages', mode, ...options.extra, '--source', options.dir,
+                  '--timings_file', path.join(options.dir, '.ore_timings')];
+    const result = child_process.spawnSync(options.ore, args, { encoding: 'utf8' });
+    if (result.status !== 0 || /Parse Error/.test(result.stderr)) {
+        throw new Error(`Ore --huge-pages ${mode} failed:\n${result.stderr}${result.stdout}`);
+    }
+    const output = result.stdout + result.stderr;
+    const times = parseTable(output, 'Time Report');
+    const counters = parseTable(output, 'Hardware Counters');
+    const header = output.slice(output.indexOf('===== Hardware Counters =====')).split('\n')[1] || '';
+    const dtlb = header.trim().split(/\s+/).indexOf('dTLB-misses') - 1;
+    const misses = (phase) => {
+        const value = counters[phase] && dtlb >= 0 ? Number(counters[phase][dtlb]) : NaN;
+        return Number.isFinite(value) ? value : null;
+    };
+
+    const hash = crypto.createHash('sha256');
+    for (const file of fs.readdirSync(options.dir).filter((f) => f.endsWith('.wasm')).sort()) {
+        hash.update(fs.readFileSync(path.join(options.dir, file)));
+    }
+    return {
+        parse_ms: Number(times.parse[0]),
+        codegen_ms: Number(times.codegen[0]),
+        parse_dtlb: misses('parse'),
+        codegen_dtlb: misses('codegen'),
+        digest: hash.digest('hex'),
+    };
+}
+
+// NOTE(jsn): Ore's fallback warning is hidden by -q, so ask the kernel for the pool instead.
+function hasHugeTLBPool() {
+    try {
+        const match = /^HugePages_Free:\s+(\d+)/m.exec(fs.readFileSync('/proc/meminfo', 'utf8'));
+        return match !== null && Number(match[1]) > 0;
+    }
+    catch (e) {
+        return false;
+    }
+}
+
+function main() {
+    const options = parseArguments(process.argv);
+    if (!fs.existsSync(options.ore)) {
+        throw new Error(`no Ore binary at ${options.ore}; pass --ore <path>`);
+    }
+    generate(options);
+    const bytes = fs.readdirSync(options.dir).reduce((sum, f) => sum + fs.statSync(path.join(options.dir, f)).size, 0);
+    console.log(`${options.files} files, ${options.decls} declarations each, ${(bytes / 1048576).toFixed(1)} MB of source; ${options.runs} runs per mode`);
+
+    // NOTE(jsn): Runs interleave the modes, so drift in machine load hits all of them alike.
+    const samples = {};
+    for (const mode of options.modes) samples[mode] = [];
+    compile(options, options.modes[0]);
+    for (let run = 0; run < options.runs; ++run) {
+        for (const mode of options.modes) samples[mode].push(compile(options, mode));
+    }
+
+    const digest = samples[options.modes[0]][0].digest;
+    const results = [];
+    for (const mode of options.modes) {
+        if (samples[mode].some((s) => s.digest !== digest)) {
+            throw new Error(`--huge-pages ${mode} produced a different module`);
+        }
+        const pick = (key) => {
+            const values = samples[mode].map((s) => s[key]).filter((v) => v !== null);
+            return values.length ? median(values) : null;
+        };
+        results.push({
+            mode,
+            parse_ms: pick('parse_ms'),
+            codegen_ms: pick('codegen_ms'),
+            parse_dtlb: pick('parse_dtlb'),
+            codegen_dtlb: pick('codegen_dtlb'),
+            fell_back: mode === 'hugetlb' && !hasHugeTLBPool(),
+        });
+    }
+
+    const base = results[0];
+    const format = (value, reference) => {
+        const change = reference ? ` (${((value / reference - 1) * 100).toFixed(1).padStart(5)}%)` : '';
+        return (value.toFixed(1) + change).padStart(18);
+    };
+    const formatMisses = (value) => (value === null ? 'n/a' : value.toLocaleString('en-US')).padStart(14);
+    console.log(`${'mode'.padEnd(10)} ${'parse ms'.padStart(18)} ${'codegen ms'.padStart(18)} ${'parse dTLB'.padStart(14)} ${'codegen dTLB'.padStart(14)}`);
+    for (const r of results) {
+        const label = r.mode + (r.fell_back ? '*' : '');
+        const reference = r === base ? 0 : 1;
+        console.log(`${label.padEnd(10)} ${format(r.parse_ms, reference && base.parse_ms)} ${format(r.codegen_ms, reference && base.codegen_ms)} ` +
+                    `${formatMisses(r.parse_dtlb)} ${formatMisses(r.codegen_dtlb)}`);
+    }
+    if (results.some((r) => r.fell_back)) {
+        console.log('* no hugetlb pool; Ore fell back to transparent huge pages');
+    }
+    if (results.every((r) => r.parse_dtlb === null)) {
+        console.log('dTLB counters are unavailable here (see --perf-counters); only times are compared');
+    }
+
+    if (options.json) {
+        const record = { date: new Date().toISOString(), files: options.files, decls: options.decls, runs: options.runs, results };
+        fs.writeFileSync(options.json, JSON.stringify(record, null, 2) + '\n');
+    }
+}
+
+main();
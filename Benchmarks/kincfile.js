@@ -0,0 +1,7 @@
+let project = new Project('ore_bench');
+
+project.kore = false;//No Kinc
+
+project.addFile('ore_bench.c');
+
+resolve(project);
@@ -0,0 +1,522 @@
+// NOTE(jsn): Whole-tree build benchmark. Generates a synthetic Ore project of a given
+// shape and times the real Ore driver on it, once cold and then warm.
+//
+//   ore_bench generate <dir> [shape options]
+//   ore_bench run [shape options] [--ore <path>] [--dir <dir>] [--runs <n>] [--json <path>] [-- <Ore arguments>]
+//
+// Shape options:
+//   --files <n>          number of .or sources (default 1000)
+//   --depth <n>          directory nesting levels (default 3)
+//   --files-per-dir <n>  sources per leaf directory (default 64)
+//   --decls <n>          declarations per source (default 8)
+//   --refs <n>           cross-file references per source (default 2)
+//   --wasm-blobs <n>     prebuilt .wasm modules mixed into the tree (default 0)
+//   --seed <n>           generator seed (default 1)
+//
+// A cold run deletes previous outputs and the scheduling history and asks the kernel to
+// drop the tree from the page cache; warm runs keep both. Each run reports wall time, CPU
+// time of the Ore process, its peak RSS and source files per second.
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+typedef int32_t  i32;
+typedef int64_t  i64;
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+#define MemorySet               memset
+#define CStringToInt            atoi
+
+#define BENCH_PATH_MAX 4096
+#define BENCH_ORE_ARGUMENTS_MAX 64
+
+typedef struct ProjectShape ProjectShape;
+struct ProjectShape
+{
+    int file_count;
+    int depth;
+    int files_per_dir;
+    int decls_per_file;
+    int refs_per_file;
+    int wasm_blob_count;
+    u32 seed;
+};
+
+typedef struct RunResult RunResult;
+struct RunResult
+{
+    int exit_code;
+    u64 wall_ns;
+    u64 cpu_ns;
+    u64 peak_rss_kb;
+};
+
+static int
+CStringMatch(char *a, char *b)
+{
+    return a && b && !strcmp(a, b);
+}
+
+static u64
+GetTimeNanoseconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (u64)now.tv_sec*1000000000ull + (u64)now.tv_nsec;
+}
+
+static u32
+RandomNext(u32 *state)
+{
+    // NOTE(jsn): xorshift32; the generator only has to be repeatable, not good.
+    u32 x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static int
+MakeDirectories(char *path)
+{
+    char buffer[BENCH_PATH_MAX];
+    int length = snprintf(buffer, sizeof(buffer), "%s", path);
+    for(int i = 1; i <= length; ++i)
+    {
+        if(buffer[i] == '/' || buffer[i] == 0)
+        {
+            char c = buffer[i];
+            buffer[i] = 0;
+            if(mkdir(buffer, 0755) != 0 && errno != EEXIST)
+            {
+                return 0;
+            }
+            buffer[i] = c;
+        }
+    }
+    return 1;
+}
+
+// NOTE(jsn): Leaf directory number n is spread over `depth` levels of 16-way fan-out, so
+// a tree of 10^5 files at depth 3 gets a few thousand directories, like a real project.
+static void
+GetGeneratedDirectory(char *buffer, int size, char *root, ProjectShape *shape, int file_index)
+{
+    int directory_index = file_index / (shape->files_per_dir > 0 ? shape->files_per_dir : 1);
+    int length = snprintf(buffer, size, "%s", root);
+    for(int level = shape->depth-1; level >= 0; --level)
+    {
+        int digit = directory_index;
+        for(int i = 0; i < level; ++i)
+        {
+            digit /= 16;
+        }
+        
+        // NOTE(jsn): The top level takes whatever doesn't fit below it.
+        if(level != shape->depth-1)
+        {
+            digit %= 16;
+        }
+        length += snprintf(buffer + length, size - length, "/d%x", digit);
+    }
+}
+
+static int
+GenerateProject(char *root, ProjectShape *shape)
+{
+    // NOTE(jsn): A minimal valid module (magic and version) stands in for prebuilt blobs.
+    static const unsigned char wasm_blob[] = { 0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00 };
+
+    u32 random = shape->seed ? shape->seed : 1;
+    char directory[BENCH_PATH_MAX/2];
+    char path[BENCH_PATH_MAX];
+    for(int i = 0; i < shape->file_count; ++i)
+    {
+        GetGeneratedDirectory(directory, sizeof(directory), root, shape, i);
+        if(!MakeDirectories(directory))
+        {
+            fprintf(stderr, "ERROR: could not create %s\n", directory);
+            return 0;
+        }
+        snprintf(path, sizeof(path), "%s/f%d.or", directory, i);
+        FILE *file = fopen(path, "wb");
+        if(!file)
+        {
+            fprintf(stderr, "ERROR: could not write %s\n", path);
+            return 0;
+        }
+
+        // NOTE(jsn): Symbols are prefixed with the file number so the tree also links as
+        // one --bundle. The language has no expressions that name other symbols yet, so a
+        // cross-file reference is a string holding the referenced symbol's name.
+        for(int j = 0; j < shape->decls_per_file; ++j)
+        {
+            if(RandomNext(&random) % 4 == 0)
+            {
+                fprintf(file, "var f%d_v%d = \"value %u of file %d\";\n", i, j, RandomNext(&random), i);
+            }
+            else
+            {
+                fprintf(file, "var f%d_v%d = %u;\n", i, j, RandomNext(&random) % 1000000);
+            }
+        }
+        for(int j = 0; j < shape->refs_per_file && shape->decls_per_file > 0; ++j)
+        {
+            int target = RandomNext(&random) % shape->file_count;
+            int target_decl = RandomNext(&random) % shape->decls_per_file;
+            fprintf(file, "var f%d_r%d = \"f%d_v%d\";\n", i, j, target, target_decl);
+        }
+        fclose(file);
+    }
+
+    for(int i = 0; i < shape->wasm_blob_count; ++i)
+    {
+        int file_index = shape->file_count > 0 ? (int)(RandomNext(&random) % shape->file_count) : 0;
+        GetGeneratedDirectory(directory, sizeof(directory), root, shape, file_index);
+        if(!MakeDirectories(directory))
+        {
+            return 0;
+        }
+        snprintf(path, sizeof(path), "%s/blob%d.wasm", directory, i);
+        FILE *file = fopen(path, "wb");
+        if(!file)
+        {
+            return 0;
+        }
+        fwrite(wasm_blob, 1, sizeof(wasm_blob), file);
+        fclose(file);
+    }
+    return 1;
+}
+
+// NOTE(jsn): Deletes outputs of a previous run (everything Ore writes next to a .or source)
+// and drops the remaining files from the page cache. POSIX_FADV_DONTNEED only evicts clean
+// pages, which is all a freshly written and synced tree has.
+static void
+ResetTreeForColdRun(char *path)
+{
+    DIR *dir = opendir(path);
+    if(!dir)
+    {
+        return;
+    }
+
+    char child[BENCH_PATH_MAX];
+    struct dirent *entry;
+    while((entry = readdir(dir)))
+    {
+        if(entry->d_name[0] == '.')
+        {
+            continue;
+        }
+        snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+        struct stat info;
+        if(stat(child, &info) != 0)
+        {
+            continue;
+        }
+        if(S_ISDIR(info.st_mode))
+        {
+            ResetTreeForColdRun(child);
+            continue;
+        }
+
+        char *extension = strrchr(child, '.');
+        if(extension && entry->d_name[0] == 'f' &&
+           (CStringMatch(extension, ".wasm") || CStringMatch(extension, ".c") || CStringMatch(extension, ".js")))
+        {
+            unlink(child);
+            continue;
+        }
+
+        int fd = open(child, O_RDONLY);
+        if(fd >= 0)
+        {
+            fdatasync(fd);
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            close(fd);
+        }
+    }
+    closedir(dir);
+}
+
+static RunResult
+RunOre(char *ore_path, char *source_dir, char *timings_path, char **extra_arguments, int extra_argument_count)
+{
+    RunResult result = {0};
+    result.exit_code = -1;
+
+    char *arguments[BENCH_ORE_ARGUMENTS_MAX];
+    int argument_count = 0;
+    arguments[argument_count++] = ore_path;
+    arguments[argument_count++] = "-q";
+    arguments[argument_count++] = "--wasm";
+    arguments[argument_count++] = "--source";
+    arguments[argument_count++] = source_dir;
+    arguments[argument_count++] = "--timings_file";
+    arguments[argument_count++] = timings_path;
+    for(int i = 0; i < extra_argument_count && argument_count < BENCH_ORE_ARGUMENTS_MAX-1; ++i)
+    {
+        arguments[argument_count++] = extra_arguments[i];
+    }
+    arguments[argument_count] = 0;
+
+    u64 start = GetTimeNanoseconds();
+    pid_t pid = fork();
+    if(pid == 0)
+    {
+        int null_fd = open("/dev/null", O_WRONLY);
+        if(null_fd >= 0)
+        {
+            dup2(null_fd, STDOUT_FILENO);
+            close(null_fd);
+        }
+        execv(ore_path, arguments);
+        fprintf(stderr, "ERROR: could not run %s: %s\n", ore_path, strerror(errno));
+        _exit(127);
+    }
+    else if(pid > 0)
+    {
+        int status = 0;
+        struct rusage usage = {0};
+        if(wait4(pid, &status, 0, &usage) == pid)
+        {
+            result.wall_ns = GetTimeNanoseconds() - start;
+            result.cpu_ns = ((u64)usage.ru_utime.tv_sec + (u64)usage.ru_stime.tv_sec)*1000000000ull +
+                ((u64)usage.ru_utime.tv_usec + (u64)usage.ru_stime.tv_usec)*1000ull;
+            result.peak_rss_kb = (u64)usage.ru_maxrss;
+            result.exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+        }
+    }
+    return result;
+}
+
+static void
+PrintRunResult(FILE *out, char *label, RunResult *result, int file_count)
+{
+    double wall_seconds = result->wall_ns / 1e9;
+    fprintf(out, "%-8s %10.3f %10.3f %12llu %12.0f %6d\n", label,
+            wall_seconds * 1000.0,
+            result->cpu_ns / 1e6,
+            (unsigned long long)result->peak_rss_kb,
+            wall_seconds > 0 ? file_count / wall_seconds : 0.0,
+            result->exit_code);
+}
+
+static void
+WriteRunResultJSON(FILE *out, RunResult *result, int file_count, int last)
+{
+    double wall_seconds = result->wall_ns / 1e9;
+    fprintf(out, "    { \"wall_ns\": %llu, \"cpu_ns\": %llu, \"peak_rss_kb\": %llu, \"files_per_second\": %.1f, \"exit_code\": %d }%s\n",
+            (unsigned long long)result->wall_ns,
+            (unsigned long long)result->cpu_ns,
+            (unsigned long long)result->peak_rss_kb,
+            wall_seconds > 0 ? file_count / wall_seconds : 0.0,
+            result->exit_code,
+            last ? "" : ",");
+}
+
+static int
+ParseShapeArgument(ProjectShape *shape, char *argument, char *value)
+{
+    int *field = 0;
+    if(CStringMatch(argument, "--files"))              field = &shape->file_count;
+    else if(CStringMatch(argument, "--depth"))         field = &shape->depth;
+    else if(CStringMatch(argument, "--files-per-dir")) field = &shape->files_per_dir;
+    else if(CStringMatch(argument, "--decls"))         field = &shape->decls_per_file;
+    else if(CStringMatch(argument, "--refs"))          field = &shape->refs_per_file;
+    else if(CStringMatch(argument, "--wasm-blobs"))    field = &shape->wasm_blob_count;
+    else if(CStringMatch(argument, "--seed"))
+    {
+        shape->seed = (u32)strtoul(value, 0, 10);
+        return 1;
+    }
+
+    if(field)
+    {
+        *field = CStringToInt(value);
+        return 1;
+    }
+    return 0;
+}
+
+static void
+PrintUsage(void)
+{
+    fprintf(stderr,
+            "usage: ore_bench generate <dir> [shape options]\n"
+            "       ore_bench run [shape options] [--ore <path>] [--dir <dir>] [--runs <n>] [--json <path>] [-- <Ore arguments>]\n"
+            "shape options: --files --depth --files-per-dir --decls --refs --wasm-blobs --seed\n");
+}
+
+int
+main(int argument_count, char **arguments)
+{
+    if(argument_count < 2)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    ProjectShape shape = {0};
+    {
+        shape.file_count = 1000;
+        shape.depth = 3;
+        shape.files_per_dir = 64;
+        shape.decls_per_file = 8;
+        shape.refs_per_file = 2;
+        shape.seed = 1;
+    }
+
+    char *command = arguments[1];
+    char *ore_path = "./Ore";
+    char *project_dir = "ore_bench_project";
+    char *json_path = 0;
+    int warm_run_count = 3;
+    char **ore_arguments = 0;
+    int ore_argument_count = 0;
+
+    int i = 2;
+    if(CStringMatch(command, "generate"))
+    {
+        if(argument_count < 3)
+        {
+            PrintUsage();
+            return 1;
+        }
+        project_dir = arguments[2];
+        i = 3;
+    }
+    else if(!CStringMatch(command, "run"))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    for(; i < argument_count; ++i)
+    {
+        if(CStringMatch(arguments[i], "--"))
+        {
+            ore_arguments = arguments + i + 1;
+            ore_argument_count = argument_count - i - 1;
+            break;
+        }
+        else if(i+1 >= argument_count)
+        {
+            fprintf(stderr, "ERROR: %s expects a value\n", arguments[i]);
+            return 1;
+        }
+        else if(ParseShapeArgument(&shape, arguments[i], arguments[i+1]))
+        {
+        }
+        else if(CStringMatch(arguments[i], "--ore"))
+        {
+            ore_path = arguments[i+1];
+        }
+        else if(CStringMatch(arguments[i], "--dir"))
+        {
+            project_dir = arguments[i+1];
+        }
+        else if(CStringMatch(arguments[i], "--runs"))
+        {
+            warm_run_count = CStringToInt(arguments[i+1]);
+        }
+        else if(CStringMatch(arguments[i], "--json"))
+        {
+            json_path = arguments[i+1];
+        }
+        else
+        {
+            fprintf(stderr, "ERROR: unknown argument %s\n", arguments[i]);
+            return 1;
+        }
+        ++i;
+    }
+
+    u64 generate_start = GetTimeNanoseconds();
+    if(!GenerateProject(project_dir, &shape))
+    {
+        return 1;
+    }
+    fprintf(stderr, "Generated %d files (%d blobs) in %s in %.1f ms.\n",
+            shape.file_count, shape.wasm_blob_count, project_dir,
+            (GetTimeNanoseconds() - generate_start) / 1e6);
+    if(CStringMatch(command, "generate"))
+    {
+        return 0;
+    }
+
+    char timings_path[BENCH_PATH_MAX];
+    snprintf(timings_path, sizeof(timings_path), "%s/.ore_timings", project_dir);
+
+    if(warm_run_count < 0)
+    {
+        warm_run_count = 0;
+    }
+    int run_count = 1 + warm_run_count;
+    RunResult *results = calloc(run_count, sizeof(RunResult));
+
+    unlink(timings_path);
+    ResetTreeForColdRun(project_dir);
+    results[0] = RunOre(ore_path, project_dir, timings_path, ore_arguments, ore_argument_count);
+    for(int run = 1; run < run_count; ++run)
+    {
+        results[run] = RunOre(ore_path, project_dir, timings_path, ore_arguments, ore_argument_count);
+    }
+
+    fprintf(stdout, "%-8s %10s %10s %12s %12s %6s\n", "run", "wall ms", "cpu ms", "peak rss kb", "files/s", "exit");
+    char label[32];
+    for(int run = 0; run < run_count; ++run)
+    {
+        snprintf(label, sizeof(label), run == 0 ? "cold" : "warm%d", run);
+        PrintRunResult(stdout, label, results + run, shape.file_count);
+    }
+
+    int failed = 0;
+    for(int run = 0; run < run_count; ++run)
+    {
+        failed |= results[run].exit_code != 0;
+    }
+
+    if(json_path)
+    {
+        FILE *out = fopen(json_path, "wb");
+        if(out)
+        {
+            fprintf(out, "{\n");
+            fprintf(out, "  \"shape\": { \"files\": %d, \"depth\": %d, \"files_per_dir\": %d, \"decls\": %d, \"refs\": %d, \"wasm_blobs\": %d, \"seed\": %u },\n",
+                    shape.file_count, shape.depth, shape.files_per_dir, shape.decls_per_file,
+                    shape.refs_per_file, shape.wasm_blob_count, shape.seed);
+            fprintf(out, "  \"cold\":\n");
+            WriteRunResultJSON(out, results, shape.file_count, 0);
+            fprintf(out, "  \"warm\": [\n");
+            for(int run = 1; run < run_count; ++run)
+            {
+                WriteRunResultJSON(out, results + run, shape.file_count, run+1 == run_count);
+            }
+            fprintf(out, "  ]\n}\n");
+            fclose(out);
+        }
+        else
+        {
+            fprintf(stderr, "ERROR: could not write %s\n", json_path);
+            failed = 1;
+        }
+    }
+
+    free(results);
+    return failed;
+}
@@ -0,0 +1,175 @@
+// Performance regression gate. Runs the lexer, whole-tree and runtime benchmarks several
+// times, takes the median of every metric and compares it against perf_baseline.json.
+// Exits with 1 and prints a diff when a metric moves past its tolerance in the bad
+// direction. Everything runs locally; nothing is fetched.
+//
+//   node Benchmarks/perf-check.js [--ore <path>] [--bench <path>] [--runs <n>] [--update-baseline]
+//
+// --update-baseline rewrites the stored values from this run and keeps the tolerances.
+// Baselines are only meaningful on the machine they were recorded on.
+
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const child_process = require('child_process');
+
+const BASELINE_PATH = path.join(__dirname, 'perf_baseline.json');
+
+function parseArguments(argv) {
+    const options = {
+        ore: path.resolve('Ore'),
+        bench: path.resolve('ore_bench'),
+        runs: 5,
+        update_baseline: false,
+    };
+    for (let i = 2; i < argv.length; ++i) {
+        if (argv[i] === '--update-baseline') { options.update_baseline = true; continue; }
+        const value = argv[++i];
+        if (argv[i - 1] === '--ore') options.ore = path.resolve(value);
+        else if (argv[i - 1] === '--bench') options.bench = path.resolve(value);
+        else if (argv[i - 1] === '--runs') options.runs = parseInt(value);
+        else throw new Error('unknown argument ' + argv[i - 1]);
+    }
+    return options;
+}
+
+function median(samples) {
+    const sorted = samples.slice().sort((a, b) => a - b);
+    return sorted[sorted.length >> 1];
+}
+
+function run(command, args, options) {
+    const result = child_process.spawnSync(command, args, Object.assign({ encoding: 'utf8' }, options));
+    if (result.error) throw result.error;
+    if (result.status !== 0) {
+        throw new Error(command + ' ' + args.join(' ') + ' failed:\n' + result.stderr);
+    }
+    return result;
+}
+
+// NOTE: Lexing is timed inside Ore (--time-report) and divided by the bytes it lexed
+// (--stats-json), so process startup and the other phases don't leak into the number.
+function measureLexer(options, work_dir) {
+    const tree = path.join(work_dir, 'lexer');
+    run(options.bench, ['generate', tree, '--files', '2000', '--decls', '32', '--refs', '8']);
+    const stats_path = path.join(work_dir, 'lexer_stats.json');
+    const samples = [];
+    for (let i = 0; i < options.runs; ++i) {
+        const result = run(options.ore, ['-q', '--wasm', '--time-report', '--stats-json', stats_path, '--source', tree,
+                                         '--timings_file', path.join(work_dir, '.lexer_timings')]);
+        const lex_row = result.stderr.split('\n').find(line => /^lex\s/.test(line));
+        const lex_ms = parseFloat(lex_row.trim().split(/\s+/)[1]);
+        const bytes = JSON.parse(fs.readFileSync(stats_path, 'utf8')).bytes_lexed;
+        samples.push(bytes / 1e6 / (lex_ms / 1e3));
+    }
+    return { 'lexer.mb_per_second': median(samples) };
+}
+
+function measureWholeTree(options, work_dir) {
+    const json_path = path.join(work_dir, 'tree.json');
+    const cold_wall = [], warm_files = [], peak_rss = [];
+    for (let i = 0; i < options.runs; ++i) {
+        run(options.bench, ['run', '--ore', options.ore, '--dir', path.join(work_dir, 'tree'),
+                            '--files', '5000', '--runs', '2', '--json', json_path], { stdio: ['ignore', 'ignore', 'pipe'] });
+        const result = JSON.parse(fs.readFileSync(json_path, 'utf8'));
+        cold_wall.push(result.cold.wall_ns / 1e6);
+        warm_files.push(median(result.warm.map(w => w.files_per_second)));
+        peak_rss.push(Math.max(result.cold.peak_rss_kb, ...result.warm.map(w => w.peak_rss_kb)));
+    }
+    return {
+        'tree.cold_wall_ms': median(cold_wall),
+        'tree.warm_files_per_second': median(warm_files),
+        'tree.peak_rss_kb': median(peak_rss),
+    };
+}
+
+function measureRuntime(options, work_dir) {
+    const history_path = path.join(work_dir, 'runtime_history.jsonl');
+    const samples = {};
+    for (let i = 0; i < options.runs; ++i) {
+        fs.rmSync(history_path, { force: true });
+        run(process.execPath, [path.join(__dirname, 'runtime', 'run.js'), '--ore', options.ore, '--iterations', '50',
+                               '--history', history_path]);
+        for (const line of fs.readFileSync(history_path, 'utf8').split('\n')) {
+            if (!line) continue;
+            const entry = JSON.parse(line);
+            const key = 'runtime.' + entry.benchmark + '.' + entry.path + '.instantiate_ms';
+            (samples[key] = samples[key] || []).push(entry.instantiate_ms);
+        }
+    }
+    const metrics = {};
+    for (const key in samples) metrics[key] = median(samples[key]);
+    return metrics;
+}
+
+// NOTE: New metrics get a default tolerance; direction follows from the unit. Cold runs
+// go to the disk and sub-millisecond runtime numbers are noisy, so both get more slack.
+function getDefaultMetric(name) {
+    const higher_is_better = /per_second$/.test(name);
+    const tolerance = name.includes('cold') ? 0.5 : name.startsWith('runtime.') ? 0.25 : 0.15;
+    return { direction: higher_is_better ? 'higher' : 'lower', tolerance: tolerance };
+}
+
+function compare(baseline, metrics) {
+    let failed = false;
+    const rows = [];
+    for (const name of Object.keys(metrics).sort()) {
+        const stored = baseline.metrics[name];
+        const value = metrics[name];
+        if (!stored) {
+            rows.push([name, '-', value.toFixed(3), '', 'new']);
+            continue;
+        }
+        const change = (value - stored.value) / stored.value;
+        const worse = stored.direction === 'higher' ? -change : change;
+        const regressed = worse > stored.tolerance;
+        failed = failed || regressed;
+        rows.push([name, stored.value.toFixed(3), value.toFixed(3),
+                   (change >= 0 ? '+' : '') + (change * 100).toFixed(1) + '%',
+                   regressed ? 'REGRESSED (limit ' + (stored.tolerance * 100).toFixed(0) + '%)' : 'ok']);
+    }
+    for (const name in baseline.metrics) {
+        if (!(name in metrics)) rows.push([name, baseline.metrics[name].value.toFixed(3), '-', '', 'missing']);
+    }
+
+    console.log('metric'.padEnd(44) + 'baseline'.padStart(14) + 'current'.padStart(14) + 'change'.padStart(10) + '  status');
+    for (const row of rows) {
+        console.log(row[0].padEnd(44) + row[1].padStart(14) + row[2].padStart(14) + row[3].padStart(10) + '  ' + row[4]);
+    }
+    return !failed;
+}
+
+function main() {
+    const options = parseArguments(process.argv);
+    const work_dir = fs.mkdtempSync(path.join(os.tmpdir(), 'ore_perf_check_'));
+    let metrics;
+    try {
+        metrics = Object.assign({},
+                                measureLexer(options, work_dir),
+                                measureWholeTree(options, work_dir),
+                                measureRuntime(options, work_dir));
+    }
+    finally {
+        fs.rmSync(work_dir, { recursive: true, force: true });
+    }
+
+    const baseline = fs.existsSync(BASELINE_PATH) ? JSON.parse(fs.readFileSync(BASELINE_PATH, 'utf8')) : { metrics: {} };
+    if (options.update_baseline) {
+        const updated = { host: os.hostname(), cpu: os.cpus()[0].model, runs: options.runs, metrics: {} };
+        for (const name of Object.keys(metrics).sort()) {
+            const stored = baseline.metrics[name] || getDefaultMetric(name);
+            updated.metrics[name] = { value: metrics[name], direction: stored.direction, tolerance: stored.tolerance };
+        }
+        fs.writeFileSync(BASELINE_PATH, JSON.stringify(updated, null, 2) + '\n');
+        console.log('Updated ' + BASELINE_PATH);
+        return;
+    }
+
+    if (!compare(baseline, metrics)) {
+        console.error('perf-check failed: at least one metric regressed past its tolerance.');
+        process.exit(1);
+    }
+    console.log('perf-check passed.');
+}
+
+main();
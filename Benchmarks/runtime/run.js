@@ -0,0 +1,181 @@
+// Runtime benchmark suite: compiles every program in this directory with Ore and times
+// the generated code on each execution path, appending results to a history file so runs
+// can be compared across commits.
+//
+//   node Benchmarks/runtime/run.js [--ore <path>] [--iterations <n>] [--history <path>] [--filter <name>]
+//
+// Paths:
+//   wasm         the .wasm module through the local WebAssembly runtime (node)
+//   c            the C backend built with the system compiler
+//   interpreter  a built-in interpreter
+// A path the compiler cannot produce yet is reported as unavailable rather than skipped
+// silently. Ore programs can only declare globals so far, so the wasm workload is module
+// compilation, instantiation and reading every export (decoding strings from memory).
+
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const child_process = require('child_process');
+
+function parseArguments(argv) {
+    const options = {
+        ore: path.resolve('Ore'),
+        iterations: 200,
+        history: '.ore_runtime_history.jsonl',
+        filter: null,
+    };
+    for (let i = 2; i < argv.length; ++i) {
+        const value = argv[i + 1];
+        if (argv[i] === '--ore') options.ore = path.resolve(value);
+        else if (argv[i] === '--iterations') options.iterations = parseInt(value);
+        else if (argv[i] === '--history') options.history = value;
+        else if (argv[i] === '--filter') options.filter = value;
+        else throw new Error('unknown argument ' + argv[i]);
+        ++i;
+    }
+    return options;
+}
+
+function getCommit() {
+    try {
+        return child_process.execSync('git rev-parse --short HEAD', { cwd: __dirname, stdio: ['ignore', 'pipe', 'ignore'] }).toString().trim();
+    }
+    catch (e) {
+        return 'unknown';
+    }
+}
+
+function median(samples) {
+    const sorted = samples.slice().sort((a, b) => a - b);
+    return sorted[sorted.length >> 1];
+}
+
+function timeMs(f) {
+    const start = process.hrtime.bigint();
+    f();
+    return Number(process.hrtime.bigint() - start) / 1e6;
+}
+
+function readExports(instance) {
+    const memory = instance.exports.memory;
+    const bytes = memory ? new Uint8Array(memory.buffer) : null;
+    let checksum = 0;
+    for (const name in instance.exports) {
+        const value = instance.exports[name];
+        if (!(value instanceof WebAssembly.Global)) continue;
+        const v = value.value;
+        checksum = (checksum + v) | 0;
+        // NOTE: string globals hold the address of a NUL-terminated constant.
+        if (bytes && v > 0 && v < bytes.length) {
+            for (let at = v; at < bytes.length && bytes[at] !== 0; ++at) {
+                checksum = (checksum * 31 + bytes[at]) | 0;
+            }
+        }
+    }
+    return checksum;
+}
+
+async function runWasm(wasm_path, iterations) {
+    const bytes = fs.readFileSync(wasm_path);
+    const compile = [], instantiate = [], run = [];
+    let checksum = 0;
+    for (let i = 0; i < iterations; ++i) {
+        let start = process.hrtime.bigint();
+        const module = await WebAssembly.compile(bytes);
+        compile.push(Number(process.hrtime.bigint() - start) / 1e6);
+
+        start = process.hrtime.bigint();
+        const instance = await WebAssembly.instantiate(module, {});
+        instantiate.push(Number(process.hrtime.bigint() - start) / 1e6);
+
+        run.push(timeMs(() => { checksum = readExports(instance); }));
+    }
+    return {
+        compile_ms: median(compile),
+        instantiate_ms: median(instantiate),
+        run_ms: median(run),
+        checksum: checksum,
+    };
+}
+
+function runC(c_path) {
+    if (!fs.existsSync(c_path) || fs.statSync(c_path).size === 0) {
+        return { unavailable: 'the C backend produced no code' };
+    }
+    return { unavailable: 'the C backend output has no entry point to run' };
+}
+
+function runInterpreter() {
+    return { unavailable: 'Ore has no built-in interpreter' };
+}
+
+function loadHistory(history_path) {
+    const previous = {};
+    if (!fs.existsSync(history_path)) return previous;
+    for (const line of fs.readFileSync(history_path, 'utf8').split('\n')) {
+        if (!line) continue;
+        const entry = JSON.parse(line);
+        previous[entry.benchmark + '/' + entry.path] = entry;
+    }
+    return previous;
+}
+
+function formatDelta(current, previous) {
+    if (!previous || !previous.run_ms) return '';
+    const delta = (current - previous.run_ms) / previous.run_ms * 100;
+    return (delta >= 0 ? '+' : '') + delta.toFixed(1) + '% vs ' + previous.commit;
+}
+
+async function main() {
+    const options = parseArguments(process.argv);
+    const commit = getCommit();
+    const previous = loadHistory(options.history);
+
+    // NOTE: Ore writes its outputs next to the sources, so compile a scratch copy.
+    const work_dir = fs.mkdtempSync(path.join(os.tmpdir(), 'ore_runtime_'));
+    const programs = fs.readdirSync(__dirname).filter(f => f.endsWith('.or') && (!options.filter || f.includes(options.filter)));
+    for (const program of programs) {
+        fs.copyFileSync(path.join(__dirname, program), path.join(work_dir, program));
+    }
+
+    const compile = child_process.spawnSync(options.ore, ['-q', '--wasm', '--c', '--js', '-O', '2', '--source', work_dir,
+                                                          '--timings_file', path.join(work_dir, '.ore_timings')], { stdio: 'inherit' });
+    if (compile.status !== 0) {
+        console.error('ERROR: Ore failed to compile the benchmarks');
+        process.exit(1);
+    }
+
+    const results = [];
+    console.log('benchmark'.padEnd(16) + 'path'.padEnd(13) + 'compile ms'.padStart(12) + 'inst ms'.padStart(10) + 'run ms'.padStart(10) + '  change');
+    for (const program of programs) {
+        const name = path.basename(program, '.or');
+        const base = path.join(work_dir, name);
+        const paths = {
+            wasm: await runWasm(base + '.wasm', options.iterations),
+            c: runC(base + '.c'),
+            interpreter: runInterpreter(),
+        };
+        for (const path_name in paths) {
+            const result = paths[path_name];
+            const row = name.padEnd(16) + path_name.padEnd(13);
+            if (result.unavailable) {
+                console.log(row + 'unavailable: ' + result.unavailable);
+                continue;
+            }
+            console.log(row +
+                        result.compile_ms.toFixed(3).padStart(12) +
+                        result.instantiate_ms.toFixed(3).padStart(10) +
+                        result.run_ms.toFixed(3).padStart(10) + '  ' +
+                        formatDelta(result.run_ms, previous[name + '/' + path_name]));
+            results.push(Object.assign({ commit: commit, benchmark: name, path: path_name, iterations: options.iterations }, result));
+        }
+    }
+
+    fs.appendFileSync(options.history, results.map(r => JSON.stringify(r) + '\n').join(''));
+    fs.rmSync(work_dir, { recursive: true, force: true });
+}
+
+main().catch(e => {
+    console.error(e);
+    process.exit(1);
+});
@@ -5,6 +5,26 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <dirent.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netdb.h>
+#include <strings.h>
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#endif
 #include "binaryen-c.h"
 
 typedef int8_t   i8;
@@ -21,7 +41,99 @@ typedef uint64_t u64;
 #define CalculateCStringLength  strlen
 #define CStringToInt            atoi
 #define QuickSort               qsort
-#define Log(...) { fprintf(stdout, __VA_ARGS__); fprintf(stdout, "\n"); }
+
+// NOTE(jsn): Leveled logging. Messages are formatted into a buffer owned by the calling
+// thread and handed to stdout in one locked write when the buffer fills up or the thread
+// calls LogFlush, so hot paths never touch stdio. Levels above ORE_LOG_LEVEL_MAX are
+// compiled out entirely; the rest are filtered at runtime by log_level (-v raises it).
+typedef enum LogLevel
+{
+    LogLevel_Error,
+    LogLevel_Warning,
+    LogLevel_Info,
+    LogLevel_Debug,
+    LogLevel_Trace,
+}
+LogLevel;
+
+#ifndef ORE_LOG_LEVEL_MAX
+#define ORE_LOG_LEVEL_MAX LogLevel_Trace
+#endif
+
+#define LOG_BUFFER_SIZE (16*1024)
+
+typedef struct LogBuffer LogBuffer;
+struct LogBuffer
+{
+    int length;
+    char data[LOG_BUFFER_SIZE];
+};
+
+static LogLevel log_level = LogLevel_Info;
+static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+static _Thread_local LogBuffer log_buffer;
+
+static void
+LogWriteOut(char *data, int length)
+{
+    pthread_mutex_lock(&log_mutex);
+    fwrite(data, 1, length, stdout);
+    fflush(stdout);
+    pthread_mutex_unlock(&log_mutex);
+}
+
+static void
+LogFlush(void)
+{
+    if(log_buffer.length)
+    {
+        LogWriteOut(log_buffer.data, log_buffer.length);
+        log_buffer.length = 0;
+    }
+}
+
+static void
+LogWrite(char *format, ...)
+{
+    for(int attempt = 0; attempt < 2; ++attempt)
+    {
+        int available = LOG_BUFFER_SIZE - log_buffer.length;
+        va_list args;
+        va_start(args, format);
+        int length = vsnprintf(log_buffer.data + log_buffer.length, available, format, args);
+        va_end(args);
+        
+        if(length >= 0 && length+1 < available)
+        {
+            log_buffer.length += length;
+            log_buffer.data[log_buffer.length++] = '\n';
+            return;
+        }
+        
+        // NOTE(jsn): Didn't fit; flush and retry once with an empty buffer.
+        log_buffer.data[log_buffer.length] = 0;
+        LogFlush();
+        if(length >= 0 && length+1 >= LOG_BUFFER_SIZE)
+        {
+            // NOTE(jsn): Larger than the whole buffer, so it is written directly.
+            char *message = malloc(length+2);
+            va_start(args, format);
+            vsnprintf(message, length+1, format, args);
+            va_end(args);
+            message[length] = '\n';
+            LogWriteOut(message, length+1);
+            free(message);
+            return;
+        }
+    }
+}
+
+#define LogAt(level, ...) do { if((level) <= ORE_LOG_LEVEL_MAX && (level) <= log_level) { LogWrite(__VA_ARGS__); } } while(0)
+#define LogError(...)   LogAt(LogLevel_Error, __VA_ARGS__)
+#define LogWarning(...) LogAt(LogLevel_Warning, __VA_ARGS__)
+#define Log(...)        LogAt(LogLevel_Info, __VA_ARGS__)
+#define LogDebug(...)   LogAt(LogLevel_Debug, __VA_ARGS__)
+#define LogTrace(...)   LogAt(LogLevel_Trace, __VA_ARGS__)
 
 static int
 CharIsAlpha(int c)
@@ -35,6 +147,12 @@ CharIsDigit(int c)
     return (c >= '0' && c <= '9');
 }
 
+static int
+CharToUpper(int c)
+{
+    return (c >= 'a' && c <= 'z') ? c - 'a' + 'A' : c;
+}
+
 static int
 CharIsSpace(int c)
 {
@@ -45,7 +163,7 @@ static char symbols[6] = {'=','{','}','*','|','`'};
 static int
 CharIsSymbol(int c)
 {
-	for(int i = 0; i < CalculateCStringLength(symbols);i++){
+	for(int i = 0; i < sizeof(symbols);i++){
 		if(symbols[i] == c){
 			return 1;
 		}
@@ -101,589 +219,2394 @@ CStringMatchCaseInsensitive(char *a, char *b)
     return matches;
 }
 
-typedef u32 OutputFlags;
-#define OutputFlag_WASM      (1<<0)
-#define OutputFlag_C         (1<<1)
-#define OutputFlag_js    (1<<2)
-
-typedef enum InputType
+static u64
+GetTimeNanoseconds(void)
 {
-	InputType_Invalid,
-    InputType_OR,
-    InputType_WASM,
+    struct timespec time = {0};
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (u64)time.tv_sec*1000000000ull + (u64)time.tv_nsec;
 }
-InputType;
 
+// NOTE(jsn): Allocation profiling. A build with ORE_ALLOC_PROFILE=1 routes every malloc,
+// calloc, realloc and free below this point through the recorders here, which log the call
+// site (function and line), size, address and time. Run such a build with --alloc-log <path>
+// and read the log with --alloc-report <path> (which any build can do). Lifetimes come from
+// pairing frees with allocations by address in the report, so memory allocated here and
+// freed by Binaryen, or the other way round, is simply reported as never freed. Modules
+// built with --profile-allocations produce the same log for their own allocator, recorded
+// by Tools/ore-alloc-profile.js.
+//
+// Log layout: "OREALLOC" u32 version, then events, then the site table:
+//   event: u8 kind (1 alloc, 2 free, 0 end of events), u32 site, u64 address, u64 size, u64 ns
+//   sites: u32 count, count * { u32 line, u16 length, function name }
+#ifndef ORE_ALLOC_PROFILE
+#define ORE_ALLOC_PROFILE 0
+#endif
 
-typedef enum ExprType
-{
-    ExprType_Invalid,
-    ExprType_Var,
-    ExprType_Const,
-    ExprType_Func,
-}
-ExprType ;
+#define ALLOC_LOG_MAGIC "OREALLOC"
+#define ALLOC_LOG_VERSION 1
+#define ALLOC_LOG_EVENT_SIZE 29
 
-typedef enum TokenType
+typedef enum AllocEventKind
 {
-    Token_None,
-	Token_Var,
-	Token_Const,
-    Token_Func,
-    Token_Int,
-	Token_Float,
-    Token_DoubleNewline,
-    Token_Symbol,
-    Token_StringConstant,
+    AllocEventKind_End,
+    AllocEventKind_Alloc,
+    AllocEventKind_Free,
 }
-TokenType;
+AllocEventKind;
 
-typedef struct Token Token;
-struct Token
+#if ORE_ALLOC_PROFILE
+typedef struct AllocSite AllocSite;
+struct AllocSite
 {
-    TokenType type;
-	Token* tokens;
-    char *string;
-    int string_length;
-    int lines_traversed;
+    const char *function;
+    int line;
 };
 
-typedef struct ExprNode ExprNode;
-struct ExprNode
+typedef struct AllocLogBuffer AllocLogBuffer;
+struct AllocLogBuffer
 {
-    ExprType type;
-	Token* tokens;
-    int tokens_length;
-    ExprNode *next;
-    ExprNode *first_parameter;
-    
-    union
-    {
-        struct
-        {
-            ExprNode *first_item;
-        }
-        unordered_list;
-        
-        struct
-        {
-            ExprNode *first_item;
-        }
-        ordered_list;
-    };
+    int length;
+    unsigned char data[ALLOC_LOG_EVENT_SIZE*1024];
 };
 
-typedef struct Tokenizer Tokenizer;
-struct Tokenizer
+typedef struct AllocProfile AllocProfile;
+struct AllocProfile
 {
-    char *at;
-    int line;
-    char *file;
-    int break_text_by_commas;
+    int enabled;
+    FILE *file;
+    u64 start_ns;
+    // NOTE(jsn): Sites are keyed by the address of __func__, which is unique per function.
+    int site_count;
+    int site_capacity;
+    AllocSite *sites;
+    int *site_slots;
+    int site_slot_capacity;
 };
 
-#define PARSE_CONTEXT_MEMORY_BLOCK_SIZE_DEFAULT 4096
-typedef struct ParseContextMemoryBlock ParseContextMemoryBlock;
-struct ParseContextMemoryBlock
-{
-    int size;
-    int alloc_position;
-    void *memory;
-    ParseContextMemoryBlock *next;
-};
+// NOTE(jsn): Each thread caches the ids of the sites it has seen, so the shared site table
+// and its mutex are only touched the first time a thread allocates from a site; the
+// pipeline's workers would otherwise take turns on every malloc.
+#define ALLOC_SITE_CACHE_SIZE 1024
+#define ALLOC_SITE_CACHE_PROBES 8
 
-typedef struct ParseError ParseError;
-struct ParseError
+typedef struct AllocSiteCacheEntry AllocSiteCacheEntry;
+struct AllocSiteCacheEntry
 {
-    char *file;
+    const char *function;
     int line;
-    char *message;
+    u32 site;
 };
 
-typedef struct ParseContext ParseContext;
-struct ParseContext
-{
-    ParseContextMemoryBlock *head;
-    ParseContextMemoryBlock *active;
-    int error_stack_size;
-    int error_stack_size_max;
-    ParseError *error_stack;
-};
+static AllocProfile alloc_profile;
+static pthread_mutex_t alloc_profile_mutex = PTHREAD_MUTEX_INITIALIZER;
+static _Thread_local AllocLogBuffer alloc_log_buffer;
+static _Thread_local AllocSiteCacheEntry alloc_site_cache[ALLOC_SITE_CACHE_SIZE];
 
-static void *
-ParseContextAllocateMemory(ParseContext *context, int size)
+static u32
+AllocProfileInternSite(const char *function, int line)
 {
-    void *memory = 0;
+    pthread_mutex_lock(&alloc_profile_mutex);
+    if((alloc_profile.site_count+1)*2 > alloc_profile.site_slot_capacity)
+    {
+        int capacity = alloc_profile.site_slot_capacity ? alloc_profile.site_slot_capacity*2 : 256;
+        int *slots = calloc(capacity, sizeof(int));
+        for(int i = 0; i < alloc_profile.site_count; ++i)
+        {
+            u64 hash = ((u64)(uintptr_t)alloc_profile.sites[i].function * 31 + alloc_profile.sites[i].line) * 0x9E3779B97F4A7C15ull;
+            int slot = (int)(hash >> 40) & (capacity-1);
+            for(; slots[slot]; slot = (slot+1) & (capacity-1));
+            slots[slot] = i+1;
+        }
+        free(alloc_profile.site_slots);
+        alloc_profile.site_slots = slots;
+        alloc_profile.site_slot_capacity = capacity;
+    }
     
-    ParseContextMemoryBlock *chunk = context->active;
-    if(!chunk || chunk->alloc_position + size > chunk->size)
+    u64 hash = ((u64)(uintptr_t)function * 31 + line) * 0x9E3779B97F4A7C15ull;
+    int slot = (int)(hash >> 40) & (alloc_profile.site_slot_capacity-1);
+    for(; alloc_profile.site_slots[slot]; slot = (slot+1) & (alloc_profile.site_slot_capacity-1))
     {
-        ParseContextMemoryBlock *old_chunk = chunk;
-        int needed_bytes = size < PARSE_CONTEXT_MEMORY_BLOCK_SIZE_DEFAULT ? PARSE_CONTEXT_MEMORY_BLOCK_SIZE_DEFAULT : size;
-        chunk = malloc(sizeof(ParseContextMemoryBlock) + needed_bytes);
-        chunk->memory = (char *)chunk + sizeof(ParseContextMemoryBlock);
-        chunk->size = needed_bytes;
-        chunk->alloc_position = 0;
-        chunk->next = 0;
-        if(old_chunk)
+        AllocSite *site = alloc_profile.sites + alloc_profile.site_slots[slot]-1;
+        if(site->function == function && site->line == line)
         {
-            old_chunk->next = chunk;
+            break;
         }
-        else
+    }
+    if(!alloc_profile.site_slots[slot])
+    {
+        if(alloc_profile.site_count >= alloc_profile.site_capacity)
         {
-            context->head = chunk;
+            alloc_profile.site_capacity = alloc_profile.site_capacity ? alloc_profile.site_capacity*2 : 64;
+            alloc_profile.sites = realloc(alloc_profile.sites, sizeof(AllocSite)*alloc_profile.site_capacity);
         }
-        context->active = chunk;
+        alloc_profile.sites[alloc_profile.site_count].function = function;
+        alloc_profile.sites[alloc_profile.site_count].line = line;
+        alloc_profile.site_slots[slot] = ++alloc_profile.site_count;
     }
-    
-    memory = (char *)chunk->memory + chunk->alloc_position;
-    chunk->alloc_position += size;
-    return memory;
+    u32 site = alloc_profile.site_slots[slot]-1;
+    pthread_mutex_unlock(&alloc_profile_mutex);
+    return site;
 }
 
-static char *
-ParseContextAllocateCStringCopy(ParseContext *context, char *str)
+static u32
+AllocProfileGetSite(const char *function, int line)
 {
-    int needed_bytes = CalculateCStringLength(str)+1;
-    char *str_copy = ParseContextAllocateMemory(context, needed_bytes);
-    MemoryCopy(str_copy, str, needed_bytes);
-    return str_copy;
+    u64 hash = ((u64)(uintptr_t)function * 31 + line) * 0x9E3779B97F4A7C15ull;
+    int slot = (int)(hash >> 40) & (ALLOC_SITE_CACHE_SIZE-1);
+    for(int i = 0; i < ALLOC_SITE_CACHE_PROBES; ++i, slot = (slot+1) & (ALLOC_SITE_CACHE_SIZE-1))
+    {
+        AllocSiteCacheEntry *entry = alloc_site_cache + slot;
+        if(entry->function == function && entry->line == line)
+        {
+            return entry->site;
+        }
+        if(!entry->function)
+        {
+            entry->function = function;
+            entry->line = line;
+            entry->site = AllocProfileInternSite(function, line);
+            return entry->site;
+        }
+    }
+    return AllocProfileInternSite(function, line);
 }
 
-static char *
-ParseContextAllocateCStringCopyN(ParseContext *context, char *str, int n)
+static void
+AllocProfileFlush(void)
 {
-    int needed_bytes = n+1;
-    char *str_copy = ParseContextAllocateMemory(context, needed_bytes);
-    MemoryCopy(str_copy, str, needed_bytes);
-    str_copy[n] = 0;
-    return str_copy;
+    if(alloc_log_buffer.length)
+    {
+        pthread_mutex_lock(&alloc_profile_mutex);
+        if(alloc_profile.file)
+        {
+            fwrite(alloc_log_buffer.data, 1, alloc_log_buffer.length, alloc_profile.file);
+        }
+        pthread_mutex_unlock(&alloc_profile_mutex);
+        alloc_log_buffer.length = 0;
+    }
 }
 
-static ExprNode *
-ParseContextAllocateNode(ParseContext *context)
+static void
+AllocProfileRecord(AllocEventKind kind, const char *function, int line, uintptr_t address, u64 size)
 {
-    ExprNode *node = ParseContextAllocateMemory(context, sizeof(ExprNode));
-    MemorySet(node, 0, sizeof(*node));
-    return node;
+    if(!alloc_profile.enabled || !address)
+    {
+        return;
+    }
+    if(alloc_log_buffer.length + ALLOC_LOG_EVENT_SIZE > (int)sizeof(alloc_log_buffer.data))
+    {
+        AllocProfileFlush();
+    }
+    
+    u32 site = AllocProfileGetSite(function, line);
+    u64 fields[3] = { (u64)address, size, GetTimeNanoseconds() - alloc_profile.start_ns };
+    unsigned char *at = alloc_log_buffer.data + alloc_log_buffer.length;
+    at[0] = (unsigned char)kind;
+    MemoryCopy(at + 1, &site, 4);
+    MemoryCopy(at + 5, fields, sizeof(fields));
+    alloc_log_buffer.length += ALLOC_LOG_EVENT_SIZE;
 }
 
-static Token*
-ParseContextAllocateToken(ParseContext *context)
+static void *
+AllocProfileMalloc(size_t size, const char *function, int line)
 {
-    Token *t = ParseContextAllocateMemory(context, sizeof(Token));
-    MemorySet(t, 0, sizeof(*t));
-    return t;
+    void *result = malloc(size);
+    AllocProfileRecord(AllocEventKind_Alloc, function, line, (uintptr_t)result, size);
+    return result;
+}
+
+static void *
+AllocProfileCalloc(size_t count, size_t size, const char *function, int line)
+{
+    void *result = calloc(count, size);
+    AllocProfileRecord(AllocEventKind_Alloc, function, line, (uintptr_t)result, (u64)count*size);
+    return result;
+}
+
+static void *
+AllocProfileRealloc(void *memory, size_t size, const char *function, int line)
+{
+    // NOTE(jsn): The free is logged up front; after a successful realloc the old pointer
+    // may not be looked at any more. If realloc fails the old block is still live, which
+    // the log can only show as a new zero-sized block.
+    AllocProfileRecord(AllocEventKind_Free, function, line, (uintptr_t)memory, 0);
+    void *result = realloc(memory, size);
+    if(result)
+    {
+        AllocProfileRecord(AllocEventKind_Alloc, function, line, (uintptr_t)result, size);
+    }
+    else if(size)
+    {
+        AllocProfileRecord(AllocEventKind_Alloc, function, line, (uintptr_t)memory, 0);
+    }
+    return result;
 }
 
 static void
-PushParseError(ParseContext *context, Tokenizer *tokenizer, char *format, ...)
+AllocProfileFree(void *memory, const char *function, int line)
 {
-    if(!context->error_stack)
+    AllocProfileRecord(AllocEventKind_Free, function, line, (uintptr_t)memory, 0);
+    free(memory);
+}
+
+static int
+AllocProfileBegin(char *filename)
+{
+    alloc_profile.file = fopen(filename, "wb");
+    if(!alloc_profile.file)
     {
-        context->error_stack_size = 0;
-        context->error_stack_size_max = 32;
-        context->error_stack = ParseContextAllocateMemory(context, sizeof(ParseError)*context->error_stack_size_max);
+        return 0;
     }
-    
-    if(context->error_stack_size < context->error_stack_size_max)
+    u32 version = ALLOC_LOG_VERSION;
+    fwrite(ALLOC_LOG_MAGIC, 1, 8, alloc_profile.file);
+    fwrite(&version, 4, 1, alloc_profile.file);
+    alloc_profile.start_ns = GetTimeNanoseconds();
+    alloc_profile.enabled = 1;
+    return 1;
+}
+
+// NOTE(jsn): Must run after every other thread has flushed; the sites are written last.
+static void
+AllocProfileEnd(void)
+{
+    AllocProfileFlush();
+    alloc_profile.enabled = 0;
+    if(alloc_profile.file)
     {
-        va_list args;
-        va_start(args, format);
-        int needed_bytes = vsnprintf(0, 0, format, args)+1;
-        va_end(args);
-        
-        char *message = ParseContextAllocateMemory(context, needed_bytes);
-        
-        va_start(args, format);
-        vsnprintf(message, needed_bytes, format, args);
-        va_end(args);
-        
-        message[needed_bytes-1] = 0;
-        
-        ParseError error = {0};
+        unsigned char end = AllocEventKind_End;
+        fwrite(&end, 1, 1, alloc_profile.file);
+        u32 count = alloc_profile.site_count;
+        fwrite(&count, 4, 1, alloc_profile.file);
+        for(int i = 0; i < alloc_profile.site_count; ++i)
         {
-            error.file = tokenizer->file;
-            error.line = tokenizer->line;
-            error.message = message;
+            u32 line = alloc_profile.sites[i].line;
+            u16 length = (u16)CalculateCStringLength(alloc_profile.sites[i].function);
+            fwrite(&line, 4, 1, alloc_profile.file);
+            fwrite(&length, 2, 1, alloc_profile.file);
+            fwrite(alloc_profile.sites[i].function, 1, length, alloc_profile.file);
         }
-        
-        context->error_stack[context->error_stack_size++] = error;
+        fclose(alloc_profile.file);
     }
+    free(alloc_profile.sites);
+    free(alloc_profile.site_slots);
+    MemorySet(&alloc_profile, 0, sizeof(alloc_profile));
 }
 
+#define malloc(size)           AllocProfileMalloc((size), __func__, __LINE__)
+#define calloc(count, size)    AllocProfileCalloc((count), (size), __func__, __LINE__)
+#define realloc(memory, size)  AllocProfileRealloc((memory), (size), __func__, __LINE__)
+#define free(memory)           AllocProfileFree((memory), __func__, __LINE__)
+#else
+#define AllocProfileFlush()
+#endif
 
+// NOTE(jsn): Phase timers for --time-report. Work done for a file is accumulated in that
+// file's own phase array without synchronization and folded into the global totals once,
+// when the file leaves the pipeline. A timer also samples the perf counters and the memory
+// usage when those reports are on; with all of them off it costs one predictable branch
+// per report.
+typedef enum TimePhase
+{
+    TimePhase_Walk,
+    TimePhase_Load,
+    TimePhase_Lex,
+    TimePhase_Parse,
+    TimePhase_Codegen,
+    TimePhase_Optimize,
+    TimePhase_Validate,
+    TimePhase_Emit,
+    TimePhase_Write,
+    TimePhase_MAX
+}
+TimePhase;
 
+static char *time_phase_names[TimePhase_MAX] =
+{
+    "walk", "load", "lex", "parse", "codegen", "optimize", "validate", "emit", "write",
+};
 
-static Token
-GetNextTokenFromBuffer(Tokenizer *tokenizer)
+typedef struct TimeReportFile TimeReportFile;
+struct TimeReportFile
 {
-    char *buffer = tokenizer->at;
-    Token token = {0};
-    
-    for(int i = 0; buffer[i]; ++i)
-    {
-        // NOTE(jsn): Newline
-        if(buffer[i] == '\n' && buffer[i+1] == '\n')
+    char *path;
+    u64 total_ns;
+    u64 phase_ns[TimePhase_MAX];
+};
+
+typedef struct TimeReport TimeReport;
+struct TimeReport
+{
+    int enabled;
+    u64 start_ns;
+    atomic_ullong phase_ns[TimePhase_MAX];
+    atomic_int file_count;
+    pthread_mutex_t mutex;
+    int slowest_file_capacity;
+    int slowest_file_count;
+    TimeReportFile *slowest_files;
+};
+
+static TimeReport time_report;
+
+// NOTE(jsn): With --perf-counters and --rss-report the same blocks also sample the hardware
+// counters and the memory usage; see PerfCounters and MemoryReport below.
+#define TimeBlockBegin(name) u64 name##_time_start = time_report.enabled ? GetTimeNanoseconds() : 0; \
+    PerfCounterValues name##_counters_start = {0}; \
+    int name##_counters_valid = perf_counters.enabled && PerfCountersRead(&name##_counters_start); \
+    MemorySample name##_memory_start = {0}; \
+    if(memory_report.enabled) { MemoryReportPhaseBegin(&name##_memory_start); }
+#define TimeBlockEnd(name, phase_ns, phase) if(time_report.enabled) { (phase_ns)[phase] += GetTimeNanoseconds() - name##_time_start; } \
+    if(perf_counters.enabled) { PerfCountersAddPhase(phase, &name##_counters_start, name##_counters_valid); } \
+    if(memory_report.enabled) { MemoryReportPhaseEnd(phase, &name##_memory_start); }
+
+static void
+TimeReportBegin(int slowest_file_capacity)
+{
+    time_report.enabled = 1;
+    time_report.start_ns = GetTimeNanoseconds();
+    pthread_mutex_init(&time_report.mutex, 0);
+    time_report.slowest_file_capacity = slowest_file_capacity;
+    if(slowest_file_capacity)
+    {
+        time_report.slowest_files = calloc(slowest_file_capacity, sizeof(TimeReportFile));
+    }
+}
+
+static void
+TimeReportAddPhases(u64 *phase_ns)
+{
+    for(int i = 0; i < TimePhase_MAX; ++i)
+    {
+        if(phase_ns[i])
         {
-            token.type = Token_DoubleNewline;
-            token.string = buffer+i;
-            token.string_length = 2;
-            break;
+            atomic_fetch_add_explicit(&time_report.phase_ns[i], phase_ns[i], memory_order_relaxed);
         }
-		else if(buffer[i] == 'v' && buffer[i+1] == 'a' && buffer[i+2] == 'r'){
-			token.type = Token_Var;
-            token.string = buffer+i;
-            token.string_length = 0;
-			int escaped = 1;
-			for(; (token.string[token.string_length] != '=' && token.string[token.string_length] != ':' || escaped) && token.string[token.string_length];
-                ++token.string_length)
-            {
-                if(escaped)
-                {
-                    escaped = 0;
-                }
-                else
-                {
-                    if(token.string[token.string_length] == '\\')
-                    {
-                        escaped = 1;
-                    }
-                }
-            }
-            break;
-		}
-		else if(buffer[i] == 'c' && buffer[i+1] == 'o' && buffer[i+2] == 'n' && buffer[i+3] == 's' && buffer[i+4] == 't'){
-			token.type = Token_Const;
-            token.string = buffer+i;
-            token.string_length = 0;
-			int escaped = 1;
-			for(; (token.string[token.string_length] != ';' || escaped) && token.string[token.string_length];
-                ++token.string_length)
-            {
-                if(escaped)
-                {
-                    escaped = 0;
-                }
-                else
-                {
-                    if(token.string[token.string_length] == '\\')
-                    {
-                        escaped = 1;
-                    }
-                }
-            }
-            break;
-		}
-        // NOTE(jsn): String Constant
-        else if(buffer[i] == '"')
+    }
+}
+
+static void
+TimeReportAddFile(char *path, u64 *phase_ns)
+{
+    TimeReportAddPhases(phase_ns);
+    atomic_fetch_add_explicit(&time_report.file_count, 1, memory_order_relaxed);
+    
+    if(time_report.slowest_file_capacity)
+    {
+        u64 total_ns = 0;
+        for(int i = 0; i < TimePhase_MAX; ++i)
         {
-            token.type = Token_StringConstant;
-            token.string = buffer+i;
-            token.string_length = 0;
-            int escaped = 1;
-            for(; (token.string[token.string_length] != '"' || escaped) && token.string[token.string_length];
-                ++token.string_length)
-            {
-                if(escaped)
-                {
-                    escaped = 0;
-                }
-                else
-                {
-                    if(token.string[token.string_length] == '\\')
-                    {
-                        escaped = 1;
-                    }
-                }
-            }
-            
-            ++token.string_length;
-            
-            break;
-        }
-        // NOTE(jsn): Int
-        // @TODO: Fix me we need to consider only numbers and only returnn a string of numbers
-        else if(CharIsDigit(buffer[i])){
-            token.type = Token_Int;
-            token.string = buffer+i;
-            token.string_length = 0;
-            int strlen = 0;
-            for(; token.string[strlen] != ';' && token.string[strlen];
-                ++strlen)
-            {
-                int isValid = CharIsDigit(token.string[strlen]) || CharIsSpace(token.string[strlen]);
-                if(!isValid)
-                {
-                    break;//We will push an error since we have an invalid value
-                }
-                else{
-                    ++token.string_length;
-                }
-            }
-            // if(token.string[token.string_length] == ';')
-            //     --token.string_length;
-            break;
+            total_ns += phase_ns[i];
         }
-        //@TODO: Use this for functions eventually
-        else if(!CharIsSpace(buffer[i]))
+        
+        // NOTE(jsn): Kept sorted slowest first; the new file bubbles up from the end.
+        pthread_mutex_lock(&time_report.mutex);
+        TimeReportFile *files = time_report.slowest_files;
+        int count = time_report.slowest_file_count;
+        if(count < time_report.slowest_file_capacity || files[count-1].total_ns < total_ns)
         {
-            int j = 0;
-            
-            // NOTE(rjf): Symbol
-            if(CharIsSymbol(buffer[i]))
-            {
-                static char *symbolic_blocks_to_break_out[] =
-                {
-                    "=",
-                    "*",
-                    "_",
-                    "`",
-                    "{",
-                    "}",
-                    "|",
-                    ";",
-                };
-                
-                for(j=i+1; buffer[j] && CharIsSymbol(buffer[j]); ++j);
-                token.type = Token_Symbol;
-                
-                for(int k = 0; k < sizeof(symbolic_blocks_to_break_out)/sizeof(symbolic_blocks_to_break_out[0]);
-                    ++k)
-                {
-                    int length_to_compare = CalculateCStringLength(symbolic_blocks_to_break_out[k]);
-                    if(CStringMatchCaseSensitiveN(symbolic_blocks_to_break_out[k], buffer+i, length_to_compare))
-                    {
-                        j = i+length_to_compare;
-                        break;
-                    }
-                }
-            }
-            
-        //     // NOTE(rjf): Text
-        //     else
-        //     {
-        //         for(j=i+1;
-        //             buffer[j] &&
-        //             CharIsText(buffer[j]) &&
-        //             buffer[j] != '\n' &&
-        //             (!tokenizer->break_text_by_commas ||
-        //              buffer[j] != ','); ++j);
-        //         token.type = Token_Text;
-                
-        //         // NOTE(rjf): Add skipped whitespace to text node
-        //         for(; i > 0 && CharIsSpace(buffer[i-1]); --i);
-        //     }
-            
-            if(j != 0)
+            int i = count < time_report.slowest_file_capacity ? count++ : count-1;
+            for(; i > 0 && files[i-1].total_ns < total_ns; --i)
             {
-                token.string = buffer+i;
-                token.string_length = j-i;
-                break;
+                files[i] = files[i-1];
             }
+            files[i].path = path;
+            files[i].total_ns = total_ns;
+            MemoryCopy(files[i].phase_ns, phase_ns, sizeof(files[i].phase_ns));
+            time_report.slowest_file_count = count;
         }
+        pthread_mutex_unlock(&time_report.mutex);
+    }
+}
+
+static void
+TimeReportPrint(FILE *out)
+{
+    u64 wall_ns = GetTimeNanoseconds() - time_report.start_ns;
+    int file_count = atomic_load(&time_report.file_count);
+    u64 phase_total_ns = 0;
+    for(int i = 0; i < TimePhase_MAX; ++i)
+    {
+        phase_total_ns += atomic_load(&time_report.phase_ns[i]);
     }
-	
     
-    for(int i = 0; i < token.string_length; ++i)
+    fprintf(out, "\n===== Time Report =====\n");
+    fprintf(out, "%-10s %12s %7s %14s\n", "phase", "total ms", "%", "avg us/file");
+    for(int i = 0; i < TimePhase_MAX; ++i)
     {
-        if(token.string[i] == '\n')
+        u64 ns = atomic_load(&time_report.phase_ns[i]);
+        fprintf(out, "%-10s %12.3f %6.1f%% %14.3f\n", time_phase_names[i], ns/1e6,
+                phase_total_ns ? 100.0*ns/phase_total_ns : 0.0,
+                file_count ? ns/1e3/file_count : 0.0);
+    }
+    fprintf(out, "%-10s %12.3f\n", "sum", phase_total_ns/1e6);
+    fprintf(out, "%-10s %12.3f  (%i files)\n", "wall", wall_ns/1e6, file_count);
+    fprintf(out, "Phase times are summed over threads, so they can exceed wall time.\n");
+    
+    if(time_report.slowest_file_count)
+    {
+        fprintf(out, "\nSlowest %i files (ms):\n", time_report.slowest_file_count);
+        fprintf(out, "%10s", "total");
+        for(int i = TimePhase_Load; i < TimePhase_MAX; ++i)
         {
-            ++token.lines_traversed;
+            fprintf(out, " %9s", time_phase_names[i]);
+        }
+        fprintf(out, "  file\n");
+        for(int i = 0; i < time_report.slowest_file_count; ++i)
+        {
+            TimeReportFile *file = time_report.slowest_files+i;
+            fprintf(out, "%10.3f", file->total_ns/1e6);
+            for(int j = TimePhase_Load; j < TimePhase_MAX; ++j)
+            {
+                fprintf(out, " %9.3f", file->phase_ns[j]/1e6);
+            }
+            fprintf(out, "  %s\n", file->path);
         }
     }
-    
-    return token;
 }
 
-static Token
-PeekToken(Tokenizer *tokenizer)
+static void
+TimeReportEnd(void)
 {
-    Token token = GetNextTokenFromBuffer(tokenizer);
-    return token;
+    free(time_report.slowest_files);
+    pthread_mutex_destroy(&time_report.mutex);
+    MemorySet(&time_report, 0, sizeof(time_report));
 }
 
-static Token
-NextToken(Tokenizer *tokenizer)
+// NOTE(jsn): Zone markers for --trace. A zone is recorded as one complete event when it
+// ends, into a ring buffer owned by the calling thread, so recording never takes a lock
+// and an overflowing ring drops the oldest zones instead of unbalancing begin/end pairs.
+// Building with ORE_TRACE=0 compiles every marker away.
+#ifndef ORE_TRACE
+#define ORE_TRACE 1
+#endif
+
+#define TRACE_BUFFER_EVENT_COUNT (1<<16)
+
+typedef struct TraceEvent TraceEvent;
+struct TraceEvent
 {
-    Token token = GetNextTokenFromBuffer(tokenizer);
-    tokenizer->at = token.string + token.string_length;
-    tokenizer->line += token.lines_traversed;
-    return token;
-}
+    char *name;
+    int file_id;
+    u64 begin_ns;
+    u64 end_ns;
+};
 
-static int
-RequireTokenType(Tokenizer *tokenizer, TokenType type, Token *token_ptr)
+typedef struct TraceBuffer TraceBuffer;
+struct TraceBuffer
 {
-    int match = 0;
-    Token token = GetNextTokenFromBuffer(tokenizer);
-    if(token.type == type)
+    TraceBuffer *next;
+    int thread_index;
+    char *thread_name;
+    u64 event_count;
+    TraceEvent events[TRACE_BUFFER_EVENT_COUNT];
+};
+
+typedef struct Trace Trace;
+struct Trace
+{
+    int enabled;
+    u64 start_ns;
+    pthread_mutex_t mutex;
+    TraceBuffer *first_buffer;
+    int buffer_count;
+};
+
+static Trace trace;
+static _Thread_local TraceBuffer *trace_thread_buffer;
+
+static TraceBuffer *
+TraceGetThreadBuffer(void)
+{
+    if(!trace_thread_buffer)
     {
-        match = 1;
-        if(token_ptr)
-        {
-            *token_ptr = token;
-        }
-        tokenizer->at = token.string + token.string_length;
-        tokenizer->line += token.lines_traversed;
+        TraceBuffer *buffer = calloc(1, sizeof(TraceBuffer));
+        pthread_mutex_lock(&trace.mutex);
+        buffer->thread_index = trace.buffer_count++;
+        buffer->next = trace.first_buffer;
+        trace.first_buffer = buffer;
+        pthread_mutex_unlock(&trace.mutex);
+        trace_thread_buffer = buffer;
     }
-    return match;
+    return trace_thread_buffer;
 }
 
-static int
-TokenMatch(Token token, char *string)
+static void
+TraceRecord(char *name, int file_id, u64 begin_ns, u64 end_ns)
 {
-    return (token.type != Token_None &&
-            CStringMatchCaseSensitiveN(token.string, string, token.string_length) &&
-            string[token.string_length] == 0);
+    TraceBuffer *buffer = TraceGetThreadBuffer();
+    TraceEvent *event = buffer->events + (buffer->event_count++ % TRACE_BUFFER_EVENT_COUNT);
+    event->name = name;
+    event->file_id = file_id;
+    event->begin_ns = begin_ns;
+    event->end_ns = end_ns;
 }
 
-static int
-RequireToken(Tokenizer *tokenizer, char *string, Token *token_ptr)
+static void
+TraceSetThreadName(char *name)
 {
-    int match = 0;
-    Token token = GetNextTokenFromBuffer(tokenizer);
-    if(TokenMatch(token, string))
+    if(trace.enabled)
     {
-        match = 1;
-        if(token_ptr)
-        {
-            *token_ptr = token;
-        }
-        tokenizer->at = token.string + token.string_length;
-        tokenizer->line += token.lines_traversed;
+        TraceGetThreadBuffer()->thread_name = name;
     }
-    return match;
 }
 
+#if ORE_TRACE
+#define TraceZoneBegin(name) u64 name##_trace_start = trace.enabled ? GetTimeNanoseconds() : 0
+#define TraceZoneEnd(name, label, file_id) if(trace.enabled) { TraceRecord(label, file_id, name##_trace_start, GetTimeNanoseconds()); }
+#else
+#define TraceZoneBegin(name)
+#define TraceZoneEnd(name, label, file_id)
+#endif
+
 static void
-SkipToAfterNextComma(Tokenizer *tokenizer)
+TraceBegin(void)
 {
-    for(int i = 0; tokenizer->at[i]; ++i)
-    {
-        if(tokenizer->at[i] == ',')
-        {
-            tokenizer->at += i+1;
-            break;
-        }
-    }
+    trace.enabled = 1;
+    trace.start_ns = GetTimeNanoseconds();
+    pthread_mutex_init(&trace.mutex, 0);
+    TraceSetThreadName("main");
 }
 
 static void
-TrimQuotationMarks(char **text, int *text_length)
+WriteJSONString(FILE *out, char *string)
 {
-    if(*text[0] == '"')
+    fputc('"', out);
+    for(char *at = string; *at; ++at)
     {
-        *text = *text + 1;
-        *text_length -= 2;
+        if(*at == '"' || *at == '\\')
+        {
+            fprintf(out, "\\%c", *at);
+        }
+        else if((u8)*at < 32)
+        {
+            fprintf(out, "\\u%04x", (u8)*at);
+        }
+        else
+        {
+            fputc(*at, out);
+        }
     }
+    fputc('"', out);
 }
 
-static i8 
-GetValue(ParseContext *context, Tokenizer *tokenizer, char* link,Token* value){
-    int link_length = 0;
-    i8 isSet = 0;
-    int bracket_stack = 0;
-    for(int i = 0; link[i]; ++i)
+typedef char *TraceGetFilePathProc(void *user_data, int file_id);
+
+// NOTE(jsn): Chrome trace-event format, loadable in chrome://tracing and Perfetto.
+static int
+TraceWrite(char *filename, TraceGetFilePathProc *get_file_path, void *user_data)
+{
+    FILE *out = fopen(filename, "wb");
+    if(!out)
     {
-        if(link[i] == '"')
+        return 0;
+    }
+    
+    fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    int first = 1;
+    for(TraceBuffer *buffer = trace.first_buffer; buffer; buffer = buffer->next)
+    {
+        if(buffer->thread_name)
         {
-            if(RequireTokenType(tokenizer, Token_StringConstant, value)){
-                i += value->string_length;
-                isSet = 1;
-            }
-            else{
-                PushParseError(context, tokenizer, "Expected \" to follow String assignation.");
+            fprintf(out, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%i,\"args\":{\"name\":",
+                    first ? "" : ",\n", buffer->thread_index);
+            WriteJSONString(out, buffer->thread_name);
+            fprintf(out, "}}");
+            first = 0;
+        }
+        
+        u64 event_count = buffer->event_count;
+        u64 first_event = event_count > TRACE_BUFFER_EVENT_COUNT ? event_count - TRACE_BUFFER_EVENT_COUNT : 0;
+        for(u64 i = first_event; i < event_count; ++i)
+        {
+            TraceEvent *event = buffer->events + (i % TRACE_BUFFER_EVENT_COUNT);
+            fprintf(out, "%s{\"ph\":\"X\",\"pid\":1,\"tid\":%i,\"ts\":%.3f,\"dur\":%.3f,\"name\":",
+                    first ? "" : ",\n", buffer->thread_index,
+                    (event->begin_ns - trace.start_ns)/1e3, (event->end_ns - event->begin_ns)/1e3);
+            WriteJSONString(out, event->name);
+            if(event->file_id >= 0)
+            {
+                fprintf(out, ",\"args\":{\"file_id\":%i", event->file_id);
+                char *path = get_file_path ? get_file_path(user_data, event->file_id) : 0;
+                if(path)
+                {
+                    fprintf(out, ",\"path\":");
+                    WriteJSONString(out, path);
+                }
+                fprintf(out, "}");
             }
-            break;
+            fprintf(out, "}");
+            first = 0;
         }
-        else if(link[i] == '[')
+    }
+    fprintf(out, "\n]}\n");
+    fclose(out);
+    return 1;
+}
+
+static void
+TraceEnd(void)
+{
+    for(TraceBuffer *buffer = trace.first_buffer; buffer;)
+    {
+        TraceBuffer *next = buffer->next;
+        free(buffer);
+        buffer = next;
+    }
+    pthread_mutex_destroy(&trace.mutex);
+    MemorySet(&trace, 0, sizeof(trace));
+}
+
+typedef u32 OutputFlags;
+#define OutputFlag_WASM      (1<<0)
+#define OutputFlag_C         (1<<1)
+#define OutputFlag_js    (1<<2)
+
+typedef enum InputType
+{
+	InputType_Invalid,
+    InputType_OR,
+    InputType_WASM,
+}
+InputType;
+
+
+typedef enum ExprType
+{
+    ExprType_Invalid,
+    ExprType_Var,
+    ExprType_Const,
+    ExprType_Func,
+}
+ExprType ;
+
+typedef enum TokenType
+{
+    Token_None,
+	Token_Var,
+	Token_Const,
+    Token_Func,
+    Token_Int,
+	Token_Float,
+    Token_DoubleNewline,
+    Token_Symbol,
+    Token_StringConstant,
+    Token_MAX
+}
+TokenType;
+
+// NOTE(jsn): Work counters for --stats. Each thread bumps its own heap-allocated block of
+// counters, so hot paths need no atomics; the blocks are summed when the report is made.
+// The token and node ranges follow the order of TokenType and ExprType.
+typedef enum Stat
+{
+    Stat_FilesParsed,
+    Stat_BytesLexed,
+    Stat_TokensFirst,
+    Stat_TokensLast = Stat_TokensFirst + Token_MAX - 1,
+    Stat_NodesFirst,
+    Stat_NodesLast = Stat_NodesFirst + 3,
+    Stat_ParseErrors,
+    Stat_SymbolsInterned,
+    Stat_Globals,
+    Stat_DataBytes,
+    Stat_ArenaHugeBlocks,
+    Stat_IRValues,
+    Stat_IRValuesRemoved,
+    Stat_BinaryenModules,
+    Stat_BinaryenFunctions,
+    Stat_ExpressionsBeforeOptimization,
+    Stat_ExpressionsAfterOptimization,
+    Stat_SecondaryFunctions,
+    Stat_CacheHits,
+    Stat_CacheRemoteHits,
+    Stat_CacheMisses,
+    Stat_CacheUploads,
+    Stat_OutputFiles,
+    Stat_OutputBytes,
+    Stat_MAX
+}
+Stat;
+
+static char *stat_names[Stat_MAX] =
+{
+    "files_parsed",
+    "bytes_lexed",
+    "tokens.none", "tokens.var", "tokens.const", "tokens.func", "tokens.int", "tokens.float",
+    "tokens.double_newline", "tokens.symbol", "tokens.string_constant",
+    "nodes.invalid", "nodes.var", "nodes.const", "nodes.func",
+    "parse_errors",
+    "symbols_interned",
+    "globals",
+    "data_bytes",
+    "arena.huge_blocks",
+    "ir.values",
+    "ir.values_removed",
+    "binaryen.modules",
+    "binaryen.functions",
+    "binaryen.expressions_before_optimization",
+    "binaryen.expressions_after_optimization",
+    "binaryen.secondary_functions",
+    "cache.hits",
+    "cache.remote_hits",
+    "cache.misses",
+    "cache.uploads",
+    "output.files",
+    "output.bytes",
+};
+
+typedef struct StatsBlock StatsBlock;
+struct StatsBlock
+{
+    StatsBlock *next;
+    u64 counters[Stat_MAX];
+};
+
+typedef struct Stats Stats;
+struct Stats
+{
+    int enabled;
+    pthread_mutex_t mutex;
+    StatsBlock *first_block;
+};
+
+static Stats stats;
+static _Thread_local StatsBlock *stats_thread_block;
+
+static StatsBlock *
+StatsGetThreadBlock(void)
+{
+    if(!stats_thread_block)
+    {
+        StatsBlock *block = calloc(1, sizeof(StatsBlock));
+        pthread_mutex_lock(&stats.mutex);
+        block->next = stats.first_block;
+        stats.first_block = block;
+        pthread_mutex_unlock(&stats.mutex);
+        stats_thread_block = block;
+    }
+    return stats_thread_block;
+}
+
+#define StatAdd(stat, amount) if(stats.enabled) { StatsGetThreadBlock()->counters[stat] += (amount); }
+
+static void
+StatsBegin(void)
+{
+    stats.enabled = 1;
+    pthread_mutex_init(&stats.mutex, 0);
+}
+
+static void
+StatsSum(u64 *counters)
+{
+    MemorySet(counters, 0, sizeof(u64)*Stat_MAX);
+    for(StatsBlock *block = stats.first_block; block; block = block->next)
+    {
+        for(int i = 0; i < Stat_MAX; ++i)
         {
-            bracket_stack++;
+            counters[i] += block->counters[i];
         }
-        else if(link[i] == ']')
+    }
+}
+
+static void
+StatsPrint(FILE *out)
+{
+    u64 counters[Stat_MAX];
+    StatsSum(counters);
+    fprintf(out, "\n===== Stats =====\n");
+    for(int i = 0; i < Stat_MAX; ++i)
+    {
+        fprintf(out, "%-42s %14llu\n", stat_names[i], (unsigned long long)counters[i]);
+    }
+}
+
+static int
+StatsWriteJSON(char *filename)
+{
+    FILE *out = fopen(filename, "wb");
+    if(!out)
+    {
+        return 0;
+    }
+    u64 counters[Stat_MAX];
+    StatsSum(counters);
+    fprintf(out, "{\n");
+    for(int i = 0; i < Stat_MAX; ++i)
+    {
+        fprintf(out, "  \"%s\": %llu%s\n", stat_names[i], (unsigned long long)counters[i], i+1 < Stat_MAX ? "," : "");
+    }
+    fprintf(out, "}\n");
+    fclose(out);
+    return 1;
+}
+
+static void
+StatsEnd(void)
+{
+    for(StatsBlock *block = stats.first_block; block;)
+    {
+        StatsBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    pthread_mutex_destroy(&stats.mutex);
+    MemorySet(&stats, 0, sizeof(stats));
+}
+
+// NOTE(jsn): Hardware counters for --perf-counters, read around every TimeBlock. Each
+// thread opens its own counter group on first use and reads all counters with a single
+// read(); the deltas go into a per-thread block of per-phase totals, summed for the report
+// like the stats. When the kernel refuses the counters (containers, perf_event_paranoid,
+// no PMU) the feature switches itself off and the report says why; a worker thread that
+// can't open its group is left out of the report, which says how many were. A group with
+// more events than the PMU has counters is multiplexed: each read also returns how long
+// the group was enabled and how long it actually ran, and every delta is scaled up by
+// their ratio, like perf stat does, with the report saying how much was estimated.
+typedef enum PerfCounter
+{
+    PerfCounter_Cycles,
+    PerfCounter_Instructions,
+    PerfCounter_BranchMisses,
+    PerfCounter_L1DMisses,
+    PerfCounter_LLCMisses,
+    PerfCounter_DTLBMisses,
+    PerfCounter_MAX
+}
+PerfCounter;
+
+static char *perf_counter_names[PerfCounter_MAX] =
+{
+    "cycles", "instructions", "branch-misses", "L1d-misses", "LLC-misses", "dTLB-misses",
+};
+
+typedef struct PerfCounterValues PerfCounterValues;
+struct PerfCounterValues
+{
+    u64 values[PerfCounter_MAX];
+    u64 time_enabled;
+    u64 time_running;
+};
+
+typedef struct PerfCounterBlock PerfCounterBlock;
+struct PerfCounterBlock
+{
+    PerfCounterBlock *next;
+    int group_fd;
+    int fds[PerfCounter_MAX];
+    // NOTE(jsn): Position of each counter in the group read, or -1 if it didn't open.
+    int slots[PerfCounter_MAX];
+    int slot_count;
+    int open_errno;
+    u64 phases[TimePhase_MAX][PerfCounter_MAX];
+    u64 time_enabled;
+    u64 time_running;
+};
+
+typedef struct PerfCounters PerfCounters;
+struct PerfCounters
+{
+    int enabled;
+    int unavailable_errno;
+    pthread_mutex_t mutex;
+    PerfCounterBlock *first_block;
+};
+
+static PerfCounters perf_counters;
+static _Thread_local PerfCounterBlock *perf_counters_thread_block;
+
+#if defined(__linux__)
+static int
+PerfCounterOpen(PerfCounter counter, int group_fd)
+{
+    struct perf_event_attr attr = {0};
+    attr.size = sizeof(attr);
+    attr.disabled = group_fd < 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    switch(counter)
+    {
+        case PerfCounter_Cycles:       { attr.type = PERF_TYPE_HARDWARE; attr.config = PERF_COUNT_HW_CPU_CYCLES; } break;
+        case PerfCounter_Instructions: { attr.type = PERF_TYPE_HARDWARE; attr.config = PERF_COUNT_HW_INSTRUCTIONS; } break;
+        case PerfCounter_BranchMisses: { attr.type = PERF_TYPE_HARDWARE; attr.config = PERF_COUNT_HW_BRANCH_MISSES; } break;
+        case PerfCounter_L1DMisses:
         {
-            --bracket_stack;
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        } break;
+        case PerfCounter_LLCMisses:    { attr.type = PERF_TYPE_HARDWARE; attr.config = PERF_COUNT_HW_CACHE_MISSES; } break;
+        case PerfCounter_DTLBMisses:
+        {
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        } break;
+        default: break;
+    }
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+#endif
+
+static PerfCounterBlock *
+PerfCountersGetThreadBlock(void)
+{
+    if(!perf_counters_thread_block)
+    {
+        PerfCounterBlock *block = calloc(1, sizeof(PerfCounterBlock));
+        block->group_fd = -1;
+        for(int i = 0; i < PerfCounter_MAX; ++i)
+        {
+            block->fds[i] = -1;
+            block->slots[i] = -1;
         }
-        else if(CharIsDigit(link[i]) && RequireTokenType(tokenizer, Token_Int, value))
+        
+#if defined(__linux__)
+        block->group_fd = PerfCounterOpen(PerfCounter_Cycles, -1);
+        if(block->group_fd >= 0)
         {
-            if(CharIsDigit(value->string[value->string_length-1]))
+            block->fds[PerfCounter_Cycles] = block->group_fd;
+            block->slots[PerfCounter_Cycles] = block->slot_count++;
+            for(int i = PerfCounter_Cycles+1; i < PerfCounter_MAX; ++i)
             {
-                isSet = 1;
-            }
-            else {
-                PushParseError(context, tokenizer, "Expected Int value but had incorrect char %c.",value->string[value->string_length-1]);
+                block->fds[i] = PerfCounterOpen(i, block->group_fd);
+                if(block->fds[i] >= 0)
+                {
+                    block->slots[i] = block->slot_count++;
+                }
             }
-            i += value->string_length;
+            ioctl(block->group_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(block->group_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
         }
-        
-        if(link[i] == ';')
+        else
         {
-            ++link_length;
-            break;
+            block->open_errno = errno;
         }
+#else
+        block->open_errno = ENOSYS;
+#endif
         
-        ++link_length;
+        pthread_mutex_lock(&perf_counters.mutex);
+        block->next = perf_counters.first_block;
+        perf_counters.first_block = block;
+        pthread_mutex_unlock(&perf_counters.mutex);
+        perf_counters_thread_block = block;
     }
-    if(isSet == 0){
-        PushParseError(context, tokenizer, "Expected value before endline");
+    return perf_counters_thread_block;
+}
+
+// NOTE(jsn): Returns 0 unless the whole group was read.
+static int
+PerfCountersRead(PerfCounterValues *values)
+{
+    int result = 0;
+    PerfCounterBlock *block = PerfCountersGetThreadBlock();
+    if(block->group_fd >= 0)
+    {
+        // NOTE(jsn): Read layout: the number of counters, the enabled and running times,
+        // then the values.
+        u64 buffer[3 + PerfCounter_MAX] = {0};
+        if(read(block->group_fd, buffer, sizeof(buffer)) == (ssize_t)(sizeof(u64)*(3 + block->slot_count)))
+        {
+            result = 1;
+            values->time_enabled = buffer[1];
+            values->time_running = buffer[2];
+            for(int i = 0; i < PerfCounter_MAX; ++i)
+            {
+                values->values[i] = block->slots[i] >= 0 ? buffer[3 + block->slots[i]] : 0;
+            }
+        }
     }
-    return isSet == 0 ? isSet : link_length;
+    return result;
 }
+
+// NOTE(jsn): A phase with a failed read at either end is left out; the deltas against a
+// zeroed sample would wrap.
 static void
-setTokenFromOther(Token* to, Token from){
-    to->type = from.type;
-    to->string = from.string;
-    to->string_length = from.string_length;
-    to->lines_traversed = from.lines_traversed;
+PerfCountersAddPhase(TimePhase phase, PerfCounterValues *start, int start_is_valid)
+{
+    PerfCounterValues end = {0};
+    if(start_is_valid && PerfCountersRead(&end))
+    {
+        PerfCounterBlock *block = PerfCountersGetThreadBlock();
+        u64 enabled = end.time_enabled - start->time_enabled;
+        u64 running = end.time_running - start->time_running;
+        block->time_enabled += enabled;
+        block->time_running += running;
+        if(running)
+        {
+            double scale = running < enabled ? (double)enabled / running : 1.0;
+            for(int i = 0; i < PerfCounter_MAX; ++i)
+            {
+                block->phases[phase][i] += (u64)((end.values[i] - start->values[i])*scale);
+            }
+        }
+    }
 }
-static ExprNode *
-ParseText(ParseContext *context, Tokenizer *tokenizer)
+
+static void
+PerfCountersBegin(void)
 {
-    ExprNode *result = 0;
+    perf_counters.enabled = 1;
+    pthread_mutex_init(&perf_counters.mutex, 0);
     
-    Token token = PeekToken(tokenizer);
-    int text_style_flags = 0;
+    // NOTE(jsn): Opened here for the main thread so an unavailable PMU is known up front.
+    PerfCounterBlock *block = PerfCountersGetThreadBlock();
+    if(block->open_errno)
+    {
+        perf_counters.unavailable_errno = block->open_errno;
+        perf_counters.enabled = 0;
+    }
     
-    ExprNode **node_store_target = &result;
+    // NOTE(jsn): The per-byte and per-token figures come from the stats counters.
+    if(!stats.enabled)
+    {
+        StatsBegin();
+    }
+}
+
+static void
+PerfCountersPrint(FILE *out)
+{
+    fprintf(out, "\n===== Hardware Counters =====\n");
+    if(perf_counters.unavailable_errno)
+    {
+        fprintf(out, "unavailable: %s\n", strerror(perf_counters.unavailable_errno));
+        return;
+    }
     
-    while(token.type != Token_None)
+    u64 phases[TimePhase_MAX][PerfCounter_MAX] = {0};
+    int available[PerfCounter_MAX] = {0};
+    int failed_thread_count = 0;
+    int failed_errno = 0;
+    u64 time_enabled = 0;
+    u64 time_running = 0;
+    for(PerfCounterBlock *block = perf_counters.first_block; block; block = block->next)
     {
-        Token isVar = {0};
-        Token symbol = {0};
-        Token text = {0};
-        
-        if(RequireTokenType(tokenizer, Token_Var, &isVar))
+        if(block->open_errno)
         {
-            Token* var = ParseContextAllocateToken(context);
-            setTokenFromOther(var,isVar);
-			Token isAssign = {0};
-            tokenizer->at = var->string + var->string_length;
-			if(RequireToken(tokenizer, "=", &isAssign))
-			{
-                Token* assign = ParseContextAllocateToken(context);
-                setTokenFromOther(assign,isAssign);
-				char *link = assign->string+1;
-				Token* value = ParseContextAllocateToken(context);
-                int link_length = GetValue(context,tokenizer,link,value);
-				if(link_length){
-					ExprNode *node = ParseContextAllocateNode(context);
-					assign->tokens = value;
-					var->tokens = assign;
-					node->tokens = var;
-                    node->tokens_length = 3;
-					node->type = ExprType_Var;
-					*node_store_target = node;
-					node_store_target = &(*node_store_target)->next;
-					
-					tokenizer->at = link + link_length;
-                }
-				
-
-			}
-            // else if(TokenMatch(tag, "@Code"))
-            // {
-            //     Token open_bracket = {0};
+            ++failed_thread_count;
+            failed_errno = block->open_errno;
+            continue;
+        }
+        time_enabled += block->time_enabled;
+        time_running += block->time_running;
+        for(int i = 0; i < PerfCounter_MAX; ++i)
+        {
+            available[i] |= block->slots[i] >= 0;
+        }
+        for(int phase = 0; phase < TimePhase_MAX; ++phase)
+        {
+            for(int i = 0; i < PerfCounter_MAX; ++i)
+            {
+                phases[phase][i] += block->phases[phase][i];
+            }
+        }
+    }
+    
+    fprintf(out, "%-10s", "phase");
+    for(int i = 0; i < PerfCounter_MAX; ++i)
+    {
+        fprintf(out, " %14s", perf_counter_names[i]);
+    }
+    fprintf(out, " %6s\n", "IPC");
+    for(int phase = 0; phase < TimePhase_MAX; ++phase)
+    {
+        if(phase == TimePhase_Lex)
+        {
+            continue;
+        }
+        fprintf(out, "%-10s", time_phase_names[phase]);
+        for(int i = 0; i < PerfCounter_MAX; ++i)
+        {
+            if(available[i])
+            {
+                fprintf(out, " %14llu", (unsigned long long)phases[phase][i]);
+            }
+            else
+            {
+                fprintf(out, " %14s", "n/a");
+            }
+        }
+        u64 cycles = phases[phase][PerfCounter_Cycles];
+        fprintf(out, " %6.2f\n", cycles ? (double)phases[phase][PerfCounter_Instructions] / cycles : 0.0);
+    }
+    fprintf(out, "Lexing runs inside the parser and is counted in the parse row.\n");
+    if(time_enabled && !time_running)
+    {
+        fprintf(out, "The counter group never got onto the PMU (more events than counters); the counts are empty.\n");
+    }
+    else if(time_running < time_enabled)
+    {
+        fprintf(out, "Counters were multiplexed, running %.1f%% of the time; counts are scaled estimates.\n",
+                100.0*time_running/time_enabled);
+    }
+    if(failed_thread_count)
+    {
+        fprintf(out, "%d thread%s could not open counters (%s); their work is not counted.\n", failed_thread_count,
+                failed_thread_count == 1 ? "" : "s", strerror(failed_errno));
+    }
+    
+    u64 counters[Stat_MAX];
+    StatsSum(counters);
+    u64 bytes = counters[Stat_BytesLexed];
+    u64 tokens = 0;
+    for(int i = Stat_TokensFirst; i <= Stat_TokensLast; ++i)
+    {
+        tokens += counters[i];
+    }
+    u64 *parse = phases[TimePhase_Parse];
+    if(bytes && tokens)
+    {
+        fprintf(out, "\nparse %-14s %10s %10s\n", "", "per byte", "per token");
+        for(int i = 0; i < PerfCounter_MAX; ++i)
+        {
+            if(available[i])
+            {
+                fprintf(out, "      %-14s %10.3f %10.3f\n", perf_counter_names[i], (double)parse[i] / bytes, (double)parse[i] / tokens);
+            }
+        }
+    }
+}
+
+static void
+PerfCountersEnd(void)
+{
+    for(PerfCounterBlock *block = perf_counters.first_block; block;)
+    {
+        PerfCounterBlock *next = block->next;
+        for(int i = PerfCounter_MAX-1; i >= 0; --i)
+        {
+            if(block->fds[i] >= 0)
+            {
+                close(block->fds[i]);
+            }
+        }
+        free(block);
+        block = next;
+    }
+    pthread_mutex_destroy(&perf_counters.mutex);
+    MemorySet(&perf_counters, 0, sizeof(perf_counters));
+}
+
+// NOTE(jsn): Memory accounting for --rss-report. Page faults are read per thread with
+// getrusage(RUSAGE_THREAD) around every TimeBlock, so they belong to exactly one phase even
+// with the pipeline running phases side by side. The peak RSS is process-wide; whichever
+// phase block was running when the high-water mark went up gets charged for the growth.
+// ParseContext arena bytes are counted per thread as blocks are allocated. An optional
+// sampler thread (--rss-sample-ms) polls VmRSS, which also sees memory that goes up and
+// comes back down inside a single phase.
+typedef struct MemorySample MemorySample;
+struct MemorySample
+{
+    u64 minor_faults;
+    u64 major_faults;
+    u64 arena_bytes;
+};
+
+typedef struct MemoryPhase MemoryPhase;
+struct MemoryPhase
+{
+    u64 minor_faults;
+    u64 major_faults;
+    u64 arena_bytes;
+};
+
+typedef struct MemoryReportBlock MemoryReportBlock;
+struct MemoryReportBlock
+{
+    MemoryReportBlock *next;
+    u64 arena_bytes;
+    MemoryPhase phases[TimePhase_MAX];
+};
+
+typedef struct MemoryReport MemoryReport;
+struct MemoryReport
+{
+    int enabled;
+    pthread_mutex_t mutex;
+    MemoryReportBlock *first_block;
+    u64 start_ns;
+    
+    atomic_ullong peak_rss_kb;
+    atomic_ullong phase_rss_growth_kb[TimePhase_MAX];
+    atomic_llong arena_live_bytes;
+    atomic_llong arena_peak_bytes;
+    
+    int sample_interval_ms;
+    atomic_int sampler_running;
+    pthread_t sampler_thread;
+    u64 sample_count;
+    u64 sampled_peak_rss_kb;
+    u64 sampled_peak_time_ns;
+};
+
+static MemoryReport memory_report;
+static _Thread_local MemoryReportBlock *memory_report_thread_block;
+
+static MemoryReportBlock *
+MemoryReportGetThreadBlock(void)
+{
+    if(!memory_report_thread_block)
+    {
+        MemoryReportBlock *block = calloc(1, sizeof(MemoryReportBlock));
+        pthread_mutex_lock(&memory_report.mutex);
+        block->next = memory_report.first_block;
+        memory_report.first_block = block;
+        pthread_mutex_unlock(&memory_report.mutex);
+        memory_report_thread_block = block;
+    }
+    return memory_report_thread_block;
+}
+
+static void
+MemoryReportAddArenaBytes(i64 bytes)
+{
+    if(bytes > 0)
+    {
+        MemoryReportGetThreadBlock()->arena_bytes += bytes;
+    }
+    i64 live = atomic_fetch_add_explicit(&memory_report.arena_live_bytes, bytes, memory_order_relaxed) + bytes;
+    i64 peak = atomic_load_explicit(&memory_report.arena_peak_bytes, memory_order_relaxed);
+    while(live > peak && !atomic_compare_exchange_weak(&memory_report.arena_peak_bytes, &peak, live))
+    {
+    }
+}
+
+static u64
+MemoryReportReadUsage(MemorySample *sample)
+{
+    struct rusage usage = {0};
+#if defined(RUSAGE_THREAD)
+    getrusage(RUSAGE_THREAD, &usage);
+#else
+    getrusage(RUSAGE_SELF, &usage);
+#endif
+    sample->minor_faults = (u64)usage.ru_minflt;
+    sample->major_faults = (u64)usage.ru_majflt;
+    sample->arena_bytes = MemoryReportGetThreadBlock()->arena_bytes;
+    
+    // NOTE(jsn): ru_maxrss is the process high-water mark (KB) even for RUSAGE_THREAD.
+    return (u64)usage.ru_maxrss;
+}
+
+static void
+MemoryReportPhaseBegin(MemorySample *sample)
+{
+    MemoryReportReadUsage(sample);
+}
+
+static void
+MemoryReportPhaseEnd(TimePhase phase, MemorySample *start)
+{
+    MemorySample end = {0};
+    u64 max_rss_kb = MemoryReportReadUsage(&end);
+    MemoryPhase *totals = MemoryReportGetThreadBlock()->phases + phase;
+    totals->minor_faults += end.minor_faults - start->minor_faults;
+    totals->major_faults += end.major_faults - start->major_faults;
+    totals->arena_bytes += end.arena_bytes - start->arena_bytes;
+    
+    u64 peak = atomic_load_explicit(&memory_report.peak_rss_kb, memory_order_relaxed);
+    while(max_rss_kb > peak)
+    {
+        if(atomic_compare_exchange_weak(&memory_report.peak_rss_kb, &peak, max_rss_kb))
+        {
+            atomic_fetch_add_explicit(&memory_report.phase_rss_growth_kb[phase], max_rss_kb - peak, memory_order_relaxed);
+            break;
+        }
+    }
+}
+
+static u64
+ReadCurrentRSSKilobytes(void)
+{
+    u64 rss_kb = 0;
+    FILE *file = fopen("/proc/self/status", "rb");
+    if(file)
+    {
+        char line[256];
+        while(fgets(line, sizeof(line), file))
+        {
+            if(!strncmp(line, "VmRSS:", 6))
+            {
+                rss_kb = strtoull(line + 6, 0, 10);
+                break;
+            }
+        }
+        fclose(file);
+    }
+    return rss_kb;
+}
+
+static void *
+MemoryReportSamplerThread(void *data)
+{
+    (void)data;
+    TraceSetThreadName("rss sampler");
+    struct timespec interval = {0};
+    interval.tv_sec = memory_report.sample_interval_ms / 1000;
+    interval.tv_nsec = (long)(memory_report.sample_interval_ms % 1000) * 1000000l;
+    while(atomic_load(&memory_report.sampler_running))
+    {
+        u64 rss_kb = ReadCurrentRSSKilobytes();
+        ++memory_report.sample_count;
+        if(rss_kb > memory_report.sampled_peak_rss_kb)
+        {
+            memory_report.sampled_peak_rss_kb = rss_kb;
+            memory_report.sampled_peak_time_ns = GetTimeNanoseconds() - memory_report.start_ns;
+        }
+        nanosleep(&interval, 0);
+    }
+    return 0;
+}
+
+static void
+MemoryReportBegin(int sample_interval_ms)
+{
+    memory_report.enabled = 1;
+    memory_report.start_ns = GetTimeNanoseconds();
+    pthread_mutex_init(&memory_report.mutex, 0);
+    memory_report.sample_interval_ms = sample_interval_ms;
+    if(sample_interval_ms > 0)
+    {
+        atomic_store(&memory_report.sampler_running, 1);
+        if(pthread_create(&memory_report.sampler_thread, 0, MemoryReportSamplerThread, 0) != 0)
+        {
+            atomic_store(&memory_report.sampler_running, 0);
+        }
+    }
+}
+
+static void
+MemoryReportPrint(FILE *out)
+{
+    MemoryPhase phases[TimePhase_MAX] = {0};
+    for(MemoryReportBlock *block = memory_report.first_block; block; block = block->next)
+    {
+        for(int i = 0; i < TimePhase_MAX; ++i)
+        {
+            phases[i].minor_faults += block->phases[i].minor_faults;
+            phases[i].major_faults += block->phases[i].major_faults;
+            phases[i].arena_bytes += block->phases[i].arena_bytes;
+        }
+    }
+    
+    struct rusage usage = {0};
+    getrusage(RUSAGE_SELF, &usage);
+    
+    fprintf(out, "\n===== Memory Report =====\n");
+    fprintf(out, "%-10s %12s %12s %12s %14s\n", "phase", "minor flt", "major flt", "arena KB", "rss growth KB");
+    for(int i = 0; i < TimePhase_MAX; ++i)
+    {
+        if(i == TimePhase_Lex)
+        {
+            continue;
+        }
+        fprintf(out, "%-10s %12llu %12llu %12.1f %14llu\n", time_phase_names[i],
+                (unsigned long long)phases[i].minor_faults,
+                (unsigned long long)phases[i].major_faults,
+                phases[i].arena_bytes / 1024.0,
+                (unsigned long long)atomic_load(&memory_report.phase_rss_growth_kb[i]));
+    }
+    fprintf(out, "Lexing runs inside the parser and is counted in the parse row.\n");
+    fprintf(out, "peak rss           %10ld KB\n", usage.ru_maxrss);
+    fprintf(out, "faults (process)   %10ld minor, %ld major\n", usage.ru_minflt, usage.ru_majflt);
+    fprintf(out, "peak arena live    %10.1f KB\n", atomic_load(&memory_report.arena_peak_bytes) / 1024.0);
+    if(memory_report.sample_count)
+    {
+        fprintf(out, "sampled peak rss   %10llu KB at %.1f ms (%llu samples every %i ms)\n",
+                (unsigned long long)memory_report.sampled_peak_rss_kb,
+                memory_report.sampled_peak_time_ns / 1e6,
+                (unsigned long long)memory_report.sample_count,
+                memory_report.sample_interval_ms);
+    }
+}
+
+static void
+MemoryReportEnd(void)
+{
+    if(atomic_load(&memory_report.sampler_running))
+    {
+        atomic_store(&memory_report.sampler_running, 0);
+        pthread_join(memory_report.sampler_thread, 0);
+    }
+    for(MemoryReportBlock *block = memory_report.first_block; block;)
+    {
+        MemoryReportBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    pthread_mutex_destroy(&memory_report.mutex);
+    MemorySet(&memory_report, 0, sizeof(memory_report));
+}
+
+typedef struct Token Token;
+struct Token
+{
+    TokenType type;
+	Token* tokens;
+    char *string;
+    int string_length;
+    int lines_traversed;
+};
+
+typedef struct ExprNode ExprNode;
+struct ExprNode
+{
+    ExprType type;
+	Token* tokens;
+    int tokens_length;
+    int line;
+    ExprNode *next;
+    ExprNode *first_parameter;
+    
+    union
+    {
+        struct
+        {
+            ExprNode *first_item;
+        }
+        unordered_list;
+        
+        struct
+        {
+            ExprNode *first_item;
+        }
+        ordered_list;
+    };
+};
+
+typedef struct Tokenizer Tokenizer;
+struct Tokenizer
+{
+    char *at;
+    int line;
+    char *file;
+    int break_text_by_commas;
+    u64 lex_ns;
+};
+
+#define PARSE_CONTEXT_MEMORY_BLOCK_SIZE_DEFAULT 4096
+typedef struct ParseContextMemoryBlock ParseContextMemoryBlock;
+struct ParseContextMemoryBlock
+{
+    int size;
+    int alloc_position;
+    int is_mapped;
+    void *memory;
+    ParseContextMemoryBlock *next;
+};
+
+// NOTE(jsn): --huge-pages. An arena that has grown past --huge-page-threshold belongs to a
+// file whose AST no longer fits in what the TLB covers with 4K pages, so walking it misses
+// the TLB on nearly every node. From there on it maps 2M blocks instead of taking 4K blocks
+// from malloc: from the reserved hugetlb pool with MAP_HUGETLB ("hugetlb"), or as
+// transparent huge pages, madvise(MADV_HUGEPAGE) on a 2M-aligned mapping ("thp"). An empty
+// hugetlb pool falls back to THP for the rest of the run, a failed mapping to malloc.
+#define ORE_HUGE_PAGE_SIZE (2*1024*1024)
+#define ORE_HUGE_PAGE_THRESHOLD_DEFAULT (4*1024*1024)
+
+typedef enum HugePageMode
+{
+    HugePageMode_Off,
+    HugePageMode_THP,
+    HugePageMode_HugeTLB,
+}
+HugePageMode;
+
+typedef struct HugePageOptions HugePageOptions;
+struct HugePageOptions
+{
+    HugePageMode mode;
+    u32 threshold;
+    atomic_int hugetlb_unavailable;
+};
+
+static HugePageOptions huge_pages = { .mode = HugePageMode_Off, .threshold = ORE_HUGE_PAGE_THRESHOLD_DEFAULT };
+
+// NOTE(jsn): size is a multiple of ORE_HUGE_PAGE_SIZE. Returns 0 when nothing could be mapped.
+static void *
+MapHugePages(u64 size)
+{
+    void *memory = MAP_FAILED;
+#if defined(__linux__)
+    if(huge_pages.mode == HugePageMode_HugeTLB && !atomic_load_explicit(&huge_pages.hugetlb_unavailable, memory_order_relaxed))
+    {
+        memory = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if(memory == MAP_FAILED && !atomic_exchange(&huge_pages.hugetlb_unavailable, 1))
+        {
+            LogWarning("MAP_HUGETLB failed (%s); using transparent huge pages instead. The pool is sized with vm.nr_hugepages.",
+                       strerror(errno));
+        }
+    }
+    if(memory == MAP_FAILED)
+    {
+        // NOTE(jsn): Over-mapped by a huge page and trimmed, so the block starts on a huge
+        // page boundary and every 2M of it can be backed by one.
+        char *mapping = mmap(0, size + ORE_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(mapping != MAP_FAILED)
+        {
+            char *aligned = (char *)(((uintptr_t)mapping + ORE_HUGE_PAGE_SIZE-1) & ~(uintptr_t)(ORE_HUGE_PAGE_SIZE-1));
+            if(aligned > mapping)
+            {
+                munmap(mapping, aligned - mapping);
+            }
+            munmap(aligned + size, ORE_HUGE_PAGE_SIZE - (aligned - mapping));
+            madvise(aligned, size, MADV_HUGEPAGE);
+            memory = aligned;
+        }
+    }
+#else
+    (void)size;
+#endif
+    return memory == MAP_FAILED ? 0 : memory;
+}
+
+typedef struct ParseError ParseError;
+struct ParseError
+{
+    char *file;
+    int line;
+    char *message;
+};
+
+typedef struct ParseContext ParseContext;
+struct ParseContext
+{
+    ParseContextMemoryBlock *head;
+    ParseContextMemoryBlock *active;
+    u64 total_size;
+    int error_stack_size;
+    int error_stack_size_max;
+    ParseError *error_stack;
+};
+
+static void *
+ParseContextAllocateMemory(ParseContext *context, int size)
+{
+    void *memory = 0;
+    
+    ParseContextMemoryBlock *chunk = context->active;
+    if(!chunk || chunk->alloc_position + size > chunk->size)
+    {
+        ParseContextMemoryBlock *old_chunk = chunk;
+        int needed_bytes = size < PARSE_CONTEXT_MEMORY_BLOCK_SIZE_DEFAULT ? PARSE_CONTEXT_MEMORY_BLOCK_SIZE_DEFAULT : size;
+        chunk = 0;
+        if(huge_pages.mode != HugePageMode_Off && context->total_size >= huge_pages.threshold)
+        {
+            u64 mapped_size = ((u64)sizeof(ParseContextMemoryBlock) + size + ORE_HUGE_PAGE_SIZE-1) & ~(u64)(ORE_HUGE_PAGE_SIZE-1);
+            chunk = MapHugePages(mapped_size);
+            if(chunk)
+            {
+                needed_bytes = (int)(mapped_size - sizeof(ParseContextMemoryBlock));
+                StatAdd(Stat_ArenaHugeBlocks, 1);
+            }
+        }
+        int is_mapped = chunk != 0;
+        if(!chunk)
+        {
+            chunk = malloc(sizeof(ParseContextMemoryBlock) + needed_bytes);
+        }
+        if(memory_report.enabled)
+        {
+            MemoryReportAddArenaBytes(needed_bytes);
+        }
+        chunk->memory = (char *)chunk + sizeof(ParseContextMemoryBlock);
+        chunk->size = needed_bytes;
+        chunk->alloc_position = 0;
+        chunk->is_mapped = is_mapped;
+        chunk->next = 0;
+        context->total_size += needed_bytes;
+        if(old_chunk)
+        {
+            old_chunk->next = chunk;
+        }
+        else
+        {
+            context->head = chunk;
+        }
+        context->active = chunk;
+    }
+    
+    memory = (char *)chunk->memory + chunk->alloc_position;
+    chunk->alloc_position += size;
+    return memory;
+}
+
+static char *
+ParseContextAllocateCStringCopy(ParseContext *context, char *str)
+{
+    int needed_bytes = CalculateCStringLength(str)+1;
+    char *str_copy = ParseContextAllocateMemory(context, needed_bytes);
+    MemoryCopy(str_copy, str, needed_bytes);
+    return str_copy;
+}
+
+static char *
+ParseContextAllocateCStringCopyN(ParseContext *context, char *str, int n)
+{
+    int needed_bytes = n+1;
+    char *str_copy = ParseContextAllocateMemory(context, needed_bytes);
+    MemoryCopy(str_copy, str, needed_bytes);
+    str_copy[n] = 0;
+    return str_copy;
+}
+
+static char *
+ParseContextAllocateCStringWithSuffix(ParseContext *context, char *str, char *suffix)
+{
+    int length = CalculateCStringLength(str);
+    int suffix_length = CalculateCStringLength(suffix);
+    char *result = ParseContextAllocateMemory(context, length+suffix_length+1);
+    MemoryCopy(result, str, length);
+    MemoryCopy(result+length, suffix, suffix_length+1);
+    return result;
+}
+
+static ExprNode *
+ParseContextAllocateNode(ParseContext *context)
+{
+    ExprNode *node = ParseContextAllocateMemory(context, sizeof(ExprNode));
+    MemorySet(node, 0, sizeof(*node));
+    return node;
+}
+
+static Token*
+ParseContextAllocateToken(ParseContext *context)
+{
+    Token *t = ParseContextAllocateMemory(context, sizeof(Token));
+    MemorySet(t, 0, sizeof(*t));
+    return t;
+}
+
+static void
+ParseContextRelease(ParseContext *context)
+{
+    for(ParseContextMemoryBlock *chunk = context->head; chunk;)
+    {
+        ParseContextMemoryBlock *next = chunk->next;
+        if(memory_report.enabled)
+        {
+            MemoryReportAddArenaBytes(-(i64)chunk->size);
+        }
+        if(chunk->is_mapped)
+        {
+            munmap(chunk, sizeof(ParseContextMemoryBlock) + chunk->size);
+        }
+        else
+        {
+            free(chunk);
+        }
+        chunk = next;
+    }
+    MemorySet(context, 0, sizeof(*context));
+}
+
+static void
+PushParseError(ParseContext *context, Tokenizer *tokenizer, char *format, ...)
+{
+    if(!context->error_stack)
+    {
+        context->error_stack_size = 0;
+        context->error_stack_size_max = 32;
+        context->error_stack = ParseContextAllocateMemory(context, sizeof(ParseError)*context->error_stack_size_max);
+    }
+    
+    if(context->error_stack_size < context->error_stack_size_max)
+    {
+        va_list args;
+        va_start(args, format);
+        int needed_bytes = vsnprintf(0, 0, format, args)+1;
+        va_end(args);
+        
+        char *message = ParseContextAllocateMemory(context, needed_bytes);
+        
+        va_start(args, format);
+        vsnprintf(message, needed_bytes, format, args);
+        va_end(args);
+        
+        message[needed_bytes-1] = 0;
+        
+        ParseError error = {0};
+        {
+            error.file = tokenizer->file;
+            error.line = tokenizer->line;
+            error.message = message;
+        }
+        
+        context->error_stack[context->error_stack_size++] = error;
+    }
+}
+
+
+
+
+// NOTE(jsn): Interns strings and hands out dense IDs in insertion order. The strings
+// live in the table's own arena; lookups go through an open-addressing index kept at
+// most half full.
+typedef struct StringTable StringTable;
+struct StringTable
+{
+    ParseContext arena;
+    u32 *slots;
+    int slot_capacity;
+    u64 *hashes;
+    char **strings;
+    int count;
+    int capacity;
+};
+
+static u64
+HashStringN(char *string, int length)
+{
+    // NOTE(jsn): FNV-1a
+    u64 hash = 14695981039346656037ull;
+    for(int i = 0; i < length; ++i)
+    {
+        hash ^= (u8)string[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static u32 *
+StringTableGetSlot(StringTable *table, char *string, int length, u64 hash)
+{
+    u32 *result = 0;
+    int mask = table->slot_capacity-1;
+    for(int i = hash & mask;; i = (i+1) & mask)
+    {
+        u32 *slot = table->slots+i;
+        if(!*slot)
+        {
+            result = slot;
+            break;
+        }
+        int id = *slot-1;
+        if(table->hashes[id] == hash && !strncmp(table->strings[id], string, length) &&
+           !table->strings[id][length])
+        {
+            result = slot;
+            break;
+        }
+    }
+    return result;
+}
+
+static void
+StringTableGrow(StringTable *table)
+{
+    int slot_capacity = table->slot_capacity ? table->slot_capacity*2 : 64;
+    free(table->slots);
+    table->slots = calloc(slot_capacity, sizeof(u32));
+    table->slot_capacity = slot_capacity;
+    for(int id = 0; id < table->count; ++id)
+    {
+        int mask = slot_capacity-1;
+        for(int i = table->hashes[id] & mask;; i = (i+1) & mask)
+        {
+            if(!table->slots[i])
+            {
+                table->slots[i] = id+1;
+                break;
+            }
+        }
+    }
+}
+
+// NOTE(jsn): Returns the ID of the string, adding it if it is not in the table yet.
+// is_new_ptr (optional) tells which of the two happened.
+static int
+StringTableIntern(StringTable *table, char *string, int length, int *is_new_ptr)
+{
+    if((table->count+1)*2 > table->slot_capacity)
+    {
+        StringTableGrow(table);
+    }
+    
+    u64 hash = HashStringN(string, length);
+    u32 *slot = StringTableGetSlot(table, string, length, hash);
+    int is_new = !*slot;
+    if(is_new)
+    {
+        if(table->count >= table->capacity)
+        {
+            table->capacity = table->capacity ? table->capacity*2 : 64;
+            table->strings = realloc(table->strings, sizeof(char *)*table->capacity);
+            table->hashes = realloc(table->hashes, sizeof(u64)*table->capacity);
+        }
+        table->strings[table->count] = ParseContextAllocateCStringCopyN(&table->arena, string, length);
+        table->hashes[table->count] = hash;
+        *slot = ++table->count;
+    }
+    if(is_new_ptr)
+    {
+        *is_new_ptr = is_new;
+    }
+    return *slot-1;
+}
+
+// NOTE(jsn): Returns the ID of the string, or -1 when it is not in the table.
+static int
+StringTableFind(StringTable *table, char *string, int length)
+{
+    int result = -1;
+    if(table->slot_capacity)
+    {
+        u32 *slot = StringTableGetSlot(table, string, length, HashStringN(string, length));
+        result = (int)*slot-1;
+    }
+    return result;
+}
+
+static char *
+StringTableGetString(StringTable *table, int id)
+{
+    return table->strings[id];
+}
+
+static void
+StringTableRelease(StringTable *table)
+{
+    ParseContextRelease(&table->arena);
+    free(table->slots);
+    free(table->hashes);
+    free(table->strings);
+    MemorySet(table, 0, sizeof(*table));
+}
+
+static Token
+LexNextToken(Tokenizer *tokenizer)
+{
+    char *buffer = tokenizer->at;
+    Token token = {0};
+    
+    for(int i = 0; buffer[i]; ++i)
+    {
+        // NOTE(jsn): Newline
+        if(buffer[i] == '\n' && buffer[i+1] == '\n')
+        {
+            token.type = Token_DoubleNewline;
+            token.string = buffer+i;
+            token.string_length = 2;
+            break;
+        }
+		else if(buffer[i] == 'v' && buffer[i+1] == 'a' && buffer[i+2] == 'r'){
+			token.type = Token_Var;
+            token.string = buffer+i;
+            token.string_length = 0;
+			int escaped = 1;
+			for(; (token.string[token.string_length] != '=' && token.string[token.string_length] != ':' || escaped) && token.string[token.string_length];
+                ++token.string_length)
+            {
+                if(escaped)
+                {
+                    escaped = 0;
+                }
+                else
+                {
+                    if(token.string[token.string_length] == '\\')
+                    {
+                        escaped = 1;
+                    }
+                }
+            }
+            break;
+		}
+		else if(buffer[i] == 'c' && buffer[i+1] == 'o' && buffer[i+2] == 'n' && buffer[i+3] == 's' && buffer[i+4] == 't'){
+			token.type = Token_Const;
+            token.string = buffer+i;
+            token.string_length = 0;
+			int escaped = 1;
+			for(; (token.string[token.string_length] != ';' || escaped) && token.string[token.string_length];
+                ++token.string_length)
+            {
+                if(escaped)
+                {
+                    escaped = 0;
+                }
+                else
+                {
+                    if(token.string[token.string_length] == '\\')
+                    {
+                        escaped = 1;
+                    }
+                }
+            }
+            break;
+		}
+        // NOTE(jsn): String Constant
+        else if(buffer[i] == '"')
+        {
+            token.type = Token_StringConstant;
+            token.string = buffer+i;
+            token.string_length = 0;
+            int escaped = 1;
+            for(; (token.string[token.string_length] != '"' || escaped) && token.string[token.string_length];
+                ++token.string_length)
+            {
+                if(escaped)
+                {
+                    escaped = 0;
+                }
+                else
+                {
+                    if(token.string[token.string_length] == '\\')
+                    {
+                        escaped = 1;
+                    }
+                }
+            }
+            
+            ++token.string_length;
+            
+            break;
+        }
+        // NOTE(jsn): Int
+        // @TODO: Fix me we need to consider only numbers and only returnn a string of numbers
+        else if(CharIsDigit(buffer[i])){
+            token.type = Token_Int;
+            token.string = buffer+i;
+            token.string_length = 0;
+            int strlen = 0;
+            for(; token.string[strlen] != ';' && token.string[strlen];
+                ++strlen)
+            {
+                int isValid = CharIsDigit(token.string[strlen]) || CharIsSpace(token.string[strlen]);
+                if(!isValid)
+                {
+                    break;//We will push an error since we have an invalid value
+                }
+                else{
+                    ++token.string_length;
+                }
+            }
+            // if(token.string[token.string_length] == ';')
+            //     --token.string_length;
+            break;
+        }
+        //@TODO: Use this for functions eventually
+        else if(!CharIsSpace(buffer[i]))
+        {
+            int j = 0;
+            
+            // NOTE(rjf): Symbol
+            if(CharIsSymbol(buffer[i]))
+            {
+                static char *symbolic_blocks_to_break_out[] =
+                {
+                    "=",
+                    "*",
+                    "_",
+                    "`",
+                    "{",
+                    "}",
+                    "|",
+                    ";",
+                };
+                
+                for(j=i+1; buffer[j] && CharIsSymbol(buffer[j]); ++j);
+                token.type = Token_Symbol;
+                
+                for(int k = 0; k < sizeof(symbolic_blocks_to_break_out)/sizeof(symbolic_blocks_to_break_out[0]);
+                    ++k)
+                {
+                    int length_to_compare = CalculateCStringLength(symbolic_blocks_to_break_out[k]);
+                    if(CStringMatchCaseSensitiveN(symbolic_blocks_to_break_out[k], buffer+i, length_to_compare))
+                    {
+                        j = i+length_to_compare;
+                        break;
+                    }
+                }
+            }
+            
+        //     // NOTE(rjf): Text
+        //     else
+        //     {
+        //         for(j=i+1;
+        //             buffer[j] &&
+        //             CharIsText(buffer[j]) &&
+        //             buffer[j] != '\n' &&
+        //             (!tokenizer->break_text_by_commas ||
+        //              buffer[j] != ','); ++j);
+        //         token.type = Token_Text;
+                
+        //         // NOTE(rjf): Add skipped whitespace to text node
+        //         for(; i > 0 && CharIsSpace(buffer[i-1]); --i);
+        //     }
+            
+            if(j != 0)
+            {
+                token.string = buffer+i;
+                token.string_length = j-i;
+                break;
+            }
+        }
+    }
+	
+    
+    for(int i = 0; i < token.string_length; ++i)
+    {
+        if(token.string[i] == '\n')
+        {
+            ++token.lines_traversed;
+        }
+    }
+    
+    return token;
+}
+
+// NOTE(jsn): The parser lexes on demand, one token read at a time, so under --time-report
+// each read is timed where it happens. Part of each clock read falls inside the interval it
+// measures, so the lex row runs somewhat high, and the reads are only paid with the report on.
+static Token
+GetNextTokenFromBuffer(Tokenizer *tokenizer)
+{
+    Token token;
+    if(time_report.enabled)
+    {
+        u64 start_ns = GetTimeNanoseconds();
+        token = LexNextToken(tokenizer);
+        tokenizer->lex_ns += GetTimeNanoseconds() - start_ns;
+    }
+    else
+    {
+        token = LexNextToken(tokenizer);
+    }
+    return token;
+}
+
+static Token
+PeekToken(Tokenizer *tokenizer)
+{
+    Token token = GetNextTokenFromBuffer(tokenizer);
+    return token;
+}
+
+static void
+ConsumeToken(Tokenizer *tokenizer, Token token)
+{
+    tokenizer->at = token.string + token.string_length;
+    tokenizer->line += token.lines_traversed;
+    StatAdd(Stat_TokensFirst + token.type, 1);
+}
+
+static Token
+NextToken(Tokenizer *tokenizer)
+{
+    Token token = GetNextTokenFromBuffer(tokenizer);
+    ConsumeToken(tokenizer, token);
+    return token;
+}
+
+static int
+RequireTokenType(Tokenizer *tokenizer, TokenType type, Token *token_ptr)
+{
+    int match = 0;
+    Token token = GetNextTokenFromBuffer(tokenizer);
+    if(token.type == type)
+    {
+        match = 1;
+        if(token_ptr)
+        {
+            *token_ptr = token;
+        }
+        ConsumeToken(tokenizer, token);
+    }
+    return match;
+}
+
+static int
+TokenMatch(Token token, char *string)
+{
+    return (token.type != Token_None &&
+            CStringMatchCaseSensitiveN(token.string, string, token.string_length) &&
+            string[token.string_length] == 0);
+}
+
+static int
+RequireToken(Tokenizer *tokenizer, char *string, Token *token_ptr)
+{
+    int match = 0;
+    Token token = GetNextTokenFromBuffer(tokenizer);
+    if(TokenMatch(token, string))
+    {
+        match = 1;
+        if(token_ptr)
+        {
+            *token_ptr = token;
+        }
+        ConsumeToken(tokenizer, token);
+    }
+    return match;
+}
+
+static void
+SkipToAfterNextComma(Tokenizer *tokenizer)
+{
+    for(int i = 0; tokenizer->at[i]; ++i)
+    {
+        if(tokenizer->at[i] == ',')
+        {
+            tokenizer->at += i+1;
+            break;
+        }
+    }
+}
+
+static void
+TrimQuotationMarks(char **text, int *text_length)
+{
+    if(*text[0] == '"')
+    {
+        *text = *text + 1;
+        *text_length -= 2;
+    }
+}
+
+// NOTE(jsn): Shared buffers, "var <name>: <type>[<count>];". The module reserves a zeroed,
+// aligned region for them that the host fills (or reads) in place, and the variable holds
+// its address. The JS glue and C header generated next to the module describe each one as
+// a typed view.
+typedef enum SharedBufferType
+{
+    SharedBufferType_U8,
+    SharedBufferType_I8,
+    SharedBufferType_U16,
+    SharedBufferType_I16,
+    SharedBufferType_U32,
+    SharedBufferType_I32,
+    SharedBufferType_F32,
+    SharedBufferType_F64,
+    SharedBufferType_MAX
+}
+SharedBufferType;
+
+static struct
+{
+    char *name;
+    u32 size;
+    char *js_array;
+    char *c_type;
+}
+shared_buffer_types[SharedBufferType_MAX] =
+{
+    { "u8",  1, "Uint8Array",   "uint8_t"  },
+    { "i8",  1, "Int8Array",    "int8_t"   },
+    { "u16", 2, "Uint16Array",  "uint16_t" },
+    { "i16", 2, "Int16Array",   "int16_t"  },
+    { "u32", 4, "Uint32Array",  "uint32_t" },
+    { "i32", 4, "Int32Array",   "int32_t"  },
+    { "f32", 4, "Float32Array", "float"    },
+    { "f64", 8, "Float64Array", "double"   },
+};
+
+static int
+ParseSharedBufferType(char *string, int length, SharedBufferType *type_ptr, u32 *count_ptr)
+{
+    int i = 0;
+    for(; i < length && CharIsSpace(string[i]); ++i);
+    int name_start = i;
+    for(; i < length && (CharIsAlpha(string[i]) || CharIsDigit(string[i])); ++i);
+    int name_length = i - name_start;
+    
+    SharedBufferType type = SharedBufferType_MAX;
+    for(int j = 0; j < SharedBufferType_MAX; ++j)
+    {
+        if((int)CalculateCStringLength(shared_buffer_types[j].name) == name_length &&
+           !strncmp(shared_buffer_types[j].name, string + name_start, name_length))
+        {
+            type = j;
+        }
+    }
+    
+    for(; i < length && CharIsSpace(string[i]); ++i);
+    if(type == SharedBufferType_MAX || i >= length || string[i++] != '[')
+    {
+        return 0;
+    }
+    for(; i < length && CharIsSpace(string[i]); ++i);
+    u64 count = 0;
+    int digits_start = i;
+    for(; i < length && CharIsDigit(string[i]) && count <= 0xFFFFFFFFull; ++i)
+    {
+        count = count*10 + (string[i] - '0');
+    }
+    int digits_end = i;
+    for(; i < length && CharIsSpace(string[i]); ++i);
+    if(digits_end == digits_start || i >= length || string[i++] != ']' ||
+       count == 0 || count*shared_buffer_types[type].size > 0xFFFFFFFFull)
+    {
+        return 0;
+    }
+    for(; i < length && CharIsSpace(string[i]); ++i);
+    if(i != length)
+    {
+        return 0;
+    }
+    
+    *type_ptr = type;
+    *count_ptr = (u32)count;
+    return 1;
+}
+
+static i8 
+GetValue(ParseContext *context, Tokenizer *tokenizer, char* link,Token* value){
+    int link_length = 0;
+    i8 isSet = 0;
+    int bracket_stack = 0;
+    for(int i = 0; link[i]; ++i)
+    {
+        if(link[i] == '"')
+        {
+            if(RequireTokenType(tokenizer, Token_StringConstant, value)){
+                i += value->string_length;
+                isSet = 1;
+            }
+            else{
+                PushParseError(context, tokenizer, "Expected \" to follow String assignation.");
+            }
+            break;
+        }
+        else if(link[i] == '[')
+        {
+            bracket_stack++;
+        }
+        else if(link[i] == ']')
+        {
+            --bracket_stack;
+        }
+        else if(CharIsDigit(link[i]) && RequireTokenType(tokenizer, Token_Int, value))
+        {
+            if(CharIsDigit(value->string[value->string_length-1]))
+            {
+                isSet = 1;
+            }
+            else {
+                PushParseError(context, tokenizer, "Expected Int value but had incorrect char %c.",value->string[value->string_length-1]);
+            }
+            i += value->string_length;
+        }
+        
+        if(link[i] == ';')
+        {
+            ++link_length;
+            break;
+        }
+        
+        ++link_length;
+    }
+    if(isSet == 0){
+        PushParseError(context, tokenizer, "Expected value before endline");
+    }
+    else
+    {
+        // NOTE(jsn): The value token has already been consumed, so the statement ends at the
+        // tokenizer position plus an optional ';'. Counting characters of link instead drops
+        // the value's length and leaves the parser stuck on its tail.
+        char *end = tokenizer->at;
+        for(; *end == ' ' || *end == '\t'; ++end);
+        if(*end == ';')
+        {
+            ++end;
+        }
+        link_length = (int)(end - link);
+    }
+    return isSet == 0 ? isSet : link_length;
+}
+static void
+setTokenFromOther(Token* to, Token from){
+    to->type = from.type;
+    to->string = from.string;
+    to->string_length = from.string_length;
+    to->lines_traversed = from.lines_traversed;
+}
+static ExprNode *
+ParseText(ParseContext *context, Tokenizer *tokenizer)
+{
+    ExprNode *result = 0;
+    
+    Token token = PeekToken(tokenizer);
+    int text_style_flags = 0;
+    
+    ExprNode **node_store_target = &result;
+    
+    while(token.type != Token_None)
+    {
+        Token isVar = {0};
+        Token symbol = {0};
+        Token text = {0};
+        char *token_start = tokenizer->at;
+        
+        if(RequireTokenType(tokenizer, Token_Var, &isVar))
+        {
+            Token* var = ParseContextAllocateToken(context);
+            setTokenFromOther(var,isVar);
+			Token isAssign = {0};
+            tokenizer->at = var->string + var->string_length;
+			if(RequireToken(tokenizer, "=", &isAssign))
+			{
+                Token* assign = ParseContextAllocateToken(context);
+                setTokenFromOther(assign,isAssign);
+				char *link = assign->string+1;
+				Token* value = ParseContextAllocateToken(context);
+                int link_length = GetValue(context,tokenizer,link,value);
+				if(link_length){
+					ExprNode *node = ParseContextAllocateNode(context);
+					assign->tokens = value;
+					var->tokens = assign;
+					node->tokens = var;
+                    node->tokens_length = 3;
+					node->type = ExprType_Var;
+                    node->line = tokenizer->line;
+                    StatAdd(Stat_NodesFirst + node->type, 1);
+					*node_store_target = node;
+					node_store_target = &(*node_store_target)->next;
+					
+					tokenizer->at = link + link_length;
+                }
+				
+
+			}
+            else if(*tokenizer->at == ':')
+            {
+                char *type = tokenizer->at+1;
+                int type_length = 0;
+                for(; type[type_length] && type[type_length] != ';' && type[type_length] != '\n'; ++type_length);
+                SharedBufferType buffer_type;
+                u32 count = 0;
+                if(type[type_length] != ';' || !ParseSharedBufferType(type, type_length, &buffer_type, &count))
+                {
+                    PushParseError(context, tokenizer, "Expected <type>[<count>]; after ':', with type u8, i8, u16, i16, u32, i32, f32 or f64.");
+                }
+                else
+                {
+                    Token *colon = ParseContextAllocateToken(context);
+                    colon->type = Token_Symbol;
+                    colon->string = tokenizer->at;
+                    colon->string_length = 1;
+                    Token *value = ParseContextAllocateToken(context);
+                    value->type = Token_Symbol;
+                    value->string = type;
+                    value->string_length = type_length;
+                    colon->tokens = value;
+                    var->tokens = colon;
+                    
+                    ExprNode *node = ParseContextAllocateNode(context);
+                    node->tokens = var;
+                    node->tokens_length = 3;
+                    node->type = ExprType_Var;
+                    node->line = tokenizer->line;
+                    StatAdd(Stat_NodesFirst + node->type, 1);
+                    *node_store_target = node;
+                    node_store_target = &(*node_store_target)->next;
+                    
+                    tokenizer->at = type + type_length + 1;
+                }
+            }
+            // else if(TokenMatch(tag, "@Code"))
+            // {
+            //     Token open_bracket = {0};
             //     if(RequireToken(tokenizer, "{", &open_bracket))
             //     {
             //         char *link = open_bracket.string+1;
@@ -767,397 +2690,5721 @@ ParseText(ParseContext *context, Tokenizer *tokenizer)
             //     }
             // }
             
-            else
+            else
+            {
+                PushParseError(context, tokenizer, "Malformed tag.");
+            }
+            
+        }
+        // else if(RequireTokenType(tokenizer, Token_Text, &text))
+        // {
+        //     ExprNode *node = ParseContextAllocateNode(context);
+        //     node->type = ExprNodeType_Text;
+        //     node->string = text.string;
+        //     node->string_length = text.string_length;
+        //     node->text_style_flags = text_style_flags;
+        //     *node_store_target = node;
+        //     node_store_target = &(*node_store_target)->next;
+        // }
+        else if(RequireTokenType(tokenizer, Token_Symbol, &symbol))
+        {
+            if(TokenMatch(symbol, "*"))
+            {
+                //multiply
+            }
+            else if(TokenMatch(symbol, "|"))
+            {
+                //or
+            }
+            else if(TokenMatch(symbol, "`"))
+            {
+                //String
+            }
+            else
+            {
+                PushParseError(context, tokenizer, "Unexpected symbol '%.*s'", symbol.string_length,
+                               symbol.string);
+            }
+        }
+        else if(RequireTokenType(tokenizer, Token_DoubleNewline, &text))
+        {
+            // ExprNode *node = ParseContextAllocateNode(context);
+            // node->type = ExprNodeType_ParagraphBreak;
+            // node->string = 0;
+            // node->string_length = 0;
+            // node->text_style_flags = text_style_flags;
+            // *node_store_target = node;
+            // node_store_target = &(*node_store_target)->next;
+        }
+        
+        if(tokenizer->at == token_start && context->error_stack_size == 0)
+        {
+            PushParseError(context, tokenizer, "Unexpected '%.*s'", token.string_length, token.string);
+        }
+        
+        token = PeekToken(tokenizer);
+        
+        if(context->error_stack_size > 0)
+        {
+            break;
+        }
+    }
+    
+    return result;
+}
+
+// NOTE(jsn): Every file discovered in the source tree, addressed by a dense ID. Paths are
+// interned, so the ID of a path is the order it was found in. Entries are handed out in
+// fixed-size chunks from the table's arena and never move, which lets pipeline stages keep
+// pointers to them while the walker is still adding files.
+#define FILE_TABLE_CHUNK_SIZE 4096
+
+typedef struct FileTableEntry FileTableEntry;
+struct FileTableEntry
+{
+    int id;
+    char *path;
+    u64 size;
+    u64 estimated_cost;
+    u64 compile_time_ns;
+};
+
+typedef struct FileTable FileTable;
+struct FileTable
+{
+    ParseContext arena;
+    StringTable paths;
+    FileTableEntry **chunks;
+    int chunk_count;
+    int chunk_capacity;
+    int count;
+};
+
+// NOTE(jsn): Returns 0 when the path is already in the table.
+static FileTableEntry *
+FileTableAdd(FileTable *table, char *path, int path_length)
+{
+    FileTableEntry *entry = 0;
+    int is_new = 0;
+    int id = StringTableIntern(&table->paths, path, path_length, &is_new);
+    if(is_new)
+    {
+        if(id / FILE_TABLE_CHUNK_SIZE >= table->chunk_count)
+        {
+            if(table->chunk_count >= table->chunk_capacity)
+            {
+                table->chunk_capacity = table->chunk_capacity ? table->chunk_capacity*2 : 16;
+                table->chunks = realloc(table->chunks, sizeof(FileTableEntry *)*table->chunk_capacity);
+            }
+            table->chunks[table->chunk_count++] = ParseContextAllocateMemory(&table->arena, sizeof(FileTableEntry)*FILE_TABLE_CHUNK_SIZE);
+        }
+        entry = table->chunks[id / FILE_TABLE_CHUNK_SIZE] + id % FILE_TABLE_CHUNK_SIZE;
+        MemorySet(entry, 0, sizeof(*entry));
+        entry->id = id;
+        entry->path = StringTableGetString(&table->paths, id);
+        table->count = id+1;
+    }
+    return entry;
+}
+
+static FileTableEntry *
+FileTableGetEntry(FileTable *table, int id)
+{
+    return table->chunks[id / FILE_TABLE_CHUNK_SIZE] + id % FILE_TABLE_CHUNK_SIZE;
+}
+
+static void
+FileTableRelease(FileTable *table)
+{
+    StringTableRelease(&table->paths);
+    ParseContextRelease(&table->arena);
+    free(table->chunks);
+    MemorySet(table, 0, sizeof(*table));
+}
+
+typedef struct FileProcessData FileProcessData;
+struct FileProcessData
+{
+    InputType input_type;
+    OutputFlags output_flags;
+    char *filename_no_extension;
+    char *wasm_output_path;
+    char *c_output_path;
+    char *js_output_path;
+};
+
+typedef struct ProcessedFile ProcessedFile;
+struct ProcessedFile
+{
+    ExprNode *root;
+    char* wasm_file_contents;
+    int wasm_file_size;
+
+    // File Data
+    char *filename;
+    char *file_contents;
+    int file_size;
+    ParseContext context;
+	
+    int date_year;
+    int date_month;
+    int date_day;
+    
+    // General Input/Output Data
+    InputType input_type;
+    OutputFlags output_flags;
+    
+    // File Table Data
+    int file_id;
+    FileTableEntry *entry;
+    u64 phase_ns[TimePhase_MAX];
+    u64 lex_ns;
+    
+    // Wasm Output
+    char *wasm_output_path;
+    char *wasm_output_contents;
+    int wasm_output_size;
+    char *secondary_output_contents;
+    int secondary_output_size;
+    
+    // @TODO: Other Formats
+    char *c_output_path;
+    char *c_header_contents;
+    int c_header_size;
+    char *js_output_path;
+    char *js_output_contents;
+    int js_output_size;
+};
+static const char* GetExprType(ExprType type){
+    switch (type)
+    {
+    case ExprType_Var:
+        return "Var";
+    case ExprType_Const:
+        return "Const";
+    case ExprType_Func:
+        return "Func";
+    default:
+        return "Invalid";
+    }
+}
+// NOTE(jsn): Lowers parsed files into a Binaryen module. A builder either backs a single
+// file, or is shared by every file of the tree when bundling; in both cases all top-level
+// names live in one namespace and strings are laid out in one linear memory.
+#define WASM_DATA_BASE_ADDRESS 16
+#define WASM_PAGE_SIZE 65536
+#define WASM_MAX_PAGES 65536
+#define WASM_REGION_ALIGNMENT 16
+#define ORE_DEFAULT_STACK_SIZE (64*1024)
+#define ORE_DEFAULT_ASYNC_STACK_SIZE (16*1024)
+
+// NOTE(jsn): Static memory planning. Linear memory is laid out as
+//   [0, 16)                    reserved, so that 0 is never a valid address
+//   [16, data_end)             data segments
+//   [stack_base, stack_top)    the shadow stack, growing down from stack_top
+//   [async_base, heap_base)    the asyncify unwind buffer, for modules with async imports
+//   [heap_base, ...)           the heap
+// with every region 16-byte aligned. The initial size covers all of it plus the expected
+// heap (--heap-size, either annotated or measured with Tools/ore-profile.js --heap-out),
+// so a module doesn't start out by calling memory.grow. The stack is only reserved when
+// the module defines functions.
+typedef struct SharedBuffer SharedBuffer;
+struct SharedBuffer
+{
+    char *name;
+    SharedBufferType type;
+    u32 count;
+    u32 address;
+};
+
+typedef struct MemoryPlanOptions MemoryPlanOptions;
+struct MemoryPlanOptions
+{
+    u32 stack_size;
+    u32 async_stack_size;
+    u32 heap_size;
+    u32 max_memory;
+    int report;
+};
+
+typedef struct MemoryPlan MemoryPlan;
+struct MemoryPlan
+{
+    int has_memory;
+    int has_memory_grow;
+    u32 data_end;
+    u32 stack_base;
+    u32 stack_top;
+    u32 async_base;
+    u32 heap_base;
+    u32 heap_size;
+    BinaryenIndex initial_pages;
+    BinaryenIndex maximum_pages;
+};
+
+typedef struct WASMModuleBuilder WASMModuleBuilder;
+struct WASMModuleBuilder
+{
+    BinaryenModuleRef module;
+    StringTable symbols;
+    int *symbol_files;
+    int symbol_files_capacity;
+    
+    int segment_count;
+    int segment_capacity;
+    char **segments;
+    u32 *segment_offsets;
+    BinaryenIndex *segment_sizes;
+    u32 data_end;
+    int has_table;
+    int profile_functions;
+    MemoryPlanOptions memory_options;
+    MemoryPlan memory_plan;
+    char *async_imports;
+    int export_allocator;
+    int profile_allocations;
+    u32 stdlib_required;
+    u32 stdlib_digit_pairs;
+    
+    SharedBuffer *shared_buffers;
+    int shared_buffer_count;
+    int shared_buffer_capacity;
+    
+    // NOTE(jsn): The start function is only attached in WASMModuleBuilderFinish, so that
+    // --preinit can hand it to wasm-ctor-eval instead.
+    char *start_function;
+    int preinit;
+    char *preinit_tool_path;
+    
+    // NOTE(jsn): --split. The startup set in, the secondary module out.
+    StringTable *split_startup;
+    char *secondary_output;
+    int secondary_output_size;
+};
+
+static void
+WASMModuleBuilderInit(WASMModuleBuilder *builder)
+{
+    MemorySet(builder, 0, sizeof(*builder));
+    builder->module = BinaryenModuleCreate();
+    BinaryenModuleSetFeatures(builder->module, BinaryenFeatureMVP() | BinaryenFeatureMutableGlobals());
+    builder->data_end = WASM_DATA_BASE_ADDRESS;
+}
+
+static void
+WASMModuleBuilderRelease(WASMModuleBuilder *builder)
+{
+    for(int i = 0; i < builder->segment_count; ++i)
+    {
+        free(builder->segments[i]);
+    }
+    free(builder->segments);
+    free(builder->segment_offsets);
+    free(builder->segment_sizes);
+    free(builder->symbol_files);
+    free(builder->shared_buffers);
+    free(builder->secondary_output);
+    StringTableRelease(&builder->symbols);
+    if(builder->module)
+    {
+        BinaryenModuleDispose(builder->module);
+    }
+    MemorySet(builder, 0, sizeof(*builder));
+}
+
+static u32
+WASMModuleBuilderPushData(WASMModuleBuilder *builder, char *data, int size)
+{
+    if(builder->segment_count >= builder->segment_capacity)
+    {
+        builder->segment_capacity = builder->segment_capacity ? builder->segment_capacity*2 : 16;
+        builder->segments = realloc(builder->segments, sizeof(char *)*builder->segment_capacity);
+        builder->segment_offsets = realloc(builder->segment_offsets, sizeof(u32)*builder->segment_capacity);
+        builder->segment_sizes = realloc(builder->segment_sizes, sizeof(BinaryenIndex)*builder->segment_capacity);
+    }
+    u32 address = builder->data_end;
+    builder->segments[builder->segment_count] = malloc(size ? size : 1);
+    MemoryCopy(builder->segments[builder->segment_count], data, size);
+    builder->segment_offsets[builder->segment_count] = address;
+    builder->segment_sizes[builder->segment_count] = size;
+    ++builder->segment_count;
+    builder->data_end += size;
+    return address;
+}
+
+// NOTE(jsn): Shared buffers live between the data segments and the stack, but outside any
+// segment; fresh memory is already zero.
+static u32
+WASMModuleBuilderPushSharedBuffer(WASMModuleBuilder *builder, char *name, SharedBufferType type, u32 count)
+{
+    if(builder->shared_buffer_count >= builder->shared_buffer_capacity)
+    {
+        builder->shared_buffer_capacity = builder->shared_buffer_capacity ? builder->shared_buffer_capacity*2 : 8;
+        builder->shared_buffers = realloc(builder->shared_buffers, sizeof(SharedBuffer)*builder->shared_buffer_capacity);
+    }
+    u32 alignment = shared_buffer_types[type].size > WASM_REGION_ALIGNMENT ? shared_buffer_types[type].size : WASM_REGION_ALIGNMENT;
+    u32 address = (builder->data_end + alignment-1) & ~(alignment-1);
+    SharedBuffer *buffer = &builder->shared_buffers[builder->shared_buffer_count++];
+    buffer->name = name;
+    buffer->type = type;
+    buffer->count = count;
+    buffer->address = address;
+    builder->data_end = address + count*shared_buffer_types[type].size;
+    return address;
+}
+
+static int
+GetVarNodeName(ExprNode *node, char **name_ptr)
+{
+    // NOTE(jsn): The var token spans "var <name> " up to the '=' or ':'.
+    Token *var = node->tokens;
+    char *name = var->string+3;
+    int length = var->string_length-3;
+    for(; length > 0 && CharIsSpace(*name); ++name, --length);
+    for(; length > 0 && CharIsSpace(name[length-1]); --length);
+    *name_ptr = name;
+    return length;
+}
+
+static void
+PushLineError(ParseContext *context, char *filename, int line, char *format, char *name, int name_length)
+{
+    Tokenizer tokenizer = {0};
+    tokenizer.file = filename;
+    tokenizer.line = line;
+    PushParseError(context, &tokenizer, format, name_length, name);
+}
+
+// NOTE(jsn): The mid-level IR between the expression tree and the backends. A file lowers
+// to a straight-line list of typed SSA values: each is defined once, by one instruction,
+// and operands name earlier values by index. Globals are instructions too, whose operand
+// is the initial value. The passes work on language facts the wasm optimizer no longer
+// sees: constants and strings are immutable, so equal ones can be one value
+// (IRNumberValues), while every shared buffer is a distinct array and is never merged.
+// Values left without uses are dropped (IREliminateDeadValues), so a string merged into
+// another never gets a data segment of its own.
+typedef enum IROp
+{
+    IROp_Nop,
+    IROp_Const,
+    IROp_String,
+    IROp_Buffer,
+    IROp_Global,
+    IROp_MAX
+}
+IROp;
+
+typedef enum IRType
+{
+    IRType_None,
+    IRType_I32,
+    IRType_Pointer,
+    IRType_MAX
+}
+IRType;
+
+static char *ir_op_names[IROp_MAX] = { "nop", "const", "string", "buffer", "global" };
+static char *ir_type_names[IRType_MAX] = { "none", "i32", "ptr" };
+
+typedef struct IRValue IRValue;
+struct IRValue
+{
+    IROp op;
+    IRType type;
+    int operand;
+    int use_count;
+    int line;
+    i32 immediate;
+    SharedBufferType buffer_type;
+
+    // NOTE(jsn): The bytes of a string, or the name of a global. Both point into the file.
+    char *string;
+    int string_length;
+};
+
+typedef struct IRFunction IRFunction;
+struct IRFunction
+{
+    IRValue *values;
+    int value_count;
+    int value_capacity;
+    char *string_data;
+};
+
+static void
+IRFunctionRelease(IRFunction *function)
+{
+    free(function->values);
+    free(function->string_data);
+    MemorySet(function, 0, sizeof(*function));
+}
+
+// NOTE(jsn): Copies the strings the values point at out of the file, so the function can
+// outlive it.
+static void
+IRFunctionOwnStrings(IRFunction *function)
+{
+    int size = 0;
+    for(int i = 0; i < function->value_count; ++i)
+    {
+        size += function->values[i].string ? function->values[i].string_length : 0;
+    }
+    function->string_data = malloc(size ? size : 1);
+    char *at = function->string_data;
+    for(int i = 0; i < function->value_count; ++i)
+    {
+        IRValue *value = &function->values[i];
+        if(value->string)
+        {
+            MemoryCopy(at, value->string, value->string_length);
+            value->string = at;
+            at += value->string_length;
+        }
+    }
+}
+
+static IRValue *
+IRPushValue(IRFunction *function, IROp op, IRType type, int operand, int line)
+{
+    if(function->value_count >= function->value_capacity)
+    {
+        function->value_capacity = function->value_capacity ? function->value_capacity*2 : 64;
+        function->values = realloc(function->values, sizeof(IRValue)*function->value_capacity);
+    }
+    IRValue *value = &function->values[function->value_count++];
+    MemorySet(value, 0, sizeof(*value));
+    value->op = op;
+    value->type = type;
+    value->operand = operand;
+    value->line = line;
+    if(operand >= 0)
+    {
+        ++function->values[operand].use_count;
+    }
+    StatAdd(Stat_IRValues, 1);
+    return value;
+}
+
+static void
+GenerateIRFromExprTree(IRFunction *function, ExprNode *node, char *filename, ParseContext *context)
+{
+    for(; node; node = node->next)
+    {
+        if(LogLevel_Trace <= ORE_LOG_LEVEL_MAX && log_level >= LogLevel_Trace)
+        {
+            LogTrace("%s",GetExprType(node->type));
+            // NOTE(jsn): A node's tokens are chained through Token::tokens, not laid out as an array.
+            for(Token *token = node->tokens; token; token = token->tokens)
+            {
+                if(token->string_length > 0)
+                    LogTrace("%.*s",token->string_length,token->string);
+            }
+        }
+
+        if(node->type == ExprType_Var)
+        {
+            char *name = 0;
+            int name_length = GetVarNodeName(node, &name);
+            Token *value = node->tokens->tokens ? node->tokens->tokens->tokens : 0;
+
+            SharedBufferType buffer_type;
+            u32 buffer_count = 0;
+            IRValue *init = 0;
+            if(value && node->tokens->tokens->string[0] == ':' &&
+               ParseSharedBufferType(value->string, value->string_length, &buffer_type, &buffer_count))
+            {
+                init = IRPushValue(function, IROp_Buffer, IRType_Pointer, -1, node->line);
+                init->buffer_type = buffer_type;
+                init->immediate = (i32)buffer_count;
+            }
+            else if(value && value->type == Token_Int)
+            {
+                init = IRPushValue(function, IROp_Const, IRType_I32, -1, node->line);
+                init->immediate = CStringToInt(value->string);
+            }
+            else if(value && value->type == Token_StringConstant)
+            {
+                init = IRPushValue(function, IROp_String, IRType_Pointer, -1, node->line);
+                init->string = value->string;
+                init->string_length = value->string_length;
+                TrimQuotationMarks(&init->string, &init->string_length);
+            }
+            else
+            {
+                PushLineError(context, filename, node->line, "Unsupported initializer for '%.*s'.", name, name_length);
+                continue;
+            }
+
+            IRValue *global = IRPushValue(function, IROp_Global, IRType_None, (int)(init - function->values), node->line);
+            global->string = name;
+            global->string_length = name_length;
+        }
+    }
+}
+
+static int
+IRValuesAreEqual(IRValue *a, IRValue *b)
+{
+    return a->op == b->op && a->type == b->type && a->immediate == b->immediate && a->string_length == b->string_length &&
+        (!a->string_length || !memcmp(a->string, b->string, a->string_length));
+}
+
+// NOTE(jsn): Value numbering over the immutable values. Operands are rewritten to the first
+// equal value as the list is walked, which is enough for straight-line SSA.
+static void
+IRNumberValues(IRFunction *function)
+{
+    int capacity = 16;
+    for(; capacity < function->value_count*2; capacity *= 2);
+    int *slots = malloc(sizeof(int)*capacity);
+    int *leaders = malloc(sizeof(int)*(function->value_count ? function->value_count : 1));
+    for(int i = 0; i < capacity; ++i)
+    {
+        slots[i] = -1;
+    }
+
+    for(int i = 0; i < function->value_count; ++i)
+    {
+        IRValue *value = &function->values[i];
+        leaders[i] = i;
+        if(value->operand >= 0 && leaders[value->operand] != value->operand)
+        {
+            --function->values[value->operand].use_count;
+            value->operand = leaders[value->operand];
+            ++function->values[value->operand].use_count;
+        }
+        if(value->op != IROp_Const && value->op != IROp_String)
+        {
+            continue;
+        }
+
+        u64 hash = HashStringN(value->string, value->string_length) ^ ((u64)value->op << 56) ^ (u32)value->immediate;
+        for(int slot = (int)(hash & (capacity-1));; slot = (slot+1) & (capacity-1))
+        {
+            if(slots[slot] < 0)
+            {
+                slots[slot] = i;
+                break;
+            }
+            if(IRValuesAreEqual(&function->values[slots[slot]], value))
+            {
+                leaders[i] = slots[slot];
+                break;
+            }
+        }
+    }
+    free(leaders);
+    free(slots);
+}
+
+// NOTE(jsn): Globals are exported, so they and everything they use stay. Walking backwards
+// frees a value's operand before the operand itself is looked at.
+static void
+IREliminateDeadValues(IRFunction *function)
+{
+    for(int i = function->value_count-1; i >= 0; --i)
+    {
+        IRValue *value = &function->values[i];
+        if(value->op != IROp_Nop && value->op != IROp_Global && value->use_count == 0)
+        {
+            if(value->operand >= 0)
+            {
+                --function->values[value->operand].use_count;
+            }
+            value->op = IROp_Nop;
+            StatAdd(Stat_IRValuesRemoved, 1);
+        }
+    }
+}
+
+static void
+IROptimize(IRFunction *function)
+{
+    IRNumberValues(function);
+    IREliminateDeadValues(function);
+}
+
+// NOTE(jsn): --dump-ir. Formatted whole before printing, so files compiled on different
+// workers don't interleave.
+static void
+IRPrint(FILE *file, char *filename, IRFunction *function)
+{
+    char *text = 0;
+    size_t size = 0;
+    FILE *out = open_memstream(&text, &size);
+    if(!out)
+    {
+        return;
+    }
+    fprintf(out, "; %s\n", filename);
+    for(int i = 0; i < function->value_count; ++i)
+    {
+        IRValue *value = &function->values[i];
+        if(value->op == IROp_Nop)
+        {
+            continue;
+        }
+        if(value->type != IRType_None)
+        {
+            fprintf(out, "  %%%d = %s %s", i, ir_op_names[value->op], ir_type_names[value->type]);
+        }
+        else
+        {
+            fprintf(out, "  %s", ir_op_names[value->op]);
+        }
+        switch(value->op)
+        {
+            case IROp_Const:  fprintf(out, " %d", value->immediate); break;
+            case IROp_String: fprintf(out, " \"%.*s\"", value->string_length, value->string); break;
+            case IROp_Buffer: fprintf(out, " %s[%u]", shared_buffer_types[value->buffer_type].name, (u32)value->immediate); break;
+            case IROp_Global: fprintf(out, " %.*s, %%%d", value->string_length, value->string, value->operand); break;
+            default: break;
+        }
+        fprintf(out, "\n");
+    }
+    fclose(out);
+    fputs(text, file);
+    free(text);
+}
+
+// NOTE(jsn): Every value is a constant at the wasm level so far; constants holds what each
+// one lowered to.
+static void
+GenerateWASMFromIR(WASMModuleBuilder *builder, IRFunction *function, int file_id, char *filename, ParseContext *context)
+{
+    BinaryenModuleRef module = builder->module;
+    u32 *constants = malloc(sizeof(u32)*(function->value_count ? function->value_count : 1));
+
+    for(int i = 0; i < function->value_count; ++i)
+    {
+        IRValue *value = &function->values[i];
+        if(value->op == IROp_Const)
+        {
+            constants[i] = (u32)value->immediate;
+        }
+        else if(value->op == IROp_String)
+        {
+            // NOTE(jsn): Strings are stored null-terminated in linear memory and the
+            // variable holds their address.
+            char *data = malloc(value->string_length+1);
+            MemoryCopy(data, value->string, value->string_length);
+            data[value->string_length] = 0;
+            constants[i] = WASMModuleBuilderPushData(builder, data, value->string_length+1);
+            StatAdd(Stat_DataBytes, value->string_length+1);
+            free(data);
+        }
+        else if(value->op == IROp_Global)
+        {
+            int is_new = 0;
+            int symbol = StringTableIntern(&builder->symbols, value->string, value->string_length, &is_new);
+            if(!is_new)
+            {
+                PushLineError(context, filename, value->line, "Redefinition of '%.*s'.", value->string, value->string_length);
+                continue;
+            }
+            if(symbol >= builder->symbol_files_capacity)
+            {
+                builder->symbol_files_capacity = builder->symbol_files_capacity ? builder->symbol_files_capacity*2 : 64;
+                builder->symbol_files = realloc(builder->symbol_files, sizeof(int)*builder->symbol_files_capacity);
+            }
+            builder->symbol_files[symbol] = file_id;
+            StatAdd(Stat_SymbolsInterned, 1);
+
+            // NOTE(jsn): A buffer belongs to exactly one global, and is only reserved once
+            // that global's name is known to be free.
+            char *symbol_name = StringTableGetString(&builder->symbols, symbol);
+            IRValue *init = &function->values[value->operand];
+            if(init->op == IROp_Buffer)
+            {
+                constants[value->operand] = WASMModuleBuilderPushSharedBuffer(builder, symbol_name, init->buffer_type, (u32)init->immediate);
+            }
+            BinaryenAddGlobal(module, symbol_name, BinaryenTypeInt32(), 1, BinaryenConst(module, BinaryenLiteralInt32(constants[value->operand])));
+            StatAdd(Stat_Globals, 1);
+            BinaryenAddGlobalExport(module, symbol_name, symbol_name);
+        }
+    }
+    free(constants);
+}
+
+// NOTE(jsn): Calls proc on expr and every expression below it, parents first. Only the node
+// kinds the backend can produce are descended into; anything else is visited as a leaf.
+typedef void VisitExpressionProc(BinaryenExpressionRef expr, void *user_data);
+
+static void
+VisitExpressions(BinaryenExpressionRef expr, VisitExpressionProc *proc, void *user_data)
+{
+    if(!expr)
+    {
+        return;
+    }
+    
+    proc(expr, user_data);
+    BinaryenExpressionId id = BinaryenExpressionGetId(expr);
+    if(id == BinaryenBlockId())
+    {
+        for(BinaryenIndex i = 0; i < BinaryenBlockGetNumChildren(expr); ++i)
+        {
+            VisitExpressions(BinaryenBlockGetChildAt(expr, i), proc, user_data);
+        }
+    }
+    else if(id == BinaryenIfId())
+    {
+        VisitExpressions(BinaryenIfGetCondition(expr), proc, user_data);
+        VisitExpressions(BinaryenIfGetIfTrue(expr), proc, user_data);
+        VisitExpressions(BinaryenIfGetIfFalse(expr), proc, user_data);
+    }
+    else if(id == BinaryenLoopId())
+    {
+        VisitExpressions(BinaryenLoopGetBody(expr), proc, user_data);
+    }
+    else if(id == BinaryenBreakId())
+    {
+        VisitExpressions(BinaryenBreakGetCondition(expr), proc, user_data);
+        VisitExpressions(BinaryenBreakGetValue(expr), proc, user_data);
+    }
+    else if(id == BinaryenCallId())
+    {
+        for(BinaryenIndex i = 0; i < BinaryenCallGetNumOperands(expr); ++i)
+        {
+            VisitExpressions(BinaryenCallGetOperandAt(expr, i), proc, user_data);
+        }
+    }
+    else if(id == BinaryenCallIndirectId())
+    {
+        VisitExpressions(BinaryenCallIndirectGetTarget(expr), proc, user_data);
+        for(BinaryenIndex i = 0; i < BinaryenCallIndirectGetNumOperands(expr); ++i)
+        {
+            VisitExpressions(BinaryenCallIndirectGetOperandAt(expr, i), proc, user_data);
+        }
+    }
+    else if(id == BinaryenLocalSetId())
+    {
+        VisitExpressions(BinaryenLocalSetGetValue(expr), proc, user_data);
+    }
+    else if(id == BinaryenGlobalSetId())
+    {
+        VisitExpressions(BinaryenGlobalSetGetValue(expr), proc, user_data);
+    }
+    else if(id == BinaryenLoadId())
+    {
+        VisitExpressions(BinaryenLoadGetPtr(expr), proc, user_data);
+    }
+    else if(id == BinaryenStoreId())
+    {
+        VisitExpressions(BinaryenStoreGetPtr(expr), proc, user_data);
+        VisitExpressions(BinaryenStoreGetValue(expr), proc, user_data);
+    }
+    else if(id == BinaryenUnaryId())
+    {
+        VisitExpressions(BinaryenUnaryGetValue(expr), proc, user_data);
+    }
+    else if(id == BinaryenBinaryId())
+    {
+        VisitExpressions(BinaryenBinaryGetLeft(expr), proc, user_data);
+        VisitExpressions(BinaryenBinaryGetRight(expr), proc, user_data);
+    }
+    else if(id == BinaryenSelectId())
+    {
+        VisitExpressions(BinaryenSelectGetIfTrue(expr), proc, user_data);
+        VisitExpressions(BinaryenSelectGetIfFalse(expr), proc, user_data);
+        VisitExpressions(BinaryenSelectGetCondition(expr), proc, user_data);
+    }
+    else if(id == BinaryenDropId())
+    {
+        VisitExpressions(BinaryenDropGetValue(expr), proc, user_data);
+    }
+    else if(id == BinaryenReturnId())
+    {
+        VisitExpressions(BinaryenReturnGetValue(expr), proc, user_data);
+    }
+    else if(id == BinaryenMemoryGrowId())
+    {
+        VisitExpressions(BinaryenMemoryGrowGetDelta(expr), proc, user_data);
+    }
+    else if(id == BinaryenMemoryCopyId())
+    {
+        VisitExpressions(BinaryenMemoryCopyGetDest(expr), proc, user_data);
+        VisitExpressions(BinaryenMemoryCopyGetSource(expr), proc, user_data);
+        VisitExpressions(BinaryenMemoryCopyGetSize(expr), proc, user_data);
+    }
+    else if(id == BinaryenMemoryFillId())
+    {
+        VisitExpressions(BinaryenMemoryFillGetDest(expr), proc, user_data);
+        VisitExpressions(BinaryenMemoryFillGetValue(expr), proc, user_data);
+        VisitExpressions(BinaryenMemoryFillGetSize(expr), proc, user_data);
+    }
+    else if(id == BinaryenSwitchId())
+    {
+        VisitExpressions(BinaryenSwitchGetCondition(expr), proc, user_data);
+        VisitExpressions(BinaryenSwitchGetValue(expr), proc, user_data);
+    }
+}
+
+static void
+CountExpression(BinaryenExpressionRef expr, void *user_data)
+{
+    (void)expr;
+    ++*(u64 *)user_data;
+}
+
+static u64
+CountModuleExpressions(WASMModuleBuilder *builder)
+{
+    BinaryenModuleRef module = builder->module;
+    u64 count = 0;
+    for(BinaryenIndex i = 0; i < BinaryenGetNumFunctions(module); ++i)
+    {
+        VisitExpressions(BinaryenFunctionGetBody(BinaryenGetFunctionByIndex(module, i)), CountExpression, &count);
+    }
+    
+    // NOTE(jsn): The C API can't enumerate globals, but every symbol is one global with a
+    // single constant initializer.
+    count += builder->symbols.count;
+    return count;
+}
+
+// NOTE(jsn): --profile-functions. Every function gets an entry event as its first statement
+// and an exit event around its result (and around every `return` value). Events go into a
+// ring buffer in linear memory, timestamped by the imported ore_profile.now (any f64 clock
+// in milliseconds, e.g. performance.now), so profiling needs nothing from the engine.
+//
+// The region is exported as __ore_profile_buffer / __ore_profile_size and is self-describing,
+// so a host only has to copy it out to a file for --profile-collapse:
+//   u32 event count (total ever written), u32 capacity, u32 names offset, u32 names size
+//   capacity * { u32 function id, u32 kind (0 enter, 1 exit), f64 time }
+//   function names, one per line, in id order
+#define ORE_PROFILE_CAPACITY 65536
+#define ORE_PROFILE_HEADER_SIZE 16
+#define ORE_PROFILE_EVENT_SIZE 16
+#define ORE_PROFILE_PREFIX "__ore_profile_"
+
+typedef struct ProfileInstrumentData ProfileInstrumentData;
+struct ProfileInstrumentData
+{
+    BinaryenModuleRef module;
+    int function_id;
+};
+
+static int
+IsImportedFunction(BinaryenFunctionRef function)
+{
+    const char *module_name = BinaryenFunctionImportGetModule(function);
+    return module_name && *module_name;
+}
+
+static char *
+GetProfileExitFunctionName(BinaryenType type)
+{
+    char *name = 0;
+    if(type == BinaryenTypeInt32())        name = ORE_PROFILE_PREFIX "exit_i32";
+    else if(type == BinaryenTypeInt64())   name = ORE_PROFILE_PREFIX "exit_i64";
+    else if(type == BinaryenTypeFloat32()) name = ORE_PROFILE_PREFIX "exit_f32";
+    else if(type == BinaryenTypeFloat64()) name = ORE_PROFILE_PREFIX "exit_f64";
+    return name;
+}
+
+static BinaryenExpressionRef
+ProfileRecordEvent(BinaryenModuleRef module, int function_id, int kind)
+{
+    BinaryenExpressionRef operands[] =
+    {
+        BinaryenConst(module, BinaryenLiteralInt32(function_id)),
+        BinaryenConst(module, BinaryenLiteralInt32(kind)),
+    };
+    return BinaryenCall(module, ORE_PROFILE_PREFIX "record", operands, 2, BinaryenTypeNone());
+}
+
+// NOTE(jsn): Wraps value in an exit event. Returns 0 for types the profiler has no exit
+// helper for (multi-value, unreachable); those exits are left out and --profile-collapse
+// unwinds the frame at its caller's exit instead.
+static BinaryenExpressionRef
+ProfileWrapExit(BinaryenModuleRef module, int function_id, BinaryenExpressionRef value)
+{
+    BinaryenType type = BinaryenExpressionGetType(value);
+    if(type == BinaryenTypeNone())
+    {
+        BinaryenExpressionRef children[] = { value, ProfileRecordEvent(module, function_id, 1) };
+        return BinaryenBlock(module, 0, children, 2, BinaryenTypeNone());
+    }
+    
+    char *exit_function = GetProfileExitFunctionName(type);
+    if(!exit_function)
+    {
+        return 0;
+    }
+    BinaryenExpressionRef operands[] = { BinaryenConst(module, BinaryenLiteralInt32(function_id)), value };
+    return BinaryenCall(module, exit_function, operands, 2, type);
+}
+
+// NOTE(jsn): A valueless `return` can't be wrapped without rewriting its parent, so only
+// returns that carry a value get an exit event.
+static void
+ProfileInstrumentReturn(BinaryenExpressionRef expr, void *user_data)
+{
+    ProfileInstrumentData *data = user_data;
+    if(BinaryenExpressionGetId(expr) == BinaryenReturnId() && BinaryenReturnGetValue(expr))
+    {
+        BinaryenExpressionRef wrapped = ProfileWrapExit(data->module, data->function_id, BinaryenReturnGetValue(expr));
+        if(wrapped)
+        {
+            BinaryenReturnSetValue(expr, wrapped);
+        }
+    }
+}
+
+static void
+ProfileAddHelpers(BinaryenModuleRef module, u32 buffer_address)
+{
+    BinaryenAddFunctionImport(module, ORE_PROFILE_PREFIX "now", "ore_profile", "now", BinaryenTypeNone(), BinaryenTypeFloat64());
+    
+    // NOTE(jsn): record(id, kind): locals 2 and 3 are the event address and the event count.
+    BinaryenType record_params[] = { BinaryenTypeInt32(), BinaryenTypeInt32() };
+    BinaryenType record_vars[] = { BinaryenTypeInt32(), BinaryenTypeInt32() };
+    BinaryenExpressionRef header = BinaryenConst(module, BinaryenLiteralInt32(buffer_address));
+    BinaryenExpressionRef count = BinaryenLocalGet(module, 3, BinaryenTypeInt32());
+    BinaryenExpressionRef slot = BinaryenBinary(module, BinaryenAndInt32(), count, BinaryenConst(module, BinaryenLiteralInt32(ORE_PROFILE_CAPACITY-1)));
+    BinaryenExpressionRef offset = BinaryenBinary(module, BinaryenShlInt32(), slot, BinaryenConst(module, BinaryenLiteralInt32(4)));
+    BinaryenExpressionRef event = BinaryenBinary(module, BinaryenAddInt32(),
+                                                 BinaryenConst(module, BinaryenLiteralInt32(buffer_address + ORE_PROFILE_HEADER_SIZE)),
+                                                 offset);
+    BinaryenExpressionRef record_body[] =
+    {
+        BinaryenLocalSet(module, 3, BinaryenLoad(module, 4, 0, 0, 0, BinaryenTypeInt32(), header)),
+        BinaryenLocalSet(module, 2, event),
+        BinaryenStore(module, 4, 0, 0, BinaryenConst(module, BinaryenLiteralInt32(buffer_address)),
+                      BinaryenBinary(module, BinaryenAddInt32(), BinaryenLocalGet(module, 3, BinaryenTypeInt32()),
+                                     BinaryenConst(module, BinaryenLiteralInt32(1))),
+                      BinaryenTypeInt32()),
+        BinaryenStore(module, 4, 0, 0, BinaryenLocalGet(module, 2, BinaryenTypeInt32()),
+                      BinaryenLocalGet(module, 0, BinaryenTypeInt32()), BinaryenTypeInt32()),
+        BinaryenStore(module, 4, 4, 0, BinaryenLocalGet(module, 2, BinaryenTypeInt32()),
+                      BinaryenLocalGet(module, 1, BinaryenTypeInt32()), BinaryenTypeInt32()),
+        BinaryenStore(module, 8, 8, 0, BinaryenLocalGet(module, 2, BinaryenTypeInt32()),
+                      BinaryenCall(module, ORE_PROFILE_PREFIX "now", 0, 0, BinaryenTypeFloat64()), BinaryenTypeFloat64()),
+    };
+    BinaryenAddFunction(module, ORE_PROFILE_PREFIX "record", BinaryenTypeCreate(record_params, 2), BinaryenTypeNone(),
+                        record_vars, 2, BinaryenBlock(module, 0, record_body, 6, BinaryenTypeNone()));
+    
+    BinaryenType value_types[] = { BinaryenTypeInt32(), BinaryenTypeInt64(), BinaryenTypeFloat32(), BinaryenTypeFloat64() };
+    for(int i = 0; i < 4; ++i)
+    {
+        BinaryenType params[] = { BinaryenTypeInt32(), value_types[i] };
+        BinaryenExpressionRef record_exit_operands[] = { BinaryenLocalGet(module, 0, BinaryenTypeInt32()), BinaryenConst(module, BinaryenLiteralInt32(1)) };
+        BinaryenExpressionRef body[] =
+        {
+            BinaryenCall(module, ORE_PROFILE_PREFIX "record", record_exit_operands, 2, BinaryenTypeNone()),
+            BinaryenLocalGet(module, 1, value_types[i]),
+        };
+        BinaryenAddFunction(module, GetProfileExitFunctionName(value_types[i]), BinaryenTypeCreate(params, 2), value_types[i],
+                            0, 0, BinaryenBlock(module, 0, body, 2, value_types[i]));
+    }
+}
+
+static void
+WASMModuleBuilderAddProfiler(WASMModuleBuilder *builder)
+{
+    BinaryenModuleRef module = builder->module;
+    BinaryenIndex function_count = BinaryenGetNumFunctions(module);
+    
+    int names_size = 0;
+    int instrumented_count = 0;
+    for(BinaryenIndex i = 0; i < function_count; ++i)
+    {
+        BinaryenFunctionRef function = BinaryenGetFunctionByIndex(module, i);
+        if(!IsImportedFunction(function))
+        {
+            names_size += (int)CalculateCStringLength(BinaryenFunctionGetName(function)) + 1;
+            ++instrumented_count;
+        }
+    }
+    if(!instrumented_count)
+    {
+        return;
+    }
+    
+    char *names = malloc(names_size);
+    int names_length = 0;
+    int function_id = 0;
+    for(BinaryenIndex i = 0; i < function_count; ++i)
+    {
+        BinaryenFunctionRef function = BinaryenGetFunctionByIndex(module, i);
+        if(IsImportedFunction(function))
+        {
+            continue;
+        }
+        
+        const char *name = BinaryenFunctionGetName(function);
+        int name_length = (int)CalculateCStringLength(name);
+        MemoryCopy(names + names_length, name, name_length);
+        names_length += name_length;
+        names[names_length++] = '\n';
+        
+        ProfileInstrumentData data = { module, function_id };
+        BinaryenExpressionRef body = BinaryenFunctionGetBody(function);
+        VisitExpressions(body, ProfileInstrumentReturn, &data);
+        BinaryenExpressionRef exit = ProfileWrapExit(module, function_id, body);
+        BinaryenExpressionRef children[] = { ProfileRecordEvent(module, function_id, 0), exit ? exit : body };
+        BinaryenFunctionSetBody(function, BinaryenBlock(module, 0, children, 2, BinaryenFunctionGetResults(function)));
+        ++function_id;
+    }
+    
+    // NOTE(jsn): The events are never part of a data segment; fresh memory is already zero.
+    builder->data_end = (builder->data_end + 15) & ~15u;
+    u32 events_size = ORE_PROFILE_CAPACITY * ORE_PROFILE_EVENT_SIZE;
+    u32 header[4] = { 0, ORE_PROFILE_CAPACITY, ORE_PROFILE_HEADER_SIZE + events_size, (u32)names_length };
+    u32 buffer_address = WASMModuleBuilderPushData(builder, (char *)header, sizeof(header));
+    builder->data_end += events_size;
+    WASMModuleBuilderPushData(builder, names, names_length);
+    free(names);
+    
+    ProfileAddHelpers(module, buffer_address);
+    BinaryenAddGlobal(module, ORE_PROFILE_PREFIX "buffer", BinaryenTypeInt32(), 0, BinaryenConst(module, BinaryenLiteralInt32(buffer_address)));
+    BinaryenAddGlobal(module, ORE_PROFILE_PREFIX "size", BinaryenTypeInt32(), 0, BinaryenConst(module, BinaryenLiteralInt32(builder->data_end - buffer_address)));
+    BinaryenAddGlobalExport(module, ORE_PROFILE_PREFIX "buffer", ORE_PROFILE_PREFIX "buffer");
+    BinaryenAddGlobalExport(module, ORE_PROFILE_PREFIX "size", ORE_PROFILE_PREFIX "size");
+}
+
+static void
+FindMemoryGrow(BinaryenExpressionRef expr, void *user_data)
+{
+    if(BinaryenExpressionGetId(expr) == BinaryenMemoryGrowId())
+    {
+        *(int *)user_data = 1;
+    }
+}
+
+static u32
+AlignRegion(u32 address)
+{
+    return (address + WASM_REGION_ALIGNMENT-1) & ~(u32)(WASM_REGION_ALIGNMENT-1);
+}
+
+static BinaryenIndex
+GetPageCount(u64 size)
+{
+    return (BinaryenIndex)((size + WASM_PAGE_SIZE-1) / WASM_PAGE_SIZE);
+}
+
+static MemoryPlan
+PlanMemory(WASMModuleBuilder *builder, int is_bundle, int is_async)
+{
+    BinaryenModuleRef module = builder->module;
+    MemoryPlanOptions *options = &builder->memory_options;
+    MemoryPlan plan = {0};
+    
+    int defines_functions = 0;
+    for(BinaryenIndex i = 0; i < BinaryenGetNumFunctions(module); ++i)
+    {
+        BinaryenFunctionRef function = BinaryenGetFunctionByIndex(module, i);
+        if(!IsImportedFunction(function))
+        {
+            defines_functions = 1;
+            VisitExpressions(BinaryenFunctionGetBody(function), FindMemoryGrow, &plan.has_memory_grow);
+        }
+    }
+    
+    u32 stack_size = defines_functions ? AlignRegion(options->stack_size) : 0;
+    plan.data_end = builder->data_end;
+    plan.stack_base = AlignRegion(plan.data_end);
+    plan.stack_top = plan.stack_base + stack_size;
+    plan.async_base = plan.stack_top;
+    plan.heap_base = plan.async_base + (is_async ? AlignRegion(options->async_stack_size) : 0);
+    plan.heap_size = options->heap_size;
+    plan.has_memory = builder->segment_count || is_bundle || plan.heap_base > WASM_DATA_BASE_ADDRESS || plan.heap_size ||
+        builder->export_allocator;
+    
+    u64 initial_size = (u64)plan.heap_base + plan.heap_size;
+    plan.initial_pages = GetPageCount(initial_size);
+    if(plan.initial_pages == 0)
+    {
+        plan.initial_pages = 1;
+    }
+    if(plan.initial_pages > WASM_MAX_PAGES)
+    {
+        fprintf(stderr, "WARNING: the planned memory (%llu bytes) is larger than 4 GiB; clamping it\n",
+                (unsigned long long)initial_size);
+        plan.initial_pages = WASM_MAX_PAGES;
+    }
+    
+    // NOTE(jsn): Hosts can grow an exported memory too, so without --max-memory it stays
+    // unbounded.
+    plan.maximum_pages = 0xFFFFFFFF;
+    if(options->max_memory)
+    {
+        plan.maximum_pages = GetPageCount(options->max_memory);
+        if(plan.maximum_pages < plan.initial_pages)
+        {
+            fprintf(stderr, "WARNING: --max-memory %u is smaller than the planned layout; using %u pages\n",
+                    options->max_memory, plan.initial_pages);
+            plan.maximum_pages = plan.initial_pages;
+        }
+    }
+    return plan;
+}
+
+static void
+MemoryPlanPrint(FILE *file, char *name, MemoryPlan *plan)
+{
+    // NOTE(jsn): Formatted up front so reports from several workers don't interleave.
+    char report[1024];
+    int length = 0;
+    length += snprintf(report + length, sizeof(report) - length, "memory layout of %s:\n", name);
+    if(!plan->has_memory)
+    {
+        length += snprintf(report + length, sizeof(report) - length, "  no linear memory\n");
+    }
+    else
+    {
+        char maximum[32];
+        if(plan->maximum_pages == 0xFFFFFFFF)
+        {
+            snprintf(maximum, sizeof(maximum), "unbounded");
+        }
+        else
+        {
+            snprintf(maximum, sizeof(maximum), "%u", plan->maximum_pages);
+        }
+        char *format = "  %-6s %10u .. %-10u %10u bytes\n";
+        length += snprintf(report + length, sizeof(report) - length, format,
+                           "data", WASM_DATA_BASE_ADDRESS, plan->data_end, plan->data_end - WASM_DATA_BASE_ADDRESS);
+        length += snprintf(report + length, sizeof(report) - length, format,
+                           "stack", plan->stack_base, plan->stack_top, plan->stack_top - plan->stack_base);
+        if(plan->heap_base > plan->async_base)
+        {
+            length += snprintf(report + length, sizeof(report) - length, format,
+                               "async", plan->async_base, plan->heap_base, plan->heap_base - plan->async_base);
+        }
+        length += snprintf(report + length, sizeof(report) - length,
+                           "  %-6s %10u .. %-10s %10u bytes expected\n"
+                           "  pages  %u initial (%u bytes), %s maximum; %s\n",
+                           "heap", plan->heap_base, "", plan->heap_size,
+                           plan->initial_pages, plan->initial_pages*WASM_PAGE_SIZE, maximum,
+                           plan->has_memory_grow ? "the module calls memory.grow" : "no memory.grow in the module");
+    }
+    fputs(report, file);
+}
+
+// NOTE(jsn): --export-allocator. A mark/release arena over the heap, for buffers whose size
+// is only known at run time: __ore_alloc(size) returns a 16-byte aligned region the host can
+// fill in place (growing memory when needed, 0 when it can't), and __ore_release(address)
+// frees that region and everything allocated after it.
+#define ORE_ALLOCATOR_TOP "__ore_heap_top"
+
+static void
+WASMModuleBuilderAddAllocator(WASMModuleBuilder *builder)
+{
+    BinaryenModuleRef module = builder->module;
+    BinaryenType i32 = BinaryenTypeInt32();
+    
+    // NOTE(jsn): Parameter 0 is the size; locals 1, 2 and 3 are the address, the end and the
+    // pages needed to reach the end. Expressions can't be shared, so every use is a new get.
+#define ALLOCATOR_LOCAL(index) BinaryenLocalGet(module, index, i32)
+    BinaryenExpressionRef alloc_body[] =
+    {
+        BinaryenLocalSet(module, 1, BinaryenBinary(module, BinaryenAndInt32(),
+                                                   BinaryenBinary(module, BinaryenAddInt32(), BinaryenGlobalGet(module, ORE_ALLOCATOR_TOP, i32),
+                                                                  BinaryenConst(module, BinaryenLiteralInt32(WASM_REGION_ALIGNMENT-1))),
+                                                   BinaryenConst(module, BinaryenLiteralInt32(-WASM_REGION_ALIGNMENT)))),
+        BinaryenLocalSet(module, 2, BinaryenBinary(module, BinaryenAddInt32(), ALLOCATOR_LOCAL(1), ALLOCATOR_LOCAL(0))),
+        BinaryenIf(module, BinaryenBinary(module, BinaryenLtUInt32(), ALLOCATOR_LOCAL(2), ALLOCATOR_LOCAL(1)),
+                   BinaryenReturn(module, BinaryenConst(module, BinaryenLiteralInt32(0))), 0),
+        BinaryenLocalSet(module, 3, BinaryenBinary(module, BinaryenAddInt32(),
+                                                   BinaryenBinary(module, BinaryenShrUInt32(), ALLOCATOR_LOCAL(2), BinaryenConst(module, BinaryenLiteralInt32(16))),
+                                                   BinaryenBinary(module, BinaryenNeInt32(),
+                                                                  BinaryenBinary(module, BinaryenAndInt32(), ALLOCATOR_LOCAL(2), BinaryenConst(module, BinaryenLiteralInt32(0xFFFF))),
+                                                                  BinaryenConst(module, BinaryenLiteralInt32(0))))),
+        BinaryenIf(module, BinaryenBinary(module, BinaryenGtUInt32(), ALLOCATOR_LOCAL(3), BinaryenMemorySize(module)),
+                   BinaryenIf(module, BinaryenBinary(module, BinaryenEqInt32(),
+                                                     BinaryenMemoryGrow(module, BinaryenBinary(module, BinaryenSubInt32(), ALLOCATOR_LOCAL(3), BinaryenMemorySize(module))),
+                                                     BinaryenConst(module, BinaryenLiteralInt32(-1))),
+                              BinaryenReturn(module, BinaryenConst(module, BinaryenLiteralInt32(0))), 0),
+                   0),
+        BinaryenGlobalSet(module, ORE_ALLOCATOR_TOP, ALLOCATOR_LOCAL(2)),
+        ALLOCATOR_LOCAL(1),
+    };
+    BinaryenType alloc_locals[] = { i32, i32, i32 };
+    BinaryenAddFunction(module, "__ore_alloc", i32, i32, alloc_locals, 3,
+                        BinaryenBlock(module, 0, alloc_body, sizeof(alloc_body)/sizeof(alloc_body[0]), i32));
+    
+    BinaryenExpressionRef in_heap =
+        BinaryenBinary(module, BinaryenAndInt32(),
+                       BinaryenBinary(module, BinaryenGeUInt32(), ALLOCATOR_LOCAL(0), BinaryenGlobalGet(module, "__heap_base", i32)),
+                       BinaryenBinary(module, BinaryenLeUInt32(), ALLOCATOR_LOCAL(0), BinaryenGlobalGet(module, ORE_ALLOCATOR_TOP, i32)));
+    BinaryenAddFunction(module, "__ore_release", i32, BinaryenTypeNone(), 0, 0,
+                        BinaryenIf(module, in_heap, BinaryenGlobalSet(module, ORE_ALLOCATOR_TOP, ALLOCATOR_LOCAL(0)), 0));
+#undef ALLOCATOR_LOCAL
+    BinaryenAddFunctionExport(module, "__ore_alloc", "__ore_alloc");
+    BinaryenAddFunctionExport(module, "__ore_release", "__ore_release");
+}
+
+// NOTE(jsn): --profile-allocations. Routes the allocator through the import
+// ore_alloc.record(kind, site, address, size), with kind 1 for __ore_alloc and 2 for
+// __ore_release. Every call to either in the module gets a site of its own, named after the
+// calling function, with the call's ordinal in that function as the line. Calls from the
+// host, through the exports, are site 0. The site table goes into the "ore.alloc_sites"
+// custom section, laid out like the site table of an --alloc-log log, so that
+// Tools/ore-alloc-profile.js can record a run into a log --alloc-report reads.
+#define ORE_ALLOC_SITES_SECTION "ore.alloc_sites"
+
+typedef struct AllocationSiteData AllocationSiteData;
+struct AllocationSiteData
+{
+    BinaryenExpressionRef *calls;
+    int call_count;
+    int call_capacity;
+};
+
+static void
+CollectAllocatorCall(BinaryenExpressionRef expr, void *user_data)
+{
+    AllocationSiteData *data = user_data;
+    if(BinaryenExpressionGetId(expr) == BinaryenCallId())
+    {
+        const char *target = BinaryenCallGetTarget(expr);
+        if(!strcmp(target, "__ore_alloc") || !strcmp(target, "__ore_release"))
+        {
+            if(data->call_count >= data->call_capacity)
+            {
+                data->call_capacity = data->call_capacity ? data->call_capacity*2 : 16;
+                data->calls = realloc(data->calls, sizeof(BinaryenExpressionRef)*data->call_capacity);
+            }
+            data->calls[data->call_count++] = expr;
+        }
+    }
+}
+
+static void
+PushAllocationSite(FILE *sites, const char *function, u32 line)
+{
+    u16 length = (u16)CalculateCStringLength(function);
+    fwrite(&line, 4, 1, sites);
+    fwrite(&length, 2, 1, sites);
+    fwrite(function, 1, length, sites);
+}
+
+static void
+WASMModuleBuilderAddAllocationProfiler(WASMModuleBuilder *builder)
+{
+    BinaryenModuleRef module = builder->module;
+    if(!builder->export_allocator)
+    {
+        LogWarning("--profile-allocations: the module has no allocator (see --export-allocator); nothing to profile.");
+        return;
+    }
+    BinaryenType i32 = BinaryenTypeInt32();
+    BinaryenType none = BinaryenTypeNone();
+    BinaryenType record_params[] = { i32, i32, i32, i32 };
+    BinaryenAddFunctionImport(module, "__ore_alloc_record", "ore_alloc", "record", BinaryenTypeCreate(record_params, 4), none);
+    
+    char *sites_data = 0;
+    size_t sites_size = 0;
+    FILE *sites = open_memstream(&sites_data, &sites_size);
+    u32 site_count = 0;
+    fwrite(&site_count, 4, 1, sites);
+    PushAllocationSite(sites, "<host>", 0);
+    ++site_count;
+    
+    // NOTE(jsn): Functions added below are past function_count, so they aren't rewritten.
+    BinaryenIndex function_count = BinaryenGetNumFunctions(module);
+    for(BinaryenIndex i = 0; i < function_count; ++i)
+    {
+        BinaryenFunctionRef function = BinaryenGetFunctionByIndex(module, i);
+        if(IsImportedFunction(function))
+        {
+            continue;
+        }
+        AllocationSiteData data = {0};
+        VisitExpressions(BinaryenFunctionGetBody(function), CollectAllocatorCall, &data);
+        for(int j = 0; j < data.call_count; ++j)
+        {
+            int is_alloc = !strcmp(BinaryenCallGetTarget(data.calls[j]), "__ore_alloc");
+            BinaryenCallSetTarget(data.calls[j], is_alloc ? "__ore_alloc_at" : "__ore_release_at");
+            BinaryenCallAppendOperand(data.calls[j], BinaryenConst(module, BinaryenLiteralInt32(site_count)));
+            PushAllocationSite(sites, BinaryenFunctionGetName(function), j+1);
+            ++site_count;
+        }
+        free(data.calls);
+    }
+    fclose(sites);
+    MemoryCopy(sites_data, &site_count, 4);
+    BinaryenAddCustomSection(module, ORE_ALLOC_SITES_SECTION, sites_data, (BinaryenIndex)sites_size);
+    free(sites_data);
+    
+    // NOTE(jsn): __ore_alloc_at(size, site): local 2 is the address. Expressions can't be
+    // shared, so every use of a local is a new get.
+#define ALLOCATOR_LOCAL(index) BinaryenLocalGet(module, index, i32)
+#define ALLOCATOR_CONST(value) BinaryenConst(module, BinaryenLiteralInt32(value))
+    BinaryenType site_params[] = { i32, i32 };
+    BinaryenType alloc_vars[] = { i32 };
+    BinaryenExpressionRef alloc_operands[] = { ALLOCATOR_LOCAL(0) };
+    BinaryenExpressionRef alloc_record_operands[] = { ALLOCATOR_CONST(1), ALLOCATOR_LOCAL(1), ALLOCATOR_LOCAL(2), ALLOCATOR_LOCAL(0) };
+    BinaryenExpressionRef alloc_body[] =
+    {
+        BinaryenLocalSet(module, 2, BinaryenCall(module, "__ore_alloc", alloc_operands, 1, i32)),
+        BinaryenCall(module, "__ore_alloc_record", alloc_record_operands, 4, none),
+        ALLOCATOR_LOCAL(2),
+    };
+    BinaryenAddFunction(module, "__ore_alloc_at", BinaryenTypeCreate(site_params, 2), i32, alloc_vars, 1,
+                        BinaryenBlock(module, 0, alloc_body, 3, i32));
+    
+    BinaryenExpressionRef release_operands[] = { ALLOCATOR_LOCAL(0) };
+    BinaryenExpressionRef release_record_operands[] = { ALLOCATOR_CONST(2), ALLOCATOR_LOCAL(1), ALLOCATOR_LOCAL(0), ALLOCATOR_CONST(0) };
+    BinaryenExpressionRef release_body[] =
+    {
+        BinaryenCall(module, "__ore_alloc_record", release_record_operands, 4, none),
+        BinaryenCall(module, "__ore_release", release_operands, 1, none),
+    };
+    BinaryenAddFunction(module, "__ore_release_at", BinaryenTypeCreate(site_params, 2), none, 0, 0,
+                        BinaryenBlock(module, 0, release_body, 2, none));
+    
+    BinaryenExpressionRef alloc_host_operands[] = { ALLOCATOR_LOCAL(0), ALLOCATOR_CONST(0) };
+    BinaryenExpressionRef release_host_operands[] = { ALLOCATOR_LOCAL(0), ALLOCATOR_CONST(0) };
+    BinaryenAddFunction(module, "__ore_alloc_host", i32, i32, 0, 0, BinaryenCall(module, "__ore_alloc_at", alloc_host_operands, 2, i32));
+    BinaryenAddFunction(module, "__ore_release_host", i32, none, 0, 0, BinaryenCall(module, "__ore_release_at", release_host_operands, 2, none));
+#undef ALLOCATOR_CONST
+#undef ALLOCATOR_LOCAL
+    BinaryenRemoveExport(module, "__ore_alloc");
+    BinaryenRemoveExport(module, "__ore_release");
+    BinaryenAddFunctionExport(module, "__ore_alloc_host", "__ore_alloc");
+    BinaryenAddFunctionExport(module, "__ore_release_host", "__ore_release");
+    LogDebug("--profile-allocations: %u allocation sites", site_count);
+}
+
+// NOTE(jsn): The standard library. Every piece is built straight into the module as IR, and
+// only the pieces a module requires (plus what they depend on) are added. The ones it asks
+// for are exported as __ore_<name>:
+//   memcpy, memset           memory.copy / memory.fill, which engines lower to their own
+//                            vectorized routines
+//   memchr, memcmp           16 bytes at a time with SIMD compares, then a scalar tail
+//   vec_new, vec_push        growable i32 vector { data, length, capacity }, capacity doubles
+//   map_new, map_get,        i32 -> i32 Swiss table: a control byte per slot (0x80 empty,
+//   map_insert               else the low 7 bits of the hash), probed a 16-byte group at a time;
+//                            map_grow is internal to map_insert and never exported
+//   sort_u32, sort_i32       LSD radix sort, insertion sort below 32 elements
+//   format_u64, format_i64,  integers two digits at a time from a lookup table; floats in
+//   format_f64               fixed point, with an exponent from 1e18 up
+// Containers and sort buffers come from the --export-allocator arena, so they are freed in
+// bulk with __ore_release.
+typedef enum StdlibFunction StdlibFunction;
+enum StdlibFunction
+{
+    Stdlib_Memcpy,
+    Stdlib_Memset,
+    Stdlib_Memchr,
+    Stdlib_Memcmp,
+    Stdlib_VecNew,
+    Stdlib_VecPush,
+    Stdlib_MapNew,
+    Stdlib_MapGet,
+    Stdlib_MapInsert,
+    Stdlib_MapGrow,
+    Stdlib_SortU32,
+    Stdlib_SortI32,
+    Stdlib_FormatU64,
+    Stdlib_FormatI64,
+    Stdlib_FormatF64,
+    Stdlib_MAX
+};
+
+#define STDLIB_INTERNAL (1u << Stdlib_MapGrow)
+#define STDLIB_ALL (((1u << Stdlib_MAX) - 1) & ~STDLIB_INTERNAL)
+#define STDLIB_NEEDS_SIMD        (1 << 0)
+#define STDLIB_NEEDS_BULK_MEMORY (1 << 1)
+#define STDLIB_NEEDS_ALLOCATOR   (1 << 2)
+
+// NOTE(jsn): Shorthands for the IR below; expressions can't be shared, so every use of a
+// local is a new get.
+#define IR_LIST(type, ...) ((type[]){ __VA_ARGS__ }), (BinaryenIndex)(sizeof((type[]){ __VA_ARGS__ })/sizeof(type))
+#define IR_BLOCK(name, ...) BinaryenBlock(module, name, IR_LIST(BinaryenExpressionRef, __VA_ARGS__), BinaryenTypeAuto())
+#define IR_LOOP(name, ...) BinaryenLoop(module, name, IR_BLOCK(0, __VA_ARGS__))
+#define IR_BR(name) BinaryenBreak(module, name, 0, 0)
+#define IR_BR_IF(name, condition) BinaryenBreak(module, name, condition, 0)
+#define IR_IF(condition, then) BinaryenIf(module, condition, then, 0)
+#define IR_IF_ELSE(condition, then, otherwise) BinaryenIf(module, condition, then, otherwise)
+#define IR_RETURN(value) BinaryenReturn(module, value)
+#define IR_CALL(name, type, ...) BinaryenCall(module, name, IR_LIST(BinaryenExpressionRef, __VA_ARGS__), type)
+#define IR_I32(value) BinaryenConst(module, BinaryenLiteralInt32(value))
+#define IR_I64(value) BinaryenConst(module, BinaryenLiteralInt64(value))
+#define IR_F64(value) BinaryenConst(module, BinaryenLiteralFloat64(value))
+#define IR_GET(index) BinaryenLocalGet(module, index, BinaryenTypeInt32())
+#define IR_GET_OF(index, type) BinaryenLocalGet(module, index, type)
+#define IR_SET(index, value) BinaryenLocalSet(module, index, value)
+#define IR_UNARY(op, a) BinaryenUnary(module, Binaryen##op(), a)
+#define IR_BINARY(op, a, b) BinaryenBinary(module, Binaryen##op(), a, b)
+#define IR_ADD(a, b) IR_BINARY(AddInt32, a, b)
+#define IR_SUB(a, b) IR_BINARY(SubInt32, a, b)
+#define IR_INC(index, amount) IR_SET(index, IR_ADD(IR_GET(index), IR_I32(amount)))
+#define IR_INDEX(base, index, shift) IR_ADD(base, IR_BINARY(ShlInt32, index, IR_I32(shift)))
+#define IR_LOAD(bytes, type, pointer, offset) BinaryenLoad(module, bytes, 0, offset, 1, type, pointer)
+#define IR_STORE(bytes, type, pointer, offset, value) BinaryenStore(module, bytes, offset, 1, pointer, value, type)
+#define IR_LOAD32(pointer, offset) IR_LOAD(4, BinaryenTypeInt32(), pointer, offset)
+#define IR_STORE32(pointer, offset, value) IR_STORE(4, BinaryenTypeInt32(), pointer, offset, value)
+#define IR_LOAD8(pointer) IR_LOAD(1, BinaryenTypeInt32(), pointer, 0)
+#define IR_STORE8(pointer, value) IR_STORE(1, BinaryenTypeInt32(), pointer, 0, value)
+#define IR_ALLOC(size) IR_CALL("__ore_alloc", BinaryenTypeInt32(), size)
+
+static void
+StdlibAddFunction(BinaryenModuleRef module, char *name, BinaryenType *params, BinaryenIndex param_count, BinaryenType result,
+                  BinaryenType *locals, BinaryenIndex local_count, BinaryenExpressionRef body)
+{
+    BinaryenAddFunction(module, name, BinaryenTypeCreate(params, param_count), result, locals, local_count, body);
+}
+
+static void
+StdlibBuildMemcpy(WASMModuleBuilder *builder)
+{
+    BinaryenModuleRef module = builder->module;
+    BinaryenType i32 = BinaryenTypeInt32();
+    StdlibAddFunction(module, "__ore_memcpy", IR_LIST(BinaryenType, i32, i32, i32), BinaryenTypeNone(), 0, 0,
+                      BinaryenMemoryCopy(module, IR_GET(0), IR_GET(1), IR_GET(2)));
+}
+
+static void
+StdlibBuildMemset(WASMModuleBuilder *builder)
+{
+    BinaryenModuleRef module = builder->module;
+    BinaryenType i32 = BinaryenTypeInt32();
+    StdlibAddFunction(module, "__ore_memset", IR_LIST(BinaryenType, i32, i32, i32), BinaryenTypeNone(), 0, 0,
+                      BinaryenMemoryFill(module, IR_GET(0), IR_GET(1), IR_GET(2)));
+}
+
+// NOTE(jsn): memchr(pointer 0, byte 1, size 2); locals are the end 3, the match mask 4 and
+// the splatted byte 5. Returns the address of the first match or 0.
+static void
+StdlibBuildMemchr(WASMModuleBuilder *builder)
+{
+    BinaryenModuleRef module = builder->module;
+    BinaryenType i32 = BinaryenTypeInt32();
+    BinaryenType v128 = BinaryenTypeVec128();
+    BinaryenExpressionRef body = IR_BLOCK(0,
+        IR_SET(3, IR_ADD(IR_GET(0), IR_GET(2))),
+        IR_SET(5, IR_UNARY(SplatVecI8x16, IR_GET(1))),
+        IR_BLOCK("simd_done", IR_LOOP("simd",
+            IR_BR_IF("simd_done", IR_BINARY(LtUInt32, IR_SUB(IR_GET(3), IR_GET(0)), IR_I32(16))),
+            IR_SET(4, IR_UNARY(BitmaskVecI8x16, IR_BINARY(EqVecI8x16, IR_LOAD(16, v128, IR_GET(0), 0), IR_GET_OF(5, v128)))),
+            IR_IF(IR_GET(4), IR_RETURN(IR_ADD(IR_GET(0), IR_UNARY(CtzInt32, IR_GET(4))))),
+            IR_INC(0, 16),
+            IR_BR("simd"))),
+        IR_LOOP("scalar",
+            IR_IF(IR_BINARY(GeUInt32, IR_GET(0), IR_GET(3)), IR_RETURN(IR_I32(0))),
+            IR_IF(IR_BINARY(EqInt32, IR_LOAD8(IR_GET(0)), IR_BINARY(AndInt32, IR_GET(1), IR_I32(0xFF))), IR_RETURN(IR_GET(0))),
+            IR_INC(0, 1),
+            IR_BR("scalar")),
+        BinaryenUnreachable(module));
+    StdlibAddFunction(module, "__ore_memchr", IR_LIST(BinaryenType, i32, i32, i32), i32, IR_LIST(BinaryenType, i32, i32, v128), body);
+}
+
+// NOTE(jsn): memcmp(a 0, b 1, size 2); locals are the end of a 3 and the differing bytes 4
+// and 5. Whole equal blocks are skipped with SIMD, the first difference is found bytewise.
+static void
+StdlibBuildMemcmp(WASMModuleBuilder *builder)
+{
+    BinaryenModuleRef module = builder->module;
+    BinaryenType i32 = BinaryenTypeInt32();
+    BinaryenType v128 = BinaryenTypeVec128();
+    BinaryenExpressionRef body = IR_BLOCK(0,
+        IR_SET(3, IR_ADD(IR_GET(0), IR_GET(2))),
+        IR_BLOCK("simd_done", IR_LOOP("simd",
+            IR_BR_IF("simd_done", IR_BINARY(LtUInt32, IR_SUB(IR_GET(3), IR_GET(0)), IR_I32(16))),
+            IR_BR_IF("simd_done", IR_UNARY(EqZInt32, IR_UNARY(AllTrueVecI8x16, IR_BINARY(EqVecI8x16, IR_LOAD(16, v128, IR_GET(0), 0),
+                                                                                         IR_LOAD(16, v128, IR_GET(1), 0))))),
+            IR_INC(0, 16),
+            IR_INC(1, 16),
+            IR_BR("simd"))),
+        IR_LOOP("scalar",
+            IR_IF(IR_BINARY(GeUInt32, IR_GET(0), IR_GET(3)), IR_RETURN(IR_I32(0))),
+            IR_SET(4, IR_LOAD8(IR_GET(0))),
+            IR_SET(5, IR_LOAD8(IR_GET(1))),
+            IR_IF(IR_BINARY(NeInt32, IR_GET(4), IR_GET(5)), IR_RETURN(IR_SUB(IR_GET(4), IR_GET(5)))),
+            IR_INC(0, 1),
+            IR_INC(1, 1),
+            IR_BR("scalar")),
+        BinaryenUnreachable(module));
+    StdlibAddFunction(module, "__ore_memcmp", IR_LIST(BinaryenType, i32, i32, i32), i32, IR_LIST(BinaryenType, i32, i32, i32), body);
+}
+
+// NOTE(jsn): vec_new(capacity 0) returns a vector header { data, length, capacity } or 0;
+// local 1 is the header. vec_push(vector 0, value 1) returns the value's index or -1;
+// locals are the length 2, the capacity 3, the data 4 and the grown data 5. Grown data is
+// copied and the old data left to the arena.
+static void
+StdlibBuildVecNew(WASMModuleBuilder *builder)
+{
+    BinaryenModuleRef module = builder->module;
+    BinaryenType i32 = BinaryenTypeInt32();
+    BinaryenExpressionRef body = IR_BLOCK(0,
+        IR_IF(IR_BINARY(LtUInt32, IR_GET(0), IR_I32(4)), IR_SET(0, IR_I32(4))),
+        IR_IF(IR_BINARY(GtUInt32, IR_GET(0), IR_I32(0x3FFFFFFF)), IR_RETURN(IR_I32(0))),
+        IR_SET(1, IR_ALLOC(IR_I32(12))),
+        IR_IF(IR_UNARY(EqZInt32, IR_GET(1)), IR_RETURN(IR_I32(0))),
+        IR_STORE32(IR_GET(1), 0, IR_ALLOC(IR_BINARY(ShlInt32, IR_GET(0), IR_I32(2)))),
+        IR_IF(IR_UNARY(EqZInt32, IR_LOAD32(IR_GET(1), 0)), IR_RETURN(IR_I32(0))),
+        IR_STORE32(IR_GET(1), 4, IR_I32(0)),
+        IR_STORE32(IR_GET(1), 8, IR_GET(0)),
+        IR_GET(1));
+    StdlibAddFunction(module, "__ore_vec_new", IR_LIST(BinaryenType, i32), i32, IR_LIST(BinaryenType, i32), body);
+}
+
+static void
+StdlibBuildVecPush(WASMModuleBuilder *builder)
+{
+    BinaryenModuleRef module = builder->module;
+    BinaryenType i32 = BinaryenTypeInt32();
+    BinaryenExpressionRef body = IR_BLOCK(0,
+        IR_SET(2, IR_LOAD32(IR_GET(0), 4)),
+        IR_SET(3, IR_LOAD32(IR_GET(0), 8)),
+        IR_SET(4, IR_LOAD32(IR_GET(0), 0)),
+        IR_IF(IR_BINARY(EqInt32, IR_GET(2), IR_GET(3)), IR_BLOCK(0,
+            IR_IF(IR_BINARY(GeUInt32, IR_GET(3), IR_I32(0x20000000)), IR_RETURN(IR_I32(-1))),
+            IR_SET(3, IR_BINARY(ShlInt32, IR_GET(3), IR_I32(1))),
+            IR_SET(5, IR_ALLOC(IR_BINARY(ShlInt32, IR_GET(3), IR_I32(2)))),
+            IR_IF(IR_UNARY(EqZInt32, IR_GET(5)), IR_RETURN(IR_I32(-1))),
+            BinaryenMemoryCopy(module, IR_GET(5), IR_GET(4), IR_BINARY(ShlInt32, IR_GET(2), IR_I32(2))),
+            IR_SET(4, IR_GET(5)),
+            IR_STORE32(IR_GET(0), 0, IR_GET(4)),
+            IR_STORE32(IR_GET(0), 8, IR_GET(3)))),
+        IR_STORE32(IR_INDEX(IR_GET(4), IR_GET(2), 2), 0, IR_GET(1)),
+        IR_STORE32(IR_GET(0), 4, IR_ADD(IR_GET(2), IR_I32(1))),
+        IR_GET(2));
+    StdlibAddFunction(module, "__ore_vec_push", IR_LIST(BinaryenType, i32, i32), i32, IR_LIST(BinaryenType, i32, i32, i32, i32), body);
+}
+
+// NOTE(jsn): A map is a header { control, slots, capacity, count } over a power-of-two
+// capacity of at least 16, so groups of 16 control bytes are always aligned and in bounds.
+// Slots are { key, value } pairs. It grows at 7/8 full and has no deletion yet.
+#define STDLIB_MAP_EMPTY 0x80
+#define STDLIB_MAP_MAX_CAPACITY 0x10000000
+
+// NOTE(jsn): Allocates a cleared table into the control and slots locals first, so a map
+// is left untouched when the arena runs out.
+static BinaryenExpressionRef
+StdlibMapAllocateTable(BinaryenModuleRef module, BinaryenIndex map, BinaryenIndex capacity, BinaryenIndex control, BinaryenIndex slots)
+{
+    return IR_BLOCK(0,
+        IR_SET(control, IR_ALLOC(IR_GET(capacity))),
+        IR_IF(IR_UNARY(EqZInt32, IR_GET(control)), IR_RETURN(IR_I32(0))),
+        IR_SET(slots, IR_ALLOC(IR_BINARY(ShlInt32, IR_GET(capacity), IR_I32(3)))),
+        IR_IF(IR_UNARY(EqZInt32, IR_GET(slots)), IR_RETURN(IR_I32(0))),
+        BinaryenMemoryFill(module, IR_GET(control), IR_I32(STDLIB_MAP_EMPTY), IR_GET(capacity)),
+        IR_STORE32(IR_GET(map), 0, IR_GET(control)),
+        IR_STORE32(IR_GET(map), 4, IR_GET(slots)),
+        IR_STORE32(IR_GET(map), 8, IR_GET(capacity)),
+        IR_STORE32(IR_GET(map), 12, IR_I32(0)));
+}
+
+// NOTE(jsn): map_new(expected count 0); locals are the capacity 1, the map 2 and the
+// table 3 and 4.
+static void
+StdlibBuildMapNew(WASMModuleBuilder *builder)
+{
+    BinaryenModuleRef module = builder->module;
+    BinaryenType i32 = BinaryenTypeInt32();
+    BinaryenExpressionRef body = IR_BLOCK(0,
+        IR_SET(0, IR_ADD(IR_GET(0), IR_BINARY(ShrUInt32, IR_GET(0), IR_I32(2)))),
+        IR_SET(1, IR_I32(16)),
+        IR_LOOP("grow",
+            IR_IF(IR_BINARY(AndInt32, IR_BINARY(LtUInt32, IR_GET(1), IR_GET(0)), IR_BINARY(LtUInt32, IR_GET(1), IR_I32(STDLIB_MAP_MAX_CAPACITY))),
+                  IR_BLOCK(0, IR_SET(1, IR_BINARY(ShlInt32, IR_GET(1), IR_I32(1))), IR_BR("grow")))),
+        IR_SET(2, IR_ALLOC(IR_I32(16))),
+        IR_IF(IR_UNARY(EqZInt32, IR_GET(2)), IR_RETURN(IR_I32(0))),
+        StdlibMapAllocateTable(module, 2, 1, 3, 4),
+        IR_GET(2));
+    StdlibAddFunction(module, "__ore_map_new", IR_LIST(BinaryenType, i32), i32, IR_LIST(BinaryenType, i32, i32, i32, i32), body);
+}
+
+// NOTE(jsn): The probe loop shared by map_get and map_insert, over parameters map 0 and key
+// 1 and locals hash 3, control 4, slots 5, mask 6, group 7, match bits 8, slot index 9,
+// the group's control bytes 10 and the splatted tag 11. on_found runs with the key's index
+// in local 9, on_empty with the group's empty bits in local 8; both must return.
+static BinaryenExpressionRef
+StdlibMapProbe(BinaryenModuleRef module, BinaryenExpressionRef on_found, BinaryenExpressionRef on_empty)
+{
+    BinaryenType v128 = BinaryenTypeVec128();
+    return IR_BLOCK(0,
+        IR_SET(3, IR_BINARY(MulInt32, IR_GET(1), IR_I32((int)0x9E3779B1))),
+        IR_SET(4, IR_LOAD32(IR_GET(0), 0)),
+        IR_SET(5, IR_LOAD32(IR_GET(0), 4)),
+        IR_SET(6, IR_SUB(IR_LOAD32(IR_GET(0), 8), IR_I32(1))),
+        IR_SET(11, IR_UNARY(SplatVecI8x16, IR_BINARY(AndInt32, IR_GET(3), IR_I32(0x7F)))),
+        IR_SET(7, IR_BINARY(AndInt32, IR_BINARY(AndInt32, IR_BINARY(ShrUInt32, IR_GET(3), IR_I32(7)), IR_GET(6)), IR_I32(-16))),
+        IR_LOOP("probe",
+            IR_SET(10, IR_LOAD(16, v128, IR_ADD(IR_GET(4), IR_GET(7)), 0)),
+            IR_SET(8, IR_UNARY(BitmaskVecI8x16, IR_BINARY(EqVecI8x16, IR_GET_OF(10, v128), IR_GET_OF(11, v128)))),
+            IR_BLOCK("match_done", IR_LOOP("match",
+                IR_BR_IF("match_done", IR_UNARY(EqZInt32, IR_GET(8))),
+                IR_SET(9, IR_ADD(IR_GET(7), IR_UNARY(CtzInt32, IR_GET(8)))),
+                IR_IF(IR_BINARY(EqInt32, IR_LOAD32(IR_INDEX(IR_GET(5), IR_GET(9), 3), 0), IR_GET(1)), on_found),
+                IR_SET(8, IR_BINARY(AndInt32, IR_GET(8), IR_SUB(IR_GET(8), IR_I32(1)))),
+                IR_BR("match"))),
+            IR_SET(8, IR_UNARY(BitmaskVecI8x16, IR_BINARY(EqVecI8x16, IR_GET_OF(10, v128), IR_UNARY(SplatVecI8x16, IR_I32(STDLIB_MAP_EMPTY))))),
+            IR_IF(IR_GET(8), on_empty),
+            IR_SET(7, IR_BINARY(AndInt32, IR_ADD(IR_GET(7), IR_I32(16)), IR_GET(6))),
+            IR_BR("probe")),
+        BinaryenUnreachable(module));
+}
+
+// NOTE(jsn): map_get(map 0, key 1, missing 2) returns the key's value, or missing.
+static void
+StdlibBuildMapGet(WASMModuleBuilder *builder)
+{
+    BinaryenModuleRef module = builder->module;
+    BinaryenType i32 = BinaryenTypeInt32();
+    BinaryenType v128 = BinaryenTypeVec128();
+    BinaryenExpressionRef body = StdlibMapProbe(module, IR_RETURN(IR_LOAD32(IR_INDEX(IR_GET(5), IR_GET(9), 3), 4)), IR_RETURN(IR_GET(2)));
+    StdlibAddFunction(module, "__ore_map_get", IR_LIST(BinaryenType, i32, i32, i32), i32,
+                      IR_LIST(BinaryenType, i32, i32, i32, i32, i32, i32, i32, v128, v128), body);
+}
+
+// NOTE(jsn): map_insert(map 0, key 1, value 2) inserts or overwrites; returns 0 when the
+// map can't grow.
+static void
+StdlibBuildMapInsert(WASMModuleBuilder *builder)
+{
+    BinaryenModuleRef module = builder->module;
+    BinaryenType i32 = BinaryenTypeInt32();
+    BinaryenType v128 = BinaryenTypeVec128();
+    BinaryenExpressionRef on_found = IR_BLOCK(0,
+        IR_STORE32(IR_INDEX(IR_GET(5), IR_GET(9), 3), 4, IR_GET(2)),
+        IR_RETURN(IR_I32(1)));
+    BinaryenExpressionRef on_empty = IR_BLOCK(0,
+        IR_SET(9, IR_ADD(IR_GET(7), IR_UNARY(CtzInt32, IR_GET(8)))),
+        IR_STORE8(IR_ADD(IR_GET(4), IR_GET(9)), IR_BINARY(AndInt32, IR_GET(3), IR_I32(0x7F))),
+        IR_STORE32(IR_INDEX(IR_GET(5), IR_GET(9), 3), 0, IR_GET(1)),
+        IR_STORE32(IR_INDEX(IR_GET(5), IR_GET(9), 3), 4, IR_GET(2)),
+        IR_STORE32(IR_GET(0), 12, IR_ADD(IR_LOAD32(IR_GET(0), 12), IR_I32(1))),
+        IR_RETURN(IR_I32(1)));
+    BinaryenExpressionRef body = IR_BLOCK(0,
+        IR_IF(IR_BINARY(GtUInt32, IR_BINARY(MulInt32, IR_ADD(IR_LOAD32(IR_GET(0), 12), IR_I32(1)), IR_I32(8)),
+                                  IR_BINARY(MulInt32, IR_LOAD32(IR_GET(0), 8), IR_I32(7))),
+              IR_IF(IR_UNARY(EqZInt32, IR_CALL("__ore_map_grow", i32, IR_GET(0))), IR_RETURN(IR_I32(0)))),
+        StdlibMapProbe(module, on_found, on_empty));
+    StdlibAddFunction(module, "__ore_map_insert", IR_LIST(BinaryenType, i32, i32, i32), i32,
+                      IR_LIST(BinaryenType, i32, i32, i32, i32, i32, i32, i32, v128, v128), body);
+}
+
+// NOTE(jsn): map_grow(map 0) doubles the table and reinserts; locals are the old control 1,
+// old slots 2, old capacity 3, index 4, new capacity 5 and the new
+// table 6 and 7.
+static void
+StdlibBuildMapGrow(WASMModuleBuilder *builder)
+{
+    BinaryenModuleRef module = builder->module;
+    BinaryenType i32 = BinaryenTypeInt32();
+    BinaryenExpressionRef body = IR_BLOCK(0,
+        IR_SET(1, IR_LOAD32(IR_GET(0), 0)),
+        IR_SET(2, IR_LOAD32(IR_GET(0), 4)),
+        IR_SET(3, IR_LOAD32(IR_GET(0), 8)),
+        IR_IF(IR_BINARY(GeUInt32, IR_GET(3), IR_I32(STDLIB_MAP_MAX_CAPACITY)), IR_RETURN(IR_I32(0))),
+        IR_SET(5, IR_BINARY(ShlInt32, IR_GET(3), IR_I32(1))),
+        StdlibMapAllocateTable(module, 0, 5, 6, 7),
+        IR_SET(4, IR_I32(0)),
+        IR_BLOCK("copy_done", IR_LOOP("copy",
+            IR_BR_IF("copy_done", IR_BINARY(GeUInt32, IR_GET(4), IR_GET(3))),
+            IR_IF(IR_BINARY(LtUInt32, IR_LOAD8(IR_ADD(IR_GET(1), IR_GET(4))), IR_I32(STDLIB_MAP_EMPTY)),
+                  BinaryenDrop(module, IR_CALL("__ore_map_insert", i32, IR_GET(0),
+                                               IR_LOAD32(IR_INDEX(IR_GET(2), IR_GET(4), 3), 0),
+                                               IR_LOAD32(IR_INDEX(IR_GET(2), IR_GET(4), 3), 4)))),
+            IR_INC(4, 1),
+            IR_BR("copy"))),
+        IR_I32(1));
+    StdlibAddFunction(module, "__ore_map_grow", IR_LIST(BinaryenType, i32), i32, IR_LIST(BinaryenType, i32, i32, i32, i32, i32, i32, i32), body);
+}
+
+// NOTE(jsn): sort(pointer 0, count 1) sorts 32-bit keys in place: four passes of an 8-bit
+// LSD radix sort, skipping passes where every key shares the digit, or insertion sort for
+// short arrays and when the arena is out of memory. Signed keys flip the sign bit so they
+// order as unsigned. Locals: index 2, position 3, key 4, counts 5, buffer 6, source 7,
+// destination 8, shift 9, digit 10, running sum 11, scratch 12.
+#define STDLIB_SORT_INSERTION_MAX 32
+
+static void
+StdlibBuildSort(WASMModuleBuilder *builder, char *name, int is_signed)
+{
+    BinaryenModuleRef module = builder->module;
+    BinaryenType i32 = BinaryenTypeInt32();
+    u32 flip = is_signed ? 0x80000000 : 0;
+#define SORT_DIGIT(key) IR_BINARY(AndInt32, IR_BINARY(ShrUInt32, IR_BINARY(XorInt32, key, IR_I32(flip)), IR_GET(9)), IR_I32(0xFF))
+#define SORT_COUNT(digit) IR_INDEX(IR_GET(5), digit, 2)
+    BinaryenExpressionRef radix = IR_BLOCK(0,
+        IR_SET(5, IR_ALLOC(IR_I32(256*4))),
+        IR_SET(6, IR_ALLOC(IR_BINARY(ShlInt32, IR_GET(1), IR_I32(2)))),
+        IR_IF(IR_BINARY(AndInt32, IR_BINARY(NeInt32, IR_GET(5), IR_I32(0)), IR_BINARY(NeInt32, IR_GET(6), IR_I32(0))), IR_BLOCK(0,
+            IR_SET(7, IR_GET(0)),
+            IR_SET(8, IR_GET(6)),
+            IR_SET(9, IR_I32(0)),
+            IR_LOOP("pass",
+                BinaryenMemoryFill(module, IR_GET(5), IR_I32(0), IR_I32(256*4)),
+                IR_SET(2, IR_I32(0)),
+                IR_BLOCK("count_done", IR_LOOP("count",
+                    IR_BR_IF("count_done", IR_BINARY(GeUInt32, IR_GET(2), IR_GET(1))),
+                    IR_SET(10, SORT_DIGIT(IR_LOAD32(IR_INDEX(IR_GET(7), IR_GET(2), 2), 0))),
+                    IR_STORE32(SORT_COUNT(IR_GET(10)), 0, IR_ADD(IR_LOAD32(SORT_COUNT(IR_GET(10)), 0), IR_I32(1))),
+                    IR_INC(2, 1),
+                    IR_BR("count"))),
+                IR_IF(IR_BINARY(NeInt32, IR_LOAD32(SORT_COUNT(SORT_DIGIT(IR_LOAD32(IR_GET(7), 0))), 0), IR_GET(1)), IR_BLOCK(0,
+                    IR_SET(11, IR_I32(0)),
+                    IR_SET(10, IR_I32(0)),
+                    IR_BLOCK("sum_done", IR_LOOP("sum",
+                        IR_BR_IF("sum_done", IR_BINARY(GeUInt32, IR_GET(10), IR_I32(256))),
+                        IR_SET(12, IR_LOAD32(SORT_COUNT(IR_GET(10)), 0)),
+                        IR_STORE32(SORT_COUNT(IR_GET(10)), 0, IR_GET(11)),
+                        IR_SET(11, IR_ADD(IR_GET(11), IR_GET(12))),
+                        IR_INC(10, 1),
+                        IR_BR("sum"))),
+                    IR_SET(2, IR_I32(0)),
+                    IR_BLOCK("scatter_done", IR_LOOP("scatter",
+                        IR_BR_IF("scatter_done", IR_BINARY(GeUInt32, IR_GET(2), IR_GET(1))),
+                        IR_SET(4, IR_LOAD32(IR_INDEX(IR_GET(7), IR_GET(2), 2), 0)),
+                        IR_SET(10, SORT_DIGIT(IR_GET(4))),
+                        IR_SET(3, IR_LOAD32(SORT_COUNT(IR_GET(10)), 0)),
+                        IR_STORE32(IR_INDEX(IR_GET(8), IR_GET(3), 2), 0, IR_GET(4)),
+                        IR_STORE32(SORT_COUNT(IR_GET(10)), 0, IR_ADD(IR_GET(3), IR_I32(1))),
+                        IR_INC(2, 1),
+                        IR_BR("scatter"))),
+                    IR_SET(12, IR_GET(7)),
+                    IR_SET(7, IR_GET(8)),
+                    IR_SET(8, IR_GET(12)))),
+                IR_INC(9, 8),
+                IR_BR_IF("pass", IR_BINARY(LtUInt32, IR_GET(9), IR_I32(32)))),
+            IR_IF(IR_BINARY(NeInt32, IR_GET(7), IR_GET(0)), BinaryenMemoryCopy(module, IR_GET(0), IR_GET(7), IR_BINARY(ShlInt32, IR_GET(1), IR_I32(2)))),
+            IR_CALL("__ore_release", BinaryenTypeNone(), IR_GET(5)),
+            IR_RETURN(0))),
+        IR_IF(IR_GET(5), IR_CALL("__ore_release", BinaryenTypeNone(), IR_GET(5))));
+#undef SORT_COUNT
+#undef SORT_DIGIT
+
+    BinaryenExpressionRef body = IR_BLOCK(0,
+        IR_IF(IR_BINARY(AndInt32, IR_BINARY(GtUInt32, IR_GET(1), IR_I32(STDLIB_SORT_INSERTION_MAX)),
+                                  IR_BINARY(LeUInt32, IR_GET(1), IR_I32(0x3FFFFFFF))),
+              radix),
+        IR_SET(2, IR_I32(1)),
+        IR_BLOCK("insert_done", IR_LOOP("insert",
+            IR_BR_IF("insert_done", IR_BINARY(GeUInt32, IR_GET(2), IR_GET(1))),
+            IR_SET(4, IR_LOAD32(IR_INDEX(IR_GET(0), IR_GET(2), 2), 0)),
+            IR_SET(3, IR_GET(2)),
+            IR_BLOCK("shift_done", IR_LOOP("shift",
+                IR_BR_IF("shift_done", IR_UNARY(EqZInt32, IR_GET(3))),
+                IR_SET(12, IR_LOAD32(IR_INDEX(IR_GET(0), IR_SUB(IR_GET(3), IR_I32(1)), 2), 0)),
+                IR_BR_IF("shift_done", BinaryenBinary(module, is_signed ? BinaryenLeSInt32() : BinaryenLeUInt32(), IR_GET(12), IR_GET(4))),
+                IR_STORE32(IR_INDEX(IR_GET(0), IR_GET(3), 2), 0, IR_GET(12)),
+                IR_INC(3, -1),
+                IR_BR("shift"))),
+            IR_STORE32(IR_INDEX(IR_GET(0), IR_GET(3), 2), 0, IR_GET(4)),
+            IR_INC(2, 1),
+            IR_BR("insert"))));
+    StdlibAddFunction(module, name, IR_LIST(BinaryenType, i32, i32), BinaryenTypeNone(),
+                      IR_LIST(BinaryenType, i32, i32, i32, i32, i32, i32, i32, i32, i32, i32, i32), body);
+}
+
+static void
+StdlibBuildSortU32(WASMModuleBuilder *builder)
+{
+    StdlibBuildSort(builder, "__ore_sort_u32", 0);
+}
+
+static void
+StdlibBuildSortI32(WASMModuleBuilder *builder)
+{
+    StdlibBuildSort(builder, "__ore_sort_i32", 1);
+}
+
+// NOTE(jsn): format_u64(value 0, out 1) writes the digits without a terminator and returns
+// their count; out needs 20 bytes. Locals are the length 2, a scratch value 3, the write
+// position 4 and the pair 5. The pair table "000102..99" sits in a data segment.
+static void
+StdlibBuildFormatU64(WASMModuleBuilder *builder)
+{
+    BinaryenModuleRef module = builder->module;
+    BinaryenType i32 = BinaryenTypeInt32();
+    BinaryenType i64 = BinaryenTypeInt64();
+#define FORMAT_VALUE(index) IR_GET_OF(index, i64)
+#define FORMAT_PAIR(pair) IR_LOAD(2, i32, IR_INDEX(IR_I32(builder->stdlib_digit_pairs), pair, 1), 0)
+    BinaryenExpressionRef body = IR_BLOCK(0,
+        IR_SET(2, IR_I32(1)),
+        IR_SET(3, FORMAT_VALUE(0)),
+        IR_LOOP("length",
+            IR_IF(IR_BINARY(GeUInt64, FORMAT_VALUE(3), IR_I64(10)), IR_BLOCK(0,
+                IR_SET(3, IR_BINARY(DivUInt64, FORMAT_VALUE(3), IR_I64(10))),
+                IR_INC(2, 1),
+                IR_BR("length")))),
+        IR_SET(4, IR_ADD(IR_GET(1), IR_GET(2))),
+        IR_BLOCK("pairs_done", IR_LOOP("pairs",
+            IR_BR_IF("pairs_done", IR_BINARY(LtUInt64, FORMAT_VALUE(0), IR_I64(100))),
+            IR_SET(5, IR_UNARY(WrapInt64, IR_BINARY(RemUInt64, FORMAT_VALUE(0), IR_I64(100)))),
+            IR_SET(0, IR_BINARY(DivUInt64, FORMAT_VALUE(0), IR_I64(100))),
+            IR_INC(4, -2),
+            IR_STORE(2, i32, IR_GET(4), 0, FORMAT_PAIR(IR_GET(5))),
+            IR_BR("pairs"))),
+        IR_IF_ELSE(IR_BINARY(GeUInt64, FORMAT_VALUE(0), IR_I64(10)),
+                   IR_STORE(2, i32, IR_SUB(IR_GET(4), IR_I32(2)), 0, FORMAT_PAIR(IR_UNARY(WrapInt64, FORMAT_VALUE(0)))),
+                   IR_STORE8(IR_SUB(IR_GET(4), IR_I32(1)), IR_ADD(IR_UNARY(WrapInt64, FORMAT_VALUE(0)), IR_I32('0')))),
+        IR_GET(2));
+#undef FORMAT_PAIR
+#undef FORMAT_VALUE
+    StdlibAddFunction(module, "__ore_format_u64", IR_LIST(BinaryenType, i64, i32), i32, IR_LIST(BinaryenType, i32, i64, i32, i32), body);
+}
+
+// NOTE(jsn): format_i64(value 0, out 1); out needs 20 bytes.
+static void
+StdlibBuildFormatI64(WASMModuleBuilder *builder)
+{
+    BinaryenModuleRef module = builder->module;
+    BinaryenType i32 = BinaryenTypeInt32();
+    BinaryenType i64 = BinaryenTypeInt64();
+    BinaryenExpressionRef body = IR_BLOCK(0,
+        IR_IF(IR_BINARY(LtSInt64, IR_GET_OF(0, i64), IR_I64(0)), IR_BLOCK(0,
+            IR_STORE8(IR_GET(1), IR_I32('-')),
+            IR_RETURN(IR_ADD(IR_I32(1), IR_CALL("__ore_format_u64", i32, IR_BINARY(SubInt64, IR_I64(0), IR_GET_OF(0, i64)),
+                                                IR_ADD(IR_GET(1), IR_I32(1))))))),
+        IR_CALL("__ore_format_u64", i32, IR_GET_OF(0, i64), IR_GET(1)));
+    StdlibAddFunction(module, "__ore_format_i64", IR_LIST(BinaryenType, i64, i32), i32, 0, 0, body);
+}
+
+// NOTE(jsn): format_f64(value 0, precision 1, out 2) writes fixed point with precision
+// (clamped to 0..17) fraction digits, rounded half up, and switches to d.ddde<n> from
+// 1e18 up; returns the length, out needs 48 bytes. Locals are the position 3, exponent 4,
+// scale 5, integer part 6, fraction 7, integer scale 8, fraction length 9 and counter 10.
+static void
+StdlibBuildFormatF64(WASMModuleBuilder *builder)
+{
+    BinaryenModuleRef module = builder->module;
+    BinaryenType i32 = BinaryenTypeInt32();
+    BinaryenType i64 = BinaryenTypeInt64();
+    BinaryenType f64 = BinaryenTypeFloat64();
+#define FORMAT_VALUE() IR_GET_OF(0, f64)
+#define FORMAT_TEXT3(a, b, c) IR_STORE8(IR_GET(3), IR_I32(a)), IR_STORE8(IR_ADD(IR_GET(3), IR_I32(1)), IR_I32(b)), \
+                              IR_STORE8(IR_ADD(IR_GET(3), IR_I32(2)), IR_I32(c))
+    BinaryenExpressionRef body = IR_BLOCK(0,
+        IR_SET(3, IR_GET(2)),
+        IR_IF(IR_BINARY(NeFloat64, FORMAT_VALUE(), FORMAT_VALUE()), IR_BLOCK(0,
+            FORMAT_TEXT3('n', 'a', 'n'),
+            IR_RETURN(IR_I32(3)))),
+        IR_IF(IR_BINARY(LtFloat64, FORMAT_VALUE(), IR_F64(0)), IR_BLOCK(0,
+            IR_STORE8(IR_GET(3), IR_I32('-')),
+            IR_INC(3, 1),
+            IR_SET(0, IR_UNARY(NegFloat64, FORMAT_VALUE())))),
+        IR_IF(IR_BINARY(GtFloat64, FORMAT_VALUE(), IR_F64(1.7976931348623157e308)), IR_BLOCK(0,
+            FORMAT_TEXT3('i', 'n', 'f'),
+            IR_RETURN(IR_SUB(IR_ADD(IR_GET(3), IR_I32(3)), IR_GET(2))))),
+        IR_IF(IR_BINARY(LtSInt32, IR_GET(1), IR_I32(0)), IR_SET(1, IR_I32(0))),
+        IR_IF(IR_BINARY(GtSInt32, IR_GET(1), IR_I32(17)), IR_SET(1, IR_I32(17))),
+        IR_SET(4, IR_I32(-1)),
+        IR_IF(IR_BINARY(GeFloat64, FORMAT_VALUE(), IR_F64(1e18)), IR_BLOCK(0,
+            IR_SET(4, IR_I32(0)),
+            IR_LOOP("normalize",
+                IR_IF(IR_BINARY(GeFloat64, FORMAT_VALUE(), IR_F64(10)), IR_BLOCK(0,
+                    IR_SET(0, IR_BINARY(DivFloat64, FORMAT_VALUE(), IR_F64(10))),
+                    IR_INC(4, 1),
+                    IR_BR("normalize")))))),
+        IR_SET(5, IR_F64(1)),
+        IR_SET(10, IR_I32(0)),
+        IR_LOOP("scale",
+            IR_IF(IR_BINARY(LtSInt32, IR_GET(10), IR_GET(1)), IR_BLOCK(0,
+                IR_SET(5, IR_BINARY(MulFloat64, IR_GET_OF(5, f64), IR_F64(10))),
+                IR_INC(10, 1),
+                IR_BR("scale")))),
+        IR_SET(8, IR_UNARY(TruncUFloat64ToInt64, IR_GET_OF(5, f64))),
+        IR_SET(6, IR_UNARY(TruncUFloat64ToInt64, FORMAT_VALUE())),
+        IR_SET(7, IR_UNARY(TruncUFloat64ToInt64, IR_UNARY(FloorFloat64, IR_BINARY(AddFloat64, IR_F64(0.5),
+            IR_BINARY(MulFloat64, IR_BINARY(SubFloat64, FORMAT_VALUE(), IR_UNARY(ConvertUInt64ToFloat64, IR_GET_OF(6, i64))), IR_GET_OF(5, f64)))))),
+        IR_IF(IR_BINARY(GeUInt64, IR_GET_OF(7, i64), IR_GET_OF(8, i64)), IR_BLOCK(0,
+            IR_SET(6, IR_BINARY(AddInt64, IR_GET_OF(6, i64), IR_I64(1))),
+            IR_SET(7, IR_BINARY(SubInt64, IR_GET_OF(7, i64), IR_GET_OF(8, i64))))),
+        IR_SET(3, IR_ADD(IR_GET(3), IR_CALL("__ore_format_u64", i32, IR_GET_OF(6, i64), IR_GET(3)))),
+        IR_IF(IR_BINARY(GtSInt32, IR_GET(1), IR_I32(0)), IR_BLOCK(0,
+            IR_STORE8(IR_GET(3), IR_I32('.')),
+            IR_INC(3, 1),
+            IR_SET(9, IR_CALL("__ore_format_u64", i32, IR_GET_OF(7, i64), IR_GET(3))),
+            IR_IF(IR_BINARY(LtSInt32, IR_GET(9), IR_GET(1)), IR_BLOCK(0,
+                BinaryenMemoryCopy(module, IR_ADD(IR_GET(3), IR_SUB(IR_GET(1), IR_GET(9))), IR_GET(3), IR_GET(9)),
+                BinaryenMemoryFill(module, IR_GET(3), IR_I32('0'), IR_SUB(IR_GET(1), IR_GET(9))))),
+            IR_SET(3, IR_ADD(IR_GET(3), IR_GET(1))))),
+        IR_IF(IR_BINARY(GeSInt32, IR_GET(4), IR_I32(0)), IR_BLOCK(0,
+            IR_STORE8(IR_GET(3), IR_I32('e')),
+            IR_INC(3, 1),
+            IR_SET(3, IR_ADD(IR_GET(3), IR_CALL("__ore_format_u64", i32, IR_UNARY(ExtendUInt32, IR_GET(4)), IR_GET(3)))))),
+        IR_SUB(IR_GET(3), IR_GET(2)));
+#undef FORMAT_TEXT3
+#undef FORMAT_VALUE
+    StdlibAddFunction(module, "__ore_format_f64", IR_LIST(BinaryenType, f64, i32, i32), i32,
+                      IR_LIST(BinaryenType, i32, i32, f64, i64, i64, i64, i32, i32), body);
+}
+
+typedef void StdlibBuildProc(WASMModuleBuilder *builder);
+
+static struct
+{
+    char *name;
+    u32 needs;
+    u32 dependencies;
+    StdlibBuildProc *build;
+}
+stdlib_functions[Stdlib_MAX] =
+{
+    [Stdlib_Memcpy]    = { "memcpy",     STDLIB_NEEDS_BULK_MEMORY, 0, StdlibBuildMemcpy },
+    [Stdlib_Memset]    = { "memset",     STDLIB_NEEDS_BULK_MEMORY, 0, StdlibBuildMemset },
+    [Stdlib_Memchr]    = { "memchr",     STDLIB_NEEDS_SIMD, 0, StdlibBuildMemchr },
+    [Stdlib_Memcmp]    = { "memcmp",     STDLIB_NEEDS_SIMD, 0, StdlibBuildMemcmp },
+    [Stdlib_VecNew]    = { "vec_new",    STDLIB_NEEDS_ALLOCATOR, 0, StdlibBuildVecNew },
+    [Stdlib_VecPush]   = { "vec_push",   STDLIB_NEEDS_ALLOCATOR | STDLIB_NEEDS_BULK_MEMORY, 1 << Stdlib_VecNew, StdlibBuildVecPush },
+    [Stdlib_MapNew]    = { "map_new",    STDLIB_NEEDS_ALLOCATOR | STDLIB_NEEDS_BULK_MEMORY, 0, StdlibBuildMapNew },
+    [Stdlib_MapGet]    = { "map_get",    STDLIB_NEEDS_SIMD, 1 << Stdlib_MapNew, StdlibBuildMapGet },
+    [Stdlib_MapInsert] = { "map_insert", STDLIB_NEEDS_SIMD, (1 << Stdlib_MapNew) | (1 << Stdlib_MapGrow), StdlibBuildMapInsert },
+    [Stdlib_MapGrow]   = { "map_grow",   STDLIB_NEEDS_ALLOCATOR | STDLIB_NEEDS_BULK_MEMORY, 1 << Stdlib_MapInsert, StdlibBuildMapGrow },
+    [Stdlib_SortU32]   = { "sort_u32",   STDLIB_NEEDS_ALLOCATOR | STDLIB_NEEDS_BULK_MEMORY, 0, StdlibBuildSortU32 },
+    [Stdlib_SortI32]   = { "sort_i32",   STDLIB_NEEDS_ALLOCATOR | STDLIB_NEEDS_BULK_MEMORY, 0, StdlibBuildSortI32 },
+    [Stdlib_FormatU64] = { "format_u64", 0, 0, StdlibBuildFormatU64 },
+    [Stdlib_FormatI64] = { "format_i64", 0, 1 << Stdlib_FormatU64, StdlibBuildFormatI64 },
+    [Stdlib_FormatF64] = { "format_f64", STDLIB_NEEDS_BULK_MEMORY, 1 << Stdlib_FormatU64, StdlibBuildFormatF64 },
+};
+
+#undef IR_ALLOC
+#undef IR_STORE8
+#undef IR_LOAD8
+#undef IR_STORE32
+#undef IR_LOAD32
+#undef IR_STORE
+#undef IR_LOAD
+#undef IR_INDEX
+#undef IR_INC
+#undef IR_SUB
+#undef IR_ADD
+#undef IR_BINARY
+#undef IR_UNARY
+#undef IR_SET
+#undef IR_GET_OF
+#undef IR_GET
+#undef IR_F64
+#undef IR_I64
+#undef IR_I32
+#undef IR_CALL
+#undef IR_RETURN
+#undef IR_IF_ELSE
+#undef IR_IF
+#undef IR_BR_IF
+#undef IR_BR
+#undef IR_LOOP
+#undef IR_BLOCK
+#undef IR_LIST
+
+// NOTE(jsn): Parses a --stdlib list of names, or "all"; returns 0 on an unknown name.
+static int
+ParseStdlibList(char *list, u32 *required_ptr)
+{
+    u32 required = 0;
+    for(char *at = list; *at;)
+    {
+        char *end = at;
+        while(*end && *end != ',')
+        {
+            ++end;
+        }
+        int length = (int)(end - at);
+        int found = 0;
+        if(length == 3 && !strncmp(at, "all", 3))
+        {
+            required = STDLIB_ALL;
+            found = 1;
+        }
+        for(int i = 0; i < Stdlib_MAX && !found; ++i)
+        {
+            if(!(STDLIB_INTERNAL & (1u << i)) &&
+               (int)strlen(stdlib_functions[i].name) == length && !strncmp(at, stdlib_functions[i].name, length))
+            {
+                required |= 1u << i;
+                found = 1;
+            }
+        }
+        if(!found)
+        {
+            return 0;
+        }
+        at = *end ? end+1 : end;
+    }
+    *required_ptr |= required;
+    return 1;
+}
+
+static void
+WASMModuleBuilderAddStdlib(WASMModuleBuilder *builder)
+{
+    BinaryenModuleRef module = builder->module;
+
+    u32 requested = builder->stdlib_required & ~STDLIB_INTERNAL;
+    u32 required = requested;
+    for(u32 previous = 0; previous != required;)
+    {
+        previous = required;
+        for(int i = 0; i < Stdlib_MAX; ++i)
+        {
+            if(required & (1u << i))
+            {
+                required |= stdlib_functions[i].dependencies;
+            }
+        }
+    }
+
+    u32 needs = 0;
+    for(int i = 0; i < Stdlib_MAX; ++i)
+    {
+        if(required & (1u << i))
+        {
+            needs |= stdlib_functions[i].needs;
+        }
+    }
+    BinaryenFeatures features = BinaryenModuleGetFeatures(module);
+    if(needs & STDLIB_NEEDS_SIMD)
+    {
+        features |= BinaryenFeatureSIMD128();
+    }
+    if(needs & STDLIB_NEEDS_BULK_MEMORY)
+    {
+        features |= BinaryenFeatureBulkMemory();
+    }
+    BinaryenModuleSetFeatures(module, features);
+    if(needs & STDLIB_NEEDS_ALLOCATOR)
+    {
+        builder->export_allocator = 1;
+    }
+
+    if(required & (1u << Stdlib_FormatU64))
+    {
+        char pairs[200];
+        for(int i = 0; i < 100; ++i)
+        {
+            pairs[i*2] = '0' + i/10;
+            pairs[i*2+1] = '0' + i%10;
+        }
+        builder->stdlib_digit_pairs = WASMModuleBuilderPushData(builder, pairs, sizeof(pairs));
+    }
+
+    for(int i = 0; i < Stdlib_MAX; ++i)
+    {
+        if(required & (1u << i))
+        {
+            char name[64];
+            snprintf(name, sizeof(name), "__ore_%s", stdlib_functions[i].name);
+            stdlib_functions[i].build(builder);
+            if(requested & (1u << i))
+            {
+                BinaryenAddFunctionExport(module, name, name);
+            }
+        }
+    }
+}
+
+// NOTE(jsn): The interface of a module's shared buffers, for --js and --c. Addresses are
+// offsets into the module's memory, also exported as globals of the same name. Views into
+// memory are invalidated when it grows, so the JS glue builds them on demand.
+static char *
+WriteSharedBufferJSGlue(WASMModuleBuilder *builder, char *source_name, char *wasm_name, int *size_ptr)
+{
+    char *text = 0;
+    size_t size = 0;
+    FILE *out = open_memstream(&text, &size);
+    fprintf(out,
+            "// Generated by Ore from %s; typed views over the shared buffers of %s.\n"
+            "'use strict';\n\n"
+            "const buffers = {\n", source_name, wasm_name);
+    for(int i = 0; i < builder->shared_buffer_count; ++i)
+    {
+        SharedBuffer *buffer = &builder->shared_buffers[i];
+        fprintf(out, "    %s: { type: '%s', array: %s, address: %u, count: %u },\n", buffer->name,
+                shared_buffer_types[buffer->type].name, shared_buffer_types[buffer->type].js_array, buffer->address, buffer->count);
+    }
+    fprintf(out,
+            "};\n\n"
+            "function views(instance) {\n"
+            "    const memory = instance.exports.memory.buffer;\n"
+            "    const result = {};\n"
+            "    for (const name in buffers) {\n"
+            "        const buffer = buffers[name];\n"
+            "        result[name] = new buffer.array(memory, buffer.address, buffer.count);\n"
+            "    }\n"
+            "    return result;\n"
+            "}\n\n"
+            "// NOTE: Needs a module built with --export-allocator. Returns null when memory is exhausted.\n"
+            "function alloc(instance, array, count) {\n"
+            "    const address = instance.exports.__ore_alloc(count * array.BYTES_PER_ELEMENT);\n"
+            "    return address ? new array(instance.exports.memory.buffer, address, count) : null;\n"
+            "}\n\n"
+            "function release(instance, view) {\n"
+            "    instance.exports.__ore_release(view.byteOffset);\n"
+            "}\n\n"
+            "module.exports = { buffers, views, alloc, release };\n");
+    fclose(out);
+    *size_ptr = (int)size;
+    return text;
+}
+
+static char *
+WriteSharedBufferCHeader(WASMModuleBuilder *builder, char *source_name, char *wasm_name, int *size_ptr)
+{
+    // NOTE(jsn): Macro prefix from the file's base name, e.g. "ORE_IMAGE_" for image.or.
+    char prefix[128];
+    char *base = strrchr(source_name, '/') ? strrchr(source_name, '/') + 1 : source_name;
+    int prefix_length = snprintf(prefix, sizeof(prefix), "ORE_");
+    for(; *base && *base != '.' && prefix_length < (int)sizeof(prefix)-2; ++base)
+    {
+        prefix[prefix_length++] = CharIsAlpha(*base) || CharIsDigit(*base) ? (char)CharToUpper(*base) : '_';
+    }
+    prefix[prefix_length++] = '_';
+    prefix[prefix_length] = 0;
+    
+    char *text = 0;
+    size_t size = 0;
+    FILE *out = open_memstream(&text, &size);
+    fprintf(out,
+            "// Generated by Ore from %s; the shared buffers of %s. Addresses are offsets into\n"
+            "// the module's linear memory.\n"
+            "#ifndef %sH\n"
+            "#define %sH\n\n"
+            "#include <stdint.h>\n\n", source_name, wasm_name, prefix, prefix);
+    for(int i = 0; i < builder->shared_buffer_count; ++i)
+    {
+        SharedBuffer *buffer = &builder->shared_buffers[i];
+        char name[128];
+        int name_length = 0;
+        for(char *at = buffer->name; *at && name_length < (int)sizeof(name)-1; ++at)
+        {
+            name[name_length++] = (char)CharToUpper(*at);
+        }
+        name[name_length] = 0;
+        fprintf(out,
+                "typedef %s %s%s_type;\n"
+                "#define %s%s_ADDRESS %uu\n"
+                "#define %s%s_COUNT %uu\n\n",
+                shared_buffer_types[buffer->type].c_type, prefix, name,
+                prefix, name, buffer->address,
+                prefix, name, buffer->count);
+    }
+    if(builder->export_allocator)
+    {
+        fprintf(out, "// uint32_t __ore_alloc(uint32_t size) and void __ore_release(uint32_t address) are exported.\n"
+                "#define %sHAS_ALLOCATOR 1\n\n", prefix);
+    }
+    fprintf(out, "#endif // %sH\n", prefix);
+    fclose(out);
+    *size_ptr = (int)size;
+    return text;
+}
+
+// NOTE(jsn): Async host imports. Imports named with --async-import <module>.<base> may
+// suspend the caller: the module goes through Binaryen's asyncify pass, restricted by
+// asyncify-imports to those imports, so only functions that can reach one of them are
+// instrumented and everything else runs as before. The unwind buffer gets its own region
+// in the memory plan; __ore_async_buffer points at its { current, end } header, which the host
+// (Tools/ore-async.js) resets before each unwind.
+#define ORE_ASYNCIFY_HEADER_SIZE 8
+
+static int
+ModuleImportsAsyncFunction(WASMModuleBuilder *builder)
+{
+    BinaryenModuleRef module = builder->module;
+    for(BinaryenIndex i = 0; i < BinaryenGetNumFunctions(module); ++i)
+    {
+        BinaryenFunctionRef function = BinaryenGetFunctionByIndex(module, i);
+        if(IsImportedFunction(function))
+        {
+            char name[256];
+            snprintf(name, sizeof(name), "%s.%s", BinaryenFunctionImportGetModule(function),
+                     BinaryenFunctionImportGetBase(function));
+            int name_length = CalculateCStringLength(name);
+            for(char *at = builder->async_imports; *at;)
+            {
+                int length = 0;
+                for(; at[length] && at[length] != ','; ++length);
+                if(length == name_length && !strncmp(at, name, length))
+                {
+                    return 1;
+                }
+                at += length + (at[length] == ',');
+            }
+        }
+    }
+    return 0;
+}
+
+// NOTE(jsn): --preinit. Binaryen's C API has no entry point for ctor evaluation, so the
+// module is handed to the bundled wasm-ctor-eval with the start function exported as its
+// ctor. When everything the start function does can be evaluated ahead of time its memory
+// writes are baked into data segments and the ctor disappears; the Binaryen 97 tool stops at
+// a global write or an import call, and then the export survives and becomes the start
+// function again. Any failure leaves the module as it was.
+#define ORE_PREINIT_EXPORT "__ore_preinit"
+#define ORE_PREINIT_TOOL_DEFAULT "wasm-ctor-eval"
+
+static char *
+LoadEntireFileAndNullTerminateWithSize(char *filename, int *size_ptr)
+{
+    char *result = 0;
+    FILE *file = fopen(filename, "rb");
+    if(file)
+    {
+        fseek(file, 0, SEEK_END);
+        int file_size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        result = malloc(file_size+1);
+        if(result)
+        {
+            file_size = fread(result, 1, file_size, file);
+            result[file_size] = 0;
+            if(size_ptr)
+            {
+                *size_ptr = file_size;
+            }
+        }
+        fclose(file);
+    }
+    return result;
+}
+
+static char *
+LoadEntireFileAndNullTerminate(char *filename)
+{
+    return LoadEntireFileAndNullTerminateWithSize(filename, 0);
+}
+
+static int
+RunProcess(char *path, char **arguments)
+{
+    pid_t pid = 0;
+    extern char **environ;
+    int status = -1;
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, 1, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, 1, 2);
+    if(posix_spawnp(&pid, path, &actions, 0, arguments, environ) == 0)
+    {
+        if(waitpid(pid, &status, 0) != pid)
+        {
+            status = -1;
+        }
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    return status == 0;
+}
+
+static int
+WriteEntireFile(char *filename, void *data, int size)
+{
+    FILE *file = fopen(filename, "wb");
+    if(!file)
+    {
+        return 0;
+    }
+    int written = (int)fwrite(data, 1, size, file) == size;
+    return fclose(file) == 0 && written;
+}
+
+static BinaryenModuleRef
+PreinitModule(WASMModuleBuilder *builder)
+{
+    BinaryenModuleRef module = builder->module;
+    BinaryenModuleAllocateAndWriteResult written = BinaryenModuleAllocateAndWrite(module, 0);
+    free(written.sourceMap);
+    
+    char *temp_directory = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+    char input_path[1024];
+    char output_path[1024 + 16];
+    snprintf(input_path, sizeof(input_path), "%s/ore_preinit_XXXXXX", temp_directory);
+    int input_fd = mkstemp(input_path);
+    snprintf(output_path, sizeof(output_path), "%s.out.wasm", input_path);
+    
+    BinaryenModuleRef result = 0;
+    if(input_fd >= 0)
+    {
+        close(input_fd);
+        if(WriteEntireFile(input_path, written.binary, (int)written.binaryBytes))
+        {
+            char *arguments[] =
+            {
+                builder->preinit_tool_path, input_path, "--ctors", ORE_PREINIT_EXPORT,
+                "--all-features", "-o", output_path, 0,
+            };
+            int output_size = 0;
+            char *output = RunProcess(builder->preinit_tool_path, arguments) ?
+                LoadEntireFileAndNullTerminateWithSize(output_path, &output_size) : 0;
+            if(output)
+            {
+                result = BinaryenModuleRead(output, output_size);
+                free(output);
+            }
+        }
+        unlink(input_path);
+        unlink(output_path);
+    }
+    free(written.binary);
+    
+    if(!result)
+    {
+        fprintf(stderr, "WARNING: --preinit: could not run %s; the start function runs at instantiation\n",
+                builder->preinit_tool_path);
+        result = module;
+    }
+    else
+    {
+        BinaryenModuleSetFeatures(result, BinaryenModuleGetFeatures(module));
+    }
+    
+    // NOTE(jsn): A ctor that couldn't be evaluated keeps its export.
+    for(BinaryenIndex i = 0; i < BinaryenGetNumExports(result); ++i)
+    {
+        BinaryenExportRef export = BinaryenGetExportByIndex(result, i);
+        if(!strcmp(BinaryenExportGetName(export), ORE_PREINIT_EXPORT))
+        {
+            const char *start_function = BinaryenExportGetValue(export);
+            BinaryenSetStart(result, BinaryenGetFunction(result, start_function));
+            BinaryenRemoveExport(result, ORE_PREINIT_EXPORT);
+            LogDebug("--preinit: %s runs at instantiation", start_function);
+            break;
+        }
+    }
+    return result;
+}
+
+// NOTE(jsn): --split. Splits a finished module in two, so a host can start on less code: the
+// primary module keeps the startup set (the functions named in the --split file, the start
+// function and every import) and a secondary module gets every other function. Binaryen 97
+// has no wasm-split, so this goes through the C API. Secondary functions are copied into a
+// fresh module, and their bodies in the primary become stubs that call ore_split.load the
+// first time (Tools/ore-split.js instantiates the secondary module there) and then
+// call_indirect through the table, where the secondary module's element segment put the
+// real function: secondary function i lives in slot i. The secondary module imports the
+// primary's memory and table, and every function and global its code refers to, through
+// "split:<name>" exports of the primary.
+#define ORE_SPLIT_PRIMARY_MODULE "primary"
+#define ORE_SPLIT_EXPORT_PREFIX "split:"
+#define ORE_SPLIT_LOAD "__ore_split_load"
+#define ORE_SPLIT_LOADED "__ore_split_loaded"
+
+typedef struct SplitReferences SplitReferences;
+struct SplitReferences
+{
+    StringTable functions;
+    StringTable globals;
+};
+
+static void
+CollectSplitReference(BinaryenExpressionRef expr, void *user_data)
+{
+    SplitReferences *references = user_data;
+    BinaryenExpressionId id = BinaryenExpressionGetId(expr);
+    if(id == BinaryenCallId())
+    {
+        char *name = (char *)BinaryenCallGetTarget(expr);
+        StringTableIntern(&references->functions, name, CalculateCStringLength(name), 0);
+    }
+    else if(id == BinaryenGlobalGetId() || id == BinaryenGlobalSetId())
+    {
+        char *name = (char *)(id == BinaryenGlobalGetId() ? BinaryenGlobalGetGetName(expr) : BinaryenGlobalSetGetName(expr));
+        StringTableIntern(&references->globals, name, CalculateCStringLength(name), 0);
+    }
+}
+
+static BinaryenExpressionRef
+BuildSplitStub(BinaryenModuleRef module, BinaryenFunctionRef function, int slot)
+{
+    BinaryenType params = BinaryenFunctionGetParams(function);
+    BinaryenType results = BinaryenFunctionGetResults(function);
+    BinaryenIndex param_count = BinaryenTypeArity(params);
+    BinaryenType *param_types = malloc(sizeof(BinaryenType)*(param_count+1));
+    BinaryenExpressionRef *operands = malloc(sizeof(BinaryenExpressionRef)*(param_count+1));
+    BinaryenTypeExpand(params, param_types);
+    for(BinaryenIndex i = 0; i < param_count; ++i)
+    {
+        operands[i] = BinaryenLocalGet(module, i, param_types[i]);
+    }
+
+    BinaryenExpressionRef is_loaded = BinaryenGlobalGet(module, ORE_SPLIT_LOADED, BinaryenTypeInt32());
+    BinaryenExpressionRef stub[] =
+    {
+        BinaryenIf(module, BinaryenUnary(module, BinaryenEqZInt32(), is_loaded),
+                   BinaryenCall(module, ORE_SPLIT_LOAD, 0, 0, BinaryenTypeNone()), 0),
+        BinaryenCallIndirect(module, BinaryenConst(module, BinaryenLiteralInt32(slot)), operands, param_count, params, results),
+    };
+    free(operands);
+    free(param_types);
+    return BinaryenBlock(module, 0, stub, 2, results);
+}
+
+// NOTE(jsn): Leaves the primary in builder->module and the serialized secondary module in
+// builder->secondary_output. Returns 0 if the primary no longer validates; a module that
+// can't be split is left whole, with a warning.
+static int
+WASMModuleBuilderSplit(WASMModuleBuilder *builder, int is_bundle)
+{
+    BinaryenModuleRef module = builder->module;
+    BinaryenIndex function_count = BinaryenGetNumFunctions(module);
+    BinaryenFunctionRef *secondary = malloc(sizeof(BinaryenFunctionRef)*(function_count+1));
+    const char **secondary_names = malloc(sizeof(char *)*(function_count+1));
+    StringTable secondary_set = {0};
+    int secondary_count = 0;
+    for(BinaryenIndex i = 0; i < function_count; ++i)
+    {
+        BinaryenFunctionRef function = BinaryenGetFunctionByIndex(module, i);
+        char *name = (char *)BinaryenFunctionGetName(function);
+        int name_length = CalculateCStringLength(name);
+        int is_start = builder->start_function && !strcmp(name, builder->start_function);
+        if(!IsImportedFunction(function) && !is_start && StringTableFind(builder->split_startup, name, name_length) < 0)
+        {
+            secondary[secondary_count] = function;
+            secondary_names[secondary_count] = name;
+            StringTableIntern(&secondary_set, name, name_length, 0);
+            ++secondary_count;
+        }
+    }
+
+    // NOTE(jsn): Slots are handed out from 0, so the table has to start out empty.
+    BinaryenIndex table_entry_count = 0;
+    for(BinaryenIndex i = 0; i < BinaryenGetNumFunctionTableSegments(module); ++i)
+    {
+        table_entry_count += BinaryenGetFunctionTableSegmentLength(module, i);
+    }
+
+    int is_valid = 1;
+    BinaryenModuleRef secondary_module = 0;
+    if(!secondary_count)
+    {
+        LogDebug("--split: every function is in the startup set; nothing to split");
+    }
+    else if(table_entry_count)
+    {
+        fprintf(stderr, "WARNING: --split: the module already has a function table; it is not split\n");
+    }
+    else
+    {
+        secondary_module = BinaryenModuleCreate();
+        BinaryenModuleSetFeatures(secondary_module, BinaryenModuleGetFeatures(module));
+        SplitReferences references = {0};
+        for(int i = 0; i < secondary_count; ++i)
+        {
+            BinaryenFunctionRef function = secondary[i];
+            BinaryenExpressionRef body = BinaryenFunctionGetBody(function);
+            VisitExpressions(body, CollectSplitReference, &references);
+            BinaryenIndex var_count = BinaryenFunctionGetNumVars(function);
+            BinaryenType *vars = malloc(sizeof(BinaryenType)*(var_count+1));
+            for(BinaryenIndex j = 0; j < var_count; ++j)
+            {
+                vars[j] = BinaryenFunctionGetVar(function, j);
+            }
+            BinaryenAddFunction(secondary_module, secondary_names[i], BinaryenFunctionGetParams(function),
+                                BinaryenFunctionGetResults(function), vars, var_count, BinaryenExpressionCopy(body, secondary_module));
+            free(vars);
+        }
+
+        char export_name[1024];
+        for(int i = 0; i < references.functions.count; ++i)
+        {
+            char *name = StringTableGetString(&references.functions, i);
+            if(StringTableFind(&secondary_set, name, CalculateCStringLength(name)) < 0)
+            {
+                BinaryenFunctionRef function = BinaryenGetFunction(module, name);
+                snprintf(export_name, sizeof(export_name), ORE_SPLIT_EXPORT_PREFIX "%s", name);
+                BinaryenAddFunctionImport(secondary_module, name, ORE_SPLIT_PRIMARY_MODULE, export_name,
+                                          BinaryenFunctionGetParams(function), BinaryenFunctionGetResults(function));
+            }
+        }
+        for(int i = 0; i < references.globals.count; ++i)
+        {
+            char *name = StringTableGetString(&references.globals, i);
+            BinaryenGlobalRef global = BinaryenGetGlobal(module, name);
+            snprintf(export_name, sizeof(export_name), ORE_SPLIT_EXPORT_PREFIX "%s", name);
+            BinaryenAddGlobalImport(secondary_module, name, ORE_SPLIT_PRIMARY_MODULE, export_name, BinaryenGlobalGetType(global),
+                                    BinaryenGlobalIsMutable(global));
+        }
+        if(builder->memory_plan.has_memory)
+        {
+            BinaryenSetMemory(secondary_module, builder->memory_plan.initial_pages, builder->memory_plan.maximum_pages,
+                              0, 0, 0, 0, 0, 0, 0);
+            BinaryenAddMemoryImport(secondary_module, "0", ORE_SPLIT_PRIMARY_MODULE, "memory", 0);
+        }
+        BinaryenIndex table_maximum = is_bundle ? 0xFFFFFFFF : (BinaryenIndex)secondary_count;
+        BinaryenSetFunctionTable(secondary_module, secondary_count, table_maximum, secondary_names, secondary_count,
+                                 BinaryenConst(secondary_module, BinaryenLiteralInt32(0)));
+        BinaryenAddTableImport(secondary_module, "0", ORE_SPLIT_PRIMARY_MODULE, "table");
+
+        // NOTE(jsn): A reference the walk missed shows up here, as a name the secondary
+        // module doesn't define, before the primary has been touched.
+        if(!BinaryenModuleValidate(secondary_module))
+        {
+            fprintf(stderr, "WARNING: --split: the secondary module failed validation; the module is not split\n");
+            BinaryenModuleDispose(secondary_module);
+            secondary_module = 0;
+        }
+        else
+        {
+            BinaryenAddFunctionImport(module, ORE_SPLIT_LOAD, "ore_split", "load", BinaryenTypeNone(), BinaryenTypeNone());
+            BinaryenAddGlobal(module, ORE_SPLIT_LOADED, BinaryenTypeInt32(), 1, BinaryenConst(module, BinaryenLiteralInt32(0)));
+            BinaryenAddGlobalExport(module, ORE_SPLIT_LOADED, ORE_SPLIT_LOADED);
+            for(int i = 0; i < secondary_count; ++i)
+            {
+                BinaryenFunctionSetBody(secondary[i], BuildSplitStub(module, secondary[i], i));
+            }
+            BinaryenSetFunctionTable(module, secondary_count, table_maximum, 0, 0, BinaryenConst(module, BinaryenLiteralInt32(0)));
+            if(!builder->has_table)
+            {
+                BinaryenAddTableExport(module, "0", "table");
+                builder->has_table = 1;
+            }
+            for(int i = 0; i < references.functions.count; ++i)
+            {
+                char *name = StringTableGetString(&references.functions, i);
+                if(StringTableFind(&secondary_set, name, CalculateCStringLength(name)) < 0)
+                {
+                    snprintf(export_name, sizeof(export_name), ORE_SPLIT_EXPORT_PREFIX "%s", name);
+                    BinaryenAddFunctionExport(module, name, export_name);
+                }
+            }
+            for(int i = 0; i < references.globals.count; ++i)
+            {
+                char *name = StringTableGetString(&references.globals, i);
+                snprintf(export_name, sizeof(export_name), ORE_SPLIT_EXPORT_PREFIX "%s", name);
+                BinaryenAddGlobalExport(module, name, export_name);
+            }
+
+            // NOTE(jsn): Whatever only secondary code used is gone from the primary now.
+            const char *passes[] = { "remove-unused-module-elements" };
+            BinaryenModuleRunPasses(module, passes, 1);
+            is_valid = BinaryenModuleValidate(module);
+            StatAdd(Stat_SecondaryFunctions, secondary_count);
+            LogDebug("--split: %d of %u functions moved to the secondary module", secondary_count, function_count);
+        }
+        StringTableRelease(&references.functions);
+        StringTableRelease(&references.globals);
+    }
+
+    if(secondary_module)
+    {
+        BinaryenModuleAllocateAndWriteResult written = BinaryenModuleAllocateAndWrite(secondary_module, 0);
+        builder->secondary_output = written.binary;
+        builder->secondary_output_size = (int)written.binaryBytes;
+        free(written.sourceMap);
+        BinaryenModuleDispose(secondary_module);
+    }
+    StringTableRelease(&secondary_set);
+    free(secondary_names);
+    free(secondary);
+    return is_valid;
+}
+
+// NOTE(jsn): foo.wasm's secondary module is foo.secondary.wasm.
+static char *
+GetSecondaryModulePath(char *wasm_path)
+{
+    int length = CalculateCStringLength(wasm_path);
+    if(length >= 5 && CStringMatchCaseInsensitive(wasm_path + length - 5, ".wasm"))
+    {
+        length -= 5;
+    }
+    char *path = malloc(length + sizeof(".secondary.wasm"));
+    MemoryCopy(path, wasm_path, length);
+    MemoryCopy(path + length, ".secondary.wasm", sizeof(".secondary.wasm"));
+    return path;
+}
+
+// NOTE(jsn): Sets up memory (and for bundles the shared table), validates and serializes
+// the module. The returned buffer is malloc'd; 0 is returned when validation fails.
+static char *
+WASMModuleBuilderFinish(WASMModuleBuilder *builder, int is_bundle, int optimize, int file_id, u64 *phase_ns, int *size_ptr)
+{
+    BinaryenModuleRef module = builder->module;
+    
+    if(builder->stdlib_required)
+    {
+        WASMModuleBuilderAddStdlib(builder);
+    }
+    
+    if(builder->export_allocator)
+    {
+        WASMModuleBuilderAddAllocator(builder);
+    }
+    
+    // NOTE(jsn): After the stdlib and the allocator, which are most of the functions an
+    // Ore module defines, so they are instrumented too.
+    if(builder->profile_functions)
+    {
+        WASMModuleBuilderAddProfiler(builder);
+    }
+    
+    if(builder->profile_allocations)
+    {
+        WASMModuleBuilderAddAllocationProfiler(builder);
+    }
+    
+    int is_async = builder->async_imports && ModuleImportsAsyncFunction(builder);
+    MemoryPlan plan = builder->memory_plan = PlanMemory(builder, is_bundle, is_async);
+    if(plan.has_memory)
+    {
+        BinaryenExpressionRef *offsets = malloc(sizeof(BinaryenExpressionRef)*(builder->segment_count+1));
+        int8_t *passive = calloc(builder->segment_count+1, 1);
+        for(int i = 0; i < builder->segment_count; ++i)
+        {
+            offsets[i] = BinaryenConst(module, BinaryenLiteralInt32(builder->segment_offsets[i]));
+        }
+        BinaryenSetMemory(module, plan.initial_pages, plan.maximum_pages, "memory", (const char **)builder->segments,
+                          passive, offsets, builder->segment_sizes, builder->segment_count, 0);
+        free(offsets);
+        free(passive);
+        
+        // NOTE(jsn): Same names as wasm-ld, so hosts and later codegen find the regions.
+        if(plan.stack_top > plan.stack_base)
+        {
+            BinaryenAddGlobal(module, "__stack_pointer", BinaryenTypeInt32(), 1, BinaryenConst(module, BinaryenLiteralInt32(plan.stack_top)));
+        }
+        BinaryenAddGlobal(module, "__data_end", BinaryenTypeInt32(), 0, BinaryenConst(module, BinaryenLiteralInt32(plan.data_end)));
+        BinaryenAddGlobal(module, "__heap_base", BinaryenTypeInt32(), 0, BinaryenConst(module, BinaryenLiteralInt32(plan.heap_base)));
+        BinaryenAddGlobalExport(module, "__data_end", "__data_end");
+        BinaryenAddGlobalExport(module, "__heap_base", "__heap_base");
+        if(builder->export_allocator)
+        {
+            BinaryenAddGlobal(module, ORE_ALLOCATOR_TOP, BinaryenTypeInt32(), 1, BinaryenConst(module, BinaryenLiteralInt32(plan.heap_base)));
+        }
+    }
+    
+    if(is_async)
+    {
+        // NOTE(jsn): The asyncify_* exports it adds are the host's side of the protocol.
+        TraceZoneBegin(asyncify);
+        const char *passes[] = { "asyncify" };
+        BinaryenModuleRunPasses(module, passes, 1);
+        BinaryenAddGlobal(module, "__ore_async_buffer", BinaryenTypeInt32(), 0, BinaryenConst(module, BinaryenLiteralInt32(plan.async_base)));
+        BinaryenAddGlobal(module, "__ore_async_buffer_end", BinaryenTypeInt32(), 0, BinaryenConst(module, BinaryenLiteralInt32(plan.heap_base)));
+        BinaryenAddGlobalExport(module, "__ore_async_buffer", "__ore_async_buffer");
+        BinaryenAddGlobalExport(module, "__ore_async_buffer_end", "__ore_async_buffer_end");
+        TraceZoneEnd(asyncify, "asyncify", file_id);
+    }
+    
+    if(is_bundle)
+    {
+        BinaryenSetFunctionTable(module, 0, 0xFFFFFFFF, 0, 0, BinaryenConst(module, BinaryenLiteralInt32(0)));
+        BinaryenAddTableExport(module, "0", "table");
+        builder->has_table = 1;
+    }
+    
+    // NOTE(jsn): Exporting the start function also keeps the optimizer from removing it
+    // before wasm-ctor-eval gets to see it.
+    if(builder->start_function)
+    {
+        if(builder->preinit)
+        {
+            BinaryenAddFunctionExport(module, builder->start_function, ORE_PREINIT_EXPORT);
+        }
+        else
+        {
+            BinaryenSetStart(module, BinaryenGetFunction(module, builder->start_function));
+        }
+    }
+    
+    u64 expression_count = stats.enabled ? CountModuleExpressions(builder) : 0;
+    StatAdd(Stat_BinaryenModules, 1);
+    StatAdd(Stat_BinaryenFunctions, BinaryenGetNumFunctions(module));
+    StatAdd(Stat_ExpressionsBeforeOptimization, expression_count);
+    if(optimize)
+    {
+        TimeBlockBegin(optimize);
+        TraceZoneBegin(optimize);
+        BinaryenModuleOptimize(module);
+        TraceZoneEnd(optimize, "optimize", file_id);
+        TimeBlockEnd(optimize, phase_ns, TimePhase_Optimize);
+        expression_count = stats.enabled ? CountModuleExpressions(builder) : 0;
+    }
+    StatAdd(Stat_ExpressionsAfterOptimization, expression_count);
+    
+    TimeBlockBegin(validate);
+    TraceZoneBegin(validate);
+    int is_valid = BinaryenModuleValidate(module);
+    TraceZoneEnd(validate, "validate", file_id);
+    TimeBlockEnd(validate, phase_ns, TimePhase_Validate);
+    
+    if(is_valid && builder->start_function && builder->preinit)
+    {
+        TraceZoneBegin(preinit);
+        BinaryenModuleRef preinitialized = PreinitModule(builder);
+        TraceZoneEnd(preinit, "preinit", file_id);
+        if(preinitialized != module)
+        {
+            BinaryenModuleDispose(module);
+            module = builder->module = preinitialized;
+            if(optimize)
+            {
+                BinaryenModuleOptimize(module);
+            }
+        }
+    }
+    
+    if(is_valid && builder->split_startup)
+    {
+        TraceZoneBegin(split);
+        is_valid = WASMModuleBuilderSplit(builder, is_bundle);
+        TraceZoneEnd(split, "split", file_id);
+    }
+    
+    char *result = 0;
+    if(is_valid)
+    {
+        TimeBlockBegin(emit);
+        TraceZoneBegin(emit);
+        BinaryenModuleAllocateAndWriteResult written = BinaryenModuleAllocateAndWrite(module, 0);
+        result = written.binary;
+        *size_ptr = (int)written.binaryBytes;
+        free(written.sourceMap);
+        TraceZoneEnd(emit, "emit", file_id);
+        TimeBlockEnd(emit, phase_ns, TimePhase_Emit);
+    }
+    return result;
+}
+
+// NOTE(jsn): --incremental. Relinks a bundle by patching the previous output instead of
+// rewriting it. Next to the bundle, <bundle>.link records what was last written: the
+// file's size and modification time, the type, import and function counts, and the binary
+// split into chunks (the header, every section outside the code section, the code
+// section's header and every function body) with the offset, size and hash of each. The
+// new binary is split the same way and only chunks whose offset, size or hash changed are
+// written into the existing file. A changed function of the same size rewrites just its
+// body; one that changes size rewrites everything after it, since later offsets shift.
+// When the type or import counts changed every index in the code may have moved, so the
+// whole bundle is written.
+//
+// For edits to Ore sources this saves little. Their globals, exports and data live in the
+// sections ahead of the code, so adding a declaration or changing a string's length shifts
+// every later offset and the relink is in effect a full rewrite; a same-size value edit
+// still rewrites those whole sections. What it does save is the relink of an unchanged
+// tree, which writes nothing.
+#define WASM_LINK_MAP_VERSION 1
+#define WASM_SECTION_TYPE 1
+#define WASM_SECTION_IMPORT 2
+#define WASM_SECTION_MEMORY 5
+#define WASM_SECTION_START 8
+#define WASM_SECTION_CODE 10
+
+typedef struct WASMChunk WASMChunk;
+struct WASMChunk
+{
+    u32 offset;
+    u32 size;
+    u64 hash;
+};
+
+typedef struct WASMLinkMap WASMLinkMap;
+struct WASMLinkMap
+{
+    u64 file_size;
+    i64 file_mtime_sec;
+    i64 file_mtime_nsec;
+    u32 type_count;
+    u32 import_count;
+    u32 function_count;
+    int first_function_chunk;
+    WASMChunk *chunks;
+    int chunk_count;
+    int chunk_capacity;
+};
+
+static void
+WASMLinkMapRelease(WASMLinkMap *map)
+{
+    free(map->chunks);
+    MemorySet(map, 0, sizeof(*map));
+}
+
+static void
+WASMLinkMapPushChunk(WASMLinkMap *map, char *binary, u32 offset, u32 size)
+{
+    if(map->chunk_count >= map->chunk_capacity)
+    {
+        map->chunk_capacity = map->chunk_capacity ? map->chunk_capacity*2 : 64;
+        map->chunks = realloc(map->chunks, sizeof(WASMChunk)*map->chunk_capacity);
+    }
+    WASMChunk *chunk = &map->chunks[map->chunk_count++];
+    chunk->offset = offset;
+    chunk->size = size;
+    chunk->hash = HashStringN(binary + offset, size);
+}
+
+// NOTE(jsn): Returns 0 past the end of the binary or on a malformed encoding.
+static int
+ReadULEB128(u8 *at, u8 *end, u32 *value_ptr)
+{
+    u32 value = 0;
+    for(int i = 0; at+i < end && i < 5; ++i)
+    {
+        value |= (u32)(at[i] & 0x7F) << (7*i);
+        if(!(at[i] & 0x80))
+        {
+            *value_ptr = value;
+            return i+1;
+        }
+    }
+    return 0;
+}
+
+static int
+WASMLinkMapBuild(WASMLinkMap *map, char *binary, u32 size)
+{
+    u8 *start = (u8 *)binary;
+    u8 *end = start + size;
+    if(size < 8)
+    {
+        return 0;
+    }
+    WASMLinkMapPushChunk(map, binary, 0, 8);
+    for(u8 *at = start + 8; at < end;)
+    {
+        u8 id = *at;
+        u32 payload_size = 0;
+        int length = ReadULEB128(at+1, end, &payload_size);
+        u8 *payload = at + 1 + length;
+        if(!length || payload_size > (u32)(end - payload))
+        {
+            return 0;
+        }
+
+        u32 count = 0;
+        int count_length = ReadULEB128(payload, payload + payload_size, &count);
+        if(id == WASM_SECTION_TYPE)
+        {
+            map->type_count = count;
+        }
+        else if(id == WASM_SECTION_IMPORT)
+        {
+            map->import_count = count;
+        }
+
+        if(id == WASM_SECTION_CODE && count_length)
+        {
+            map->function_count = count;
+            map->first_function_chunk = map->chunk_count + 1;
+            u8 *body = payload + count_length;
+            WASMLinkMapPushChunk(map, binary, (u32)(at - start), (u32)(body - at));
+            for(u32 i = 0; i < count; ++i)
+            {
+                u32 body_size = 0;
+                int body_length = ReadULEB128(body, payload + payload_size, &body_size);
+                if(!body_length || body_size > (u32)(payload + payload_size - body - body_length))
+                {
+                    return 0;
+                }
+                WASMLinkMapPushChunk(map, binary, (u32)(body - start), body_length + body_size);
+                body += body_length + body_size;
+            }
+        }
+        else
+        {
+            WASMLinkMapPushChunk(map, binary, (u32)(at - start), (u32)(payload + payload_size - at));
+        }
+        at = payload + payload_size;
+    }
+    return 1;
+}
+
+// NOTE(jsn): Returns a malloc'd copy of binary without its start section and the start
+// function's index, or 0 when the module has no start function. Binaryen 97 can neither
+// report nor clear a module's start function.
+static char *
+CopyWASMWithoutStart(char *binary, u32 size, u32 *copy_size_ptr, u32 *start_index_ptr)
+{
+    u8 *start = (u8 *)binary;
+    u8 *end = start + size;
+    for(u8 *at = start + 8; size >= 8 && at < end;)
+    {
+        u32 payload_size = 0;
+        int length = ReadULEB128(at+1, end, &payload_size);
+        u8 *payload = at + 1 + length;
+        if(!length || payload_size > (u32)(end - payload))
+        {
+            break;
+        }
+        u8 *next = payload + payload_size;
+        if(*at == WASM_SECTION_START && ReadULEB128(payload, next, start_index_ptr))
+        {
+            u32 copy_size = size - (u32)(next - at);
+            char *copy = malloc(copy_size);
+            MemoryCopy(copy, binary, (u32)(at - start));
+            MemoryCopy(copy + (at - start), next, (u32)(end - next));
+            *copy_size_ptr = copy_size;
+            return copy;
+        }
+        at = next;
+    }
+    return 0;
+}
+
+// NOTE(jsn): Reads the limits of the memory a module defines; returns 0 when the memory is
+// imported or there is none. Bit 0 of the flags says there is a maximum, bit 1 that the
+// memory is shared.
+static int
+ReadWASMMemoryLimits(char *binary, u32 size, u32 *flags_ptr, u32 *initial_ptr, u32 *maximum_ptr)
+{
+    u8 *start = (u8 *)binary;
+    u8 *end = start + size;
+    for(u8 *at = start + 8; size >= 8 && at < end;)
+    {
+        u32 payload_size = 0;
+        int length = ReadULEB128(at+1, end, &payload_size);
+        u8 *payload = at + 1 + length;
+        if(!length || payload_size > (u32)(end - payload))
+        {
+            break;
+        }
+        u8 *next = payload + payload_size;
+        if(*at == WASM_SECTION_MEMORY)
+        {
+            u32 count = 0;
+            int count_length = ReadULEB128(payload, next, &count);
+            int flags_length = count_length && count ? ReadULEB128(payload + count_length, next, flags_ptr) : 0;
+            u8 *limits = payload + count_length + flags_length;
+            int initial_length = flags_length ? ReadULEB128(limits, next, initial_ptr) : 0;
+            *maximum_ptr = 0;
+            return initial_length && (!(*flags_ptr & 1) || ReadULEB128(limits + initial_length, next, maximum_ptr));
+        }
+        at = next;
+    }
+    return 0;
+}
+
+static char *
+GetLinkMapPath(char *bundle_path)
+{
+    int size = CalculateCStringLength(bundle_path) + 6;
+    char *path = malloc(size);
+    snprintf(path, size, "%s.link", bundle_path);
+    return path;
+}
+
+static int
+LoadLinkMap(WASMLinkMap *map, char *path)
+{
+    char *file = LoadEntireFileAndNullTerminate(path);
+    if(!file)
+    {
+        return 0;
+    }
+    int version = 0;
+    unsigned long long file_size = 0;
+    long long mtime_sec = 0, mtime_nsec = 0;
+    int offset = 0;
+    int is_valid = sscanf(file, "ore-link %d\nfile %llu %lld %lld\ncounts %u %u %u\n%n", &version, &file_size, &mtime_sec, &mtime_nsec,
+                          &map->type_count, &map->import_count, &map->function_count, &offset) == 7 &&
+        version == WASM_LINK_MAP_VERSION;
+    map->file_size = file_size;
+    map->file_mtime_sec = mtime_sec;
+    map->file_mtime_nsec = mtime_nsec;
+    for(char *line = file + offset; is_valid && *line;)
+    {
+        unsigned chunk_offset = 0, chunk_size = 0;
+        unsigned long long hash = 0;
+        int length = 0;
+        if(sscanf(line, "chunk %u %u %llx\n%n", &chunk_offset, &chunk_size, &hash, &length) != 3 || !length)
+        {
+            is_valid = 0;
+            break;
+        }
+        if(map->chunk_count >= map->chunk_capacity)
+        {
+            map->chunk_capacity = map->chunk_capacity ? map->chunk_capacity*2 : 64;
+            map->chunks = realloc(map->chunks, sizeof(WASMChunk)*map->chunk_capacity);
+        }
+        map->chunks[map->chunk_count++] = (WASMChunk){ chunk_offset, chunk_size, hash };
+        line += length;
+    }
+    free(file);
+    return is_valid;
+}
+
+static void
+SaveLinkMap(WASMLinkMap *map, char *path)
+{
+    int path_length = CalculateCStringLength(path);
+    char *temporary_path = malloc(path_length+5);
+    MemoryCopy(temporary_path, path, path_length);
+    MemoryCopy(temporary_path + path_length, ".tmp", 5);
+    FILE *file = fopen(temporary_path, "wb");
+    if(file)
+    {
+        fprintf(file, "ore-link %d\nfile %llu %lld %lld\ncounts %u %u %u\n", WASM_LINK_MAP_VERSION,
+                (unsigned long long)map->file_size, (long long)map->file_mtime_sec, (long long)map->file_mtime_nsec,
+                map->type_count, map->import_count, map->function_count);
+        for(int i = 0; i < map->chunk_count; ++i)
+        {
+            fprintf(file, "chunk %u %u %llx\n", map->chunks[i].offset, map->chunks[i].size, (unsigned long long)map->chunks[i].hash);
+        }
+        fclose(file);
+        rename(temporary_path, path);
+    }
+    free(temporary_path);
+}
+
+// NOTE(jsn): Writes binary to path, patching the file in place when the link map from the
+// previous link still describes it. Returns the bytes written, or -1 on failure.
+static i64
+WriteBundleIncremental(char *path, char *binary, u32 size)
+{
+    char *map_path = GetLinkMapPath(path);
+    WASMLinkMap previous = {0};
+    WASMLinkMap next = {0};
+    int has_map = WASMLinkMapBuild(&next, binary, size);
+    struct stat file_stat;
+    int can_patch = has_map && LoadLinkMap(&previous, map_path) && !stat(path, &file_stat) &&
+        (u64)file_stat.st_size == previous.file_size && file_stat.st_mtim.tv_sec == previous.file_mtime_sec &&
+        file_stat.st_mtim.tv_nsec == previous.file_mtime_nsec &&
+        next.type_count == previous.type_count && next.import_count == previous.import_count;
+    
+    i64 written = 0;
+    int functions_written = 0;
+    FILE *file = can_patch ? fopen(path, "r+b") : fopen(path, "wb");
+    if(!file)
+    {
+        written = -1;
+    }
+    else if(can_patch)
+    {
+        for(int i = 0; i < next.chunk_count; ++i)
+        {
+            WASMChunk *chunk = &next.chunks[i];
+            if(i < previous.chunk_count && previous.chunks[i].offset == chunk->offset && previous.chunks[i].size == chunk->size &&
+               previous.chunks[i].hash == chunk->hash)
+            {
+                continue;
+            }
+            if(fseek(file, chunk->offset, SEEK_SET) || fwrite(binary + chunk->offset, 1, chunk->size, file) != chunk->size)
+            {
+                written = -1;
+                break;
+            }
+            written += chunk->size;
+            functions_written += i >= next.first_function_chunk && i < next.first_function_chunk + (int)next.function_count;
+        }
+        if(written < 0 || fflush(file) || ftruncate(fileno(file), size))
+        {
+            written = -1;
+        }
+    }
+    else
+    {
+        written = size;
+        if(fwrite(binary, 1, size, file) != (size_t)size)
+        {
+            written = -1;
+        }
+    }
+    if(file && fclose(file))
+    {
+        written = -1;
+    }
+    
+    if(written >= 0 && has_map && !stat(path, &file_stat))
+    {
+        if(can_patch)
+        {
+            Log("Relinked %s: wrote %lld of %u bytes, %d of %u function bodies.", path, (long long)written, size,
+                functions_written, next.function_count);
+        }
+        next.file_size = (u64)file_stat.st_size;
+        next.file_mtime_sec = file_stat.st_mtim.tv_sec;
+        next.file_mtime_nsec = file_stat.st_mtim.tv_nsec;
+        SaveLinkMap(&next, map_path);
+    }
+    else
+    {
+        remove(map_path);
+    }
+    WASMLinkMapRelease(&previous);
+    WASMLinkMapRelease(&next);
+    free(map_path);
+    return written;
+}
+
+static ProcessedFile
+ProcessFile(char *filename, char *file, FileProcessData *process_data, ParseContext *context)
+{
+    ProcessedFile processed_file = {0};
+    processed_file.filename = filename;
+    processed_file.input_type = process_data->input_type;
+    processed_file.output_flags = process_data->output_flags;
+    
+    if(process_data->input_type == InputType_WASM)
+    {
+        processed_file.wasm_file_contents = file;
+    }
+    else if(process_data->input_type == InputType_OR)
+    {
+        Tokenizer tokenizer_ = {0};
+        Tokenizer *tokenizer = &tokenizer_;
+        tokenizer->at = file;
+        tokenizer->line = 1;
+        tokenizer->file = filename;
+        
+        ExprNode *page = ParseText(context, tokenizer);
+        processed_file.root = page;
+        StatAdd(Stat_FilesParsed, 1);
+        StatAdd(Stat_BytesLexed, tokenizer->at - file);
+        StatAdd(Stat_ParseErrors, context->error_stack_size);
+        processed_file.lex_ns = tokenizer->lex_ns;
+    }
+    
+    // NOTE(jsn): Output files are opened by the write stage of the pipeline, so only the
+    // paths are recorded here.
+    if(process_data->output_flags & OutputFlag_WASM)
+    {
+        processed_file.wasm_output_path = ParseContextAllocateCStringCopy(context, process_data->wasm_output_path);
+    }
+    
+    if(process_data->output_flags & OutputFlag_C)
+    {
+        processed_file.c_output_path = ParseContextAllocateCStringCopy(context, process_data->c_output_path);
+    }
+    
+    if(process_data->output_flags & OutputFlag_js)
+    {
+        processed_file.js_output_path = ParseContextAllocateCStringCopy(context, process_data->js_output_path);
+    }
+    
+    return processed_file;
+}
+
+// NOTE(jsn): Points past the last '.' of the file name, or at the terminator if the name
+// has no extension. Periods in directory names don't count.
+static char *
+GetFileExtension(char *filename)
+{
+    char *extension = 0;
+    for(char *at = filename; *at; ++at)
+    {
+        if(*at == '.')
+        {
+            extension = at+1;
+        }
+        else if(*at == '/' || *at == '\\')
+        {
+            extension = 0;
+        }
+    }
+    return extension ? extension : filename + CalculateCStringLength(filename);
+}
+
+static void
+FreeFileData(void *data)
+{
+    free(data);
+}
+
+typedef struct KeywordPrefixTreeNode KeywordPrefixTreeNode;
+struct KeywordPrefixTreeNode
+{
+    char *prefix;
+    int prefix_length;
+    char *value;
+    int value_length;
+    KeywordPrefixTreeNode *have_child;
+    KeywordPrefixTreeNode *no_have_child;
+};
+
+void
+InsertKeywordIntoTree(KeywordPrefixTreeNode **tree, ParseContext *context, char *key, int key_length, char *value, int value_length)
+{
+    KeywordPrefixTreeNode **node_target = tree;
+    for(KeywordPrefixTreeNode *node = *tree;;)
+    {
+        int matching_key_characters = 0;
+        
+        if(node)
+        {
+            for(int i = 0; i < node->prefix_length && i < key_length; ++i)
+            {
+                if(key[i]  == node->prefix[i])
+                {
+                    ++matching_key_characters;
+                }
+                else
+                {
+                    break;
+                }
+            }
+            
+            // NOTE(rjf): We have matching characters, so this is either the node we want, or we want
+            // to allocate a new node on the "have" child.
+            if(matching_key_characters > 0)
+            {
+                if(node->prefix_length <= 1)
+                {
+                    node = node->have_child;
+                    node_target = &node->have_child;
+                }
+                else
+                {
+                    KeywordPrefixTreeNode *new_node = ParseContextAllocateMemory(context, sizeof(*new_node));
+                    new_node->have_child = node;
+                    new_node->no_have_child = 0;
+                    new_node->prefix = key;
+                    new_node->prefix_length = matching_key_characters;
+                    new_node->value = 0;
+                    new_node->value_length = 0;
+                    *node_target = new_node;
+                    node = new_node->no_have_child;
+                    node_target = &new_node->no_have_child;
+                }
+            }
+            
+            // NOTE(rjf): We don't have any matching characters, so move to the no-have child.
+            else
+            {
+                node = node->no_have_child;
+                node_target = &node->no_have_child;
+            }
+        }
+        else
+        {
+            KeywordPrefixTreeNode *new_node = ParseContextAllocateMemory(context, sizeof(*new_node));
+            new_node->have_child = 0;
+            new_node->no_have_child = 0;
+            new_node->prefix = key;
+            new_node->prefix_length = key_length;
+            new_node->value = value;
+            new_node->value_length = value_length;
+            *node_target = new_node;
+            break;
+        }
+    }
+}
+
+int
+GetKeywordValueFromTree(KeywordPrefixTreeNode *tree, char *keyword, int keyword_length, char **value_ptr)
+{
+    int value_length = 0;
+    
+    for(KeywordPrefixTreeNode *node = tree; node;)
+    {
+        int matching_key_characters = 0;
+        
+        for(int i = 0; i < node->prefix_length && i < keyword_length; ++i)
+        {
+            if(keyword[i] == node->prefix[i])
+            {
+                ++matching_key_characters;
+            }
+            else
+            {
+                break;
+            }
+        }
+        
+        if(matching_key_characters == node->prefix_length)
+        {
+            if(matching_key_characters == keyword_length)
+            {
+                if(value_ptr)
+                {
+                    *value_ptr = node->value;
+                    value_length = node->value_length;
+                    break;
+                }
+            }
+            else
+            {
+                node = node->have_child;
+            }
+        }
+        else
+        {
+            node = node->no_have_child;
+        }
+    }
+    
+    return value_length;
+}
+
+KeywordPrefixTreeNode *
+GenerateKeywordPrefixTreeFromFile(ParseContext *context, char *filename)
+{
+    KeywordPrefixTreeNode *root = 0;
+    
+    char *file = LoadEntireFileAndNullTerminate(filename);
+    
+    for(int i = 0; file[i]; ++i)
+    {
+        char *key = 0;
+        int key_length = 0;
+        char *value = 0;
+        int value_length = 0;
+        if(!CharIsSpace(file[i]))
+        {
+            key = file+i+1;
+            for(; key[key_length] != ':'; ++key_length);
+            value = file+i+key_length+1;
+            for(int j = 0; CharIsSpace(file[i+key_length+j]); ++j, ++value);
+            for(; value[value_length] != '\n'; ++value_length);
+            InsertKeywordIntoTree(&root, context, key, key_length, value, value_length);
+        }
+    }
+    
+    FreeFileData(file);
+    
+    return root;
+}
+
+static u64
+HashCString(char *string)
+{
+    return HashStringN(string, CalculateCStringLength(string));
+}
+
+// NOTE(jsn): Compile time of every file in the previous build, keyed by path. It is
+// stored as "<nanoseconds> <bytes> <path>" lines and feeds the cost estimates used to
+// start the most expensive files first. Unless --timings_file says otherwise, it lives in
+// the --source directory, where the walker skips it as a hidden entry.
+#define TIMING_HISTORY_FILE_NAME ".ore_timings"
+
+typedef struct TimingHistoryEntry TimingHistoryEntry;
+struct TimingHistoryEntry
+{
+    u64 hash;
+    char *path;
+    u64 time_ns;
+    u64 size;
+};
+
+typedef struct TimingHistory TimingHistory;
+struct TimingHistory
+{
+    ParseContext context;
+    TimingHistoryEntry *entries;
+    int entry_count;
+    int entry_capacity;
+    u64 total_time_ns;
+    u64 total_size;
+};
+
+static TimingHistoryEntry *
+TimingHistoryGetEntry(TimingHistory *history, char *path, u64 hash)
+{
+    TimingHistoryEntry *result = 0;
+    if(history->entry_capacity)
+    {
+        int mask = history->entry_capacity-1;
+        for(int i = hash & mask;; i = (i+1) & mask)
+        {
+            TimingHistoryEntry *entry = history->entries+i;
+            if(!entry->path || (entry->hash == hash && !strcmp(entry->path, path)))
+            {
+                result = entry;
+                break;
+            }
+        }
+    }
+    return result;
+}
+
+static void
+LoadTimingHistory(TimingHistory *history, char *filename)
+{
+    char *file = LoadEntireFileAndNullTerminate(filename);
+    if(file)
+    {
+        int line_count = 0;
+        for(int i = 0; file[i]; ++i)
+        {
+            line_count += file[i] == '\n';
+        }
+        
+        // NOTE(jsn): Open addressing, kept at most half full.
+        history->entry_capacity = 16;
+        for(; history->entry_capacity < line_count*2; history->entry_capacity <<= 1);
+        history->entries = ParseContextAllocateMemory(&history->context, sizeof(TimingHistoryEntry)*history->entry_capacity);
+        MemorySet(history->entries, 0, sizeof(TimingHistoryEntry)*history->entry_capacity);
+        
+        for(char *line = file; *line;)
+        {
+            char *line_end = line;
+            for(; *line_end && *line_end != '\n'; ++line_end);
+            char *next_line = *line_end ? line_end+1 : line_end;
+            *line_end = 0;
+            
+            unsigned long long time_ns = 0;
+            unsigned long long size = 0;
+            int path_offset = 0;
+            if(sscanf(line, "%llu %llu %n", &time_ns, &size, &path_offset) == 2 && line[path_offset])
+            {
+                char *path = line+path_offset;
+                u64 hash = HashCString(path);
+                TimingHistoryEntry *entry = TimingHistoryGetEntry(history, path, hash);
+                if(!entry->path)
+                {
+                    entry->path = ParseContextAllocateCStringCopy(&history->context, path);
+                    entry->hash = hash;
+                    ++history->entry_count;
+                }
+                entry->time_ns = time_ns;
+                entry->size = size;
+                history->total_time_ns += time_ns;
+                history->total_size += size;
+            }
+            line = next_line;
+        }
+        FreeFileData(file);
+    }
+}
+
+static void
+SaveTimingHistory(char *filename, FileTable *files)
+{
+    int temporary_filename_size = CalculateCStringLength(filename)+5;
+    char *temporary_filename = malloc(temporary_filename_size);
+    snprintf(temporary_filename, temporary_filename_size, "%s.tmp", filename);
+    FILE *file = fopen(temporary_filename, "wb");
+    if(file)
+    {
+        for(int i = 0; i < files->count; ++i)
+        {
+            FileTableEntry *entry = FileTableGetEntry(files, i);
+            if(entry->compile_time_ns)
+            {
+                fprintf(file, "%llu %llu %s\n", (unsigned long long)entry->compile_time_ns,
+                        (unsigned long long)entry->size, entry->path);
+            }
+        }
+        fclose(file);
+        rename(temporary_filename, filename);
+    }
+    free(temporary_filename);
+}
+
+// NOTE(jsn): Recorded compile time when the file was built before; otherwise its size,
+// scaled by the average cost per byte of the previous build so both estimates compare.
+static u64
+EstimateFileCost(TimingHistory *history, char *path, u64 size)
+{
+    u64 cost = size;
+    TimingHistoryEntry *entry = TimingHistoryGetEntry(history, path, HashCString(path));
+    if(entry && entry->path)
+    {
+        cost = entry->time_ns;
+    }
+    else if(history->total_size)
+    {
+        cost = (u64)((double)size * ((double)history->total_time_ns / (double)history->total_size));
+    }
+    return cost;
+}
+
+// NOTE(jsn): Bounded multi-producer/multi-consumer queue connecting the stages of the
+// build pipeline. Each cell carries a sequence number that tells producers and consumers
+// whether the cell is free for their lap around the ring, so pushing and popping only
+// needs a compare-and-swap on the shared position. A full queue makes the producer wait,
+// which is what keeps the walker from running arbitrarily far ahead of the writer.
+//
+// A waiting thread retries a few times, since the other side is usually mid-item, and then
+// parks: consumers on not_empty, producers on not_full. A push wakes one consumer, a pop
+// one producer and a producer signing off every consumer; each bumps the list's generation
+// but only takes the lock when someone is parked there. A waiter reads the generation
+// before its last retry, so a change after that retry can't be missed.
+#define WORK_QUEUE_CAPACITY_DEFAULT 64
+#define WORK_QUEUE_SPIN_COUNT 4
+
+typedef struct WorkQueueWaiters WorkQueueWaiters;
+struct WorkQueueWaiters
+{
+    pthread_cond_t condition;
+    atomic_uint generation;
+    atomic_int count;
+};
+
+typedef struct WorkQueueCell WorkQueueCell;
+struct WorkQueueCell
+{
+    atomic_size_t sequence;
+    void *data;
+};
+
+typedef struct WorkQueue WorkQueue;
+struct WorkQueue
+{
+    WorkQueueCell *cells;
+    size_t mask;
+    atomic_size_t enqueue_position;
+    atomic_size_t dequeue_position;
+    atomic_int producer_count;
+    
+    pthread_mutex_t lock;
+    WorkQueueWaiters not_empty;
+    WorkQueueWaiters not_full;
+};
+
+static void
+WorkQueueInit(WorkQueue *queue, int capacity, int producer_count)
+{
+    // NOTE(jsn): Capacity must be a power of two so positions can be wrapped with a mask.
+    size_t size = 1;
+    for(; size < (size_t)capacity; size <<= 1);
+    queue->cells = malloc(sizeof(WorkQueueCell)*size);
+    queue->mask = size-1;
+    for(size_t i = 0; i < size; ++i)
+    {
+        atomic_init(&queue->cells[i].sequence, i);
+        queue->cells[i].data = 0;
+    }
+    atomic_init(&queue->enqueue_position, 0);
+    atomic_init(&queue->dequeue_position, 0);
+    atomic_init(&queue->producer_count, producer_count);
+    pthread_mutex_init(&queue->lock, 0);
+    WorkQueueWaiters *lists[] = { &queue->not_empty, &queue->not_full };
+    for(int i = 0; i < 2; ++i)
+    {
+        pthread_cond_init(&lists[i]->condition, 0);
+        atomic_init(&lists[i]->generation, 0);
+        atomic_init(&lists[i]->count, 0);
+    }
+}
+
+static void
+WorkQueueRelease(WorkQueue *queue)
+{
+    pthread_cond_destroy(&queue->not_empty.condition);
+    pthread_cond_destroy(&queue->not_full.condition);
+    pthread_mutex_destroy(&queue->lock);
+    free(queue->cells);
+    queue->cells = 0;
+}
+
+static void
+WorkQueueWake(WorkQueue *queue, WorkQueueWaiters *waiters, int wake_all)
+{
+    atomic_thread_fence(memory_order_seq_cst);
+    if(atomic_load_explicit(&waiters->count, memory_order_relaxed))
+    {
+        pthread_mutex_lock(&queue->lock);
+        atomic_fetch_add_explicit(&waiters->generation, 1, memory_order_relaxed);
+        if(wake_all)
+        {
+            pthread_cond_broadcast(&waiters->condition);
+        }
+        else
+        {
+            pthread_cond_signal(&waiters->condition);
+        }
+        pthread_mutex_unlock(&queue->lock);
+    }
+}
+
+static u32
+WorkQueuePrepareWait(WorkQueueWaiters *waiters)
+{
+    atomic_fetch_add_explicit(&waiters->count, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    return atomic_load_explicit(&waiters->generation, memory_order_relaxed);
+}
+
+static void
+WorkQueueCancelWait(WorkQueueWaiters *waiters)
+{
+    atomic_fetch_sub_explicit(&waiters->count, 1, memory_order_relaxed);
+}
+
+static void
+WorkQueueWait(WorkQueue *queue, WorkQueueWaiters *waiters, u32 generation)
+{
+    pthread_mutex_lock(&queue->lock);
+    while(atomic_load_explicit(&waiters->generation, memory_order_relaxed) == generation)
+    {
+        pthread_cond_wait(&waiters->condition, &queue->lock);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    WorkQueueCancelWait(waiters);
+}
+
+static int
+WorkQueueTryPush(WorkQueue *queue, void *data)
+{
+    size_t position = atomic_load_explicit(&queue->enqueue_position, memory_order_relaxed);
+    for(;;)
+    {
+        WorkQueueCell *cell = &queue->cells[position & queue->mask];
+        size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+        if(difference == 0)
+        {
+            if(atomic_compare_exchange_weak_explicit(&queue->enqueue_position, &position, position+1,
+                                                     memory_order_relaxed, memory_order_relaxed))
+            {
+                cell->data = data;
+                atomic_store_explicit(&cell->sequence, position+1, memory_order_release);
+                return 1;
+            }
+        }
+        else if(difference < 0)
+        {
+            return 0;
+        }
+        else
+        {
+            position = atomic_load_explicit(&queue->enqueue_position, memory_order_relaxed);
+        }
+    }
+}
+
+static int
+WorkQueueTryPop(WorkQueue *queue, void **data_ptr)
+{
+    size_t position = atomic_load_explicit(&queue->dequeue_position, memory_order_relaxed);
+    for(;;)
+    {
+        WorkQueueCell *cell = &queue->cells[position & queue->mask];
+        size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t difference = (intptr_t)sequence - (intptr_t)(position+1);
+        if(difference == 0)
+        {
+            if(atomic_compare_exchange_weak_explicit(&queue->dequeue_position, &position, position+1,
+                                                     memory_order_relaxed, memory_order_relaxed))
+            {
+                *data_ptr = cell->data;
+                atomic_store_explicit(&cell->sequence, position+queue->mask+1, memory_order_release);
+                return 1;
+            }
+        }
+        else if(difference < 0)
+        {
+            return 0;
+        }
+        else
+        {
+            position = atomic_load_explicit(&queue->dequeue_position, memory_order_relaxed);
+        }
+    }
+}
+
+static void
+WorkQueuePush(WorkQueue *queue, void *data)
+{
+    if(!WorkQueueTryPush(queue, data))
+    {
+        // NOTE(jsn): Backpressure; shows up as a "queue full" zone in traces.
+        TraceZoneBegin(stall);
+        for(int spin = 0; !WorkQueueTryPush(queue, data); ++spin)
+        {
+            if(spin < WORK_QUEUE_SPIN_COUNT)
+            {
+                sched_yield();
+                continue;
+            }
+            u32 generation = WorkQueuePrepareWait(&queue->not_full);
+            if(WorkQueueTryPush(queue, data))
+            {
+                WorkQueueCancelWait(&queue->not_full);
+                break;
+            }
+            WorkQueueWait(queue, &queue->not_full, generation);
+        }
+        TraceZoneEnd(stall, "queue full", -1);
+    }
+    WorkQueueWake(queue, &queue->not_empty, 0);
+}
+
+// NOTE(jsn): Returns 0 once every producer has finished and the queue is drained.
+static void *
+WorkQueuePop(WorkQueue *queue)
+{
+    void *data = 0;
+    if(WorkQueueTryPop(queue, &data))
+    {
+        WorkQueueWake(queue, &queue->not_full, 0);
+        return data;
+    }
+    
+    // NOTE(jsn): Starved consumer; shows up as a "queue empty" zone in traces.
+    TraceZoneBegin(stall);
+    for(int spin = 0;; ++spin)
+    {
+        int parking = spin >= WORK_QUEUE_SPIN_COUNT;
+        u32 generation = parking ? WorkQueuePrepareWait(&queue->not_empty) : 0;
+        int done = WorkQueueTryPop(queue, &data);
+        if(!done && atomic_load_explicit(&queue->producer_count, memory_order_acquire) == 0)
+        {
+            // NOTE(jsn): A producer may have pushed right before signing off.
+            if(!WorkQueueTryPop(queue, &data))
+            {
+                data = 0;
+            }
+            done = 1;
+        }
+        if(done)
+        {
+            if(parking)
+            {
+                WorkQueueCancelWait(&queue->not_empty);
+            }
+            break;
+        }
+        if(parking)
+        {
+            WorkQueueWait(queue, &queue->not_empty, generation);
+        }
+        else
+        {
+            sched_yield();
+        }
+    }
+    TraceZoneEnd(stall, "queue empty", -1);
+    if(data)
+    {
+        WorkQueueWake(queue, &queue->not_full, 0);
+    }
+    return data;
+}
+
+static void
+WorkQueueProducerDone(WorkQueue *queue)
+{
+    atomic_fetch_sub_explicit(&queue->producer_count, 1, memory_order_acq_rel);
+    WorkQueueWake(queue, &queue->not_empty, 1);
+}
+
+// NOTE(jsn): --cache <dir> and --remote-cache <url>. A content-hash cache of per-file
+// compiles: the key hashes the file's contents together with the compiler build and every
+// option that changes the output (see PipelineHashOptions), and the entry holds everything
+// codegen would have produced for the file. Entries live in <dir>/<key>; with a remote, a
+// local miss asks the remote with GET <url>/<key>, and a compile that missed both is
+// uploaded with PUT <url>/<key>, so machines sharing the remote only compile a given file
+// once.
+// Tools/ore-cache-server.js is a stand-in remote backed by a local directory. A remote
+// that can't be reached is dropped for the rest of the run instead of slowing every file
+// down; the build never fails because of the cache.
+//
+// An entry is a header line, "ore-cache <version> <wasm> <secondary> <c header> <js>\n"
+// with the size of each output, followed by the outputs in that order.
+#define ORE_CACHE_VERSION 1
+#define ORE_CACHE_KEY_SIZE 48
+#define ORE_REMOTE_CACHE_TIMEOUT_S 10
+
+typedef struct RemoteCache RemoteCache;
+struct RemoteCache
+{
+    char host[256];
+    char port[8];
+    char path[1024];
+    atomic_int is_disabled;
+};
+
+typedef struct CompileCache CompileCache;
+struct CompileCache
+{
+    char *directory;
+    int has_remote;
+    RemoteCache remote;
+    u64 options_hash;
+};
+
+// NOTE(jsn): Only plain http://host[:port][/path]; the remote is meant for a build network.
+static int
+RemoteCacheParseURL(RemoteCache *remote, char *url)
+{
+    if(strncmp(url, "http://", 7))
+    {
+        return 0;
+    }
+    char *host = url + 7;
+    int host_length = 0;
+    for(; host[host_length] && host[host_length] != ':' && host[host_length] != '/'; ++host_length);
+    if(!host_length || host_length >= (int)sizeof(remote->host))
+    {
+        return 0;
+    }
+    MemoryCopy(remote->host, host, host_length);
+    remote->host[host_length] = 0;
+
+    char *at = host + host_length;
+    MemoryCopy(remote->port, "80", 3);
+    if(*at == ':')
+    {
+        int port_length = 0;
+        for(++at; at[port_length] >= '0' && at[port_length] <= '9'; ++port_length);
+        if(!port_length || port_length >= (int)sizeof(remote->port))
+        {
+            return 0;
+        }
+        MemoryCopy(remote->port, at, port_length);
+        remote->port[port_length] = 0;
+        at += port_length;
+    }
+    if(*at && *at != '/')
+    {
+        return 0;
+    }
+
+    int path_length = CalculateCStringLength(at);
+    for(; path_length && at[path_length-1] == '/'; --path_length);
+    if(path_length >= (int)sizeof(remote->path))
+    {
+        return 0;
+    }
+    MemoryCopy(remote->path, at, path_length);
+    remote->path[path_length] = 0;
+    return 1;
+}
+
+static int
+RemoteCacheConnect(RemoteCache *remote)
+{
+    struct addrinfo hints = {0};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo *addresses = 0;
+    if(getaddrinfo(remote->host, remote->port, &hints, &addresses))
+    {
+        return -1;
+    }
+
+    int fd = -1;
+    for(struct addrinfo *address = addresses; address && fd < 0; address = address->ai_next)
+    {
+        fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if(fd < 0)
+        {
+            continue;
+        }
+        // NOTE(jsn): On Linux the send timeout also bounds connect.
+        struct timeval timeout = { ORE_REMOTE_CACHE_TIMEOUT_S, 0 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        if(connect(fd, address->ai_addr, address->ai_addrlen))
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addresses);
+    return fd;
+}
+
+static int
+SendEntireBuffer(int fd, char *data, int size)
+{
+    for(int sent = 0; sent < size;)
+    {
+        // NOTE(jsn): A server hanging up mid-request must not SIGPIPE the compiler.
+        ssize_t result = send(fd, data + sent, size - sent, MSG_NOSIGNAL);
+        if(result <= 0)
+        {
+            return 0;
+        }
+        sent += (int)result;
+    }
+    return 1;
+}
+
+// NOTE(jsn): One HTTP/1.0 request per connection, so a response ends where the server
+// closes it. Returns the status code, or 0 when the remote couldn't be reached or the
+// response was cut short. The body of a 200 is returned in body_ptr (malloc'd).
+static int
+RemoteCacheRequest(RemoteCache *remote, char *method, char *key, char *body, int body_size, char **body_ptr, int *body_size_ptr)
+{
+    int fd = RemoteCacheConnect(remote);
+    if(fd < 0)
+    {
+        return 0;
+    }
+
+    char header[2048];
+    int header_size = snprintf(header, sizeof(header),
+                               "%s %s/%s HTTP/1.0\r\nHost: %s\r\nContent-Length: %d\r\nConnection: close\r\n\r\n",
+                               method, remote->path, key, remote->host, body_size);
+    int status = 0;
+    char *response = 0;
+    int response_size = 0;
+    if(SendEntireBuffer(fd, header, header_size) && SendEntireBuffer(fd, body, body_size))
+    {
+        int response_capacity = 0;
+        for(;;)
+        {
+            if(response_size + 4096 + 1 > response_capacity)
+            {
+                response_capacity = response_capacity ? response_capacity*2 : 64*1024;
+                response = realloc(response, response_capacity);
+            }
+            ssize_t received = recv(fd, response + response_size, response_capacity - response_size - 1, 0);
+            if(received <= 0)
+            {
+                status = received == 0 ? -1 : 0;
+                break;
+            }
+            response_size += (int)received;
+        }
+    }
+    close(fd);
+
+    char *response_body = 0;
+    if(status < 0)
+    {
+        response[response_size] = 0;
+        response_body = strstr(response, "\r\n\r\n");
+        int major = 0, minor = 0;
+        if(!response_body || sscanf(response, "HTTP/%d.%d %d", &major, &minor, &status) != 3)
+        {
+            status = 0;
+        }
+        else
+        {
+            response_body += 4;
+            // NOTE(jsn): A response shorter than it said it was is a dropped connection.
+            for(char *line = strstr(response, "\r\n") + 2; line < response_body - 2; line = strstr(line, "\r\n") + 2)
+            {
+                if(!strncasecmp(line, "Content-Length:", 15) &&
+                   atoll(line + 15) != (long long)(response + response_size - response_body))
+                {
+                    status = 0;
+                }
+            }
+        }
+    }
+
+    if(status == 200 && body_ptr)
+    {
+        *body_size_ptr = (int)(response + response_size - response_body);
+        *body_ptr = malloc(*body_size_ptr + 1);
+        MemoryCopy(*body_ptr, response_body, *body_size_ptr);
+    }
+    free(response);
+    return status;
+}
+
+static void
+RemoteCacheDisable(RemoteCache *remote)
+{
+    if(!atomic_exchange(&remote->is_disabled, 1))
+    {
+        fprintf(stderr, "WARNING: remote cache http://%s:%s%s is not responding; not using it for the rest of this build\n",
+                remote->host, remote->port, remote->path);
+    }
+}
+
+static void
+CompileCacheGetKey(CompileCache *cache, ProcessedFile *file, char *key)
+{
+    u64 content_hash = HashStringN(file->file_contents, file->file_size);
+    // NOTE(jsn): The glue names the source file; the module itself doesn't.
+    if(file->output_flags & (OutputFlag_C | OutputFlag_js))
+    {
+        content_hash ^= HashStringN(file->filename, CalculateCStringLength(file->filename)) * 31;
+    }
+    snprintf(key, ORE_CACHE_KEY_SIZE, "%016llx%016llx-%08x", (unsigned long long)cache->options_hash,
+             (unsigned long long)content_hash, (u32)file->file_size);
+}
+
+static char *
+CompileCacheGetEntryPath(CompileCache *cache, char *key)
+{
+    int size = CalculateCStringLength(cache->directory) + ORE_CACHE_KEY_SIZE + 2;
+    char *path = malloc(size);
+    snprintf(path, size, "%s/%s", cache->directory, key);
+    return path;
+}
+
+// NOTE(jsn): Unpacks an entry into the file's outputs. Every output gets its own buffer,
+// so the file is released the same way whether it was compiled or not.
+static int
+CompileCacheUnpackEntry(ProcessedFile *file, char *entry, int entry_size)
+{
+    int version = 0, offset = 0;
+    int sizes[4] = {0};
+    if(sscanf(entry, "ore-cache %d %d %d %d %d\n%n", &version, &sizes[0], &sizes[1], &sizes[2], &sizes[3], &offset) != 5 ||
+       version != ORE_CACHE_VERSION || !offset || sizes[0] <= 0)
+    {
+        return 0;
+    }
+    i64 total_size = offset;
+    for(int i = 0; i < 4; ++i)
+    {
+        if(sizes[i] < 0)
+        {
+            return 0;
+        }
+        total_size += sizes[i];
+    }
+    if(total_size != entry_size)
+    {
+        return 0;
+    }
+
+    char **outputs[4] = { &file->wasm_output_contents, &file->secondary_output_contents, &file->c_header_contents, &file->js_output_contents };
+    int *output_sizes[4] = { &file->wasm_output_size, &file->secondary_output_size, &file->c_header_size, &file->js_output_size };
+    for(int i = 0; i < 4; ++i)
+    {
+        if(sizes[i])
+        {
+            *outputs[i] = malloc(sizes[i]);
+            MemoryCopy(*outputs[i], entry + offset, sizes[i]);
+            *output_sizes[i] = sizes[i];
+            offset += sizes[i];
+        }
+    }
+    return 1;
+}
+
+static char *
+CompileCachePackEntry(ProcessedFile *file, int *size_ptr)
+{
+    char *outputs[4] = { file->wasm_output_contents, file->secondary_output_contents, file->c_header_contents, file->js_output_contents };
+    int sizes[4] =
+    {
+        file->wasm_output_size,
+        file->secondary_output_contents ? file->secondary_output_size : 0,
+        file->c_header_contents ? file->c_header_size : 0,
+        file->js_output_contents ? file->js_output_size : 0,
+    };
+    char header[128];
+    int header_size = snprintf(header, sizeof(header), "ore-cache %d %d %d %d %d\n", ORE_CACHE_VERSION,
+                               sizes[0], sizes[1], sizes[2], sizes[3]);
+    int size = header_size + sizes[0] + sizes[1] + sizes[2] + sizes[3];
+    char *entry = malloc(size);
+    MemoryCopy(entry, header, header_size);
+    for(int i = 0, offset = header_size; i < 4; offset += sizes[i], ++i)
+    {
+        MemoryCopy(entry + offset, outputs[i], sizes[i]);
+    }
+    *size_ptr = size;
+    return entry;
+}
+
+static void
+CompileCacheWriteLocal(CompileCache *cache, char *key, char *entry, int entry_size)
+{
+    // NOTE(jsn): Written aside and renamed into place, so concurrent builds sharing the
+    // directory never read half an entry.
+    char *path = CompileCacheGetEntryPath(cache, key);
+    int path_length = CalculateCStringLength(path);
+    char *temporary_path = malloc(path_length + sizeof(".XXXXXX"));
+    MemoryCopy(temporary_path, path, path_length);
+    MemoryCopy(temporary_path + path_length, ".XXXXXX", sizeof(".XXXXXX"));
+    int fd = mkstemp(temporary_path);
+    if(fd >= 0)
+    {
+        close(fd);
+        if(!WriteEntireFile(temporary_path, entry, entry_size) || rename(temporary_path, path))
+        {
+            unlink(temporary_path);
+        }
+    }
+    free(temporary_path);
+    free(path);
+}
+
+// NOTE(jsn): Fills in the file's outputs from the cache. Returns 0 on a miss.
+static int
+CompileCacheLoad(CompileCache *cache, ProcessedFile *file)
+{
+    char key[ORE_CACHE_KEY_SIZE];
+    CompileCacheGetKey(cache, file, key);
+
+    int is_hit = 0;
+    if(cache->directory)
+    {
+        char *path = CompileCacheGetEntryPath(cache, key);
+        int entry_size = 0;
+        char *entry = LoadEntireFileAndNullTerminateWithSize(path, &entry_size);
+        is_hit = entry && CompileCacheUnpackEntry(file, entry, entry_size);
+        free(entry);
+        free(path);
+    }
+
+    if(!is_hit && cache->has_remote && !atomic_load(&cache->remote.is_disabled))
+    {
+        char *entry = 0;
+        int entry_size = 0;
+        int status = RemoteCacheRequest(&cache->remote, "GET", key, 0, 0, &entry, &entry_size);
+        if(!status)
+        {
+            RemoteCacheDisable(&cache->remote);
+        }
+        else if(entry)
+        {
+            entry[entry_size] = 0;
+            is_hit = CompileCacheUnpackEntry(file, entry, entry_size);
+            if(is_hit)
+            {
+                StatAdd(Stat_CacheRemoteHits, 1);
+                if(cache->directory)
+                {
+                    CompileCacheWriteLocal(cache, key, entry, entry_size);
+                }
+            }
+        }
+        free(entry);
+    }
+
+    StatAdd(is_hit ? Stat_CacheHits : Stat_CacheMisses, 1);
+    LogDebug("Cache %s for %s (%s).", is_hit ? "hit" : "miss", file->filename, key);
+    return is_hit;
+}
+
+static void
+CompileCacheStore(CompileCache *cache, ProcessedFile *file)
+{
+    char key[ORE_CACHE_KEY_SIZE];
+    CompileCacheGetKey(cache, file, key);
+    int entry_size = 0;
+    char *entry = CompileCachePackEntry(file, &entry_size);
+    if(cache->directory)
+    {
+        CompileCacheWriteLocal(cache, key, entry, entry_size);
+    }
+    if(cache->has_remote && !atomic_load(&cache->remote.is_disabled))
+    {
+        int status = RemoteCacheRequest(&cache->remote, "PUT", key, entry, entry_size, 0, 0);
+        if(!status)
+        {
+            RemoteCacheDisable(&cache->remote);
+        }
+        else if(status >= 200 && status < 300)
+        {
+            StatAdd(Stat_CacheUploads, 1);
+        }
+        else
+        {
+            LogDebug("Remote cache refused %s: HTTP %d.", key, status);
+        }
+    }
+    free(entry);
+}
+
+typedef enum PipelineStageType
+{
+    PipelineStage_Walk,
+    PipelineStage_Read,
+    PipelineStage_Parse,
+    PipelineStage_Codegen,
+    PipelineStage_Write,
+    PipelineStage_MAX
+}
+PipelineStageType;
+
+typedef struct Pipeline Pipeline;
+typedef int PipelineStageProc(Pipeline *pipeline, ProcessedFile *file);
+
+typedef struct PipelineStage PipelineStage;
+struct PipelineStage
+{
+    char *name;
+    PipelineStageProc *proc;
+    Pipeline *pipeline;
+    WorkQueue *input;
+    WorkQueue *output;
+    int thread_count;
+    pthread_t *threads;
+};
+
+typedef enum ScheduleMode
+{
+    ScheduleMode_LongestFirst,
+    ScheduleMode_FIFO,
+}
+ScheduleMode;
+
+struct Pipeline
+{
+    char *source_dir_path;
+    OutputFlags output_flags;
+    ScheduleMode schedule_mode;
+    int scheduled_count;
+    int schedule_window;
+    TimingHistory history;
+    char *bundle_path;
+    int optimize_level;
+    int profile_functions;
+    int preinit;
+    char *preinit_tool_path;
+    MemoryPlanOptions memory_options;
+    char *async_imports;
+    int export_allocator;
+    int profile_allocations;
+    u32 stdlib_required;
+    int dump_ir;
+    StringTable *split_startup;
+    CompileCache *cache;
+    WASMModuleBuilder bundle;
+    pthread_mutex_t bundle_mutex;
+    IRFunction **bundle_functions;
+    int bundle_function_capacity;
+    FileTable files;
+    atomic_int error_count;
+    WorkQueue queues[PipelineStage_MAX-1];
+    PipelineStage stages[PipelineStage_MAX];
+};
+
+typedef struct PathBuffer PathBuffer;
+struct PathBuffer
+{
+    char *data;
+    int length;
+    int capacity;
+};
+
+static void
+PathBufferAppend(PathBuffer *path, char *string)
+{
+    int length = CalculateCStringLength(string);
+    if(path->length + length + 1 > path->capacity)
+    {
+        path->capacity = (path->length + length + 1)*2;
+        path->data = realloc(path->data, path->capacity);
+    }
+    MemoryCopy(path->data + path->length, string, length+1);
+    path->length += length;
+}
+
+static void
+PipelineSubmitFile(Pipeline *pipeline, FileTableEntry *entry)
+{
+    ProcessedFile *file = calloc(1, sizeof(*file));
+    file->file_id = entry->id;
+    file->entry = entry;
+    file->filename = entry->path;
+    WorkQueuePush(&pipeline->queues[PipelineStage_Walk], file);
+}
+
+static void
+PipelineReleaseFile(ProcessedFile *file)
+{
+    if(file->wasm_output_contents != file->wasm_file_contents)
+    {
+        free(file->wasm_output_contents);
+    }
+    free(file->secondary_output_contents);
+    free(file->c_header_contents);
+    free(file->js_output_contents);
+    if(time_report.enabled)
+    {
+        TimeReportAddFile(file->filename, file->phase_ns);
+    }
+    FreeFileData(file->file_contents);
+    ParseContextRelease(&file->context);
+    free(file);
+}
+
+static int
+CompareFilesByCostDescending(const void *a, const void *b)
+{
+    FileTableEntry *file_a = *(FileTableEntry **)a;
+    FileTableEntry *file_b = *(FileTableEntry **)b;
+    return (file_a->estimated_cost < file_b->estimated_cost) - (file_a->estimated_cost > file_b->estimated_cost);
+}
+
+// NOTE(jsn): Longest-processing-time-first, in windows: the files found since the last
+// window are fed most expensive first; a huge file picked up last would otherwise decide
+// the wall-clock time of the build on its own. Sorting the whole tree would hold every
+// file back until the walk is done, so the first window is one queue's worth, keeping the
+// workers busy early, and each window after that doubles, up to SCHEDULE_WINDOW_MAX.
+#define SCHEDULE_WINDOW_MAX 8192
+
+static void
+ScheduleFilesLongestFirst(Pipeline *pipeline)
+{
+    int first = pipeline->scheduled_count;
+    int file_count = pipeline->files.count - first;
+    FileTableEntry **order = malloc(sizeof(FileTableEntry *)*(file_count ? file_count : 1));
+    for(int i = 0; i < file_count; ++i)
+    {
+        order[i] = FileTableGetEntry(&pipeline->files, first + i);
+    }
+    QuickSort(order, file_count, sizeof(order[0]), CompareFilesByCostDescending);
+    for(int i = 0; i < file_count; ++i)
+    {
+        PipelineSubmitFile(pipeline, order[i]);
+    }
+    free(order);
+    pipeline->scheduled_count += file_count;
+    if(pipeline->schedule_window < SCHEDULE_WINDOW_MAX)
+    {
+        pipeline->schedule_window *= 2;
+    }
+}
+
+static int
+CompareHistoryEntriesByTimeDescending(const void *a, const void *b)
+{
+    TimingHistoryEntry *entry_a = *(TimingHistoryEntry **)a;
+    TimingHistoryEntry *entry_b = *(TimingHistoryEntry **)b;
+    return (entry_a->time_ns < entry_b->time_ns) - (entry_a->time_ns > entry_b->time_ns);
+}
+
+// NOTE(jsn): Windows only order the files found so far, so an expensive file the walk
+// reaches late would still start late. The timing history already names the expensive
+// files, so the costliest queue's worth of them that still exist under the source
+// directory is submitted before the walk begins. The walker builds the same path strings,
+// so the file table drops these when it finds them again.
+static void
+ScheduleKnownFilesFirst(Pipeline *pipeline)
+{
+    TimingHistory *history = &pipeline->history;
+    int prefix_length = CalculateCStringLength(pipeline->source_dir_path);
+    TimingHistoryEntry **order = malloc(sizeof(TimingHistoryEntry *)*(history->entry_count ? history->entry_count : 1));
+    int order_count = 0;
+    for(int i = 0; i < history->entry_capacity; ++i)
+    {
+        TimingHistoryEntry *entry = history->entries+i;
+        if(entry->path && !strncmp(entry->path, pipeline->source_dir_path, prefix_length) &&
+           entry->path[prefix_length] == '/' && !strstr(entry->path + prefix_length, "/."))
+        {
+            order[order_count++] = entry;
+        }
+    }
+    QuickSort(order, order_count, sizeof(order[0]), CompareHistoryEntriesByTimeDescending);
+    int submit_count = 0;
+    for(int i = 0; i < order_count && submit_count < WORK_QUEUE_CAPACITY_DEFAULT; ++i)
+    {
+        struct stat sb;
+        if(stat(order[i]->path, &sb) == 0 && S_ISREG(sb.st_mode))
+        {
+            FileTableEntry *entry = FileTableAdd(&pipeline->files, order[i]->path, CalculateCStringLength(order[i]->path));
+            if(entry)
+            {
+                entry->size = sb.st_size;
+                entry->estimated_cost = order[i]->time_ns;
+                PipelineSubmitFile(pipeline, entry);
+                ++submit_count;
+            }
+        }
+    }
+    free(order);
+    pipeline->scheduled_count = pipeline->files.count;
+}
+
+// NOTE(jsn): --wasm writes foo.wasm (and foo.secondary.wasm) next to foo.or, so without this
+// the next walk would take the tree's own outputs for prebuilt inputs.
+static int
+IsOutputOfSiblingSource(int directory_fd, char *name)
+{
+    int result = 0;
+    int length = CalculateCStringLength(name);
+    if(length > 5 && CStringMatchCaseInsensitive(name + length - 5, ".wasm"))
+    {
+        int stem_length = length - 5;
+        if(stem_length > 10 && !strncmp(name + stem_length - 10, ".secondary", 10))
+        {
+            stem_length -= 10;
+        }
+        char *source_name = malloc(stem_length + sizeof(".or"));
+        MemoryCopy(source_name, name, stem_length);
+        MemoryCopy(source_name + stem_length, ".or", sizeof(".or"));
+        struct stat sb;
+        result = fstatat(directory_fd, source_name, &sb, 0) == 0 && S_ISREG(sb.st_mode);
+        free(source_name);
+    }
+    return result;
+}
+
+/**
+ * Lists all files and sub-directories recursively 
+ * considering path as base path.
+ */
+void listFilesRecursively(PathBuffer *path, Pipeline *pipeline)
+{
+    struct dirent *dp;
+    DIR *dir = opendir(path->data);
+
+    // Unable to open directory stream
+    if (!dir)
+        return;
+
+    int base_length = path->length;
+    while ((dp = readdir(dir)) != NULL)
+    {
+        // NOTE(jsn): Hidden entries (., .., .git, the timing history, ...) are never sources.
+        if (dp->d_name[0] != '.')
+        {
+            // Construct new path from our base path
+            PathBufferAppend(path, "/");
+            PathBufferAppend(path, dp->d_name);
+            
+            // NOTE(jsn): d_type saves a stat for directories; files still need one for
+            // their size, done relative to the open directory to skip path resolution.
+            int is_directory = dp->d_type == DT_DIR;
+			struct stat sb;
+            if(dp->d_type != DT_DIR && fstatat(dirfd(dir), dp->d_name, &sb, 0) == 0)
             {
-                PushParseError(context, tokenizer, "Malformed tag.");
+                is_directory = S_ISDIR(sb.st_mode);
+                if(S_ISREG(sb.st_mode) && !IsOutputOfSiblingSource(dirfd(dir), dp->d_name))
+                {
+                    FileTableEntry *entry = FileTableAdd(&pipeline->files, path->data, path->length);
+                    if(entry)
+                    {
+                        entry->size = sb.st_size;
+                        entry->estimated_cost = EstimateFileCost(&pipeline->history, entry->path, sb.st_size);
+                        
+                        // NOTE(jsn): In FIFO mode the file goes to the read stage right away, so
+                        // the first outputs can be written while we are still walking the tree.
+                        // LPT holds files back only until a window of them has been found.
+                        if(pipeline->schedule_mode == ScheduleMode_FIFO)
+                        {
+                            PipelineSubmitFile(pipeline, entry);
+                        }
+                        else if(pipeline->files.count - pipeline->scheduled_count >= pipeline->schedule_window)
+                        {
+                            ScheduleFilesLongestFirst(pipeline);
+                        }
+                    }
+                }
+            }
+            if(is_directory)
+            {
+                listFilesRecursively(path,pipeline);
             }
             
+            path->length = base_length;
+            path->data[base_length] = 0;
         }
-        // else if(RequireTokenType(tokenizer, Token_Text, &text))
-        // {
-        //     ExprNode *node = ParseContextAllocateNode(context);
-        //     node->type = ExprNodeType_Text;
-        //     node->string = text.string;
-        //     node->string_length = text.string_length;
-        //     node->text_style_flags = text_style_flags;
-        //     *node_store_target = node;
-        //     node_store_target = &(*node_store_target)->next;
-        // }
-        else if(RequireTokenType(tokenizer, Token_Symbol, &symbol))
+    }
+
+    closedir(dir);
+}
+
+static int
+PipelineReadFile(Pipeline *pipeline, ProcessedFile *file)
+{
+    (void)pipeline;
+    char *filename = file->filename;
+    LogDebug("Processing file \"%s\".", filename);
+    
+    char *extension = GetFileExtension(filename);
+    
+    InputType input_type = InputType_Invalid;
+    if(CStringMatchCaseInsensitive(extension, "or"))
+    {
+        input_type = InputType_OR;
+    }
+    else if(CStringMatchCaseInsensitive(extension, "wasm")){
+        input_type = InputType_WASM;
+    }
+    
+    if(input_type == InputType_Invalid)
+    {
+        fprintf(stderr, "ERROR: input file %s is not a valid file type; Only .wasm and .or are supported\n",filename);
+        return 0;
+    }
+    
+    file->input_type = input_type;
+    TimeBlockBegin(load);
+    file->file_contents = LoadEntireFileAndNullTerminateWithSize(filename, &file->file_size);
+    TimeBlockEnd(load, file->phase_ns, TimePhase_Load);
+    if(!file->file_contents)
+    {
+        fprintf(stderr, "ERROR: could not read input file %s\n",filename);
+        return 0;
+    }
+    file->entry->size = file->file_size;
+    return 1;
+}
+
+static int
+PipelineParseFile(Pipeline *pipeline, ProcessedFile *file)
+{
+    char *filename = file->filename;
+    
+    // NOTE(jsn): Every file gets its own ParseContext, so parse workers never share an
+    // arena and the whole thing can be dropped as soon as the file has been written.
+    TimeBlockBegin(parse);
+    ParseContext context = {0};
+    char *extension = GetFileExtension(filename);
+    int filename_no_extension_length = (int)(extension - filename) - (*extension ? 1 : 0);
+    char *filename_no_extension = ParseContextAllocateCStringCopyN(&context, filename, filename_no_extension_length);
+    char *wasm_output_path = ParseContextAllocateCStringWithSuffix(&context, filename_no_extension, ".wasm");
+    char *c_output_path = ParseContextAllocateCStringWithSuffix(&context, filename_no_extension, ".c");
+    char *js_output_path = ParseContextAllocateCStringWithSuffix(&context, filename_no_extension, ".js");
+    
+    FileProcessData process_data = {0};
+    {
+        process_data.input_type = file->input_type;
+        process_data.output_flags = pipeline->output_flags;
+        process_data.filename_no_extension = filename_no_extension;
+        process_data.wasm_output_path = wasm_output_path;
+        process_data.c_output_path = c_output_path;
+        process_data.js_output_path = js_output_path;
+    }
+    
+    ProcessedFile processed_file = ProcessFile(filename, file->file_contents, &process_data, &context);
+    file->root = processed_file.root;
+    file->wasm_file_contents = processed_file.wasm_file_contents;
+    file->wasm_file_size = file->wasm_file_contents ? file->file_size : 0;
+    file->output_flags = processed_file.output_flags;
+    file->wasm_output_path = processed_file.wasm_output_path;
+    file->c_output_path = processed_file.c_output_path;
+    file->js_output_path = processed_file.js_output_path;
+    file->context = context;
+    TimeBlockEnd(parse, file->phase_ns, TimePhase_Parse);
+    
+    // NOTE(jsn): The parse block includes the token reads timed inside it; they are moved
+    // to the lex row.
+    if(time_report.enabled)
+    {
+        u64 lex_ns = processed_file.lex_ns < file->phase_ns[TimePhase_Parse] ? processed_file.lex_ns : file->phase_ns[TimePhase_Parse];
+        file->phase_ns[TimePhase_Lex] += lex_ns;
+        file->phase_ns[TimePhase_Parse] -= lex_ns;
+    }
+    return 1;
+}
+
+// NOTE(jsn): The frontend half of codegen. It doesn't touch the module, so bundle workers
+// run it before taking the bundle lock.
+static void
+PipelineGenerateIR(Pipeline *pipeline, ProcessedFile *file, IRFunction *function)
+{
+    GenerateIRFromExprTree(function, file->root, file->filename, &file->context);
+    if(pipeline->optimize_level)
+    {
+        IROptimize(function);
+    }
+    if(pipeline->dump_ir)
+    {
+        IRPrint(stderr, file->filename, function);
+    }
+}
+
+// NOTE(jsn): Identifies the compiler build in cache keys, so entries written by an older
+// or newer Ore (locally or on a shared remote) are never taken for this one's. The
+// executable's contents are hashed where it can be read back; elsewhere the build time
+// stands in.
+static u64
+GetCompilerBuildHash(void)
+{
+    u64 hash = 0;
+#if defined(__linux__)
+    int size = 0;
+    char *executable = LoadEntireFileAndNullTerminateWithSize("/proc/self/exe", &size);
+    if(executable)
+    {
+        hash = HashStringN(executable, size);
+        free(executable);
+    }
+#endif
+    if(!hash)
+    {
+        char *build_time = __DATE__ " " __TIME__;
+        hash = HashStringN(build_time, CalculateCStringLength(build_time));
+    }
+    return hash;
+}
+
+// NOTE(jsn): The part of the compile cache key that is the same for every file. Anything
+// that changes what codegen makes of a file belongs in here, including the compiler itself.
+static u64
+PipelineHashOptions(Pipeline *pipeline)
+{
+    char *text = 0;
+    size_t size = 0;
+    FILE *out = open_memstream(&text, &size);
+    if(!out)
+    {
+        return 0;
+    }
+    MemoryPlanOptions *memory = &pipeline->memory_options;
+    fprintf(out, "ore-cache %d\ncompiler %016llx\noutputs %d\noptimize %d\nprofile %d\npreinit %d\n", ORE_CACHE_VERSION,
+            (unsigned long long)GetCompilerBuildHash(), (int)pipeline->output_flags, pipeline->optimize_level,
+            pipeline->profile_functions, pipeline->preinit);
+    fprintf(out, "memory %u %u %u %u\nallocator %d %d\nstdlib %u\nasync %s\n", memory->stack_size, memory->async_stack_size,
+            memory->heap_size, memory->max_memory, pipeline->export_allocator, pipeline->profile_allocations,
+            pipeline->stdlib_required, pipeline->async_imports ? pipeline->async_imports : "");
+    if(pipeline->split_startup)
+    {
+        for(int i = 0; i < pipeline->split_startup->count; ++i)
         {
-            if(TokenMatch(symbol, "*"))
+            fprintf(out, "split %s\n", StringTableGetString(pipeline->split_startup, i));
+        }
+    }
+    fclose(out);
+    u64 hash = HashStringN(text, (int)size);
+    free(text);
+    return hash;
+}
+
+static void
+ReplacePrebuiltOutput(ProcessedFile *file, char *contents, int size)
+{
+    if(file->wasm_output_contents != file->wasm_file_contents)
+    {
+        free(file->wasm_output_contents);
+    }
+    file->wasm_output_contents = contents;
+    file->wasm_output_size = size;
+}
+
+// NOTE(jsn): --preinit for a prebuilt module, which is otherwise passed through untouched.
+// Its start function goes through PreinitModule the same way a generated one does, and the
+// result replaces the input when the start function was evaluated away; a start function
+// that can't be evaluated leaves the module as it was.
+static void
+PreinitPrebuiltModule(Pipeline *pipeline, ProcessedFile *file)
+{
+    u32 size = 0;
+    u32 start_index = 0;
+    char *binary = CopyWASMWithoutStart(file->wasm_output_contents, (u32)file->wasm_output_size, &size, &start_index);
+    if(binary)
+    {
+        WASMModuleBuilder builder = {0};
+        builder.module = BinaryenModuleRead(binary, size);
+        builder.preinit_tool_path = pipeline->preinit_tool_path;
+        BinaryenModuleSetFeatures(builder.module, BinaryenFeatureAll());
+        if(start_index < BinaryenGetNumFunctions(builder.module))
+        {
+            BinaryenFunctionRef function = BinaryenGetFunctionByIndex(builder.module, start_index);
+            BinaryenAddFunctionExport(builder.module, BinaryenFunctionGetName(function), ORE_PREINIT_EXPORT);
+            BinaryenModuleRef preinitialized = PreinitModule(&builder);
+            if(preinitialized != builder.module)
             {
-                //multiply
+                BinaryenModuleAllocateAndWriteResult written = BinaryenModuleAllocateAndWrite(preinitialized, 0);
+                free(written.sourceMap);
+                u32 ignored_size = 0;
+                char *still_starts = CopyWASMWithoutStart(written.binary, (u32)written.binaryBytes, &ignored_size, &start_index);
+                if(still_starts)
+                {
+                    free(still_starts);
+                    free(written.binary);
+                }
+                else
+                {
+                    ReplacePrebuiltOutput(file, written.binary, (int)written.binaryBytes);
+                    LogDebug("--preinit: evaluated the start function of %s", file->filename);
+                }
+                BinaryenModuleDispose(preinitialized);
             }
-            else if(TokenMatch(symbol, "|"))
+        }
+        BinaryenModuleDispose(builder.module);
+        free(binary);
+    }
+}
+
+// NOTE(jsn): --async-import for a prebuilt module that imports one of the async functions.
+// Its memory layout is its own, so the unwind buffer gets new pages past the memory's
+// initial size; memory.grow hands out pages after those. A module whose allocator assumes
+// it owns everything up to memory.size would reuse them, and needs a build of its own that
+// leaves room. A module that imports its memory or has no room to grow it is left as it was,
+// and so is one that is already asyncified, such as the output of an earlier build.
+static void
+AsyncifyPrebuiltModule(Pipeline *pipeline, ProcessedFile *file)
+{
+    WASMModuleBuilder builder = {0};
+    builder.module = BinaryenModuleRead(file->wasm_output_contents, file->wasm_output_size);
+    builder.async_imports = pipeline->async_imports;
+    BinaryenModuleSetFeatures(builder.module, BinaryenFeatureAll());
+    int is_asyncified = 0;
+    for(BinaryenIndex i = 0; i < BinaryenGetNumExports(builder.module); ++i)
+    {
+        is_asyncified |= !strcmp(BinaryenExportGetName(BinaryenGetExportByIndex(builder.module, i)), "asyncify_start_unwind");
+    }
+    if(!is_asyncified && ModuleImportsAsyncFunction(&builder))
+    {
+        u32 flags = 0;
+        u32 initial = 0;
+        u32 maximum = 0;
+        u32 buffer_pages = GetPageCount(AlignRegion(pipeline->memory_options.async_stack_size));
+        if(!ReadWASMMemoryLimits(file->wasm_output_contents, (u32)file->wasm_output_size, &flags, &initial, &maximum) ||
+           initial + buffer_pages > ((flags & 1) ? maximum : WASM_MAX_PAGES))
+        {
+            fprintf(stderr, "WARNING: %s: no room in its own memory for the --async-import unwind buffer; left as it was\n",
+                    file->filename);
+        }
+        else
+        {
+            // NOTE(jsn): Tools/ore-async.js finds the buffer through the "memory" export.
+            int exports_memory = 0;
+            for(BinaryenIndex i = 0; i < BinaryenGetNumExports(builder.module); ++i)
             {
-                //or
+                BinaryenExportRef export = BinaryenGetExportByIndex(builder.module, i);
+                exports_memory |= BinaryenExportGetKind(export) == BinaryenExternalMemory() && !strcmp(BinaryenExportGetName(export), "memory");
             }
-            else if(TokenMatch(symbol, "`"))
+            BinaryenSetMemory(builder.module, initial + buffer_pages, (flags & 1) ? maximum : 0xFFFFFFFF, exports_memory ? 0 : "memory",
+                              0, 0, 0, 0, 0, (flags & 2) != 0);
+            
+            u32 buffer_base = initial*WASM_PAGE_SIZE;
+            const char *passes[] = { "asyncify" };
+            BinaryenModuleRunPasses(builder.module, passes, 1);
+            BinaryenAddGlobal(builder.module, "__ore_async_buffer", BinaryenTypeInt32(), 0, BinaryenConst(builder.module, BinaryenLiteralInt32(buffer_base)));
+            BinaryenAddGlobal(builder.module, "__ore_async_buffer_end", BinaryenTypeInt32(), 0,
+                              BinaryenConst(builder.module, BinaryenLiteralInt32(buffer_base + buffer_pages*WASM_PAGE_SIZE)));
+            BinaryenAddGlobalExport(builder.module, "__ore_async_buffer", "__ore_async_buffer");
+            BinaryenAddGlobalExport(builder.module, "__ore_async_buffer_end", "__ore_async_buffer_end");
+            if(BinaryenModuleValidate(builder.module))
             {
-                //String
+                BinaryenModuleAllocateAndWriteResult written = BinaryenModuleAllocateAndWrite(builder.module, 0);
+                free(written.sourceMap);
+                ReplacePrebuiltOutput(file, written.binary, (int)written.binaryBytes);
             }
             else
             {
-                PushParseError(context, tokenizer, "Unexpected symbol '%.*s'", symbol.string_length,
-                               symbol.string);
+                fprintf(stderr, "WARNING: %s: asyncified module failed validation; left as it was\n", file->filename);
             }
         }
-        else if(RequireTokenType(tokenizer, Token_DoubleNewline, &text))
+    }
+    BinaryenModuleDispose(builder.module);
+}
+
+static int
+PipelineGenerateCode(Pipeline *pipeline, ProcessedFile *file)
+{
+    if(file->context.error_stack_size > 0)
+    {
+        return 1;
+    }
+    
+    if(pipeline->bundle_path)
+    {
+        if(file->root)
         {
-            // ExprNode *node = ParseContextAllocateNode(context);
-            // node->type = ExprNodeType_ParagraphBreak;
-            // node->string = 0;
-            // node->string_length = 0;
-            // node->text_style_flags = text_style_flags;
-            // *node_store_target = node;
-            // node_store_target = &(*node_store_target)->next;
+            // NOTE(jsn): Files get here in whatever order the workers finish them, so only
+            // the IR is built here; PipelineLinkBundle lowers it in path order.
+            TimeBlockBegin(codegen);
+            IRFunction *function = calloc(1, sizeof(*function));
+            PipelineGenerateIR(pipeline, file, function);
+            IRFunctionOwnStrings(function);
+            pthread_mutex_lock(&pipeline->bundle_mutex);
+            if(file->file_id >= pipeline->bundle_function_capacity)
+            {
+                int capacity = pipeline->bundle_function_capacity ? pipeline->bundle_function_capacity : 64;
+                while(file->file_id >= capacity)
+                {
+                    capacity *= 2;
+                }
+                pipeline->bundle_functions = realloc(pipeline->bundle_functions, sizeof(IRFunction *)*capacity);
+                MemorySet(pipeline->bundle_functions + pipeline->bundle_function_capacity, 0,
+                          sizeof(IRFunction *)*(capacity - pipeline->bundle_function_capacity));
+                pipeline->bundle_function_capacity = capacity;
+            }
+            pipeline->bundle_functions[file->file_id] = function;
+            pthread_mutex_unlock(&pipeline->bundle_mutex);
+            TimeBlockEnd(codegen, file->phase_ns, TimePhase_Codegen);
+        }
+        else if(file->wasm_file_contents)
+        {
+            fprintf(stderr, "ERROR: %s: prebuilt .wasm modules cannot be linked into a bundle\n", file->filename);
+            atomic_fetch_add_explicit(&pipeline->error_count, 1, memory_order_relaxed);
+        }
+    }
+    else if(file->output_flags & OutputFlag_WASM)
+    {
+        // NOTE(jsn): A cache hit fills in every output codegen would have made.
+        TimeBlockBegin(cache);
+        int is_cached = file->root && pipeline->cache && CompileCacheLoad(pipeline->cache, file);
+        TimeBlockEnd(cache, file->phase_ns, TimePhase_Codegen);
+        if(file->root && !is_cached)
+        {
+            TimeBlockBegin(codegen);
+            WASMModuleBuilder builder = {0};
+            WASMModuleBuilderInit(&builder);
+            builder.profile_functions = pipeline->profile_functions;
+            builder.memory_options = pipeline->memory_options;
+            builder.async_imports = pipeline->async_imports;
+            builder.export_allocator = pipeline->export_allocator;
+            builder.profile_allocations = pipeline->profile_allocations;
+            builder.stdlib_required = pipeline->stdlib_required;
+            builder.split_startup = pipeline->split_startup;
+            builder.preinit = pipeline->preinit;
+            builder.preinit_tool_path = pipeline->preinit_tool_path;
+            IRFunction function = {0};
+            PipelineGenerateIR(pipeline, file, &function);
+            GenerateWASMFromIR(&builder, &function, file->file_id, file->filename, &file->context);
+            IRFunctionRelease(&function);
+            TimeBlockEnd(codegen, file->phase_ns, TimePhase_Codegen);
+            if(file->context.error_stack_size == 0)
+            {
+                file->wasm_output_contents = WASMModuleBuilderFinish(&builder, 0, pipeline->optimize_level, file->file_id, file->phase_ns,
+                                                                     &file->wasm_output_size);
+                if(!file->wasm_output_contents)
+                {
+                    fprintf(stderr, "ERROR: %s: generated module failed validation\n", file->filename);
+                }
+                else
+                {
+                    file->secondary_output_contents = builder.secondary_output;
+                    file->secondary_output_size = builder.secondary_output_size;
+                    builder.secondary_output = 0;
+                    if(builder.memory_options.report)
+                    {
+                        MemoryPlanPrint(stderr, file->filename, &builder.memory_plan);
+                    }
+                    
+                    char *wasm_name = strrchr(file->wasm_output_path, '/') ? strrchr(file->wasm_output_path, '/') + 1 : file->wasm_output_path;
+                    if(file->output_flags & OutputFlag_C)
+                    {
+                        file->c_header_contents = WriteSharedBufferCHeader(&builder, file->filename, wasm_name, &file->c_header_size);
+                    }
+                    if(file->output_flags & OutputFlag_js)
+                    {
+                        file->js_output_contents = WriteSharedBufferJSGlue(&builder, file->filename, wasm_name, &file->js_output_size);
+                    }
+                    if(pipeline->cache)
+                    {
+                        CompileCacheStore(pipeline->cache, file);
+                    }
+                }
+            }
+            WASMModuleBuilderRelease(&builder);
         }
-        
-        token = PeekToken(tokenizer);
-        
-        if(context->error_stack_size > 0)
+        else if(file->wasm_file_contents)
         {
-            break;
+            file->wasm_output_contents = file->wasm_file_contents;
+            file->wasm_output_size = file->wasm_file_size;
+            if(pipeline->preinit)
+            {
+                PreinitPrebuiltModule(pipeline, file);
+            }
+            if(pipeline->async_imports)
+            {
+                AsyncifyPrebuiltModule(pipeline, file);
+            }
         }
     }
     
-    return result;
+    if(file->output_flags & OutputFlag_C)
+    {
+        // @TODO: jsn
+    }
+    
+    if(file->output_flags & OutputFlag_js)
+    {
+        // @TODO: jsn
+    }
+    return 1;
 }
 
-typedef struct FileProcessData FileProcessData;
-struct FileProcessData
+static int
+CompareFilesByPath(const void *a, const void *b)
 {
-    InputType input_type;
-    OutputFlags output_flags;
-    char *filename_no_extension;
-    char *wasm_output_path;
-    char *c_output_path;
-    char *js_output_path;
-};
+    FileTableEntry *file_a = *(FileTableEntry **)a;
+    FileTableEntry *file_b = *(FileTableEntry **)b;
+    return strcmp(file_a->path, file_b->path);
+}
 
-typedef struct ProcessedFile ProcessedFile;
-struct ProcessedFile
+// NOTE(jsn): Lowers every file's IR into the bundle once the whole tree has been through
+// codegen. Going by path, rather than by the order the workers finished in, puts globals,
+// exports and data segments in the same order on every run, so the same tree always makes
+// the same bytes.
+static void
+PipelineLinkBundle(Pipeline *pipeline, u64 *phase_ns)
 {
-    ExprNode *root;
-    char* wasm_file_contents;
-
-    // File Data
-    char *filename;
-	
-    int date_year;
-    int date_month;
-    int date_day;
-    
-    // General Input/Output Data
-    InputType input_type;
-    OutputFlags output_flags;
+    TimeBlockBegin(codegen);
+    FileTableEntry **order = malloc(sizeof(FileTableEntry *)*(pipeline->bundle_function_capacity + 1));
+    int file_count = 0;
+    for(int i = 0; i < pipeline->bundle_function_capacity && i < pipeline->files.count; ++i)
+    {
+        if(pipeline->bundle_functions[i])
+        {
+            order[file_count++] = FileTableGetEntry(&pipeline->files, i);
+        }
+    }
+    QuickSort(order, file_count, sizeof(order[0]), CompareFilesByPath);
     
-    // Wasm Output
-    char *wasm_output_path;
-    FILE *wasm_output_file;
+    for(int i = 0; i < file_count; ++i)
+    {
+        IRFunction *function = pipeline->bundle_functions[order[i]->id];
+        ParseContext context = {0};
+        GenerateWASMFromIR(&pipeline->bundle, function, order[i]->id, order[i]->path, &context);
+        for(int j = 0; j < context.error_stack_size; ++j)
+        {
+            fprintf(stderr, "Parse Error (%s:%i): %s\n", context.error_stack[j].file, context.error_stack[j].line,
+                    context.error_stack[j].message);
+        }
+        atomic_fetch_add_explicit(&pipeline->error_count, context.error_stack_size, memory_order_relaxed);
+        ParseContextRelease(&context);
+    }
     
-    // @TODO: Other Formats
-    char *c_output_path;
-    FILE *c_output_file;
-    char *js_output_path;
-    FILE *js_output_file;
-};
-static const char* GetExprType(ExprType type){
-    switch (type)
+    for(int i = 0; i < pipeline->bundle_function_capacity; ++i)
     {
-    case ExprType_Var:
-        return "Var";
-    case ExprType_Const:
-        return "Const";
-    case ExprType_Func:
-        return "Func";
-    default:
-        return "Invalid";
+        if(pipeline->bundle_functions[i])
+        {
+            IRFunctionRelease(pipeline->bundle_functions[i]);
+            free(pipeline->bundle_functions[i]);
+        }
     }
+    free(pipeline->bundle_functions);
+    pipeline->bundle_functions = 0;
+    pipeline->bundle_function_capacity = 0;
+    free(order);
+    TimeBlockEnd(codegen, phase_ns, TimePhase_Codegen);
 }
+
+// NOTE(jsn): An output that can't be written fails the build, as a parse error would.
 static void
-OutputWASMFromPageNodeTreeToFile(ExprNode *node, FILE *file, int follow_next, ProcessedFile *files, int file_count)
+PipelineWriteOutput(Pipeline *pipeline, char *path, void *data, int size)
 {
-    ExprNode *previous_node = 0;
-    
-    for(; node; previous_node = node, node = node->next)
+    if(WriteEntireFile(path, data, size))
     {
-        Log("%s",GetExprType(node->type));
-        int i =0;
-        while(i <= node->tokens_length){
-            if(node->tokens[i].string_length > 0)
-                Log("%s",node->tokens[i].string);
-            i++;
-        }
+        StatAdd(Stat_OutputFiles, 1);
+        StatAdd(Stat_OutputBytes, size);
+    }
+    else
+    {
+        fprintf(stderr, "ERROR: could not write %s\n", path);
+        atomic_fetch_add_explicit(&pipeline->error_count, 1, memory_order_relaxed);
     }
 }
-static ProcessedFile
-ProcessFile(char *filename, char *file, FileProcessData *process_data, ParseContext *context)
+
+static int
+PipelineWriteFile(Pipeline *pipeline, ProcessedFile *file)
 {
-    ProcessedFile processed_file = {0};
-    processed_file.filename = filename;
-    processed_file.output_flags = process_data->output_flags;
-    
-    if(process_data->input_type == InputType_WASM)
+    ParseContext *context = &file->context;
+    if(context->error_stack_size > 0)
     {
-        processed_file.wasm_file_contents = file;
+        for(int i = 0; i < context->error_stack_size; ++i)
+        {
+            fprintf(stderr, "Parse Error (%s:%i): %s\n",
+                    context->error_stack[i].file,
+                    context->error_stack[i].line,
+                    context->error_stack[i].message);
+        }
+        atomic_fetch_add_explicit(&pipeline->error_count, context->error_stack_size, memory_order_relaxed);
     }
-    else if(process_data->input_type == InputType_OR)
+    else
     {
-        Tokenizer tokenizer_ = {0};
-        Tokenizer *tokenizer = &tokenizer_;
-        tokenizer->at = file;
-        tokenizer->line = 1;
-        tokenizer->file = filename;
+        TimeBlockBegin(write);
+        // NOTE(jsn): A prebuilt module passed through unchanged would only be written back
+        // over itself; one changed by --preinit replaces it.
+        int is_own_input = file->input_type == InputType_WASM && file->wasm_output_path &&
+            CStringMatchCaseInsensitive(file->wasm_output_path, file->filename) &&
+            file->wasm_output_contents == file->wasm_file_contents;
+        if(file->wasm_output_path && file->wasm_output_contents && !is_own_input)
+        {
+            PipelineWriteOutput(pipeline, file->wasm_output_path, file->wasm_output_contents, file->wasm_output_size);
+        }
         
-        ExprNode *page = ParseText(context, tokenizer);
-        processed_file.root = page;
+        if(file->wasm_output_path && file->secondary_output_contents)
+        {
+            char *secondary_path = GetSecondaryModulePath(file->wasm_output_path);
+            PipelineWriteOutput(pipeline, secondary_path, file->secondary_output_contents, file->secondary_output_size);
+            free(secondary_path);
+        }
+        
+        if(file->c_output_path)
+        {
+            PipelineWriteOutput(pipeline, file->c_output_path, "", 0);
+            
+            // NOTE(jsn): The interface header goes next to the C output, as <name>.h.
+            if(file->c_header_contents)
+            {
+                char header_path[4096];
+                int length = CalculateCStringLength(file->c_output_path);
+                snprintf(header_path, sizeof(header_path), "%.*s.h", length - 2, file->c_output_path);
+                PipelineWriteOutput(pipeline, header_path, file->c_header_contents, file->c_header_size);
+            }
+        }
+        
+        // NOTE(jsn): A prebuilt foo.wasm next to foo.or shares its output paths; it must not
+        // clobber the glue generated for foo.or.
+        if(file->js_output_path && file->input_type == InputType_OR)
+        {
+            PipelineWriteOutput(pipeline, file->js_output_path, file->js_output_contents ? file->js_output_contents : "",
+                                file->js_output_contents ? file->js_output_size : 0);
+        }
+        TimeBlockEnd(write, file->phase_ns, TimePhase_Write);
     }
     
-    if(process_data->output_flags & OutputFlag_WASM)
+    return 1;
+}
+
+static void *
+PipelineStageThread(void *data)
+{
+    PipelineStage *stage = data;
+    Pipeline *pipeline = stage->pipeline;
+    int is_compile_stage = (stage == pipeline->stages+PipelineStage_Parse ||
+                            stage == pipeline->stages+PipelineStage_Codegen);
+    TraceSetThreadName(stage->name);
+    
+    if(stage->input)
     {
-        processed_file.wasm_output_path = ParseContextAllocateCStringCopy(context, process_data->wasm_output_path);
-        processed_file.wasm_output_file = fopen(process_data->wasm_output_path, "wb");
+        for(ProcessedFile *file = WorkQueuePop(stage->input); file; file = WorkQueuePop(stage->input))
+        {
+            u64 start_time = is_compile_stage ? GetTimeNanoseconds() : 0;
+            TraceZoneBegin(stage);
+            int keep = stage->proc(pipeline, file);
+            TraceZoneEnd(stage, stage->name, file->file_id);
+            if(is_compile_stage)
+            {
+                file->entry->compile_time_ns += GetTimeNanoseconds() - start_time;
+            }
+            if(keep && stage->output)
+            {
+                WorkQueuePush(stage->output, file);
+            }
+            else
+            {
+                PipelineReleaseFile(file);
+            }
+        }
     }
-    
-    if(process_data->output_flags & OutputFlag_C)
+    else if(pipeline->source_dir_path)
     {
-        processed_file.c_output_path = ParseContextAllocateCStringCopy(context, process_data->c_output_path);
-        processed_file.c_output_file = fopen(process_data->c_output_path, "wb");
+        u64 walk_phase_ns[TimePhase_MAX] = {0};
+        TimeBlockBegin(walk);
+        TraceZoneBegin(walk);
+        PathBuffer path = {0};
+        PathBufferAppend(&path, pipeline->source_dir_path);
+        pipeline->schedule_window = WORK_QUEUE_CAPACITY_DEFAULT;
+        if(pipeline->schedule_mode == ScheduleMode_LongestFirst)
+        {
+            ScheduleKnownFilesFirst(pipeline);
+        }
+        listFilesRecursively(&path, pipeline);
+        free(path.data);
+        TraceZoneEnd(walk, "walk", -1);
+        TimeBlockEnd(walk, walk_phase_ns, TimePhase_Walk);
+        if(time_report.enabled)
+        {
+            TimeReportAddPhases(walk_phase_ns);
+        }
+        if(pipeline->schedule_mode == ScheduleMode_LongestFirst)
+        {
+            TraceZoneBegin(schedule);
+            ScheduleFilesLongestFirst(pipeline);
+            TraceZoneEnd(schedule, "schedule", -1);
+        }
     }
     
-    if(process_data->output_flags & OutputFlag_js)
+    if(stage->output)
     {
-        processed_file.js_output_path = ParseContextAllocateCStringCopy(context, process_data->js_output_path);
-        processed_file.js_output_file = fopen(process_data->js_output_path, "wb");
+        WorkQueueProducerDone(stage->output);
     }
-    
-    return processed_file;
+    LogFlush();
+    AllocProfileFlush();
+    return 0;
 }
 
-static char *
-LoadEntireFileAndNullTerminate(char *filename)
+static int
+GetDefaultJobCount(void)
 {
-    char *result = 0;
-    FILE *file = fopen(filename, "rb");
-    if(file)
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+}
+
+static void
+RunPipeline(Pipeline *pipeline, int job_count)
+{
+    static char *stage_names[PipelineStage_MAX] = { "walk", "read", "parse", "codegen", "write" };
+    static PipelineStageProc *stage_procs[PipelineStage_MAX] =
     {
-        fseek(file, 0, SEEK_END);
-        int file_size = ftell(file);
-        fseek(file, 0, SEEK_SET);
-        result = malloc(file_size+1);
-        if(result)
+        0,
+        PipelineReadFile,
+        PipelineParseFile,
+        PipelineGenerateCode,
+        PipelineWriteFile,
+    };
+    
+    // NOTE(jsn): Walking, reading and writing are I/O bound and stay on one thread each;
+    // parsing and code generation are spread over the job count.
+    int thread_counts[PipelineStage_MAX] = { 1, 1, job_count, job_count, 1 };
+    
+    for(int i = 0; i < PipelineStage_MAX; ++i)
+    {
+        PipelineStage *stage = pipeline->stages+i;
+        stage->name = stage_names[i];
+        stage->proc = stage_procs[i];
+        stage->pipeline = pipeline;
+        stage->thread_count = thread_counts[i];
+        stage->input = i > 0 ? &pipeline->queues[i-1] : 0;
+        stage->output = i < PipelineStage_MAX-1 ? &pipeline->queues[i] : 0;
+        if(stage->output)
         {
-            fread(result, 1, file_size, file);
-            result[file_size] = 0;
+            WorkQueueInit(stage->output, WORK_QUEUE_CAPACITY_DEFAULT, stage->thread_count);
         }
     }
-    return result;
+    
+    for(int i = 0; i < PipelineStage_MAX; ++i)
+    {
+        PipelineStage *stage = pipeline->stages+i;
+        stage->threads = malloc(sizeof(pthread_t)*stage->thread_count);
+        for(int j = 0; j < stage->thread_count; ++j)
+        {
+            pthread_create(stage->threads+j, 0, PipelineStageThread, stage);
+        }
+    }
+    
+    for(int i = 0; i < PipelineStage_MAX; ++i)
+    {
+        PipelineStage *stage = pipeline->stages+i;
+        for(int j = 0; j < stage->thread_count; ++j)
+        {
+            pthread_join(stage->threads[j], 0);
+        }
+        free(stage->threads);
+        stage->threads = 0;
+    }
+    
+    for(int i = 0; i < PipelineStage_MAX-1; ++i)
+    {
+        WorkQueueRelease(&pipeline->queues[i]);
+    }
 }
 
-static void
-FreeFileData(void *data)
+// NOTE(jsn): Reads the header of a dumped --profile-functions buffer, checking that the
+// events and names it describes fit in the dump.
+static int
+ProfileDumpReadHeader(char *dump, int dump_size, u32 *header)
 {
-    free(data);
+    if(dump_size < ORE_PROFILE_HEADER_SIZE)
+    {
+        return 0;
+    }
+    MemoryCopy(header, dump, 4*sizeof(u32));
+    u32 capacity = header[1];
+    return capacity && (u64)ORE_PROFILE_HEADER_SIZE + (u64)capacity*ORE_PROFILE_EVENT_SIZE <= (u64)dump_size &&
+        (u64)header[2] + header[3] <= (u64)dump_size;
 }
 
-typedef struct KeywordPrefixTreeNode KeywordPrefixTreeNode;
-struct KeywordPrefixTreeNode
+// NOTE(jsn): --profile-collapse turns a dumped --profile-functions buffer into collapsed
+// stacks ("a;b;c <self ns>" per line), the input format of flamegraph.pl and speedscope.
+// Events are replayed against a call stack; an exit pops frames until it finds its own,
+// which also covers exits the instrumentation couldn't record and a ring that wrapped.
+typedef struct ProfileFrame ProfileFrame;
+struct ProfileFrame
 {
-    char *prefix;
-    int prefix_length;
-    char *value;
-    int value_length;
-    KeywordPrefixTreeNode *have_child;
-    KeywordPrefixTreeNode *no_have_child;
+    u32 function_id;
+    double enter_ms;
+    double child_ms;
+    int path_length;
 };
 
-void
-InsertKeywordIntoTree(KeywordPrefixTreeNode **tree, ParseContext *context, char *key, int key_length, char *value, int value_length)
+static int
+ProfileCollapse(char *dump_path, char *output_path)
 {
-    KeywordPrefixTreeNode **node_target = tree;
-    for(KeywordPrefixTreeNode *node = *tree;;)
+    int dump_size = 0;
+    char *dump = LoadEntireFileAndNullTerminateWithSize(dump_path, &dump_size);
+    if(!dump)
     {
-        int matching_key_characters = 0;
-        
-        if(node)
-        {
-            for(int i = 0; i < node->prefix_length && i < key_length; ++i)
-            {
-                if(key[i]  == node->prefix[i])
-                {
-                    ++matching_key_characters;
-                }
-                else
-                {
-                    break;
-                }
-            }
-            
-            // NOTE(rjf): We have matching characters, so this is either the node we want, or we want
-            // to allocate a new node on the "have" child.
-            if(matching_key_characters > 0)
-            {
-                if(node->prefix_length <= 1)
-                {
-                    node = node->have_child;
-                    node_target = &node->have_child;
-                }
-                else
-                {
-                    KeywordPrefixTreeNode *new_node = ParseContextAllocateMemory(context, sizeof(*new_node));
-                    new_node->have_child = node;
-                    new_node->no_have_child = 0;
-                    new_node->prefix = key;
-                    new_node->prefix_length = matching_key_characters;
-                    new_node->value = 0;
-                    new_node->value_length = 0;
-                    *node_target = new_node;
-                    node = new_node->no_have_child;
-                    node_target = &new_node->no_have_child;
-                }
-            }
-            
-            // NOTE(rjf): We don't have any matching characters, so move to the no-have child.
-            else
-            {
-                node = node->no_have_child;
-                node_target = &node->no_have_child;
-            }
-        }
-        else
-        {
-            KeywordPrefixTreeNode *new_node = ParseContextAllocateMemory(context, sizeof(*new_node));
-            new_node->have_child = 0;
-            new_node->no_have_child = 0;
-            new_node->prefix = key;
-            new_node->prefix_length = key_length;
-            new_node->value = value;
-            new_node->value_length = value_length;
-            *node_target = new_node;
-            break;
+        fprintf(stderr, "ERROR: could not read profile dump %s\n", dump_path);
+        return 0;
+    }
+    
+    u32 header[4];
+    if(!ProfileDumpReadHeader(dump, dump_size, header))
+    {
+        fprintf(stderr, "ERROR: %s is not a profile dump\n", dump_path);
+        free(dump);
+        return 0;
+    }
+    u32 event_count = header[0];
+    u32 capacity = header[1];
+    u32 names_offset = header[2];
+    u32 names_size = header[3];
+    
+    // NOTE(jsn): Names are newline-terminated; terminate them in place.
+    int name_count = 0;
+    char **names = malloc(sizeof(char *)*(names_size+1));
+    char *names_at = dump + names_offset;
+    for(u32 i = 0, start = 0; i < names_size; ++i)
+    {
+        if(names_at[i] == '\n')
+        {
+            names_at[i] = 0;
+            names[name_count++] = names_at + start;
+            start = i+1;
         }
     }
-}
-
-int
-GetKeywordValueFromTree(KeywordPrefixTreeNode *tree, char *keyword, int keyword_length, char **value_ptr)
-{
-    int value_length = 0;
     
-    for(KeywordPrefixTreeNode *node = tree; node;)
+    StringTable paths = {0};
+    u64 *path_ns = 0;
+    int path_ns_capacity = 0;
+    ProfileFrame *stack = 0;
+    int stack_depth = 0;
+    int stack_capacity = 0;
+    PathBuffer path = {0};
+    PathBufferAppend(&path, "");
+    
+    u32 first_event = event_count > capacity ? event_count - capacity : 0;
+    for(u32 i = first_event; i < event_count; ++i)
     {
-        int matching_key_characters = 0;
+        char *event = dump + ORE_PROFILE_HEADER_SIZE + (u64)(i % capacity)*ORE_PROFILE_EVENT_SIZE;
+        u32 function_id;
+        u32 kind;
+        double time_ms;
+        MemoryCopy(&function_id, event, 4);
+        MemoryCopy(&kind, event + 4, 4);
+        MemoryCopy(&time_ms, event + 8, 8);
+        if((int)function_id >= name_count)
+        {
+            continue;
+        }
         
-        for(int i = 0; i < node->prefix_length && i < keyword_length; ++i)
+        if(kind == 0)
         {
-            if(keyword[i] == node->prefix[i])
+            if(stack_depth >= stack_capacity)
             {
-                ++matching_key_characters;
+                stack_capacity = stack_capacity ? stack_capacity*2 : 64;
+                stack = realloc(stack, sizeof(ProfileFrame)*stack_capacity);
             }
-            else
+            ProfileFrame *frame = stack + stack_depth++;
+            frame->function_id = function_id;
+            frame->enter_ms = time_ms;
+            frame->child_ms = 0;
+            frame->path_length = path.length;
+            if(path.length)
             {
-                break;
+                PathBufferAppend(&path, ";");
             }
+            PathBufferAppend(&path, names[function_id]);
+            continue;
         }
         
-        if(matching_key_characters == node->prefix_length)
+        int match = stack_depth-1;
+        for(; match >= 0 && stack[match].function_id != function_id; --match);
+        if(match < 0)
         {
-            if(matching_key_characters == keyword_length)
+            continue;
+        }
+        while(stack_depth > match)
+        {
+            ProfileFrame *frame = stack + --stack_depth;
+            double total_ms = time_ms - frame->enter_ms;
+            double self_ms = total_ms - frame->child_ms;
+            
+            int path_id = StringTableIntern(&paths, path.data, path.length, 0);
+            if(path_id >= path_ns_capacity)
             {
-                if(value_ptr)
-                {
-                    *value_ptr = node->value;
-                    value_length = node->value_length;
-                    break;
-                }
+                int old_capacity = path_ns_capacity;
+                path_ns_capacity = path_ns_capacity ? path_ns_capacity*2 : 256;
+                path_ns = realloc(path_ns, sizeof(u64)*path_ns_capacity);
+                MemorySet(path_ns + old_capacity, 0, sizeof(u64)*(path_ns_capacity - old_capacity));
             }
-            else
+            path_ns[path_id] += self_ms > 0 ? (u64)(self_ms*1e6) : 0;
+            if(stack_depth > 0)
             {
-                node = node->have_child;
+                stack[stack_depth-1].child_ms += total_ms;
             }
+            path.length = frame->path_length;
+            path.data[path.length] = 0;
         }
-        else
+    }
+    
+    int result = 0;
+    FILE *out = fopen(output_path, "wb");
+    if(out)
+    {
+        for(int i = 0; i < paths.count; ++i)
         {
-            node = node->no_have_child;
+            fprintf(out, "%s %llu\n", StringTableGetString(&paths, i), (unsigned long long)path_ns[i]);
         }
+        fclose(out);
+        Log("Wrote %i stacks from %u events to %s.", paths.count, event_count - first_event, output_path);
+        result = 1;
+    }
+    else
+    {
+        fprintf(stderr, "ERROR: could not write %s\n", output_path);
     }
     
-    return value_length;
+    free(path.data);
+    free(stack);
+    free(path_ns);
+    StringTableRelease(&paths);
+    free(names);
+    free(dump);
+    return result;
 }
 
-KeywordPrefixTreeNode *
-GenerateKeywordPrefixTreeFromFile(ParseContext *context, char *filename)
+// NOTE(jsn): The startup set for --split. Either a --profile-functions dump of a startup run,
+// in which case every function that was entered is in the set, or a list of function names,
+// one per line, with # starting a comment.
+static int
+LoadSplitStartup(char *path, StringTable *startup)
 {
-    KeywordPrefixTreeNode *root = 0;
-    
-    char *file = LoadEntireFileAndNullTerminate(filename);
+    int file_size = 0;
+    char *file = LoadEntireFileAndNullTerminateWithSize(path, &file_size);
+    if(!file)
+    {
+        return 0;
+    }
     
-    for(int i = 0; file[i]; ++i)
+    u32 header[4];
+    if(ProfileDumpReadHeader(file, file_size, header))
     {
-        char *key = 0;
-        int key_length = 0;
-        char *value = 0;
-        int value_length = 0;
-        if(!CharIsSpace(file[i]))
+        u32 event_count = header[0];
+        u32 capacity = header[1];
+        int name_count = 0;
+        char **names = malloc(sizeof(char *)*(header[3]+1));
+        char *names_at = file + header[2];
+        for(u32 i = 0, start = 0; i < header[3]; ++i)
         {
-            key = file+i+1;
-            for(; key[key_length] != ':'; ++key_length);
-            value = file+i+key_length+1;
-            for(int j = 0; CharIsSpace(file[i+key_length+j]); ++j, ++value);
-            for(; value[value_length] != '\n'; ++value_length);
-            InsertKeywordIntoTree(&root, context, key, key_length, value, value_length);
+            if(names_at[i] == '\n')
+            {
+                names_at[i] = 0;
+                names[name_count++] = names_at + start;
+                start = i+1;
+            }
+        }
+        
+        u32 first_event = event_count > capacity ? event_count - capacity : 0;
+        for(u32 i = first_event; i < event_count; ++i)
+        {
+            char *event = file + ORE_PROFILE_HEADER_SIZE + (u64)(i % capacity)*ORE_PROFILE_EVENT_SIZE;
+            u32 function_id;
+            u32 kind;
+            MemoryCopy(&function_id, event, 4);
+            MemoryCopy(&kind, event + 4, 4);
+            if(kind == 0 && (int)function_id < name_count)
+            {
+                StringTableIntern(startup, names[function_id], CalculateCStringLength(names[function_id]), 0);
+            }
         }
+        free(names);
     }
-    
-    FreeFileData(file);
-    
-    return root;
+    else
+    {
+        for(char *line = file; *line;)
+        {
+            int line_length = 0;
+            for(; line[line_length] && line[line_length] != '\n'; ++line_length);
+            char *next_line = line + line_length + (line[line_length] == '\n');
+            
+            int length = 0;
+            for(; length < line_length && line[length] != '#'; ++length);
+            for(; length && CharIsSpace(*line); ++line, --length);
+            for(; length && CharIsSpace(line[length-1]); --length);
+            if(length)
+            {
+                StringTableIntern(startup, line, length, 0);
+            }
+            line = next_line;
+        }
+    }
+    free(file);
+    return 1;
 }
 
-#define MAX_FILE_COUNT 4096
+// NOTE(jsn): --alloc-report: reads an ORE_ALLOC_PROFILE or --profile-allocations log and
+// prints the top allocation sites by bytes and by count, with how many of their blocks were
+// freed and how long they lived. Threads flush their events independently, so the log is
+// sorted by time before it is replayed; live blocks are tracked in an address-keyed
+// open-addressing table.
+#define ALLOC_REPORT_TOP_SITES 20
 
-/**
- * Lists all files and sub-directories recursively 
- * considering path as base path.
- */
-void listFilesRecursively(char *basePath,char** filenames,int* file_count)
+typedef struct AllocReportSite AllocReportSite;
+struct AllocReportSite
 {
-    char path[1000];
-    struct dirent *dp;
-    DIR *dir = opendir(basePath);
+    char *name;
+    u64 count;
+    u64 bytes;
+    u64 freed_count;
+    u64 lifetime_ns;
+    u64 live_bytes;
+};
 
-    // Unable to open directory stream
-    if (!dir)
-        return;
+typedef struct AllocReportBlock AllocReportBlock;
+struct AllocReportBlock
+{
+    u64 address;
+    u32 site;
+    u32 kind;
+    u64 size;
+    u64 time_ns;
+    int sequence;
+};
 
-    while ((dp = readdir(dir)) != NULL)
+typedef struct AllocReportLiveTable AllocReportLiveTable;
+struct AllocReportLiveTable
+{
+    AllocReportBlock *blocks;
+    int capacity;
+    int used;
+};
+
+// NOTE(jsn): Address 0 marks an empty slot and address 1 a removed one; neither is ever a
+// real allocation.
+static AllocReportBlock *
+AllocReportLiveTableFind(AllocReportLiveTable *table, u64 address, int for_insert)
+{
+    int mask = table->capacity-1;
+    int slot = (int)((address * 0x9E3779B97F4A7C15ull) >> 40) & mask;
+    AllocReportBlock *removed = 0;
+    for(;; slot = (slot+1) & mask)
     {
-        if (strcmp(dp->d_name, ".") != 0 && strcmp(dp->d_name, "..") != 0)
+        AllocReportBlock *block = table->blocks + slot;
+        if(block->address == address)
+        {
+            return block;
+        }
+        if(block->address == 1 && !removed)
+        {
+            removed = block;
+        }
+        if(block->address == 0)
         {
+            return for_insert ? (removed ? removed : block) : 0;
+        }
+    }
+}
 
-            // Construct new path from our base path
-            strcpy(path, basePath);
-            strcat(path, "/");
-            strcat(path, dp->d_name);
-			struct stat sb;
-			if(stat(path, &sb) == 0 && S_ISREG(sb.st_mode))
+static void
+AllocReportLiveTableInsert(AllocReportLiveTable *table, AllocReportBlock *block)
+{
+    if((table->used+1)*2 > table->capacity)
+    {
+        AllocReportLiveTable grown = {0};
+        grown.capacity = table->capacity ? table->capacity*2 : 1024;
+        grown.blocks = calloc(grown.capacity, sizeof(AllocReportBlock));
+        for(int i = 0; i < table->capacity; ++i)
+        {
+            if(table->blocks[i].address > 1)
             {
-                filenames[*file_count] = malloc(sizeof(path));
-				strcpy(filenames[*file_count],path);
-				*file_count+=1;
+                *AllocReportLiveTableFind(&grown, table->blocks[i].address, 1) = table->blocks[i];
+                ++grown.used;
             }
-            if(*file_count >= MAX_FILE_COUNT)
+        }
+        free(table->blocks);
+        *table = grown;
+    }
+    AllocReportBlock *slot = AllocReportLiveTableFind(table, block->address, 1);
+    if(slot->address <= 1)
+    {
+        ++table->used;
+    }
+    *slot = *block;
+}
+
+static int
+CompareAllocReportEventsByTime(const void *a, const void *b)
+{
+    const AllocReportBlock *event_a = a;
+    const AllocReportBlock *event_b = b;
+    if(event_a->time_ns != event_b->time_ns)
+    {
+        return event_a->time_ns < event_b->time_ns ? -1 : 1;
+    }
+    // NOTE(jsn): Ties keep log order, which is program order within a thread.
+    return event_a->sequence - event_b->sequence;
+}
+
+static int
+CompareAllocReportSitesByBytes(const void *a, const void *b)
+{
+    const AllocReportSite *site_a = *(AllocReportSite *const *)a;
+    const AllocReportSite *site_b = *(AllocReportSite *const *)b;
+    return site_a->bytes < site_b->bytes ? 1 : site_a->bytes > site_b->bytes ? -1 : 0;
+}
+
+static int
+CompareAllocReportSitesByCount(const void *a, const void *b)
+{
+    const AllocReportSite *site_a = *(AllocReportSite *const *)a;
+    const AllocReportSite *site_b = *(AllocReportSite *const *)b;
+    return site_a->count < site_b->count ? 1 : site_a->count > site_b->count ? -1 : 0;
+}
+
+static void
+AllocReportPrintSites(FILE *out, char *title, AllocReportSite **sites, int site_count)
+{
+    fprintf(out, "\n%s\n", title);
+    fprintf(out, "%14s %10s %10s %14s %12s  %s\n", "bytes", "count", "freed", "avg life us", "live bytes", "site");
+    for(int i = 0; i < site_count && i < ALLOC_REPORT_TOP_SITES; ++i)
+    {
+        AllocReportSite *site = sites[i];
+        fprintf(out, "%14llu %10llu %10llu %14.1f %12llu  %s\n",
+                (unsigned long long)site->bytes,
+                (unsigned long long)site->count,
+                (unsigned long long)site->freed_count,
+                site->freed_count ? site->lifetime_ns / 1e3 / site->freed_count : 0.0,
+                (unsigned long long)site->live_bytes,
+                site->name);
+    }
+}
+
+static int
+AllocReportPrint(char *log_path, FILE *out)
+{
+    int log_size = 0;
+    unsigned char *log = (unsigned char *)LoadEntireFileAndNullTerminateWithSize(log_path, &log_size);
+    u32 version = 0;
+    if(log && log_size >= 12)
+    {
+        MemoryCopy(&version, log + 8, 4);
+    }
+    if(!log || log_size < 12 || memcmp(log, ALLOC_LOG_MAGIC, 8) || version != ALLOC_LOG_VERSION)
+    {
+        fprintf(stderr, "ERROR: %s is not an allocation log\n", log_path);
+        free(log);
+        return 0;
+    }
+    
+    // NOTE(jsn): The site table follows the end marker; find it before replaying events.
+    int at = 12;
+    for(; at + ALLOC_LOG_EVENT_SIZE <= log_size && log[at] != AllocEventKind_End; at += ALLOC_LOG_EVENT_SIZE);
+    int events_end = at;
+    u32 site_count = 0;
+    if(at + 5 <= log_size)
+    {
+        MemoryCopy(&site_count, log + at + 1, 4);
+        at += 5;
+    }
+    else
+    {
+        fprintf(stderr, "WARNING: %s is truncated; the run did not finish\n", log_path);
+    }
+    
+    AllocReportSite *sites = calloc(site_count ? site_count : 1, sizeof(AllocReportSite));
+    for(u32 i = 0; i < site_count && at + 6 <= log_size; ++i)
+    {
+        u32 line;
+        u16 length;
+        MemoryCopy(&line, log + at, 4);
+        MemoryCopy(&length, log + at + 4, 2);
+        at += 6;
+        if(at + length > log_size)
+        {
+            break;
+        }
+        int name_size = length + 16;
+        sites[i].name = malloc(name_size);
+        snprintf(sites[i].name, name_size, "%.*s:%u", (int)length, (char *)log + at, line);
+        at += length;
+    }
+    
+    int event_count = (events_end - 12) / ALLOC_LOG_EVENT_SIZE;
+    AllocReportBlock *events = malloc(sizeof(AllocReportBlock)*(event_count ? event_count : 1));
+    for(int i = 0; i < event_count; ++i)
+    {
+        unsigned char *event = log + 12 + i*ALLOC_LOG_EVENT_SIZE;
+        events[i].kind = event[0];
+        events[i].sequence = i;
+        MemoryCopy(&events[i].site, event + 1, 4);
+        MemoryCopy(&events[i].address, event + 5, 8);
+        MemoryCopy(&events[i].size, event + 13, 8);
+        MemoryCopy(&events[i].time_ns, event + 21, 8);
+    }
+    QuickSort(events, event_count, sizeof(*events), CompareAllocReportEventsByTime);
+    
+    AllocReportLiveTable live = {0};
+    u64 total_bytes = 0;
+    u64 total_count = 0;
+    for(int i = 0; i < event_count; ++i)
+    {
+        AllocReportBlock block = events[i];
+        if(block.site >= site_count || block.address <= 1)
+        {
+            continue;
+        }
+        
+        if(block.kind == AllocEventKind_Alloc)
+        {
+            AllocReportSite *site = sites + block.site;
+            ++site->count;
+            site->bytes += block.size;
+            site->live_bytes += block.size;
+            total_bytes += block.size;
+            ++total_count;
+            AllocReportLiveTableInsert(&live, &block);
+        }
+        else if(block.kind == AllocEventKind_Free && live.capacity)
+        {
+            AllocReportBlock *allocated = AllocReportLiveTableFind(&live, block.address, 0);
+            if(allocated)
             {
-                fprintf(stderr, "ERROR: Max file count reached. @John, increase this.\n");
-				break;
+                AllocReportSite *site = sites + allocated->site;
+                ++site->freed_count;
+                site->lifetime_ns += block.time_ns - allocated->time_ns;
+                site->live_bytes -= allocated->size;
+                allocated->address = 1;
             }
-            listFilesRecursively(path,filenames,file_count);
         }
     }
+    
+    AllocReportSite **sorted = malloc(sizeof(AllocReportSite *)*(site_count ? site_count : 1));
+    int sorted_count = 0;
+    for(u32 i = 0; i < site_count; ++i)
+    {
+        if(sites[i].name && sites[i].count)
+        {
+            sorted[sorted_count++] = sites + i;
+        }
+    }
+    
+    fprintf(out, "===== Allocation Report =====\n");
+    fprintf(out, "%llu allocations, %llu bytes, %i sites\n", (unsigned long long)total_count, (unsigned long long)total_bytes, sorted_count);
+    QuickSort(sorted, sorted_count, sizeof(*sorted), CompareAllocReportSitesByBytes);
+    AllocReportPrintSites(out, "Top sites by bytes:", sorted, sorted_count);
+    QuickSort(sorted, sorted_count, sizeof(*sorted), CompareAllocReportSitesByCount);
+    AllocReportPrintSites(out, "Top sites by count:", sorted, sorted_count);
+    
+    for(u32 i = 0; i < site_count; ++i)
+    {
+        free(sites[i].name);
+    }
+    free(sorted);
+    free(sites);
+    free(events);
+    free(live.blocks);
+    free(log);
+    return 1;
+}
 
-    closedir(dir);
+static int
+ParseByteSize(char *string, u32 *size_ptr)
+{
+    char *at = string;
+    while(*at && CharIsSpace(*at))
+    {
+        ++at;
+    }
+    u64 size = 0;
+    char *digits = at;
+    for(; CharIsDigit(*at); ++at)
+    {
+        size = size*10 + (*at - '0');
+        if(size > 0xFFFFFFFFull)
+        {
+            return 0;
+        }
+    }
+    if(at == digits)
+    {
+        return 0;
+    }
+    switch(*at)
+    {
+        case 'k': case 'K': { size <<= 10; ++at; } break;
+        case 'm': case 'M': { size <<= 20; ++at; } break;
+        case 'g': case 'G': { size <<= 30; ++at; } break;
+    }
+    while(*at && CharIsSpace(*at))
+    {
+        ++at;
+    }
+    if(*at || size > 0xFFFFFFFFull)
+    {
+        return 0;
+    }
+    *size_ptr = (u32)size;
+    return 1;
+}
+
+// NOTE(jsn): wasm-ctor-eval is looked for next to the Ore executable, then in the Binaryen
+// tools shipped in Libraries/, then on PATH.
+static char *
+FindPreinitTool(char *executable_path)
+{
+    static char path[4096];
+    char *candidates[] =
+    {
+        "%.*s/" ORE_PREINIT_TOOL_DEFAULT,
+        "%.*s/../../Libraries/binaryen/linux/tools/" ORE_PREINIT_TOOL_DEFAULT,
+    };
+    char *slash = strrchr(executable_path, '/');
+    int directory_length = slash ? (int)(slash - executable_path) : 1;
+    char *directory = slash ? executable_path : ".";
+    for(int i = 0; i < (int)(sizeof(candidates)/sizeof(candidates[0])); ++i)
+    {
+        snprintf(path, sizeof(path), candidates[i], directory_length, directory);
+        if(access(path, X_OK) == 0)
+        {
+            return path;
+        }
+    }
+    if(access("Libraries/binaryen/linux/tools/" ORE_PREINIT_TOOL_DEFAULT, X_OK) == 0)
+    {
+        return "Libraries/binaryen/linux/tools/" ORE_PREINIT_TOOL_DEFAULT;
+    }
+    return ORE_PREINIT_TOOL_DEFAULT;
+}
+
+static char *
+GetPipelineFilePath(void *user_data, int file_id)
+{
+    Pipeline *pipeline = user_data;
+    return file_id < pipeline->files.count ? FileTableGetEntry(&pipeline->files, file_id)->path : 0;
 }
 
 int
@@ -1168,26 +8415,139 @@ main(int argument_count, char **arguments)
 	char *source_dir_path = 0;
     char *build_file_path = 0;
 	char *build_file = "";
+    int job_count = GetDefaultJobCount();
+    ScheduleMode schedule_mode = ScheduleMode_LongestFirst;
+    char *timings_file_path = 0;
+    char *default_timings_file_path = 0;
+    char *bundle_path = 0;
+    int optimize_level = 0;
+    int time_report_enabled = 0;
+    int time_report_file_count = 0;
+    char *trace_path = 0;
+    int stats_enabled = 0;
+    int perf_counters_enabled = 0;
+    int rss_report_enabled = 0;
+    int profile_functions = 0;
+    char *alloc_log_path = 0;
+    int preinit = 0;
+    char *preinit_tool_path = 0;
+    MemoryPlanOptions memory_options = { .stack_size = ORE_DEFAULT_STACK_SIZE, .async_stack_size = ORE_DEFAULT_ASYNC_STACK_SIZE };
+    char *async_imports = 0;
+    int async_imports_length = 0;
+    int export_allocator = 0;
+    int profile_allocations = 0;
+    u32 stdlib_required = 0;
+    int dump_ir = 0;
+    int incremental_link = 0;
+    char *split_startup_path = 0;
+    StringTable split_startup = {0};
+    CompileCache cache = {0};
+    char *alloc_report_path = 0;
+    char *profile_dump_path = 0;
+    char *profile_folded_path = 0;
+    int rss_sample_ms = 0;
+    char *stats_json_path = 0;
+    
+    // NOTE(jsn): Verbosity is settled first, so it applies to the messages of every other
+    // argument no matter where -v appears.
+    for(int i = 1; i < argument_count; ++i)
+    {
+        if(CStringMatchCaseInsensitive(arguments[i], "-v") || CStringMatchCaseInsensitive(arguments[i], "--verbose"))
+        {
+            log_level = log_level < LogLevel_Trace ? log_level+1 : LogLevel_Trace;
+            arguments[i] = 0;
+        }
+        else if(CStringMatchCaseInsensitive(arguments[i], "-vv"))
+        {
+            log_level = LogLevel_Trace;
+            arguments[i] = 0;
+        }
+        else if(CStringMatchCaseInsensitive(arguments[i], "-q") || CStringMatchCaseInsensitive(arguments[i], "--quiet"))
+        {
+            log_level = LogLevel_Error;
+            arguments[i] = 0;
+        }
+    }
     
     for(int i = 1; i < argument_count; ++i)
     {
+        if(!arguments[i])
+        {
+            continue;
+        }
         
         if(CStringMatchCaseInsensitive(arguments[i], "--wasm"))
         {
-            Log("Outputting to WASM.");
-            output_flags |= OutputFlag_WASM;
+            Log("Outputting to WASM.");
+            output_flags |= OutputFlag_WASM;
+            arguments[i] = 0;
+        }
+        else if(CStringMatchCaseInsensitive(arguments[i], "--c"))
+        {
+            Log("Outputting to C.");
+            output_flags |= OutputFlag_C;
+            arguments[i] = 0;
+        }
+        else if(CStringMatchCaseInsensitive(arguments[i], "--js"))
+        {
+            Log("Outputting to js.");
+            output_flags |= OutputFlag_js;
+            arguments[i] = 0;
+        }
+        else if(CStringMatchCaseInsensitive(arguments[i], "--time-report"))
+        {
+            time_report_enabled = 1;
+            arguments[i] = 0;
+        }
+        else if(CStringMatchCaseInsensitive(arguments[i], "--stats"))
+        {
+            stats_enabled = 1;
+            arguments[i] = 0;
+        }
+        else if(CStringMatchCaseInsensitive(arguments[i], "--perf-counters"))
+        {
+            perf_counters_enabled = 1;
+            arguments[i] = 0;
+        }
+        else if(CStringMatchCaseInsensitive(arguments[i], "--rss-report"))
+        {
+            rss_report_enabled = 1;
+            arguments[i] = 0;
+        }
+        else if(CStringMatchCaseInsensitive(arguments[i], "--profile-functions"))
+        {
+            profile_functions = 1;
+            arguments[i] = 0;
+        }
+        else if(CStringMatchCaseInsensitive(arguments[i], "--export-allocator"))
+        {
+            export_allocator = 1;
+            arguments[i] = 0;
+        }
+        else if(CStringMatchCaseInsensitive(arguments[i], "--profile-allocations"))
+        {
+            profile_allocations = 1;
             arguments[i] = 0;
         }
-        else if(CStringMatchCaseInsensitive(arguments[i], "--c"))
+        else if(CStringMatchCaseInsensitive(arguments[i], "--incremental"))
         {
-            Log("Outputting to C.");
-            output_flags |= OutputFlag_C;
+            incremental_link = 1;
             arguments[i] = 0;
         }
-        else if(CStringMatchCaseInsensitive(arguments[i], "--js"))
+        else if(CStringMatchCaseInsensitive(arguments[i], "--dump-ir"))
         {
-            Log("Outputting to js.");
-            output_flags |= OutputFlag_js;
+            dump_ir = 1;
+            arguments[i] = 0;
+        }
+        else if(CStringMatchCaseInsensitive(arguments[i], "--memory-report"))
+        {
+            memory_options.report = 1;
+            arguments[i] = 0;
+        }
+        else if(CStringMatchCaseInsensitive(arguments[i], "--preinit"))
+        {
+            Log("Evaluating start functions at compile time.");
+            preinit = 1;
             arguments[i] = 0;
         }
         
@@ -1210,6 +8570,245 @@ main(int argument_count, char **arguments)
                 arguments[i+1] = 0;
                 ++i;
             }
+            else if(CStringMatchCaseInsensitive(arguments[i], "--stats-json"))
+            {
+                stats_json_path = arguments[i+1];
+                Log("Writing stats to \"%s\".", stats_json_path);
+                arguments[i] = 0;
+                arguments[i+1] = 0;
+                ++i;
+            }
+            else if(CStringMatchCaseInsensitive(arguments[i], "--rss-sample-ms"))
+            {
+                rss_report_enabled = 1;
+                rss_sample_ms = CStringToInt(arguments[i+1]);
+                Log("Sampling RSS every %i ms.", rss_sample_ms);
+                arguments[i] = 0;
+                arguments[i+1] = 0;
+                ++i;
+            }
+            else if(CStringMatchCaseInsensitive(arguments[i], "--trace"))
+            {
+                trace_path = arguments[i+1];
+                Log("Writing trace to \"%s\".", trace_path);
+                arguments[i] = 0;
+                arguments[i+1] = 0;
+                ++i;
+            }
+            else if(CStringMatchCaseInsensitive(arguments[i], "--time-report-files"))
+            {
+                time_report_enabled = 1;
+                time_report_file_count = CStringToInt(arguments[i+1]);
+                arguments[i] = 0;
+                arguments[i+1] = 0;
+                ++i;
+            }
+            else if(CStringMatchCaseInsensitive(arguments[i], "--optimize") || CStringMatchCaseInsensitive(arguments[i], "-O"))
+            {
+                optimize_level = CStringToInt(arguments[i+1]);
+                Log("Optimization level set to %i.", optimize_level);
+                arguments[i] = 0;
+                arguments[i+1] = 0;
+                ++i;
+            }
+            else if(CStringMatchCaseInsensitive(arguments[i], "--bundle"))
+            {
+                bundle_path = arguments[i+1];
+                Log("Bundling all sources into \"%s\".", bundle_path);
+                arguments[i] = 0;
+                arguments[i+1] = 0;
+                ++i;
+            }
+            else if(CStringMatchCaseInsensitive(arguments[i], "--schedule"))
+            {
+                if(CStringMatchCaseInsensitive(arguments[i+1], "fifo"))
+                {
+                    schedule_mode = ScheduleMode_FIFO;
+                }
+                else if(CStringMatchCaseInsensitive(arguments[i+1], "lpt"))
+                {
+                    schedule_mode = ScheduleMode_LongestFirst;
+                }
+                else
+                {
+                    fprintf(stderr, "ERROR: unknown schedule \"%s\"; expected lpt or fifo\n", arguments[i+1]);
+                    return 1;
+                }
+                arguments[i] = 0;
+                arguments[i+1] = 0;
+                ++i;
+            }
+            else if(CStringMatchCaseInsensitive(arguments[i], "--profile-collapse") && i+2 < argument_count)
+            {
+                profile_dump_path = arguments[i+1];
+                profile_folded_path = arguments[i+2];
+                arguments[i] = 0;
+                arguments[i+1] = 0;
+                arguments[i+2] = 0;
+                i += 2;
+            }
+            else if(CStringMatchCaseInsensitive(arguments[i], "--async-import"))
+            {
+                // NOTE(jsn): Collected in asyncify-imports form, "a.b,c.d".
+                int length = CalculateCStringLength(arguments[i+1]);
+                async_imports = realloc(async_imports, async_imports_length + length + 2);
+                if(async_imports_length)
+                {
+                    async_imports[async_imports_length++] = ',';
+                }
+                MemoryCopy(async_imports + async_imports_length, arguments[i+1], length+1);
+                async_imports_length += length;
+                arguments[i] = 0;
+                arguments[i+1] = 0;
+                ++i;
+            }
+            else if(CStringMatchCaseInsensitive(arguments[i], "--stack-size") ||
+                    CStringMatchCaseInsensitive(arguments[i], "--async-stack-size") ||
+                    CStringMatchCaseInsensitive(arguments[i], "--heap-size") ||
+                    CStringMatchCaseInsensitive(arguments[i], "--max-memory"))
+            {
+                u32 *size = arguments[i][3] == 't' ? &memory_options.stack_size :
+                    arguments[i][3] == 's' ? &memory_options.async_stack_size :
+                    arguments[i][3] == 'e' ? &memory_options.heap_size : &memory_options.max_memory;
+                // NOTE(jsn): --heap-size also takes a file written by Tools/ore-profile.js --heap-out.
+                char *profile = 0;
+                if(!ParseByteSize(arguments[i+1], size) &&
+                   !(size == &memory_options.heap_size && (profile = LoadEntireFileAndNullTerminate(arguments[i+1])) &&
+                     ParseByteSize(profile, size)))
+                {
+                    fprintf(stderr, "ERROR: %s expects a size in bytes (with an optional k, m or g suffix), got \"%s\"\n",
+                            arguments[i], arguments[i+1]);
+                    return 1;
+                }
+                free(profile);
+                arguments[i] = 0;
+                arguments[i+1] = 0;
+                ++i;
+            }
+            else if(CStringMatchCaseInsensitive(arguments[i], "--stdlib"))
+            {
+                // NOTE(jsn): Links standard library pieces in by name.
+                if(!ParseStdlibList(arguments[i+1], &stdlib_required))
+                {
+                    fprintf(stderr, "ERROR: --stdlib expects \"all\" or a comma-separated list of:");
+                    for(int j = 0; j < Stdlib_MAX; ++j)
+                    {
+                        if(!(STDLIB_INTERNAL & (1u << j)))
+                        {
+                            fprintf(stderr, " %s", stdlib_functions[j].name);
+                        }
+                    }
+                    fprintf(stderr, "; got \"%s\"\n", arguments[i+1]);
+                    return 1;
+                }
+                arguments[i] = 0;
+                arguments[i+1] = 0;
+                ++i;
+            }
+            else if(CStringMatchCaseInsensitive(arguments[i], "--huge-pages"))
+            {
+                if(CStringMatchCaseInsensitive(arguments[i+1], "thp"))
+                {
+                    huge_pages.mode = HugePageMode_THP;
+                }
+                else if(CStringMatchCaseInsensitive(arguments[i+1], "hugetlb"))
+                {
+                    huge_pages.mode = HugePageMode_HugeTLB;
+                }
+                else if(CStringMatchCaseInsensitive(arguments[i+1], "off"))
+                {
+                    huge_pages.mode = HugePageMode_Off;
+                }
+                else
+                {
+                    fprintf(stderr, "ERROR: --huge-pages expects thp, hugetlb or off, got \"%s\"\n", arguments[i+1]);
+                    return 1;
+                }
+                arguments[i] = 0;
+                arguments[i+1] = 0;
+                ++i;
+            }
+            else if(CStringMatchCaseInsensitive(arguments[i], "--huge-page-threshold"))
+            {
+                if(!ParseByteSize(arguments[i+1], &huge_pages.threshold))
+                {
+                    fprintf(stderr, "ERROR: %s expects a size in bytes (with an optional k, m or g suffix), got \"%s\"\n",
+                            arguments[i], arguments[i+1]);
+                    return 1;
+                }
+                arguments[i] = 0;
+                arguments[i+1] = 0;
+                ++i;
+            }
+            else if(CStringMatchCaseInsensitive(arguments[i], "--cache"))
+            {
+                cache.directory = arguments[i+1];
+                arguments[i] = 0;
+                arguments[i+1] = 0;
+                ++i;
+            }
+            else if(CStringMatchCaseInsensitive(arguments[i], "--remote-cache"))
+            {
+                if(!RemoteCacheParseURL(&cache.remote, arguments[i+1]))
+                {
+                    fprintf(stderr, "ERROR: --remote-cache expects a URL of the form http://host[:port][/path], got \"%s\"\n",
+                            arguments[i+1]);
+                    return 1;
+                }
+                cache.has_remote = 1;
+                arguments[i] = 0;
+                arguments[i+1] = 0;
+                ++i;
+            }
+            else if(CStringMatchCaseInsensitive(arguments[i], "--split"))
+            {
+                split_startup_path = arguments[i+1];
+                arguments[i] = 0;
+                arguments[i+1] = 0;
+                ++i;
+            }
+            else if(CStringMatchCaseInsensitive(arguments[i], "--ctor-eval"))
+            {
+                preinit_tool_path = arguments[i+1];
+                Log("Using \"%s\" for --preinit.", preinit_tool_path);
+                arguments[i] = 0;
+                arguments[i+1] = 0;
+                ++i;
+            }
+            else if(CStringMatchCaseInsensitive(arguments[i], "--alloc-log"))
+            {
+                alloc_log_path = arguments[i+1];
+                arguments[i] = 0;
+                arguments[i+1] = 0;
+                ++i;
+            }
+            else if(CStringMatchCaseInsensitive(arguments[i], "--alloc-report"))
+            {
+                alloc_report_path = arguments[i+1];
+                arguments[i] = 0;
+                arguments[i+1] = 0;
+                ++i;
+            }
+            else if(CStringMatchCaseInsensitive(arguments[i], "--timings_file"))
+            {
+                timings_file_path = arguments[i+1];
+                Log("Timing history file set as \"%s\".", timings_file_path);
+                arguments[i] = 0;
+                arguments[i+1] = 0;
+                ++i;
+            }
+            else if(CStringMatchCaseInsensitive(arguments[i], "--jobs") || CStringMatchCaseInsensitive(arguments[i], "-j"))
+            {
+                job_count = CStringToInt(arguments[i+1]);
+                if(job_count < 1)
+                {
+                    job_count = 1;
+                }
+                Log("Using %i jobs.", job_count);
+                arguments[i] = 0;
+                arguments[i+1] = 0;
+                ++i;
+            }
         }
         // NOTE(rjf): Just a file to parse.
         else
@@ -1219,132 +8818,278 @@ main(int argument_count, char **arguments)
         
     }
     
+    LogFlush();
+    
+    // NOTE(jsn): Converting a profile is a tool of its own; nothing gets compiled.
+    if(profile_dump_path)
+    {
+        int collapsed = ProfileCollapse(profile_dump_path, profile_folded_path);
+        LogFlush();
+        return collapsed ? 0 : 1;
+    }
+    if(alloc_report_path)
+    {
+        return AllocReportPrint(alloc_report_path, stdout) ? 0 : 1;
+    }
+    if(alloc_log_path)
+    {
+#if ORE_ALLOC_PROFILE
+        if(!AllocProfileBegin(alloc_log_path))
+        {
+            fprintf(stderr, "ERROR: could not write allocation log %s\n", alloc_log_path);
+        }
+#else
+        fprintf(stderr, "ERROR: --alloc-log needs a build with ORE_ALLOC_PROFILE enabled\n");
+#endif
+    }
+    
+    // NOTE(jsn): Pass arguments are process-wide, so they're set once before any worker
+    // starts running passes.
+    if(async_imports)
+    {
+        BinaryenSetPassArgument("asyncify-imports", async_imports);
+    }
+    
+    // NOTE(jsn): An asyncified stub would unwind through call_indirect into the secondary
+    // module, which asyncify never saw.
+    if(split_startup_path)
+    {
+        if(async_imports)
+        {
+            fprintf(stderr, "ERROR: --split can't be combined with --async-import\n");
+            return 1;
+        }
+        if(!LoadSplitStartup(split_startup_path, &split_startup))
+        {
+            fprintf(stderr, "ERROR: could not read the --split startup set %s\n", split_startup_path);
+            return 1;
+        }
+        Log("Splitting modules with %i startup functions from %s.", split_startup.count, split_startup_path);
+    }
+    
+    if(preinit && !preinit_tool_path)
+    {
+        preinit_tool_path = FindPreinitTool(arguments[0]);
+    }
+    
     if(build_file_path)
     {
         build_file = LoadEntireFileAndNullTerminate(build_file_path);
     }
     
-    ParseContext context = {0};
-    ProcessedFile files[MAX_FILE_COUNT];
-	char* filenames[MAX_FILE_COUNT] ={0};
-    int file_count = 0;
-	if(source_dir_path){
-		listFilesRecursively(source_dir_path,&filenames,&file_count);
-	}
-    for(int i = 0; i < file_count; i++)
+    if(!timings_file_path && source_dir_path)
+    {
+        int length = CalculateCStringLength(source_dir_path);
+        default_timings_file_path = malloc(length + sizeof("/" TIMING_HISTORY_FILE_NAME));
+        MemoryCopy(default_timings_file_path, source_dir_path, length);
+        MemoryCopy(default_timings_file_path + length, "/" TIMING_HISTORY_FILE_NAME, sizeof("/" TIMING_HISTORY_FILE_NAME));
+        timings_file_path = default_timings_file_path;
+    }
+    else if(!timings_file_path)
+    {
+        timings_file_path = TIMING_HISTORY_FILE_NAME;
+    }
+    
+    // NOTE(jsn): Files stream through walk -> read -> parse -> codegen -> write; no stage
+    // waits for the previous one to finish the whole tree.
+    Pipeline pipeline = {0};
     {
-        char *filename = filenames[i];
-        if(filename)
+        pipeline.source_dir_path = source_dir_path;
+        pipeline.output_flags = output_flags;
+        pipeline.schedule_mode = schedule_mode;
+        pipeline.bundle_path = bundle_path;
+        pipeline.optimize_level = optimize_level;
+        pipeline.profile_functions = profile_functions;
+        pipeline.memory_options = memory_options;
+        pipeline.async_imports = async_imports;
+        pipeline.export_allocator = export_allocator;
+        pipeline.profile_allocations = profile_allocations;
+        pipeline.stdlib_required = stdlib_required;
+        pipeline.split_startup = split_startup_path ? &split_startup : 0;
+        pipeline.dump_ir = dump_ir;
+        pipeline.preinit = preinit;
+        pipeline.preinit_tool_path = preinit_tool_path;
+        atomic_init(&pipeline.error_count, 0);
+    }
+    
+    // NOTE(jsn): A bundle is linked from the whole tree, and the diagnostics come out of
+    // codegen itself; neither would survive a cache hit.
+    if(cache.directory || cache.has_remote)
+    {
+        if(bundle_path || dump_ir || memory_options.report)
         {
-            Log("Processing file \"%s\".", filename);
-        
-            char extension[256] = {0};
-            char filename_no_extension[256] = {0};
-            char wasm_output_path[256] = {0};
-            char c_output_path[256] = {0};
-            char js_output_path[256] = {0};
-            
-            snprintf(filename_no_extension, sizeof(filename_no_extension), "%s", filename);
-            char *last_period = filename_no_extension;
-            for(int i = 0; filename_no_extension[i]; ++i)
+            LogWarning("The compile cache only covers per-file modules without --dump-ir or --memory-report; not using it.");
+        }
+        else
+        {
+            if(cache.directory && mkdir(cache.directory, 0777) && errno != EEXIST)
             {
-                if(filename_no_extension[i] == '.')
-                {
-                    last_period = filename_no_extension+i;
-                }
+                fprintf(stderr, "WARNING: could not create cache directory %s\n", cache.directory);
+                cache.directory = 0;
             }
-            *last_period = 0;
-            
-            snprintf(wasm_output_path, sizeof(wasm_output_path), "%s.wasm", filename_no_extension);
-            snprintf(c_output_path, sizeof(c_output_path), "%s.c", filename_no_extension);
-            snprintf(js_output_path, sizeof(js_output_path), "%s.js", filename_no_extension);
-            
-            snprintf(extension, sizeof(extension), "%s", last_period+1);
-            InputType input_type = InputType_Invalid;
-            if(CStringMatchCaseInsensitive(extension, "or"))
+            cache.options_hash = PipelineHashOptions(&pipeline);
+            pipeline.cache = &cache;
+        }
+    }
+    if(time_report_enabled)
+    {
+        TimeReportBegin(time_report_file_count);
+    }
+    if(stats_enabled || stats_json_path)
+    {
+        StatsBegin();
+    }
+    if(perf_counters_enabled)
+    {
+        PerfCountersBegin();
+    }
+    if(rss_report_enabled)
+    {
+        MemoryReportBegin(rss_sample_ms);
+    }
+    if(trace_path)
+    {
+#if ORE_TRACE
+        TraceBegin();
+#else
+        fprintf(stderr, "ERROR: --trace needs a build with ORE_TRACE enabled\n");
+#endif
+    }
+    if(optimize_level)
+    {
+        BinaryenSetOptimizeLevel(optimize_level);
+    }
+    if(bundle_path)
+    {
+        WASMModuleBuilderInit(&pipeline.bundle);
+        pipeline.bundle.profile_functions = profile_functions;
+        pipeline.bundle.memory_options = memory_options;
+        pipeline.bundle.async_imports = async_imports;
+        pipeline.bundle.export_allocator = export_allocator;
+        pipeline.bundle.profile_allocations = profile_allocations;
+        pipeline.bundle.stdlib_required = stdlib_required;
+        pipeline.bundle.split_startup = split_startup_path ? &split_startup : 0;
+        pipeline.bundle.preinit = preinit;
+        pipeline.bundle.preinit_tool_path = preinit_tool_path;
+        pthread_mutex_init(&pipeline.bundle_mutex, 0);
+    }
+    LoadTimingHistory(&pipeline.history, timings_file_path);
+    RunPipeline(&pipeline, job_count);
+    
+    // NOTE(jsn): Every file has been through codegen by now; the bundle is linked and
+    // written once, as a single module with one memory and one table.
+    if(bundle_path)
+    {
+        u64 bundle_phase_ns[TimePhase_MAX] = {0};
+        TraceZoneBegin(bundle);
+        PipelineLinkBundle(&pipeline, bundle_phase_ns);
+        if(atomic_load(&pipeline.error_count) == 0)
+        {
+            int bundle_size = 0;
+            char *bundle_contents = WASMModuleBuilderFinish(&pipeline.bundle, 1, optimize_level, -1, bundle_phase_ns, &bundle_size);
+            if(bundle_contents && memory_options.report)
             {
-                input_type = InputType_OR;
+                MemoryPlanPrint(stderr, bundle_path, &pipeline.bundle.memory_plan);
             }
-			else if(CStringMatchCaseInsensitive(extension, "wasm")){
-				input_type = InputType_WASM;
-			}
-            
-            FileProcessData process_data = {0};
+            TimeBlockBegin(write);
+            i64 bundle_written = -1;
+            if(bundle_contents && incremental_link)
             {
-                process_data.input_type = input_type;
-                process_data.output_flags = output_flags;
-                process_data.filename_no_extension = filename_no_extension;
-                process_data.wasm_output_path = wasm_output_path;
-                process_data.c_output_path = c_output_path;
-                process_data.js_output_path = js_output_path;
+                bundle_written = WriteBundleIncremental(bundle_path, bundle_contents, (u32)bundle_size);
             }
-            
-            ProcessedFile processed_file = {0};
-			if(input_type != InputType_Invalid){
-				char *file = LoadEntireFileAndNullTerminate(filename);
-				processed_file = ProcessFile(filename, file, &process_data, &context);
-			}
-			else
+            else if(bundle_contents && WriteEntireFile(bundle_path, bundle_contents, bundle_size))
             {
-                fprintf(stderr, "ERROR: input file %s.%s is not a valid file type; Only .wasm and .or are supported\n",filename,extension);
-				continue;
+                bundle_written = bundle_size;
             }
-            
-            if(file_count < sizeof(files)/sizeof(files[0]))
+            if(bundle_written >= 0)
             {
-                files[file_count++] = processed_file;
+                StatAdd(Stat_OutputFiles, 1);
+                StatAdd(Stat_OutputBytes, bundle_written);
             }
-            else
+            else if(bundle_contents)
+            {
+                fprintf(stderr, "ERROR: could not write bundle %s\n", bundle_path);
+                atomic_fetch_add_explicit(&pipeline.error_count, 1, memory_order_relaxed);
+            }
+            if(bundle_contents && pipeline.bundle.secondary_output)
             {
-                fprintf(stderr, "ERROR: Max file count reached. @John, increase this.\n");
+                char *secondary_path = GetSecondaryModulePath(bundle_path);
+                if(WriteEntireFile(secondary_path, pipeline.bundle.secondary_output, pipeline.bundle.secondary_output_size))
+                {
+                    StatAdd(Stat_OutputFiles, 1);
+                    StatAdd(Stat_OutputBytes, pipeline.bundle.secondary_output_size);
+                }
+                else
+                {
+                    fprintf(stderr, "ERROR: could not write %s\n", secondary_path);
+                    atomic_fetch_add_explicit(&pipeline.error_count, 1, memory_order_relaxed);
+                }
+                free(secondary_path);
             }
+            free(bundle_contents);
+            TimeBlockEnd(write, bundle_phase_ns, TimePhase_Write);
         }
+        else
+        {
+            fprintf(stderr, "ERROR: bundle %s not written because of errors\n", bundle_path);
+        }
+        TraceZoneEnd(bundle, "bundle", -1);
+        if(time_report.enabled)
+        {
+            TimeReportAddPhases(bundle_phase_ns);
+        }
+        WASMModuleBuilderRelease(&pipeline.bundle);
+        pthread_mutex_destroy(&pipeline.bundle_mutex);
     }
     
-    // Print errors.
-    if(context.error_stack_size > 0)
+    SaveTimingHistory(timings_file_path, &pipeline.files);
+    free(default_timings_file_path);
+    if(trace.enabled)
     {
-        for(int i = 0; i < context.error_stack_size; ++i)
+        if(!TraceWrite(trace_path, GetPipelineFilePath, &pipeline))
         {
-            fprintf(stderr, "Parse Error (%s:%i): %s\n",
-                    context.error_stack[i].file,
-                    context.error_stack[i].line,
-                    context.error_stack[i].message);
+            fprintf(stderr, "ERROR: could not write trace %s\n", trace_path);
         }
+        TraceEnd();
     }
-    
-    //Generate code for all processed files.
+    LogFlush();
+    if(time_report.enabled)
+    {
+        TimeReportPrint(stderr);
+        TimeReportEnd();
+    }
+    if(perf_counters_enabled)
+    {
+        PerfCountersPrint(stderr);
+        PerfCountersEnd();
+    }
+    if(memory_report.enabled)
+    {
+        MemoryReportPrint(stderr);
+        MemoryReportEnd();
+    }
+    if(stats.enabled)
     {
-        for(int i = 0; i < file_count; ++i)
+        if(stats_enabled)
         {
-            ProcessedFile *file = files+i;
-            
-            if(file->wasm_output_file)
-            {
-                if(file->root)
-                {
-                    OutputWASMFromPageNodeTreeToFile(file->root, file->wasm_output_file,1,files, file_count);
-                }
-                else if(file->wasm_file_contents)
-                {
-                    fprintf(file->wasm_output_file, "%s", file->wasm_file_contents);
-                }
-            }
-            
-            if(file->c_output_file)
-            {
-                // @TODO: jsn
-            }
-            
-            if(file->js_output_file)
-            {
-                // @TODO: jsn
-            }
+            StatsPrint(stderr);
+        }
+        if(stats_json_path && !StatsWriteJSON(stats_json_path))
+        {
+            fprintf(stderr, "ERROR: could not write stats %s\n", stats_json_path);
         }
+        StatsEnd();
     }
-	for(int i =0; i < file_count;i++){
-		free(filenames[i]);
-	}
+    int error_count = atomic_load(&pipeline.error_count);
+    ParseContextRelease(&pipeline.history.context);
+    FileTableRelease(&pipeline.files);
+    StringTableRelease(&split_startup);
+#if ORE_ALLOC_PROFILE
+    if(alloc_log_path)
+    {
+        AllocProfileEnd();
+    }
+#endif
     
-    return 0;
+    return error_count ? 1 : 0;
 }
@@ -0,0 +1,120 @@
+// Host side of --profile-allocations: records every __ore_alloc and __ore_release of a run
+// into an allocation log, the format an ORE_ALLOC_PROFILE build writes with --alloc-log, so
+// `Ore --alloc-report` shows the top allocation sites by bytes and by count.
+//
+//   node Tools/ore-alloc-profile.js <module.wasm> [--call <export>] [--repeat <n>] [-o <log>]
+//   Ore --alloc-report <log>
+//
+// or from a host that drives the module itself:
+//
+//   const { createAllocationProfiler } = require('./Tools/ore-alloc-profile.js');
+//   const profiler = createAllocationProfiler(module);
+//   const instance = new WebAssembly.Instance(module, { ...imports, ore_alloc: profiler.imports });
+//   ...
+//   profiler.write('ore.alloclog');
+//
+// Sites come from the module's ore.alloc_sites section: the calling function, with the
+// call's ordinal in that function as the line; site 0 is the host. __ore_release frees its
+// region and everything allocated after it, so a release is logged as a free of every live
+// block from that address up.
+
+const fs = require('fs');
+
+const ALLOC_LOG_MAGIC = 'OREALLOC';
+const ALLOC_LOG_VERSION = 1;
+const ALLOC_LOG_EVENT_SIZE = 29;
+
+function createAllocationProfiler(module) {
+    const sections = WebAssembly.Module.customSections(module, 'ore.alloc_sites');
+    if (!sections.length) {
+        throw new Error('the module was not built with --profile-allocations');
+    }
+    const sites = Buffer.from(sections[0]);
+    const start = process.hrtime.bigint();
+    const live = new Map();
+    let events = Buffer.alloc(ALLOC_LOG_EVENT_SIZE * 1024);
+    let length = 0;
+
+    const push = (kind, site, address, size) => {
+        if (length + ALLOC_LOG_EVENT_SIZE > events.length) {
+            const grown = Buffer.alloc(events.length * 2);
+            events.copy(grown, 0, 0, length);
+            events = grown;
+        }
+        events.writeUInt8(kind, length);
+        events.writeUInt32LE(site, length + 1);
+        events.writeBigUInt64LE(BigInt(address), length + 5);
+        events.writeBigUInt64LE(BigInt(size), length + 13);
+        events.writeBigUInt64LE(process.hrtime.bigint() - start, length + 21);
+        length += ALLOC_LOG_EVENT_SIZE;
+    };
+
+    const record = (kind, site, address, size) => {
+        address >>>= 0;
+        size >>>= 0;
+        if (kind === 1 && address) {
+            push(1, site, address, size);
+            live.set(address, size);
+        } else if (kind === 2) {
+            for (const block of live.keys()) {
+                if (block >= address) {
+                    push(2, site, block, 0);
+                    live.delete(block);
+                }
+            }
+        }
+    };
+
+    return {
+        imports: { record },
+        get event_count() {
+            return length / ALLOC_LOG_EVENT_SIZE;
+        },
+        write(path) {
+            const header = Buffer.alloc(12);
+            header.write(ALLOC_LOG_MAGIC, 0, 'latin1');
+            header.writeUInt32LE(ALLOC_LOG_VERSION, 8);
+            fs.writeFileSync(path, Buffer.concat([header, events.subarray(0, length), Buffer.from([0]), sites]));
+        },
+    };
+}
+
+function main() {
+    const argv = process.argv.slice(2);
+    let wasm_path = null, call = null, repeat = 1, output = 'ore.alloclog';
+    for (let i = 0; i < argv.length; ++i) {
+        if (argv[i] === '--call') call = argv[++i];
+        else if (argv[i] === '--repeat') repeat = parseInt(argv[++i]);
+        else if (argv[i] === '-o') output = argv[++i];
+        else wasm_path = argv[i];
+    }
+    if (!wasm_path) {
+        console.error('usage: node Tools/ore-alloc-profile.js <module.wasm> [--call <export>] [--repeat <n>] [-o <log>]');
+        process.exit(1);
+    }
+
+    const module = new WebAssembly.Module(fs.readFileSync(wasm_path));
+    let profiler;
+    try {
+        profiler = createAllocationProfiler(module);
+    } catch (error) {
+        console.error('ERROR: ' + wasm_path + ': ' + error.message);
+        process.exit(1);
+    }
+    const instance = new WebAssembly.Instance(module, { ore_alloc: profiler.imports });
+    if (call) {
+        if (typeof instance.exports[call] !== 'function') {
+            console.error('ERROR: ' + wasm_path + ' has no exported function ' + call);
+            process.exit(1);
+        }
+        for (let i = 0; i < repeat; ++i) instance.exports[call]();
+    }
+    profiler.write(output);
+    console.log('Wrote ' + profiler.event_count + ' events to ' + output);
+}
+
+if (require.main === module) {
+    main();
+}
+
+module.exports = { createAllocationProfiler };
@@ -0,0 +1,104 @@
+// Host side of --async-import: lets imports return promises without blocking the host
+// thread. Build the module with `Ore --async-import <module>.<name>` for every import that
+// may suspend, then
+//
+//   const { instantiate } = require('./Tools/ore-async.js');
+//   const ore = await instantiate(bytes, { host: { read: async () => ... } }, ['host.read']);
+//   const result = await ore.call('main', ...args);
+//
+// When an async import returns a promise the module unwinds into the asyncify buffer, the
+// host awaits the promise on its event loop and rewinds back into the import with the
+// result. Calls into one instance are queued, since an instance has a single stack;
+// instantiate the module once per task to run many Ore tasks concurrently.
+
+const ASYNCIFY_STATE_NORMAL = 0;
+const ASYNCIFY_STATE_UNWINDING = 1;
+const ASYNCIFY_STATE_REWINDING = 2;
+
+class OreAsyncInstance {
+    constructor(async_imports) {
+        this.async_imports = new Set(async_imports);
+        this.instance = null;
+        this.pending = null;
+        this.value = undefined;
+        this.queue = Promise.resolve();
+    }
+
+    wrapImports(imports) {
+        const wrapped = {};
+        for (const module_name in imports) {
+            wrapped[module_name] = {};
+            for (const name in imports[module_name]) {
+                const value = imports[module_name][name];
+                const is_async = this.async_imports.has(module_name + '.' + name);
+                wrapped[module_name][name] = is_async ? this.wrapImport(value) : value;
+            }
+        }
+        return wrapped;
+    }
+
+    wrapImport(f) {
+        return (...args) => {
+            const exports = this.instance.exports;
+            if (exports.asyncify_get_state() === ASYNCIFY_STATE_REWINDING) {
+                exports.asyncify_stop_rewind();
+                const value = this.value;
+                this.value = undefined;
+                return value;
+            }
+            const result = f(...args);
+            if (!(result instanceof Promise)) return result;
+            this.pending = result;
+            this.resetBuffer();
+            exports.asyncify_start_unwind(exports.__ore_async_buffer.value);
+            // NOTE: Ignored; the module is unwinding.
+            return 0;
+        };
+    }
+
+    resetBuffer() {
+        const exports = this.instance.exports;
+        const data = exports.__ore_async_buffer.value;
+        const header = new Int32Array(exports.memory.buffer, data, 2);
+        header[0] = data + 8;
+        header[1] = exports.__ore_async_buffer_end.value;
+    }
+
+    async run(name, args) {
+        const exports = this.instance.exports;
+        let result = exports[name](...args);
+        while (exports.asyncify_get_state() === ASYNCIFY_STATE_UNWINDING) {
+            exports.asyncify_stop_unwind();
+            this.value = await this.pending;
+            this.pending = null;
+            exports.asyncify_start_rewind(exports.__ore_async_buffer.value);
+            result = exports[name](...args);
+        }
+        return result;
+    }
+
+    call(name, ...args) {
+        if (typeof this.instance.exports[name] !== 'function') {
+            return Promise.reject(new Error('no exported function ' + name));
+        }
+        const result = this.queue.then(() => this.run(name, args));
+        this.queue = result.catch(() => {});
+        return result;
+    }
+
+    get exports() {
+        return this.instance.exports;
+    }
+}
+
+async function instantiate(source, imports, async_imports) {
+    const ore = new OreAsyncInstance(async_imports);
+    const module = source instanceof WebAssembly.Module ? source : await WebAssembly.compile(source);
+    ore.instance = await WebAssembly.instantiate(module, ore.wrapImports(imports));
+    if (async_imports.length && !ore.instance.exports.asyncify_start_unwind) {
+        throw new Error('the module was not built with --async-import');
+    }
+    return ore;
+}
+
+module.exports = { instantiate, ASYNCIFY_STATE_NORMAL, ASYNCIFY_STATE_UNWINDING, ASYNCIFY_STATE_REWINDING };
@@ -0,0 +1,106 @@
+// Stand-in for the remote compile cache (--remote-cache), backed by a local directory. Good
+// enough for tests, a single CI host or an air-gapped network. It has no authentication, so
+// it only listens on 127.0.0.1 unless --host says otherwise; pass --host 0.0.0.0 to serve
+// other machines:
+//
+//   node Tools/ore-cache-server.js --dir /var/cache/ore --port 7878 --host 0.0.0.0
+//   Ore --wasm --cache .ore-cache --remote-cache http://buildhost:7878/ore --source src
+//
+// GET /<path>/<key> answers with the entry or 404, PUT /<path>/<key> stores the request body.
+// Every path segment becomes a directory, so one server can hold several namespaces (one
+// per branch, say). Entries are written aside and renamed into place, so a reader never
+// sees half an entry; the compiler validates entries anyway and treats a bad one as a miss.
+
+const fs = require('fs');
+const http = require('http');
+const path = require('path');
+
+const SEGMENT = /^[A-Za-z0-9_.-]+$/;
+const MAX_ENTRY_SIZE = 256 * 1024 * 1024;
+
+function parseArguments(argv) {
+    const options = { dir: '.ore-cache-server', port: 7878, host: '127.0.0.1', quiet: false };
+    for (let i = 2; i < argv.length; ++i) {
+        if (argv[i] === '--dir') options.dir = argv[++i];
+        else if (argv[i] === '--port') options.port = Number(argv[++i]);
+        else if (argv[i] === '--host') options.host = argv[++i];
+        else if (argv[i] === '--quiet') options.quiet = true;
+        else throw new Error('unknown argument ' + argv[i]);
+    }
+    return options;
+}
+
+function entryPath(root, url) {
+    const segments = decodeURIComponent(url.split('?')[0]).split('/').filter((s) => s.length);
+    if (!segments.length || !segments.every((s) => SEGMENT.test(s) && s !== '.' && s !== '..')) return null;
+    return path.join(root, ...segments);
+}
+
+function createServer(options) {
+    const stats = { hits: 0, misses: 0, stores: 0 };
+    fs.mkdirSync(options.dir, { recursive: true });
+    const server = http.createServer((request, response) => {
+        const file = entryPath(options.dir, request.url);
+        const reply = (status, body) => {
+            response.writeHead(status, { 'Content-Length': body ? body.length : 0 });
+            response.end(body);
+        };
+        if (!file) return reply(400);
+
+        if (request.method === 'GET' || request.method === 'HEAD') {
+            fs.readFile(file, (error, data) => {
+                if (error) {
+                    ++stats.misses;
+                    return reply(404);
+                }
+                ++stats.hits;
+                response.writeHead(200, { 'Content-Length': data.length });
+                response.end(request.method === 'GET' ? data : undefined);
+            });
+        } else if (request.method === 'PUT') {
+            const chunks = [];
+            let size = 0;
+            request.on('data', (chunk) => {
+                size += chunk.length;
+                if (size > MAX_ENTRY_SIZE) {
+                    reply(413);
+                    request.destroy();
+                    return;
+                }
+                chunks.push(chunk);
+            });
+            request.on('end', () => {
+                const temporary = file + '.' + process.pid + '.' + Math.random().toString(36).slice(2);
+                fs.mkdirSync(path.dirname(file), { recursive: true });
+                fs.writeFile(temporary, Buffer.concat(chunks), (error) => {
+                    if (error) return reply(500);
+                    fs.rename(temporary, file, (error) => {
+                        if (error) return reply(500);
+                        ++stats.stores;
+                        reply(201);
+                    });
+                });
+            });
+        } else {
+            reply(405);
+        }
+    });
+    server.stats = stats;
+    return server;
+}
+
+if (require.main === module) {
+    const options = parseArguments(process.argv);
+    const server = createServer(options);
+    server.listen(options.port, options.host, () => {
+        const address = server.address();
+        if (!options.quiet) console.log(`ore cache server on ${address.address}:${address.port}, serving ${options.dir}`);
+    });
+    process.on('SIGINT', () => {
+        const { hits, misses, stores } = server.stats;
+        if (!options.quiet) console.log(`\n${hits} hits, ${misses} misses, ${stores} stores`);
+        process.exit(0);
+    });
+}
+
+module.exports = { createServer };
@@ -0,0 +1,64 @@
+// Host side of --profile-functions: instantiates a profiled module, calls an export and
+// copies the profile ring buffer out of linear memory, ready for `Ore --profile-collapse`.
+//
+//   node Tools/ore-profile.js <module.wasm> [--call <export>] [--repeat <n>] [-o <dump>] [--heap-out <file>]
+//   Ore --profile-collapse <dump> <out.folded>
+//
+// --heap-out records how far memory grew past __heap_base during the run, for
+// `Ore --heap-size <file>`; it works on modules built without --profile-functions too.
+//
+// The module's only import is ore_profile.now, a millisecond clock.
+
+const fs = require('fs');
+const { performance } = require('perf_hooks');
+
+function main() {
+    const argv = process.argv.slice(2);
+    let wasm_path = null, call = null, repeat = 1, output = 'ore.profile', heap_output = null;
+    for (let i = 0; i < argv.length; ++i) {
+        if (argv[i] === '--call') call = argv[++i];
+        else if (argv[i] === '--repeat') repeat = parseInt(argv[++i]);
+        else if (argv[i] === '-o') output = argv[++i];
+        else if (argv[i] === '--heap-out') heap_output = argv[++i];
+        else wasm_path = argv[i];
+    }
+    if (!wasm_path) {
+        console.error('usage: node Tools/ore-profile.js <module.wasm> [--call <export>] [--repeat <n>] [-o <dump>] [--heap-out <file>]');
+        process.exit(1);
+    }
+
+    const module = new WebAssembly.Module(fs.readFileSync(wasm_path));
+    const instance = new WebAssembly.Instance(module, { ore_profile: { now: () => performance.now() } });
+    const exports = instance.exports;
+    if (!exports.__ore_profile_buffer && !heap_output) {
+        console.error('ERROR: ' + wasm_path + ' was not built with --profile-functions');
+        process.exit(1);
+    }
+
+    if (call) {
+        if (typeof exports[call] !== 'function') {
+            console.error('ERROR: ' + wasm_path + ' has no exported function ' + call);
+            process.exit(1);
+        }
+        for (let i = 0; i < repeat; ++i) exports[call]();
+    }
+
+    if (heap_output) {
+        if (!exports.__heap_base) {
+            console.error('ERROR: ' + wasm_path + ' has no linear memory to measure');
+            process.exit(1);
+        }
+        const heap_bytes = Math.max(0, exports.memory.buffer.byteLength - exports.__heap_base.value);
+        fs.writeFileSync(heap_output, heap_bytes + '\n');
+        console.log('Heap grew to ' + heap_bytes + ' bytes; wrote ' + heap_output);
+    }
+    if (!exports.__ore_profile_buffer) return;
+
+    const address = exports.__ore_profile_buffer.value;
+    const size = exports.__ore_profile_size.value;
+    fs.writeFileSync(output, new Uint8Array(exports.memory.buffer, address, size));
+    const events = new Uint32Array(exports.memory.buffer, address, 1)[0];
+    console.log('Wrote ' + events + ' events to ' + output);
+}
+
+main();
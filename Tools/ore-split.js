@@ -0,0 +1,65 @@
+// Host side of --split: runs a module split into a startup (primary) module and a lazily
+// loaded secondary module. Build with `Ore --split <startup>`, where <startup> is a list of
+// function names or a --profile-functions dump of a startup run; foo.wasm is then written
+// next to foo.secondary.wasm, and
+//
+//   const { instantiate } = require('./Tools/ore-split.js');
+//   const ore = await instantiate(primary_bytes, imports, () => fs.readFileSync('foo.secondary.wasm'));
+//   ore.preload();  // optional: compile the secondary module off the critical path
+//   ore.exports.main();
+//
+// The first call into a function that isn't in the primary module calls ore_split.load,
+// which instantiates the secondary module on the spot. That has to happen synchronously,
+// so `secondary` must return the bytes (or a WebAssembly.Module) without a promise, unless
+// preload() has already finished; on the web, where synchronous compiles of large modules
+// are not allowed, await preload() before calling into secondary code.
+
+class OreSplitInstance {
+    constructor(imports, secondary) {
+        this.imports = imports;
+        this.secondary = secondary;
+        this.secondary_module = null;
+        this.secondary_instance = null;
+        this.instance = null;
+    }
+
+    load() {
+        if (this.secondary_instance) return;
+        if (!this.secondary_module) {
+            const source = this.secondary();
+            if (source instanceof Promise) {
+                throw new Error('the secondary module is needed before preload() finished');
+            }
+            this.secondary_module = source instanceof WebAssembly.Module ? source : new WebAssembly.Module(source);
+        }
+        const imports = Object.assign({}, this.imports, { primary: this.instance.exports });
+        this.secondary_instance = new WebAssembly.Instance(this.secondary_module, imports);
+        this.instance.exports.__ore_split_loaded.value = 1;
+    }
+
+    async preload() {
+        if (!this.secondary_module) {
+            const source = await this.secondary();
+            this.secondary_module = source instanceof WebAssembly.Module ? source : await WebAssembly.compile(source);
+        }
+        return this.secondary_module;
+    }
+
+    get loaded() {
+        return this.secondary_instance !== null;
+    }
+
+    get exports() {
+        return this.instance.exports;
+    }
+}
+
+async function instantiate(source, imports, secondary) {
+    const ore = new OreSplitInstance(imports, secondary);
+    const module = source instanceof WebAssembly.Module ? source : await WebAssembly.compile(source);
+    const wrapped = Object.assign({}, imports, { ore_split: { load: () => ore.load() } });
+    ore.instance = await WebAssembly.instantiate(module, wrapped);
+    return ore;
+}
+
+module.exports = { instantiate };
@@ -23,6 +23,7 @@ if (platform === Platform.Windows) {
 }
 else if (platform === Platform.Linux) {
     project.addLib('binaryen -L../../'+libdir);
+    project.addLib('pthread');
 }
 else if (platform === Platform.OSX) {
     project.addLib(libdir +'libbinaryen.a');
@@ -0,0 +1,44 @@
+// --async-import on a prebuilt module that imports the async function: the module is
+// asyncified in place, and through Tools/ore-async.js an import that returns a promise
+// suspends the call until the promise settles. A second build leaves the asyncified module
+// alone.
+
+const fs = require('fs');
+const path = require('path');
+const { REPO_PATH, writeTree, runOre, check, checkEqual, runTest } = require('./common.js');
+const { instantiate } = require(path.join(REPO_PATH, 'Tools', 'ore-async.js'));
+
+// (module
+//   (import "host" "read" (func $read (result i32)))
+//   (memory (export "memory") 1)
+//   (func (export "main") (result i32)
+//     (i32.add (call $read) (call $read))))
+const READS_TWICE = Buffer.from([
+    0, 97, 115, 109, 1, 0, 0, 0, 1, 5, 1, 96, 0, 1, 127, 2, 13, 1, 4, 104, 111, 115, 116, 4, 114, 101, 97, 100, 0,
+    0, 3, 2, 1, 0, 5, 3, 1, 0, 1, 7, 17, 2, 6, 109, 101, 109, 111, 114, 121, 2, 0, 4, 109, 97, 105, 110, 0, 1, 10,
+    9, 1, 7, 0, 16, 0, 16, 0, 106, 11,
+]);
+
+runTest('async', async (options, work_dir) => {
+    const source = path.join(work_dir, 'src');
+    const wasm_path = path.join(source, 'reads_twice.wasm');
+    writeTree(source, { 'reads_twice.wasm': READS_TWICE });
+    runOre(options, work_dir, ['--wasm', '--async-import', 'host.read', '--source', source]);
+    const asyncified = fs.readFileSync(wasm_path);
+    check(!asyncified.equals(READS_TWICE), 'reads_twice.wasm was not rewritten');
+
+    // NOTE: Each read only resolves on a later turn of the event loop, so the call has to
+    // unwind and rewind around both of them.
+    const values = [20, 22];
+    let pending = 0;
+    const read = () => new Promise(resolve => { ++pending; setTimeout(() => resolve(values.shift()), 1); });
+    const ore = await instantiate(asyncified, { host: { read } }, ['host.read']);
+    checkEqual(await ore.call('main'), 42, 'main with async reads');
+    checkEqual(pending, 2, 'reads awaited');
+
+    const sync = await instantiate(asyncified, { host: { read: () => 21 } }, ['host.read']);
+    checkEqual(await sync.call('main'), 42, 'main with reads that return at once');
+
+    runOre(options, work_dir, ['--wasm', '--async-import', 'host.read', '--source', source]);
+    check(fs.readFileSync(wasm_path).equals(asyncified), 'a second build rewrote reads_twice.wasm');
+});
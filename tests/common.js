@@ -0,0 +1,87 @@
+// Shared helpers for the end-to-end tests. Each test writes a small source tree to a fresh
+// temporary directory, builds it with Ore, runs or inspects the output, and exits with 1 on
+// the first failed check.
+//
+//   node tests/<name>.js [--ore <path>]
+//
+// Ore needs the Binaryen shared library on LD_LIBRARY_PATH, as for Benchmarks/perf-check.js.
+
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const child_process = require('child_process');
+
+const REPO_PATH = path.join(__dirname, '..');
+
+function parseArguments(argv) {
+    const options = { ore: path.resolve('Ore') };
+    for (let i = 2; i < argv.length; ++i) {
+        const value = argv[++i];
+        if (argv[i - 1] === '--ore') options.ore = path.resolve(value);
+        else throw new Error('unknown argument ' + argv[i - 1]);
+    }
+    return options;
+}
+
+function makeWorkDir(name) {
+    return fs.mkdtempSync(path.join(os.tmpdir(), 'ore-test-' + name + '-'));
+}
+
+// Writes { relative path: contents } under dir, creating directories as needed.
+function writeTree(dir, files) {
+    for (const name of Object.keys(files)) {
+        fs.mkdirSync(path.dirname(path.join(dir, name)), { recursive: true });
+        fs.writeFileSync(path.join(dir, name), files[name]);
+    }
+}
+
+function run(command, args, options) {
+    const result = child_process.spawnSync(command, args, Object.assign({ encoding: 'utf8' }, options));
+    if (result.error) throw result.error;
+    if (result.status !== 0) {
+        throw new Error(command + ' ' + args.join(' ') + ' failed:\n' + result.stdout + result.stderr);
+    }
+    return result;
+}
+
+// Runs Ore with the timing history kept inside the work directory, so tests never touch the
+// caller's tree.
+function runOre(options, work_dir, args) {
+    return run(options.ore, ['-q', '--timings_file', path.join(work_dir, '.ore_timings')].concat(args));
+}
+
+function runTool(name, args) {
+    return run(process.execPath, [path.join(REPO_PATH, 'Tools', name)].concat(args));
+}
+
+function instantiate(wasm_path, imports) {
+    const module = new WebAssembly.Module(fs.readFileSync(wasm_path));
+    return new WebAssembly.Instance(module, imports || {}).exports;
+}
+
+function check(condition, message) {
+    if (!condition) throw new Error(message);
+}
+
+function checkEqual(actual, expected, message) {
+    if (actual !== expected) {
+        throw new Error(message + ': expected ' + JSON.stringify(expected) + ', got ' + JSON.stringify(actual));
+    }
+}
+
+// Runs body(options, work_dir), which may be async, removes the work directory when it
+// passes and keeps it for inspection when it doesn't.
+function runTest(name, body) {
+    const options = parseArguments(process.argv);
+    const work_dir = makeWorkDir(name);
+    Promise.resolve().then(() => body(options, work_dir)).then(() => {
+        fs.rmSync(work_dir, { recursive: true, force: true });
+        console.log('ok ' + name);
+    }, error => {
+        console.error('FAIL ' + name + ': ' + error.message);
+        console.error('(work directory kept at ' + work_dir + ')');
+        process.exit(1);
+    });
+}
+
+module.exports = { REPO_PATH, writeTree, run, runOre, runTool, instantiate, check, checkEqual, runTest };
@@ -0,0 +1,48 @@
+// --incremental relinks of a bundle: relinking an unchanged tree writes nothing, and after
+// an edit (same size, then one that shifts every later offset) the patched bundle is byte
+// for byte the bundle a full write produces. output.bytes from --stats-json counts what the
+// bundle write actually wrote.
+
+const fs = require('fs');
+const path = require('path');
+const { writeTree, runOre, check, checkEqual, runTest } = require('./common.js');
+
+runTest('incremental', (options, work_dir) => {
+    const source = path.join(work_dir, 'src');
+    const files = {};
+    for (let i = 0; i < 24; ++i) {
+        const name = 'v' + i;
+        files[(i % 3 ? 'a/' : 'b/') + name + '.or'] = 'var ' + name + ' = ' + (i * 7) + ';\nvar s' + name + ' = "text ' + i + '";\n';
+    }
+    writeTree(source, files);
+
+    const bundle_path = path.join(work_dir, 'bundle.wasm');
+    const full_path = path.join(work_dir, 'full.wasm');
+    const stats_path = path.join(work_dir, 'stats.json');
+    const relink = () => {
+        runOre(options, work_dir, ['--bundle', bundle_path, '--incremental', '--stats-json', stats_path, '--source', source]);
+        return JSON.parse(fs.readFileSync(stats_path, 'utf8'))['output.bytes'];
+    };
+    const checkMatchesFullWrite = what => {
+        runOre(options, work_dir, ['--bundle', full_path, '--source', source]);
+        check(fs.readFileSync(bundle_path).equals(fs.readFileSync(full_path)), what + ': the relinked bundle differs from a full write');
+    };
+
+    const first = relink();
+    checkEqual(first, fs.statSync(bundle_path).size, 'bytes written by the first link');
+    checkMatchesFullWrite('first link');
+    const unchanged = fs.readFileSync(bundle_path);
+    checkEqual(relink(), 0, 'bytes written relinking an unchanged tree');
+    check(fs.readFileSync(bundle_path).equals(unchanged), 'relinking an unchanged tree changed the bundle');
+
+    const edited = path.join(source, 'a/v4.or');
+    fs.writeFileSync(edited, fs.readFileSync(edited, 'utf8').replace('= 28;', '= 29;'));
+    const same_size = relink();
+    check(same_size > 0 && same_size < first, 'a same-size edit wrote ' + same_size + ' of ' + first + ' bytes');
+    checkMatchesFullWrite('same-size edit');
+
+    fs.appendFileSync(edited, 'var added = 123456;\nvar sadded = "a longer string than before";\n');
+    check(relink() > 0, 'a growing edit wrote nothing');
+    checkMatchesFullWrite('growing edit');
+    checkEqual(relink(), 0, 'bytes written relinking after the edits');
+});
@@ -0,0 +1,66 @@
+// --preinit on prebuilt modules, which are otherwise passed through untouched: a start
+// function that only writes memory is evaluated into a data segment and the module written
+// back without a start section; one that calls an import can't be, and the module is left
+// byte for byte as it was.
+
+const fs = require('fs');
+const path = require('path');
+const { REPO_PATH, writeTree, runOre, instantiate, check, checkEqual, runTest } = require('./common.js');
+
+// (module
+//   (memory (export "memory") 1)
+//   (func $init (i32.store (i32.const 16) (i32.const 42)))
+//   (func (export "get") (result i32) (i32.load (i32.const 16)))
+//   (start $init))
+const EVALUATED = Buffer.from([
+    0, 97, 115, 109, 1, 0, 0, 0, 1, 8, 2, 96, 0, 0, 96, 0, 1, 127, 3, 3, 2, 0, 1, 5, 3, 1, 0, 1, 7, 16, 2, 6, 109,
+    101, 109, 111, 114, 121, 2, 0, 3, 103, 101, 116, 0, 1, 8, 1, 0, 10, 19, 2, 9, 0, 65, 16, 65, 42, 54, 2, 0, 11,
+    7, 0, 65, 16, 40, 2, 0, 11,
+]);
+
+// (module
+//   (import "env" "f" (func $f))
+//   (func $init (call $f))
+//   (start $init))
+const CALLS_IMPORT = Buffer.from([
+    0, 97, 115, 109, 1, 0, 0, 0, 1, 4, 1, 96, 0, 0, 2, 9, 1, 3, 101, 110, 118, 1, 102, 0, 0, 3, 2, 1, 0, 8, 1, 1,
+    10, 6, 1, 4, 0, 16, 0, 11,
+]);
+
+const WASM_SECTION_START = 8;
+
+function hasStartSection(binary) {
+    for (let at = 8; at < binary.length;) {
+        const id = binary[at++];
+        let size = 0;
+        for (let shift = 0; ; shift += 7) {
+            const byte = binary[at++];
+            size |= (byte & 0x7F) << shift;
+            if (!(byte & 0x80)) break;
+        }
+        if (id === WASM_SECTION_START) return true;
+        at += size;
+    }
+    return false;
+}
+
+runTest('preinit', (options, work_dir) => {
+    const source = path.join(work_dir, 'src');
+    writeTree(source, { 'evaluated.wasm': EVALUATED, 'calls_import.wasm': CALLS_IMPORT });
+    const tool = path.join(REPO_PATH, 'Libraries', 'binaryen', 'linux', 'tools', 'wasm-ctor-eval');
+    runOre(options, work_dir, ['--wasm', '--preinit', '--ctor-eval', tool, '--source', source]);
+
+    const evaluated = fs.readFileSync(path.join(source, 'evaluated.wasm'));
+    check(!hasStartSection(evaluated), 'evaluated.wasm still has a start section');
+    checkEqual(instantiate(path.join(source, 'evaluated.wasm')).get(), 42, 'the value the start function stored');
+
+    const calls_import = fs.readFileSync(path.join(source, 'calls_import.wasm'));
+    check(calls_import.equals(CALLS_IMPORT), 'calls_import.wasm was rewritten');
+    let calls = 0;
+    instantiate(path.join(source, 'calls_import.wasm'), { env: { f: () => ++calls } });
+    checkEqual(calls, 1, 'start function calls at instantiation');
+
+    // NOTE: A second build finds no start function left and writes nothing.
+    runOre(options, work_dir, ['--wasm', '--preinit', '--ctor-eval', tool, '--source', source]);
+    check(fs.readFileSync(path.join(source, 'evaluated.wasm')).equals(evaluated), 'a second build rewrote evaluated.wasm');
+});
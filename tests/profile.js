@@ -0,0 +1,29 @@
+// --profile-functions on a module whose only functions are the stdlib's: the profiler has
+// to run after they are added, or the module comes out with no clock import and no buffer.
+// Profiles a call through Tools/ore-profile.js and checks the collapsed stacks.
+
+const fs = require('fs');
+const path = require('path');
+const { writeTree, runOre, runTool, instantiate, check, runTest } = require('./common.js');
+
+runTest('profile', (options, work_dir) => {
+    const source = path.join(work_dir, 'src');
+    writeTree(source, { 'a.or': 'var answer = 42;\n' });
+    runOre(options, work_dir, ['--wasm', '--profile-functions', '--stdlib', 'all', '--source', source]);
+
+    const wasm_path = path.join(source, 'a.wasm');
+    const module = new WebAssembly.Module(fs.readFileSync(wasm_path));
+    const imports = WebAssembly.Module.imports(module).map(entry => entry.module + '.' + entry.name);
+    check(imports.includes('ore_profile.now'), 'no ore_profile.now import; imports are ' + imports.join(', '));
+    const exports = instantiate(wasm_path, { ore_profile: { now: () => 0 } });
+    check(exports.__ore_profile_buffer && exports.__ore_profile_size, 'no __ore_profile_buffer/__ore_profile_size exports');
+
+    const dump_path = path.join(work_dir, 'dump');
+    const folded_path = path.join(work_dir, 'out.folded');
+    const result = runTool('ore-profile.js', [wasm_path, '--call', '__ore_vec_new', '--repeat', '3', '-o', dump_path]);
+    const events = parseInt(/Wrote (\d+) events/.exec(result.stdout)[1]);
+    check(events > 0, 'the dump has no events');
+    runOre(options, work_dir, ['--profile-collapse', dump_path, folded_path]);
+    const stacks = fs.readFileSync(folded_path, 'utf8').trim().split('\n');
+    check(stacks.some(line => /^__ore_vec_new;__ore_alloc \d+$/.test(line)), 'no __ore_vec_new;__ore_alloc stack in\n' + stacks.join('\n'));
+});
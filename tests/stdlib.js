@@ -0,0 +1,95 @@
+// The exported stdlib (--stdlib all) run under node against JavaScript references: memory
+// routines across the 16-byte SIMD blocks and their scalar tails, vectors and maps past
+// several growths, both radix sorts past the insertion sort cutoff, and the formatters at
+// their edge values.
+
+const path = require('path');
+const { writeTree, runOre, instantiate, check, checkEqual, runTest } = require('./common.js');
+
+runTest('stdlib', (options, work_dir) => {
+    const source = path.join(work_dir, 'src');
+    writeTree(source, { 'a.or': 'var answer = 42;\n' });
+    runOre(options, work_dir, ['--wasm', '--stdlib', 'all', '--source', source]);
+    const ore = instantiate(path.join(source, 'a.wasm'));
+    const bytes = () => new Uint8Array(ore.memory.buffer);
+    const words = (address, count) => Array.from(new Int32Array(ore.memory.buffer, address, count));
+    const alloc = size => {
+        const address = ore.__ore_alloc(size);
+        check(address && address % 16 === 0, '__ore_alloc(' + size + ') returned ' + address);
+        return address;
+    };
+
+    // memset, memcpy, memchr, memcmp
+    const a = alloc(100), b = alloc(100);
+    ore.__ore_memset(a, 7, 100);
+    check(bytes().subarray(a, a + 100).every(byte => byte === 7), 'memset');
+    for (let i = 0; i < 100; ++i) bytes()[b + i] = i;
+    ore.__ore_memcpy(a, b, 100);
+    for (let i = 0; i < 100; ++i) checkEqual(bytes()[a + i], i, 'memcpy byte ' + i);
+    for (const i of [0, 15, 16, 31, 37, 99]) checkEqual(ore.__ore_memchr(a, i, 100), a + i, 'memchr ' + i);
+    checkEqual(ore.__ore_memchr(a, 200, 100), 0, 'memchr without a match');
+    checkEqual(ore.__ore_memchr(a, 50, 50), 0, 'memchr past the size');
+    checkEqual(ore.__ore_memcmp(a, b, 100), 0, 'memcmp of equal ranges');
+    for (const i of [3, 16, 40, 99]) {
+        bytes()[a + i] = 255;
+        check(ore.__ore_memcmp(a, b, 100) > 0 && ore.__ore_memcmp(b, a, 100) < 0, 'memcmp difference at ' + i);
+        checkEqual(ore.__ore_memcmp(a, b, i), 0, 'memcmp before the difference at ' + i);
+        bytes()[a + i] = i;
+    }
+
+    // vec_new, vec_push: { data, length, capacity }
+    const vector = ore.__ore_vec_new(1);
+    for (let i = 0; i < 1000; ++i) checkEqual(ore.__ore_vec_push(vector, i * 3), i, 'vec_push index');
+    const [data, length, capacity] = words(vector, 3);
+    checkEqual(length, 1000, 'vector length');
+    check(capacity >= 1000, 'vector capacity ' + capacity);
+    const pushed = words(data, 1000);
+    for (let i = 0; i < 1000; ++i) checkEqual(pushed[i], i * 3, 'vector element ' + i);
+
+    // map_new, map_insert, map_get: starts small, so 1000 keys grow it several times
+    const map = ore.__ore_map_new(0);
+    const keys = [];
+    for (let i = 0; i < 1000; ++i) keys.push((Math.imul(i, 2654435761) ^ (i << 7)) | 0);
+    for (let i = 0; i < keys.length; ++i) check(ore.__ore_map_insert(map, keys[i], i), 'map_insert ' + i);
+    checkEqual(words(map, 4)[3], 1000, 'map count');
+    for (let i = 0; i < keys.length; ++i) checkEqual(ore.__ore_map_get(map, keys[i], -1), i, 'map_get ' + keys[i]);
+    check(ore.__ore_map_insert(map, keys[5], 12345), 'map_insert overwrite');
+    checkEqual(ore.__ore_map_get(map, keys[5], -1), 12345, 'overwritten value');
+    checkEqual(words(map, 4)[3], 1000, 'map count after an overwrite');
+    checkEqual(ore.__ore_map_get(map, 0x7ffffff0, -1), -1, 'missing key');
+
+    // sort_i32, sort_u32, below and above the insertion sort cutoff
+    for (const count of [0, 1, 20, 1000]) {
+        let seed = count + 1;
+        const random = () => (seed = (Math.imul(seed, 1103515245) + 12345) | 0);
+        const values = [];
+        for (let i = 0; i < count; ++i) values.push(i % 7 ? random() : [0, -1, 0x7fffffff, -0x80000000][i % 4]);
+        for (const [name, view, compare] of [['sort_i32', Int32Array, (x, y) => x - y], ['sort_u32', Uint32Array, (x, y) => x - y]]) {
+            const address = alloc(count * 4 + 4);
+            const input = new view(ore.memory.buffer, address, count);
+            input.set(new view(new Int32Array(values).buffer));
+            const expected = Array.from(input).sort(compare);
+            ore['__ore_' + name](address, count);
+            const sorted = Array.from(new view(ore.memory.buffer, address, count));
+            checkEqual(sorted.join(','), expected.join(','), name + ' of ' + count);
+        }
+    }
+
+    // format_u64, format_i64, format_f64
+    const out = alloc(48);
+    const text = length => Buffer.from(bytes().subarray(out, out + length)).toString('latin1');
+    const format = (name, ...args) => text(ore['__ore_' + name](...args));
+    for (const value of [0n, 9n, 10n, 99n, 100n, 12345678901234567890n, 18446744073709551615n]) {
+        checkEqual(format('format_u64', value, out), value.toString(), 'format_u64');
+    }
+    for (const value of [0n, -1n, 42n, -1234567n, 9223372036854775807n, -9223372036854775808n]) {
+        checkEqual(format('format_i64', value, out), value.toString(), 'format_i64');
+    }
+    const f64_cases = [[0, 0, '0'], [1.5, 1, '1.5'], [-2.25, 2, '-2.25'], [3.14159, 3, '3.142'], [0.5, 0, '1'], [123.456, 2, '123.46']];
+    for (const [value, precision, expected] of f64_cases) {
+        checkEqual(format('format_f64', value, precision, out), expected, 'format_f64(' + value + ', ' + precision + ')');
+    }
+    check(/^1(\.0*)?e18$/.test(format('format_f64', 1e18, 0, out)), 'format_f64(1e18) is ' + format('format_f64', 1e18, 0, out));
+
+    ore.__ore_release(a);
+});